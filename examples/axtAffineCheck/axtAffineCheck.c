@@ -0,0 +1,299 @@
+/* axtAffineCheck - check axtAffineSimd gives the same alignments as
+ * axtAffine2Level, and time the two. */
+#include "common.h"
+#include "options.h"
+#include "portable.h"
+#include "dnautil.h"
+#include "dnaseq.h"
+#include "axt.h"
+
+#define DEFAULT_PAIRS 5000
+#define DEFAULT_MAX_SIZE 300
+#define DEFAULT_BENCH_SIZE 8000
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "axtAffineCheck - check axtAffineSimd gives the same alignments as\n"
+      "axtAffine2Level, and time the two\n"
+      "usage:\n"
+      "   axtAffineCheck now\n"
+      "Random pairs of sequences are aligned both ways and the axts compared:\n"
+      "score, coordinates, and every symbol, so gap placement and ties have to\n"
+      "match too.  Pairs are related by random substitutions and indels, some\n"
+      "with unrelated flanks, some with the longer sequence as query, a few\n"
+      "empty or one base long, in mixed case with Ns, and some protein.  Score\n"
+      "schemes are the DNA and protein defaults and random simple DNA ones,\n"
+      "some small enough for 8 bit scores, so that all three score sizes get\n"
+      "used, along with the switches to bigger ones part way through.\n"
+      "Then both are timed on a benchSize by benchSize pair of similar DNA\n"
+      "sequences, which needs 32 bit scores, on a query a tenth that size\n"
+      "against the same target, and on 150 base reads from the target, which\n"
+      "fit in 16 bit scores, or 8 bit with a small scoring scheme.\n"
+      "axtAffine itself needs pairHmm, which isn't in this tree, so it is\n"
+      "stubbed out in pairHmmStub.c.\n"
+      "options:\n"
+      "   -pairs=N - number of random pairs, default %d\n"
+      "   -maxSize=N - largest random sequence before indels and flanks, default %d\n"
+      "   -benchSize=N - size of sequences to time, 0 for none, default %d\n"
+      "   -seed=N - random number seed, default 0\n",
+      DEFAULT_PAIRS, DEFAULT_MAX_SIZE, DEFAULT_BENCH_SIZE
+  );
+}
+
+static struct optionSpec options[] = {
+    {"pairs", OPTION_INT},
+    {"maxSize", OPTION_INT},
+    {"benchSize", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+static char dnaLetters[] = "acgtACGTn";
+static char proteinLetters[] = "ACDEFGHIKLMNPQRSTVWY";
+
+static double randomFraction()
+/* Return random number from 0 to 1. */
+{
+return (double)random() / RAND_MAX;
+}
+
+static char *randomLetters(char *letters, int size)
+/* Return size random letters from letters. */
+{
+int letterCount = strlen(letters);
+char *s = needMem(size+1);
+int i;
+for (i=0; i<size; ++i)
+    s[i] = letters[random() % letterCount];
+return s;
+}
+
+static char *mutate(char *letters, char *src, int size, double subRate, double indelRate,
+	int *retSize)
+/* Return copy of src with random substitutions and indels of up to 20 letters. */
+{
+int letterCount = strlen(letters);
+char *dest = needMem(size + 21*size + 1);
+int i, j = 0;
+for (i=0; i<size; ++i)
+    {
+    if (randomFraction() < indelRate)
+        {
+	if (random() % 2)
+	    continue;
+	int insSize = 1 + random() % 20;
+	while (--insSize >= 0)
+	    dest[j++] = letters[random() % letterCount];
+	}
+    dest[j++] = (randomFraction() < subRate ? letters[random() % letterCount] : src[i]);
+    }
+*retSize = j;
+return dest;
+}
+
+static char *addFlanks(char *letters, char *s, int *pSize)
+/* Return s with unrelated letters on either side, and free s. */
+{
+int before = random() % 200, after = random() % 200;
+char *flanked = needMem(*pSize + before + after + 1);
+char *b = randomLetters(letters, before), *a = randomLetters(letters, after);
+safef(flanked, *pSize + before + after + 1, "%s%s%s", b, s, a);
+*pSize += before + after;
+freeMem(a);
+freeMem(b);
+freeMem(s);
+return flanked;
+}
+
+static boolean sameAxt(struct axt *a, struct axt *b)
+/* Return TRUE if a and b are the same alignment. */
+{
+if (a == NULL || b == NULL)
+    return a == b;
+return a->score == b->score && a->qStart == b->qStart && a->qEnd == b->qEnd
+	&& a->tStart == b->tStart && a->tEnd == b->tEnd && a->qStrand == b->qStrand
+	&& a->tStrand == b->tStrand && a->symCount == b->symCount
+	&& sameString(a->qName, b->qName) && sameString(a->tName, b->tName)
+	&& memcmp(a->qSym, b->qSym, a->symCount) == 0
+	&& memcmp(a->tSym, b->tSym, a->symCount) == 0;
+}
+
+static void describeAxt(char *label, struct axt *axt)
+/* Print out summary of axt to stderr. */
+{
+if (axt == NULL)
+    fprintf(stderr, "%s: no alignment\n", label);
+else
+    fprintf(stderr, "%s: score %d, q %d-%d, t %d-%d, %d symbols\n%s\n%s\n", label,
+	    axt->score, axt->qStart, axt->qEnd, axt->tStart, axt->tEnd, axt->symCount,
+	    axt->qSym, axt->tSym);
+}
+
+static struct axtScoreScheme *randomScheme(boolean isProt)
+/* Return a random scoring scheme.  The defaults shouldn't be freed. */
+{
+if (isProt)
+    return axtScoreSchemeProteinDefault();
+switch (random() % 4)
+    {
+    case 0:
+        return axtScoreSchemeDefault();
+    case 1:	/* Gaps small enough for 8 bit scores, and scores mostly. */
+        {
+	int size = (random() % 4 == 0 ? 100 : 10);
+	return axtScoreSchemeSimpleDna(1 + random() % size, random() % size,
+		random() % 20, random() % 3);
+	}
+    case 2:	/* Often too big for 16 bit scores. */
+        return axtScoreSchemeSimpleDna(1 + random() % 2000, random() % 2000,
+		random() % 2000, random() % 100);
+    default:
+	return axtScoreSchemeSimpleDna(1 + random() % 200, -(random() % 200),
+		random() % 600, random() % 100);
+    }
+}
+
+static void checkPair(int pairIx, int maxSize)
+/* Make a random pair of sequences, align them both ways, and compare. */
+{
+boolean isProt = (random() % 5 == 0);
+char *letters = (isProt ? proteinLetters : dnaLetters);
+int qSize = random() % (pairIx % 10 == 0 ? 3 : maxSize + 1), tSize;
+char *qDna = randomLetters(letters, qSize);
+char *tDna = mutate(letters, qDna, qSize, randomFraction() * 0.4, randomFraction() * 0.1,
+	&tSize);
+if (random() % 3 == 0)
+    tDna = addFlanks(letters, tDna, &tSize);
+if (random() % 2)
+    {
+    char *s = qDna;
+    qDna = tDna;
+    tDna = s;
+    int size = qSize;
+    qSize = tSize;
+    tSize = size;
+    }
+struct dnaSeq query = {NULL, "query", qDna, qSize};
+struct dnaSeq target = {NULL, "target", tDna, tSize};
+struct axtScoreScheme *ss = randomScheme(isProt);
+struct axt *ref = axtAffine2Level(&query, &target, ss);
+struct axt *simd = axtAffineSimd(&query, &target, ss);
+if (!sameAxt(ref, simd))
+    {
+    fprintf(stderr, "query %s\ntarget %s\n", qDna, tDna);
+    describeAxt("axtAffine2Level", ref);
+    describeAxt("axtAffineSimd", simd);
+    errAbort("Pair %d, %s %d by %d, aligned differently, gapOpen %d gapExtend %d",
+	    pairIx, (isProt ? "protein" : "DNA"), qSize, tSize, ss->gapOpen, ss->gapExtend);
+    }
+axtFree(&ref);
+axtFree(&simd);
+if (ss != axtScoreSchemeDefault() && ss != axtScoreSchemeProteinDefault())
+    axtScoreSchemeFree(&ss);
+freeMem(qDna);
+freeMem(tDna);
+}
+
+static void timePair(char *label, struct dnaSeq *query, struct dnaSeq *target,
+	struct axtScoreScheme *ss)
+/* Time both on a pair and make sure they agree. */
+{
+long startTime = clock1000();
+struct axt *ref = axtAffine2Level(query, target, ss);
+long refTime = clock1000() - startTime;
+startTime = clock1000();
+struct axt *simd = axtAffineSimd(query, target, ss);
+long simdTime = clock1000() - startTime;
+if (!sameAxt(ref, simd))
+    errAbort("%s aligned differently", label);
+verbose(1, "%s: axtAffine2Level %ld ms, axtAffineSimd %ld ms, score %d\n",
+	label, refTime, simdTime, (ref == NULL ? 0 : ref->score));
+axtFree(&ref);
+axtFree(&simd);
+}
+
+static void timeReads(char *label, struct dnaSeq *query, int readSize, struct dnaSeq *target,
+	struct axtScoreScheme *ss)
+/* Time both on a hundred reads of readSize taken from all along query, against
+ * target, and make sure they agree. */
+{
+struct dnaSeq read = {NULL, "read", NULL, min(readSize, query->size)};
+long refTime = 0, simdTime = 0;
+int i;
+for (i=0; i<100; ++i)
+    {
+    read.dna = query->dna + (long)i * (query->size - read.size) / 100;
+    long startTime = clock1000();
+    struct axt *ref = axtAffine2Level(&read, target, ss);
+    refTime += clock1000() - startTime;
+    startTime = clock1000();
+    struct axt *simd = axtAffineSimd(&read, target, ss);
+    simdTime += clock1000() - startTime;
+    if (!sameAxt(ref, simd))
+	errAbort("%s aligned differently", label);
+    axtFree(&ref);
+    axtFree(&simd);
+    }
+verbose(1, "%s: axtAffine2Level %ld ms, axtAffineSimd %ld ms\n", label, refTime, simdTime);
+}
+
+static void benchmark(int size)
+/* Time both on similar DNA sequences. */
+{
+char *tDna = randomLetters("acgt", size);
+int qSize;
+char *qDna = mutate("acgt", tDna, size, 0.15, 0.01, &qSize);
+struct dnaSeq target = {NULL, "target", tDna, size};
+struct dnaSeq query = {NULL, "query", qDna, qSize};
+char label[64];
+struct axtScoreScheme *ss = axtScoreSchemeDefault();
+safef(label, sizeof(label), "%d by %d", qSize, size);
+timePair(label, &query, &target, ss);
+query.size = qSize / 10;
+safef(label, sizeof(label), "%d by %d", query.size, size);
+timePair(label, &query, &target, ss);
+
+/* Reads, a hundred at a time so they take long enough to time. */
+struct axtScoreScheme *small = axtScoreSchemeSimpleDna(2, 3, 5, 2);
+query.size = qSize;
+int readSize = min(150, qSize);
+safef(label, sizeof(label), "100 reads of %d by %d", readSize, size);
+timeReads(label, &query, readSize, &target, ss);
+readSize = min(50, qSize);
+safef(label, sizeof(label), "100 reads of %d by %d", readSize, size);
+timeReads(label, &query, readSize, &target, ss);
+safef(label, sizeof(label), "100 reads of %d by %d, small scores", readSize, size);
+timeReads(label, &query, readSize, &target, small);
+axtScoreSchemeFree(&small);
+freeMem(tDna);
+freeMem(qDna);
+}
+
+void axtAffineCheck(int pairs, int maxSize, int benchSize)
+/* axtAffineCheck - check axtAffineSimd gives the same alignments as
+ * axtAffine2Level, and time the two. */
+{
+long startTime = clock1000();
+int i;
+for (i=0; i<pairs; ++i)
+    checkPair(i, maxSize);
+verbose(1, "%d random pairs aligned the same both ways in %ld ms\n",
+	pairs, clock1000() - startTime);
+if (benchSize > 0)
+    benchmark(benchSize);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 2 || !sameString(argv[1], "now"))
+    usage();
+  dnaUtilOpen();
+  srandom(optionInt("seed", 0));
+  axtAffineCheck(optionInt("pairs", DEFAULT_PAIRS), optionInt("maxSize", DEFAULT_MAX_SIZE),
+  	optionInt("benchSize", DEFAULT_BENCH_SIZE));
+  return 0;
+}
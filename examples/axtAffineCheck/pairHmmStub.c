@@ -0,0 +1,53 @@
+/* pairHmmStub - stand-ins for the pairHmm functions that axtAffine.c
+ * refers to.  pairHmm.c isn't in this tree, so axtAffine, which uses it,
+ * can't be run, but axtAffine2Level, in the same file, doesn't need it.
+ * These let the file link, and abort if anything does call them. */
+
+#include "common.h"
+#include "axt.h"
+#include "pairHmm.h"
+
+UBYTE phmmNullMommy = 0;
+
+static void noPairHmm(char *name)
+/* Complain that pairHmm isn't here. */
+{
+errAbort("%s called, but pairHmm isn't in this tree", name);
+}
+
+struct phmmMatrix *phmmMatrixNew(int stateCount,
+    char *query, int querySize, char *target, int targetSize)
+/* Stand in for pairHmm function. */
+{
+noPairHmm("phmmMatrixNew");
+return NULL;
+}
+
+void phmmMatrixFree(struct phmmMatrix **pAm)
+/* Stand in for pairHmm function. */
+{
+noPairHmm("phmmMatrixFree");
+}
+
+struct phmmState *phmmNameState(struct phmmMatrix *am, int stateIx,
+	char *name, char emitLetter)
+/* Stand in for pairHmm function. */
+{
+noPairHmm("phmmNameState");
+return NULL;
+}
+
+struct phmmAliPair *phmmTraceBack(struct phmmMatrix *am, struct phmmMommy *end)
+/* Stand in for pairHmm function. */
+{
+noPairHmm("phmmTraceBack");
+return NULL;
+}
+
+struct axt *phhmTraceToAxt(struct phmmMatrix *am, struct phmmAliPair *pairList,
+	int score, char *qName, char *tName)
+/* Stand in for pairHmm function. */
+{
+noPairHmm("phhmTraceToAxt");
+return NULL;
+}
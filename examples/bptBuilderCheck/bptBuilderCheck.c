@@ -0,0 +1,450 @@
+/* bptBuilderCheck - build the same b+ trees with bptBuilder and with
+ * bptFileCreate and check the files are identical. */
+#include "common.h"
+#include "options.h"
+#include "portable.h"
+#include "obscure.h"
+#include "bPlusTree.h"
+
+#define DEFAULT_MAX_ITEMS 100000
+#define MAX_RUNS 400
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "bptBuilderCheck - build the same b+ trees with bptBuilder and with\n"
+      "bptFileCreate and check the files are identical\n"
+      "usage:\n"
+      "   bptBuilderCheck tmpDir\n"
+      "Random key/value pairs are added to a bptBuilder in random order, and\n"
+      "also stably sorted and handed to bptFileCreate.  The two files must match\n"
+      "byte for byte, both on their own and written after a header into an\n"
+      "already open file.  Item counts run from zero through the edges of full\n"
+      "blocks and levels up to maxItems, over a range of block, key and value\n"
+      "sizes, with short zero padded keys, many duplicate keys, and memory\n"
+      "limits small enough to spill from one to a few hundred sorted runs.\n"
+      "Lookups with bptFileFind and bptFileFindMany are checked too.\n"
+      "options:\n"
+      "   -maxItems=N - largest number of items in a tree, default %d\n"
+      "   -seed=N - random number seed, default 0\n",
+      DEFAULT_MAX_ITEMS
+  );
+}
+
+static struct optionSpec options[] = {
+    {"maxItems", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+struct bbcCase
+/* Sizes for one tree. */
+    {
+    bits64 count;		/* Number of items. */
+    bits32 blockSize;		/* Children per node. */
+    bits32 keySize;		/* Size of keys. */
+    bits32 valSize;		/* Size of values. */
+    boolean dups;		/* If set keys come from a small set, so repeat a lot. */
+    bits64 maxMem;		/* Memory for builder, 0 for default. */
+    };
+
+/* Items are keySize bytes of zero padded key, valSize bytes of value, and
+ * the order the item was added in. */
+static bits32 curKeySize, curValSize;
+
+static int itemSize()
+/* Return size of an item. */
+{
+return curKeySize + curValSize + sizeof(bits64);
+}
+
+static bits64 itemOrder(char *item)
+/* Return order item was added in. */
+{
+bits64 order;
+memcpy(&order, item + curKeySize + curValSize, sizeof(order));
+return order;
+}
+
+static int itemCmp(const void *va, const void *vb)
+/* Compare items by key and then by the order they were added in. */
+{
+char *a = (char *)va, *b = (char *)vb;
+int diff = memcmp(a, b, curKeySize);
+if (diff == 0)
+    {
+    bits64 oa = itemOrder(a), ob = itemOrder(b);
+    diff = (oa < ob ? -1 : (oa > ob ? 1 : 0));
+    }
+return diff;
+}
+
+static void itemKey(const void *va, char *keyBuf)
+/* Copy key of item to keyBuf. */
+{
+memcpy(keyBuf, va, curKeySize);
+}
+
+static void *itemVal(const void *va)
+/* Return pointer to value of item. */
+{
+return (char *)va + curKeySize;
+}
+
+static int randomKey(char *key, boolean dups)
+/* Put a random key in key, zero padded to curKeySize, and return its length
+ * before padding. */
+{
+int maxLen = (dups ? min(curKeySize, 3) : curKeySize);
+int len = 1 + random() % maxLen;
+int i;
+for (i=0; i<len; ++i)
+    key[i] = (dups ? 'a' + random() % 2 : random() % 256);
+memset(key + len, 0, curKeySize - len);
+return len;
+}
+
+static char *makeItems(struct bbcCase *bc, int **retKeyLens)
+/* Return array of random items, in the order they are to be added, and the
+ * length of each key before padding. */
+{
+int size = itemSize();
+char *items = needLargeMem(max(bc->count, 1) * size);
+int *keyLens;
+AllocArray(keyLens, max(bc->count, 1));
+bits64 i;
+for (i=0; i<bc->count; ++i)
+    {
+    char *item = items + i*size;
+    keyLens[i] = randomKey(item, bc->dups);
+    int j;
+    for (j=0; j<curValSize; ++j)
+        item[curKeySize + j] = random() % 256;
+    memcpy(item + curKeySize + curValSize, &i, sizeof(i));
+    }
+*retKeyLens = keyLens;
+return items;
+}
+
+static void writePrefix(FILE *f)
+/* Write something for the tree to follow, so offsets don't start at zero. */
+{
+static char prefix[] = "bptBuilderCheck header";
+mustWrite(f, prefix, sizeof(prefix));
+}
+
+static void buildWithBuilder(struct bbcCase *bc, char *items, int *keyLens, char *tmpDir,
+	char *fileName, boolean withPrefix)
+/* Add items to a bptBuilder in their current order and write the tree. */
+{
+struct bptBuilder *bb = bptBuilderNew(bc->blockSize, bc->keySize, bc->valSize,
+	tmpDir, bc->maxMem);
+int size = itemSize();
+bits64 i;
+for (i=0; i<bc->count; ++i)
+    {
+    char *item = items + i*size;
+    bptBuilderAdd(bb, item, keyLens[i], item + curKeySize);
+    }
+if (withPrefix)
+    {
+    FILE *f = mustOpen(fileName, "wb");
+    writePrefix(f);
+    if (bptBuilderWriteToOpenFile(bb, f) != bc->count)
+        errAbort("bptBuilderWriteToOpenFile returned wrong item count");
+    carefulClose(&f);
+    }
+else
+    bptBuilderWrite(bb, fileName);
+bptBuilderFree(&bb);
+}
+
+static void buildFromArray(struct bbcCase *bc, char *sorted, char *fileName,
+	boolean withPrefix)
+/* Write tree from sorted array of items. */
+{
+if (withPrefix)
+    {
+    FILE *f = mustOpen(fileName, "wb");
+    writePrefix(f);
+    bptFileBulkIndexToOpenFile(sorted, itemSize(), bc->count, bc->blockSize,
+	    itemKey, bc->keySize, itemVal, bc->valSize, f);
+    carefulClose(&f);
+    }
+else
+    bptFileCreate(sorted, itemSize(), bc->count, bc->blockSize,
+	    itemKey, bc->keySize, itemVal, bc->valSize, fileName);
+}
+
+static void describeCase(struct bbcCase *bc, char *buf, int bufSize)
+/* Put a short description of case in buf. */
+{
+safef(buf, bufSize, "%llu items, blockSize %u, keySize %u, valSize %u%s, maxMem %llu",
+	bc->count, bc->blockSize, bc->keySize, bc->valSize,
+	(bc->dups ? ", duplicate keys" : ""), bc->maxMem);
+}
+
+static void compareFiles(struct bbcCase *bc, char *builtName, char *createdName)
+/* Make sure the two files are the same, saying where they differ if not.  An
+ * empty tree is the exception: bptFileCreate leaves the root pointing at the
+ * end of the file, where bptBuilder writes an empty leaf, so that is allowed
+ * for and the leaf checked. */
+{
+char *built, *created;
+size_t builtSize, createdSize;
+readInGulp(builtName, &built, &builtSize);
+readInGulp(createdName, &created, &createdSize);
+if (bc->count == 0)
+    {
+    size_t leafSize = bptBlockHeaderSize + bc->blockSize * (bc->keySize + bc->valSize);
+    size_t i;
+    if (builtSize != createdSize + leafSize || built[createdSize] != TRUE)
+        errAbort("%s doesn't end with one empty leaf", builtName);
+    for (i = createdSize + 1; i < builtSize; ++i)
+        if (built[i] != 0)
+	    errAbort("Empty leaf at end of %s isn't empty", builtName);
+    builtSize = createdSize;
+    }
+size_t minSize = min(builtSize, createdSize);
+size_t i;
+for (i=0; i<minSize; ++i)
+    if (built[i] != created[i])
+        break;
+if (i < minSize || builtSize != createdSize)
+    {
+    char desc[256];
+    describeCase(bc, desc, sizeof(desc));
+    errAbort("%s (%lld bytes) and %s (%lld bytes) differ at byte %lld, %s",
+	    builtName, (long long)builtSize, createdName, (long long)createdSize,
+	    (long long)i, desc);
+    }
+freeMem(built);
+freeMem(created);
+}
+
+static boolean findRange(char *sorted, bits64 count, char *key, bits64 *retStart, bits64 *retEnd)
+/* Find range of items in sorted array with key.  Return FALSE if there are none. */
+{
+int size = itemSize();
+bits64 lo = 0, hi = count;
+while (lo < hi)
+    {
+    bits64 mid = (lo + hi) / 2;
+    if (memcmp(sorted + mid*size, key, curKeySize) < 0)
+        lo = mid + 1;
+    else
+        hi = mid;
+    }
+bits64 end = lo;
+while (end < count && memcmp(sorted + end*size, key, curKeySize) == 0)
+    ++end;
+*retStart = lo;
+*retEnd = end;
+return end > lo;
+}
+
+static int keyCmp(const void *va, const void *vb)
+/* Compare two keys of curKeySize. */
+{
+return memcmp(va, vb, curKeySize);
+}
+
+static void checkVal(char *sorted, bits64 start, bits64 end, char *val, char *func,
+	char *fileName)
+/* Make sure val belongs to one of the items from start to end. */
+{
+int size = itemSize();
+bits64 j;
+for (j=start; j<end; ++j)
+    if (memcmp(val, sorted + j*size + curKeySize, curValSize) == 0)
+	return;
+errAbort("%s returned a value for another key in %s", func, fileName);
+}
+
+static void checkFinds(struct bbcCase *bc, char *sorted, char *fileName)
+/* Look up some keys that are there and some that aren't with bptFileFind,
+ * then all of them at once with bptFileFindMany. */
+{
+int size = itemSize();
+struct bptFile *bpt = bptFileOpen(fileName);
+char key[curKeySize], val[curValSize];
+int i, tries = min(bc->count, 200) + 20;
+char *keys = needMem(tries * curKeySize);
+for (i=0; i<tries; ++i)
+    {
+    boolean present = (bc->count > 0 && i % 2 == 0);
+    if (present)
+        memcpy(key, sorted + (random() % bc->count)*size, curKeySize);
+    else
+        randomKey(key, bc->dups);
+    memcpy(keys + i*curKeySize, key, curKeySize);
+    bits64 start, end;
+    boolean expected = findRange(sorted, bc->count, key, &start, &end);
+    boolean found = bptFileFind(bpt, key, curKeySize, val, curValSize);
+    if (found != expected)
+        errAbort("bptFileFind %s a key it should%s have in %s",
+		(found ? "found" : "missed"), (found ? "n't" : ""), fileName);
+    if (found)
+	checkVal(sorted, start, end, val, "bptFileFind", fileName);
+    }
+
+qsort(keys, tries, curKeySize, keyCmp);
+char *vals = needMem(tries * curValSize);
+boolean *founds;
+AllocArray(founds, tries);
+int foundCount = bptFileFindMany(bpt, tries, keys, curKeySize, vals, curValSize, founds);
+int expectedCount = 0;
+for (i=0; i<tries; ++i)
+    {
+    bits64 start, end;
+    boolean expected = findRange(sorted, bc->count, keys + i*curKeySize, &start, &end);
+    if (founds[i] != expected)
+        errAbort("bptFileFindMany %s a key it should%s have in %s",
+		(founds[i] ? "found" : "missed"), (founds[i] ? "n't" : ""), fileName);
+    if (expected)
+	{
+	checkVal(sorted, start, end, vals + i*curValSize, "bptFileFindMany", fileName);
+	++expectedCount;
+	}
+    }
+if (foundCount != expectedCount)
+    errAbort("bptFileFindMany says it found %d keys, not %d, in %s",
+	    foundCount, expectedCount, fileName);
+freeMem(keys);
+freeMem(vals);
+freeMem(founds);
+bptFileClose(&bpt);
+}
+
+static void checkCase(struct bbcCase *bc, char *tmpDir)
+/* Build tree for one case both ways and compare. */
+{
+curKeySize = bc->keySize;
+curValSize = bc->valSize;
+int *keyLens;
+char *items = makeItems(bc, &keyLens);
+int size = itemSize();
+char *sorted = cloneMem(items, max(bc->count, 1) * size);
+qsort(sorted, bc->count, size, itemCmp);
+
+char builtName[PATH_LEN], createdName[PATH_LEN];
+safef(builtName, sizeof(builtName), "%s/bptBuilderCheck.built.bpt", tmpDir);
+safef(createdName, sizeof(createdName), "%s/bptBuilderCheck.created.bpt", tmpDir);
+int pass;
+for (pass = 0; pass < 2; ++pass)
+    {
+    /* After a header first, then on its own to look things up in. */
+    boolean withPrefix = (pass == 0);
+    buildWithBuilder(bc, items, keyLens, tmpDir, builtName, withPrefix);
+    buildFromArray(bc, sorted, createdName, withPrefix);
+    compareFiles(bc, builtName, createdName);
+    }
+checkFinds(bc, sorted, builtName);
+remove(builtName);
+remove(createdName);
+freeMem(items);
+freeMem(keyLens);
+freeMem(sorted);
+}
+
+static bits64 memForRuns(struct bbcCase *bc, bits64 runs)
+/* Return maxMem that makes bptBuilder spill about the given number of runs. */
+{
+bits64 perRun = max((bc->count + runs - 1) / runs, 1);
+return 2 * perRun * (bc->keySize + bc->valSize);
+}
+
+static void addCounts(bits64 *counts, int *pCount, bits64 count, bits64 maxItems)
+/* Add count to array if it's not too big. */
+{
+if (count <= maxItems)
+    counts[(*pCount)++] = count;
+}
+
+void bptBuilderCheck(char *tmpDir, bits64 maxItems)
+/* bptBuilderCheck - build the same b+ trees with bptBuilder and with
+ * bptFileCreate and check the files are identical. */
+{
+static bits32 blockSizes[] = {2, 3, 4, 7, 64, 256, 1000};
+static bits32 keySizes[] = {1, 4, 13, 32};
+static bits32 valSizes[] = {1, 8, 12};
+makeDirsOnPath(tmpDir);
+long startTime = clock1000();
+int caseCount = 0, spillCount = 0;
+int bsIx;
+for (bsIx = 0; bsIx < ArraySize(blockSizes); ++bsIx)
+    {
+    bits32 bs = blockSizes[bsIx];
+    bits64 counts[16];
+    int countCount = 0;
+    addCounts(counts, &countCount, 0, maxItems);
+    addCounts(counts, &countCount, 1, maxItems);
+    addCounts(counts, &countCount, bs - 1, maxItems);
+    addCounts(counts, &countCount, bs, maxItems);
+    addCounts(counts, &countCount, bs + 1, maxItems);
+    addCounts(counts, &countCount, (bits64)bs*bs, maxItems);
+    addCounts(counts, &countCount, (bits64)bs*bs + 1, maxItems);
+    addCounts(counts, &countCount, (bits64)bs*bs*bs - 1, maxItems);
+    addCounts(counts, &countCount, (bits64)bs*bs*bs + 1, maxItems);
+    addCounts(counts, &countCount, 1 + random() % maxItems, maxItems);
+    addCounts(counts, &countCount, maxItems, maxItems);
+    int countIx;
+    for (countIx = 0; countIx < countCount; ++countIx)
+        {
+	struct bbcCase bc;
+	ZeroVar(&bc);
+	bc.count = counts[countIx];
+	bc.blockSize = bs;
+	bc.keySize = keySizes[random() % ArraySize(keySizes)];
+	bc.valSize = valSizes[random() % ArraySize(valSizes)];
+	int memIx;
+	for (memIx = 0; memIx < 4; ++memIx)
+	    {
+	    bc.dups = (memIx % 2 == 1);
+	    switch (memIx)
+	        {
+		case 0:
+		    bc.maxMem = 0;
+		    break;
+		case 1:
+		    bc.maxMem = memForRuns(&bc, 2);
+		    break;
+		case 2:
+		    bc.maxMem = memForRuns(&bc, 1 + random() % MAX_RUNS);
+		    break;
+		case 3:
+		    /* As small as it goes, a block's worth per run. */
+		    if (bc.count / bs >= MAX_RUNS)
+			continue;
+		    bc.maxMem = 1;
+		    break;
+		}
+	    bits64 bufMax = max(bc.maxMem / 2 / (bc.keySize + bc.valSize), bs);
+	    if (bc.maxMem != 0 && bc.count > bufMax)
+	        ++spillCount;
+	    char desc[256];
+	    describeCase(&bc, desc, sizeof(desc));
+	    verbose(2, "%s\n", desc);
+	    checkCase(&bc, tmpDir);
+	    ++caseCount;
+	    }
+	}
+    }
+verbose(1, "%d cases, %d of them spilling, identical both ways in %ld ms\n",
+	caseCount, spillCount, clock1000() - startTime);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 2)
+    usage();
+  srandom(optionInt("seed", 0));
+  int maxItems = optionInt("maxItems", DEFAULT_MAX_ITEMS);
+  if (maxItems < 1)
+    errAbort("maxItems must be at least 1");
+  bptBuilderCheck(argv[1], maxItems);
+  return 0;
+}
@@ -0,0 +1,422 @@
+/* chainBinQuery - write chains overlapping target regions from a binary chain file. */
+#include "common.h"
+#include "options.h"
+#include "linefile.h"
+#include "portable.h"
+#include "sqlNum.h"
+#include "hash.h"
+#include "obscure.h"
+#include "chainBin.h"
+#include <sys/wait.h>
+
+#define DEFAULT_REGIONS 100
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "chainBinQuery - write chains overlapping target regions from a binary\n"
+      "chain file\n"
+      "usage:\n"
+      "   chainBinQuery in.chainBin tName:start-end out.chain\n"
+      "or\n"
+      "   chainBinQuery in.chainBin regions.bed out.chain\n"
+      "Coordinates are zero based, half open, as in bed files.  Chains are\n"
+      "written in order of tStart for each region, and a chain is written\n"
+      "once for each region it overlaps.\n"
+      "or\n"
+      "   chainBinQuery -check in.chain tmpDir\n"
+      "which converts in.chain to tmpDir/check.chainBin, and compares the chains\n"
+      "found in it with a linear scan of in.chain, for random regions and\n"
+      "regions at the ends of every chain.  If in.chain is 'random' it is first\n"
+      "made in tmpDir with chain counts per target that fill interval trees\n"
+      "exactly, leave parts of them past the end, and are small enough to\n"
+      "just be scanned.  Truncated copies of the chainBin file are made too,\n"
+      "and must be rejected.\n"
+      "options:\n"
+      "   -noBlocks - only write chain header lines\n"
+      "   -regions=N - random regions per target with -check, default %d\n"
+      "   -seed=N - random number seed for -check, default 0\n",
+      DEFAULT_REGIONS
+  );
+}
+
+static struct optionSpec options[] = {
+    {"noBlocks", OPTION_BOOLEAN},
+    {"check", OPTION_BOOLEAN},
+    {"regions", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+static void queryRegion(struct chainBin *cb, char *tName, int start, int end,
+	boolean noBlocks, FILE *f)
+/* Write chains overlapping region to f. */
+{
+bits64 *ixs, i;
+bits64 count = chainBinOverlaps(cb, tName, start, end, &ixs);
+for (i=0; i<count; ++i)
+    {
+    struct chain *chain = chainBinLoad(cb, ixs[i]);
+    if (noBlocks)
+        chainWriteHead(chain, f);
+    else
+	{
+	chainBinLoadBlocks(cb, ixs[i], chain);
+	chainWrite(chain, f);
+	}
+    chainFree(&chain);
+    }
+freeMem(ixs);
+}
+
+void chainBinQuery(char *inFile, char *region, char *outFile)
+/* chainBinQuery - write chains overlapping target regions from a binary chain file. */
+{
+boolean noBlocks = optionExists("noBlocks");
+struct chainBin *cb = chainBinRead(inFile, TRUE);
+FILE *f = mustOpen(outFile, "w");
+char *colon = strchr(region, ':'), *dash;
+if (colon != NULL && (dash = strchr(colon, '-')) != NULL && !fileExists(region))
+    {
+    *colon++ = 0;
+    *dash++ = 0;
+    queryRegion(cb, region, sqlUnsigned(colon), sqlUnsigned(dash), noBlocks, f);
+    }
+else
+    {
+    struct lineFile *lf = lineFileOpen(region, TRUE);
+    char *row[16];
+    int wordCount;
+    while ((wordCount = lineFileChop(lf, row)) != 0)
+        {
+	lineFileExpectAtLeast(lf, 3, wordCount);
+        queryRegion(cb, row[0], lineFileNeedNum(lf, row, 1), lineFileNeedNum(lf, row, 2),
+		noBlocks, f);
+	}
+    lineFileClose(&lf);
+    }
+carefulClose(&f);
+chainBinFree(&cb);
+}
+
+static void randomChain(struct chain *chain, int tSize, int qCount, int qSize, int id)
+/* Fill in chain with random blocks somewhere in target, mostly short but
+ * some long enough to cover many others. */
+{
+int len = 1 + random() % (1 << (random() % 20));
+chain->tSize = tSize;
+chain->tStart = random() % (tSize - 1);
+chain->qSize = qSize;
+chain->qStrand = (random() % 2 ? '+' : '-');
+chain->qStart = random() % (qSize / 2);
+chain->score = random() % 100000;
+chain->id = id;
+char qName[16];
+safef(qName, sizeof(qName), "q%ld", random() % qCount);
+chain->qName = cloneString(qName);
+int tPos = chain->tStart, qPos = chain->qStart;
+int tEnd = min(tSize, tPos + len);
+do
+    {
+    struct cBlock *b;
+    AllocVar(b);
+    b->tStart = tPos;
+    b->qStart = qPos;
+    int size = 1 + random() % min(1000, tEnd - tPos);
+    size = min(size, qSize - qPos);
+    b->tEnd = tPos + size;
+    b->qEnd = qPos + size;
+    slAddHead(&chain->blockList, b);
+    tPos = b->tEnd + random() % (1 + len / 8);
+    qPos = b->qEnd + random() % (1 + len / 8);
+    }
+while (tPos < tEnd && qPos < qSize);
+slReverse(&chain->blockList);
+struct cBlock *last = slLastEl(chain->blockList);
+chain->tEnd = last->tEnd;
+chain->qEnd = last->qEnd;
+}
+
+static void makeRandomChains(char *fileName)
+/* Write chains to fileName, with a range of chain counts per target. */
+{
+struct slInt *count, *countList = NULL;
+int i, level;
+for (i = 1; i <= 40; ++i)
+    slAddHead(&countList, slIntNew(i));
+for (level = 5; level <= 11; ++level)
+    {
+    slAddHead(&countList, slIntNew((1 << level) - 1));
+    slAddHead(&countList, slIntNew(1 << level));
+    slAddHead(&countList, slIntNew((1 << level) + 1));
+    slAddHead(&countList, slIntNew((1 << level) + random() % (1 << level)));
+    }
+slReverse(&countList);
+FILE *f = mustOpen(fileName, "w");
+int tIx = 0, id = 1;
+for (count = countList; count != NULL; count = count->next)
+    {
+    char tName[16];
+    safef(tName, sizeof(tName), "t%d", ++tIx);
+    int tSize = 1000 + random() % 10000000;
+    for (i = 0; i < count->val; ++i)
+        {
+	struct chain *chain;
+	AllocVar(chain);
+	chain->tName = cloneString(tName);
+	randomChain(chain, tSize, 5, 20000000, id++);
+	chainWrite(chain, f);
+	chainFree(&chain);
+	}
+    }
+carefulClose(&f);
+slFreeList(&countList);
+}
+
+struct checkTarget
+/* Chains of one target in text file order. */
+    {
+    struct checkTarget *next;
+    char *name;			/* Name of target, not allocated here. */
+    int size;			/* Size of target. */
+    struct chain **chains;	/* Chains in file order. */
+    int chainCount;		/* Number of chains. */
+    int chainAlloc;		/* Allocated size of chains. */
+    };
+
+static struct checkTarget *cmpTarget;	/* Target whose chains are being sorted. */
+
+static int chainIxCmp(const void *va, const void *vb)
+/* Compare indexes of chains in cmpTarget by tStart, then order in file,
+ * which is the order chainBin keeps chains with the same tStart in. */
+{
+int a = *((int *)va), b = *((int *)vb);
+int aStart = cmpTarget->chains[a]->tStart, bStart = cmpTarget->chains[b]->tStart;
+if (aStart != bStart)
+    return (aStart < bStart ? -1 : 1);
+return a - b;
+}
+
+static struct checkTarget *readCheckTargets(char *fileName, struct hash *hash)
+/* Read chains from text file into targets, which are also put in hash. */
+{
+struct checkTarget *target, *targetList = NULL;
+struct lineFile *lf = lineFileOpen(fileName, TRUE);
+struct chain *chain;
+chainIdReset();
+while ((chain = chainRead(lf)) != NULL)
+    {
+    target = hashFindVal(hash, chain->tName);
+    if (target == NULL)
+        {
+	AllocVar(target);
+	target->name = hashAdd(hash, chain->tName, target)->name;
+	target->size = chain->tSize;
+	slAddHead(&targetList, target);
+	}
+    if (target->chainCount == target->chainAlloc)
+        {
+	int newAlloc = max(16, 2 * target->chainAlloc);
+	ExpandArray(target->chains, target->chainAlloc, newAlloc);
+	target->chainAlloc = newAlloc;
+	}
+    target->chains[target->chainCount++] = chain;
+    }
+lineFileClose(&lf);
+slReverse(&targetList);
+return targetList;
+}
+
+static void checkSameChain(struct chain *a, struct chain *b, char *tName, int start, int end)
+/* Make sure chain a read from chainBin is the same as b from text. */
+{
+struct cBlock *ba, *bb;
+boolean same = (a->score == b->score && sameString(a->tName, b->tName)
+	&& a->tSize == b->tSize && a->tStart == b->tStart && a->tEnd == b->tEnd
+	&& sameString(a->qName, b->qName) && a->qSize == b->qSize
+	&& a->qStrand == b->qStrand && a->qStart == b->qStart && a->qEnd == b->qEnd
+	&& a->id == b->id);
+for (ba = a->blockList, bb = b->blockList; same && ba != NULL && bb != NULL;
+	ba = ba->next, bb = bb->next)
+    same = (ba->tStart == bb->tStart && ba->tEnd == bb->tEnd
+	    && ba->qStart == bb->qStart && ba->qEnd == bb->qEnd);
+if (!same || ba != NULL || bb != NULL)
+    errAbort("Chain %d from chainBin differs from text in query %s:%d-%d",
+	    b->id, tName, start, end);
+}
+
+static long long checkRegion(struct chainBin *cb, struct checkTarget *target, char *tName,
+	int start, int end, int *found)
+/* Compare chains from cb overlapping region with a linear scan of target,
+ * which may be NULL.  Found has room for all chains of target.  Returns
+ * number of chains found. */
+{
+int foundCount = 0, i;
+if (target != NULL)
+    {
+    for (i = 0; i < target->chainCount; ++i)
+	{
+	struct chain *chain = target->chains[i];
+	if (chain->tStart < end && chain->tEnd > start)
+	    found[foundCount++] = i;
+	}
+    cmpTarget = target;
+    qsort(found, foundCount, sizeof(found[0]), chainIxCmp);
+    }
+struct chain *chain, *chainList = chainBinLoadOverlapping(cb, tName, start, end);
+int binCount = slCount(chainList);
+if (binCount != foundCount)
+    errAbort("%d chains from chainBin overlap %s:%d-%d, linear scan finds %d",
+	    binCount, tName, start, end, foundCount);
+for (chain = chainList, i = 0; chain != NULL; chain = chain->next, ++i)
+    checkSameChain(chain, target->chains[found[i]], tName, start, end);
+chainFreeList(&chainList);
+return foundCount;
+}
+
+static void checkTruncated(char *binFile, char *tmpDir)
+/* Make sure truncated copies of binFile are rejected. */
+{
+char *buf;
+size_t size;
+readInGulp(binFile, &buf, &size);
+char truncFile[PATH_LEN];
+safef(truncFile, sizeof(truncFile), "%s/truncated.chainBin", tmpDir);
+size_t cuts[] = {size - 1, size - 8, size / 2, sizeof(struct chainBinFileHeader),
+	sizeof(struct chainBinFileHeader) / 2};
+int i, memoryMap;
+for (i = 0; i < ArraySize(cuts); ++i)
+    {
+    if (cuts[i] >= size)
+        continue;
+    FILE *f = mustOpen(truncFile, "w");
+    mustWrite(f, buf, cuts[i]);
+    carefulClose(&f);
+    for (memoryMap = 0; memoryMap <= 1; ++memoryMap)
+	{
+	fflush(stdout);
+	fflush(stderr);
+	int pid = mustFork();
+	if (pid == 0)
+	    {
+	    /* Child quietly tries to read file, which should abort. */
+	    if (freopen("/dev/null", "w", stderr) == NULL)
+	        _exit(2);
+	    struct chainBin *cb = chainBinRead(truncFile, memoryMap);
+	    chainBinFree(&cb);
+	    _exit(0);
+	    }
+	int status;
+	if (waitpid(pid, &status, 0) < 0)
+	    errnoAbort("Couldn't wait for child reading %s", truncFile);
+	if (!WIFEXITED(status))
+	    errAbort("chainBinRead crashed on %s cut to %lld of %lld bytes",
+		    truncFile, (long long)cuts[i], (long long)size);
+	if (WEXITSTATUS(status) == 0)
+	    errAbort("chainBinRead accepted %s cut to %lld of %lld bytes",
+		    truncFile, (long long)cuts[i], (long long)size);
+	}
+    }
+remove(truncFile);
+freeMem(buf);
+}
+
+void chainBinCheck(char *inFile, char *tmpDir, int regions)
+/* Compare chainBin queries with a linear scan of the text chain file. */
+{
+long startTime = clock1000();
+makeDirsOnPath(tmpDir);
+char chainFile[PATH_LEN], binFile[PATH_LEN];
+if (sameString(inFile, "random"))
+    {
+    safef(chainFile, sizeof(chainFile), "%s/random.chain", tmpDir);
+    makeRandomChains(chainFile);
+    }
+else
+    safef(chainFile, sizeof(chainFile), "%s", inFile);
+safef(binFile, sizeof(binFile), "%s/check.chainBin", tmpDir);
+chainIdReset();
+chainBinMake(chainFile, binFile);
+struct hash *hash = hashNew(0);
+struct checkTarget *target, *targetList = readCheckTargets(chainFile, hash);
+struct chainBin *cb = chainBinRead(binFile, TRUE);
+verbose(1, "Converted and read %s in %ld ms\n", chainFile, clock1000() - startTime);
+
+startTime = clock1000();
+long long regionCount = 0, foundCount = 0;
+int scanOnly = 0, fullTrees = 0, partTrees = 0;
+for (target = targetList; target != NULL; target = target->next)
+    {
+    int n = target->chainCount, i;
+    int *found;
+    AllocArray(found, n);
+
+    /* Note what shape of tree the target makes. */
+    if (n < 16)
+        ++scanOnly;
+    else if (((n + 1) & n) == 0)
+        ++fullTrees;
+    else
+        ++partTrees;
+
+    /* Regions at and around the ends of every chain. */
+    for (i = 0; i < n; ++i)
+        {
+	struct chain *chain = target->chains[i];
+	int d;
+	for (d = -1; d <= 1; ++d)
+	    {
+	    foundCount += checkRegion(cb, target, target->name, chain->tStart + d,
+		    chain->tStart + d + 1, found);
+	    foundCount += checkRegion(cb, target, target->name, chain->tEnd + d - 1,
+		    chain->tEnd + d, found);
+	    regionCount += 2;
+	    }
+	foundCount += checkRegion(cb, target, target->name, chain->tStart, chain->tEnd, found);
+	++regionCount;
+	}
+
+    /* Whole target, empty regions, and random ones of all sizes. */
+    foundCount += checkRegion(cb, target, target->name, 0, target->size, found);
+    foundCount += checkRegion(cb, target, target->name, -1000, target->size + 1000, found);
+    regionCount += 2;
+    for (i = 0; i < regions; ++i)
+        {
+	int start = random() % target->size;
+	int size = (i % 10 == 0 ? 0 : 1 + random() % (1 << (random() % 24)));
+	foundCount += checkRegion(cb, target, target->name, start, start + size, found);
+	++regionCount;
+	}
+    freeMem(found);
+    }
+checkRegion(cb, NULL, "noSuchTarget", 0, 1000000, NULL);
+verbose(1, "%lld regions on %d targets with %lld chains found, same as linear scan, in %ld ms\n",
+	regionCount, slCount(targetList), foundCount, clock1000() - startTime);
+verbose(1, "%d targets scanned only, %d with full trees, %d with trees going past the end\n",
+	scanOnly, fullTrees, partTrees);
+
+chainBinFree(&cb);
+checkTruncated(binFile, tmpDir);
+verbose(1, "Truncated files rejected\n");
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  srandom(optionInt("seed", 0));
+  if (optionExists("check"))
+    {
+    if (argc != 3)
+      usage();
+    chainBinCheck(argv[1], argv[2], optionInt("regions", DEFAULT_REGIONS));
+    }
+  else
+    {
+    if (argc != 4)
+      usage();
+    chainBinQuery(argv[1], argv[2], argv[3]);
+    }
+  return 0;
+}
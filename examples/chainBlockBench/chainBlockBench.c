@@ -0,0 +1,192 @@
+/* chainBlockBench - time chainBlocks on synthetic dense syntenic alignments. */
+#include "common.h"
+#include "options.h"
+#include "portable.h"
+#include "chain.h"
+#include "chainBlock.h"
+#include "gapCalc.h"
+
+#define DEFAULT_BLOCKS 1000000
+#define DEFAULT_RUNS 2000
+#define DEFAULT_NOISE 20
+#define DEFAULT_JOBS 1
+#define DEFAULT_THREADS 1
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "chainBlockBench - time chainBlocks on synthetic dense syntenic alignments\n"
+      "usage:\n"
+      "   chainBlockBench output.chain\n"
+      "Makes runs of collinear ungapped blocks with small gaps between them,\n"
+      "the way blocks fall in a well aligned pair of genomes, mixes in some\n"
+      "randomly placed blocks, chains them and writes the chains to\n"
+      "output.chain, which may be /dev/null.  The blocks can be split into\n"
+      "several jobs, as if from different sequence pairs, which are chained\n"
+      "with chainBlocksMany.\n"
+      "options:\n"
+      "   -blocks=N - total number of blocks, default %d\n"
+      "   -runs=N - number of collinear runs, default %d\n"
+      "   -noise=N - percent of blocks placed at random, default %d\n"
+      "   -jobs=N - number of sequence pairs to spread blocks over, default %d\n"
+      "   -threads=N - number of threads to chain jobs on, default %d\n"
+      "   -seed=N - random number seed, default 0\n",
+      DEFAULT_BLOCKS, DEFAULT_RUNS, DEFAULT_NOISE, DEFAULT_JOBS, DEFAULT_THREADS
+  );
+}
+
+static struct optionSpec options[] = {
+    {"blocks", OPTION_INT},
+    {"runs", OPTION_INT},
+    {"noise", OPTION_INT},
+    {"jobs", OPTION_INT},
+    {"threads", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+#define overlapPenalty 100	/* Cost per base of overlapping blocks. */
+
+static int gapCost(int dq, int dt, void *gapData)
+/* Gap cost from gapCalc. */
+{
+return gapCalcCost(gapData, dq, dt);
+}
+
+static int connectCost(struct cBlock *a, struct cBlock *b, void *gapData)
+/* Gap cost, plus a penalty for blocks that overlap.  This stands in for
+ * the crossover scoring chainConnectCost does with the real sequence. */
+{
+int dq = b->qStart - a->qEnd;
+int dt = b->tStart - a->tEnd;
+int overlap = 0;
+if (dq < 0 || dt < 0)
+    {
+    overlap = -min(dq, dt);
+    dq += overlap;
+    dt += overlap;
+    }
+return gapCalcCost(gapData, dq, dt) + overlap * overlapPenalty;
+}
+
+static struct cBlock *randomBlock(int qStart, int tStart, struct cBlock **pList)
+/* Add block of random size starting at qStart/tStart to list. */
+{
+struct cBlock *b;
+int size = 20 + rand()%100;
+AllocVar(b);
+b->qStart = qStart;
+b->qEnd = qStart + size;
+b->tStart = tStart;
+b->tEnd = tStart + size;
+b->score = size * 80 - rand()%(size * 40);
+slAddHead(pList, b);
+return b;
+}
+
+static struct cBlock *makeBlocks(int blockCount, int runCount, int noisePercent, 
+	int *retSize)
+/* Make list of blocks in runs, and some noise.  Return list and size
+ * of sequence they fit on in *retSize. */
+{
+struct cBlock *list = NULL;
+int noiseCount = (long long)blockCount * noisePercent / 100;
+int runBlocks = blockCount - noiseCount;
+int seqSize = 0, i, runIx;
+
+/* Lay runs out one after another on the target, and shuffled a bit on the
+ * query, with gaps that are mostly small and sometimes uneven. */
+int qPos = 0, tPos = 0;
+for (runIx = 0; runIx < runCount; ++runIx)
+    {
+    int size = runBlocks/runCount + (runIx < runBlocks%runCount ? 1 : 0);
+    qPos += rand()%100000;
+    tPos += rand()%100000;
+    for (i=0; i<size; ++i)
+        {
+	struct cBlock *b = randomBlock(qPos, tPos, &list);
+	int gap = rand()%80;
+	int indel = (rand()%4 == 0 ? rand()%50 : 0);
+	qPos = b->qEnd + gap + (rand()%2 ? indel : 0);
+	tPos = b->tEnd + gap + (rand()%2 ? 0 : indel);
+	}
+    }
+seqSize = max(qPos, tPos) + 1000;
+
+/* Scatter noise over the whole thing. */
+for (i=0; i<noiseCount; ++i)
+    randomBlock(rand()%(seqSize-200), rand()%(seqSize-200), &list);
+*retSize = seqSize;
+return list;
+}
+
+void chainBlockBench(char *outFile)
+/* chainBlockBench - time chainBlocks on synthetic dense syntenic alignments. */
+{
+int blockCount = optionInt("blocks", DEFAULT_BLOCKS);
+int runCount = optionInt("runs", DEFAULT_RUNS);
+int noisePercent = optionInt("noise", DEFAULT_NOISE);
+int jobCount = optionInt("jobs", DEFAULT_JOBS);
+int threadCount = optionInt("threads", DEFAULT_THREADS);
+struct gapCalc *gapCalc = gapCalcDefault();
+struct chainBlockJob *jobList = NULL, *job;
+int i;
+
+if (jobCount < 1 || runCount < jobCount || blockCount < runCount)
+    errAbort("Need at least one job, a run per job, and a block per run.");
+srand(optionInt("seed", 0));
+for (i=0; i<jobCount; ++i)
+    {
+    int size;
+    AllocVar(job);
+    job->blockList = makeBlocks(blockCount/jobCount, runCount/jobCount, noisePercent, &size);
+    job->qName = job->tName = "chrSynth";
+    job->qSize = job->tSize = size;
+    job->qStrand = '+';
+    job->connectCost = connectCost;
+    job->gapCost = gapCost;
+    job->gapData = gapCalc;
+    slAddHead(&jobList, job);
+    }
+slReverse(&jobList);
+
+long startTime = clock1000();
+if (jobCount == 1 && threadCount <= 1)
+    {
+    job = jobList;
+    job->chainList = chainBlocks(job->qName, job->qSize, job->qStrand,
+    	job->tName, job->tSize, &job->blockList, 
+	job->connectCost, job->gapCost, job->gapData, NULL);
+    }
+else
+    chainBlocksMany(jobList, threadCount);
+long chainTime = clock1000() - startTime;
+
+FILE *f = mustOpen(outFile, "w");
+int chainCount = 0;
+double totalScore = 0;
+for (job = jobList; job != NULL; job = job->next)
+    {
+    struct chain *chain;
+    for (chain = job->chainList; chain != NULL; chain = chain->next)
+        {
+	chainWrite(chain, f);
+	++chainCount;
+	totalScore += chain->score;
+	}
+    }
+carefulClose(&f);
+printf("%d blocks in %d jobs to %d chains with total score %1.0f in %ld ms\n",
+	blockCount, jobCount, chainCount, totalScore, chainTime);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+optionInit(&argc, argv, options);
+if (argc != 2)
+    usage();
+chainBlockBench(argv[1]);
+return 0;
+}
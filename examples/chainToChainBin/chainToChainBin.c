@@ -0,0 +1,32 @@
+/* chainToChainBin - convert a text chain file to a binary indexed one. */
+#include "common.h"
+#include "options.h"
+#include "chainBin.h"
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "chainToChainBin - convert a text chain file to a binary indexed one\n"
+      "usage:\n"
+      "   chainToChainBin in.chain out.chainBin\n"
+      "The binary file is about half the size of the text, and\n"
+      "chainBinQuery can pull out the chains overlapping a target region\n"
+      "without reading all of it.  Chains without an id get one, as\n"
+      "chainWrite does.\n"
+  );
+}
+
+static struct optionSpec options[] = {
+    {NULL, 0},
+};
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 3)
+    usage();
+  chainBinMake(argv[1], argv[2]);
+  return 0;
+}
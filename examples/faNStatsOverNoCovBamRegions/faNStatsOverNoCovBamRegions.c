@@ -23,6 +23,7 @@
 #include "sam.h"
 #include "dnaseq.h"
 #include "dnaLoad.h"
+#include "dnautil.h"
 #include "hash.h"
 
 
@@ -99,7 +100,7 @@ static struct optionSpec options[] = {
  *
  */
 
-inline int addReadCovToCovLst(bam1_t *b, unsigned short *insert_coverage_counts){
+static inline int addReadCovToCovLst(bam1_t *b, unsigned short *insert_coverage_counts){
   int i,k,l,op,end;
   bam1_core_t *c = &(b->core);
   int tpos = c->pos;
@@ -167,45 +168,38 @@ inline int addReadCovToCovLst(bam1_t *b, unsigned short *insert_coverage_counts)
 }
 
 
-inline void printChromInfo(FILE *out, char *name,
+void printChromInfo(FILE *out, char *name,
     const int length, const int max_gap,
     const unsigned short * const insert_coverage_counts,
     struct hash *refListHash){
-  int i = 0;
-  struct dnaSeq *refSeq = NULL;
-  DNA *refDna = NULL;
-  refSeq = (struct dnaSeq *) hashMustFindVal(refListHash, name);
-  refDna = refSeq->dna;
-  boolean spanningseq = TRUE;
-  int thisGapLen = 0;
-  for(i=0;i<length;i++){
-    if(toupper(refDna[i]) == 'N'){
-      //we are at a gap char
-      thisGapLen++;
-      if(insert_coverage_counts[i] == 0){
-        spanningseq = FALSE;
-      }
-    }else{
-      if(thisGapLen > 0){
-        //we just got out of a gap
-        if(spanningseq == FALSE){
-          int j;
-          for(j=i-thisGapLen;j<i;j++)
-              fprintf(out, "%s\t%d\n", name, j);
-
-          if(thisGapLen < max_gap){
-            gapfreqbylenwithnosupport[thisGapLen]++;
-            if(thisGapLen>maxSeenGap)
-              maxSeenGap = thisGapLen;
-          }
-        }
-
-        //reset to normal state
-        thisGapLen = 0;
-        spanningseq = TRUE;
+  struct dnaSeq *refSeq = (struct dnaSeq *) hashMustFindVal(refListHash, name);
+  int size = min(length, refSeq->size);
+  bits32 *nStarts, *nSizes;
+  int nCount = findBlocksOfN(refSeq->dna, size, &nStarts, &nSizes);
+  int i, j;
+  for(i=0;i<nCount;i++){
+    int gapStart = nStarts[i];
+    int gapEnd = gapStart + nSizes[i];
+    int thisGapLen = nSizes[i];
+    //gaps running off the end are not followed by a base, so don't count
+    if(gapEnd >= size)
+      break;
+    for(j=gapStart;j<gapEnd;j++)
+      if(insert_coverage_counts[j] == 0)
+        break;
+    if(j < gapEnd){
+      //some part of the gap has no spanning sequence
+      for(j=gapStart;j<gapEnd;j++)
+        fprintf(out, "%s\t%d\n", name, j);
+      if(thisGapLen < max_gap){
+        gapfreqbylenwithnosupport[thisGapLen]++;
+        if(thisGapLen>maxSeenGap)
+          maxSeenGap = thisGapLen;
       }
     }
   }
+  freeMem(nStarts);
+  freeMem(nSizes);
 }
 
 
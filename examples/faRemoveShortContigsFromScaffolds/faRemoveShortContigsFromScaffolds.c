@@ -20,6 +20,7 @@
 #include "linefile.h"
 #include "fa.h"
 #include "dnaLoad.h"
+#include "dnautil.h"
 #include <math.h>
 #include <ctype.h>
 
@@ -82,85 +83,62 @@ static struct optionSpec options[] = {
  *
  */
 
-inline void maskRange(DNA *seq, int start, int end){
-  int i;
-  for(i=start;i<end;i++){
-    seq[i] = 'N';
-  }
-}
-
-inline boolean allN(DNA *seq, int len){
-  int i;
-  for(i=0;i<len;i++){
-    if(toupper(seq[i]) != 'N'){
-      return(FALSE);
-    }
-  }
-  return(TRUE);
-}
-
-inline int beginNTrimPos(DNA *seq, int len){
-  int i = 0;
-  for(i=0;i<len;i++){
-    if(toupper(seq[i]) != 'N')
-      return(i);
-  }
-  return(i);
-}
-
-inline int endNTrimPos(DNA *seq, int len){
-  int i = 0;
-  for(i=len-1; i >= 0; i--){
-    if(toupper(seq[i]) != 'N')
-      return(i+1);
-  }
-  return(i+1);
-}
-
-inline void faWriteCWithMinGaps(FILE *f, char c, const int maxPerLine, int *leftPerLine){
-  fputc(c,f);
-  if((--(*leftPerLine)) == 0){
-    fputc('\n',f);
-    (*leftPerLine) = maxPerLine;
-  }
-}
-
 void faWriteWithMinGaps(FILE *f, char *startLine,
-    const DNA *const letters, const int dnaSize,
+    DNA *letters, const int dnaSize,
     const int maxPerLine,
     const int minToCallGapLen,
     const int minGapLen){
-  int lettersLeft = dnaSize;
-  int leftPerLine = maxPerLine;
-  int gapLen = 0;
+  /* Write sequence, padding gaps of at least minToCallGapLen N's out to
+   * minGapLen.  All N's are written upper case. */
+  bits32 *nStarts, *nSizes;
+  int nCount = findBlocksOfN(letters, dnaSize, &nStarts, &nSizes);
+  int lineSize = 0;
+  int pos = 0;
+  int i;
   if (startLine != NULL)
       fprintf(f, ">%s\n", startLine);
-  int i;
-  for(i=0;i<dnaSize;i++){
-    char c = letters[i];
-    char uc = toupper(c);
-
-    if(uc == 'N'){
-      gapLen++;
-      faWriteCWithMinGaps(f,'N',maxPerLine,&leftPerLine);
-    }else{
-
-      //deal with previous gap
-      if(gapLen > 0){
-        if(gapLen >= minToCallGapLen && gapLen < minGapLen){
-          int j;
-          for(j=gapLen; j<minGapLen;j++)
-            faWriteCWithMinGaps(f,'N',maxPerLine,&leftPerLine);
-        }
-        //reset gapLen
-        gapLen = 0;
-      }
-      //now write out the char
-      faWriteCWithMinGaps(f,c,maxPerLine,&leftPerLine);
-    }
+  for(i=0;i<nCount;i++){
+    int gapLen = nSizes[i];
+    writeSeqWithBreaksAt(f, letters+pos, nStarts[i]-pos, maxPerLine, &lineSize);
+    //only pad gaps followed by a base
+    if(gapLen >= minToCallGapLen && gapLen < minGapLen && nStarts[i]+gapLen < dnaSize)
+      gapLen = minGapLen;
+    writeCharWithBreaksAt(f, 'N', gapLen, maxPerLine, &lineSize);
+    pos = nStarts[i] + nSizes[i];
   }
+  writeSeqWithBreaksAt(f, letters+pos, dnaSize-pos, maxPerLine, &lineSize);
   //newline after sequence
   fputc('\n',f);
+  freeMem(nStarts);
+  freeMem(nSizes);
+}
+
+void maskShortContigs(DNA *seq, int seqLen, const int minLen, const int minToCallGapLen){
+  /* Turn contigs shorter than minLen into N's.  Contigs are separated by
+   * runs of at least minToCallGapLen N's; shorter runs are part of the
+   * contig. */
+  bits32 *nStarts, *nSizes;
+  int nCount = findBlocksOfN(seq, seqLen, &nStarts, &nSizes);
+  int ctgStart = 0;
+  int i;
+  for(i=0;i<nCount;i++){
+    if(nSizes[i] < minToCallGapLen)
+      continue;
+    int ctgLen = nStarts[i] - ctgStart;
+    if(ctgLen > 0 && ctgLen < minLen)
+      memset(seq+ctgStart, 'N', ctgLen);
+    ctgStart = nStarts[i] + nSizes[i];
+  }
+  //last contig, not counting any short run of N's at the end.  The
+  //length compared to minLen is one more than the real length.
+  int ctgEnd = seqLen;
+  if(nCount > 0 && nStarts[nCount-1] + nSizes[nCount-1] == seqLen
+      && nSizes[nCount-1] < minToCallGapLen)
+    ctgEnd = nStarts[nCount-1];
+  if(ctgStart < seqLen && ctgEnd - ctgStart + 1 < minLen)
+    memset(seq+ctgStart, 'N', seqLen-ctgStart);
+  freeMem(nStarts);
+  freeMem(nSizes);
 }
 
 void faRemoveShortContigsFromScaffolds(char *faFile, FILE *outstream,
@@ -168,44 +146,18 @@ void faRemoveShortContigsFromScaffolds(char *faFile, FILE *outstream,
 
   struct lineFile *lf = lineFileOpen(faFile,TRUE);
   DNA *seq;
-  int seqLen , i = 0;
+  int seqLen;
   char *seqName;
 
 
   while(faMixedSpeedReadNext(lf, &seq, &seqLen, &seqName)){
-    int ctgLen = 0;
-    int gapLen = 0;
-    for(i=0;i<seqLen;i++){
-      if(toupper(seq[i]) == 'N'){
-        gapLen++;
-        if(ctgLen-gapLen+1 > 0 && ctgLen-gapLen+1 < minLen && gapLen == minToCallGapLen){
-          //need to mask
-          //we have seen minGapLen N's already
-          //and ctgLen has been incremented by minGapLen-1 N's
-          //into this gap
-          maskRange(seq,i-ctgLen,i-gapLen+1);
-        }
-        if(gapLen >= minToCallGapLen){
-          ctgLen = 0; //make sure it is 0 since we have seen a real gap
-        }else{
-          ctgLen++;
-        }
-      }else{
-        ctgLen++;
-        gapLen = 0;
-      }
-    }
-    if(ctgLen-gapLen+1 > 0 && ctgLen-gapLen+1 < minLen){
-      //need to mask
-      //we have seen minGapLen N's already
-      //and ctgLen has been incremented by minGapLen-1 N's
-      //into this gap
-      maskRange(seq,i-ctgLen,i-gapLen+1);
-    }
-
-    int beginPos = beginNTrimPos(seq,seqLen);
-    int endPos = endNTrimPos(seq,seqLen);
+    maskShortContigs(seq, seqLen, minLen, minToCallGapLen);
 
+    //trim N's off both ends
+    int beginPos = findNextNonN(seq, 0, seqLen);
+    int endPos = seqLen;
+    while(endPos > beginPos && (seq[endPos-1] == 'N' || seq[endPos-1] == 'n'))
+      endPos--;
 
     //if the sequence is longer than our minLen
     //and not all gaps, then print it!
@@ -216,10 +168,7 @@ void faRemoveShortContigsFromScaffolds(char *faFile, FILE *outstream,
     if(afterTrimLen < minLen)
       continue;
 
-    if(allN(seq+beginPos, afterTrimLen) == FALSE){
-      //faWriteNext(outstream, seqName, seq+beginPos, afterTrimLen);
-      faWriteWithMinGaps(outstream, seqName, seq+beginPos, afterTrimLen, lineWrapLen, minToCallGapLen, minGapLen);
-    }
+    faWriteWithMinGaps(outstream, seqName, seq+beginPos, afterTrimLen, lineWrapLen, minToCallGapLen, minGapLen);
   }//end loop over fasta sequences
   faFreeFastBuf();
   lineFileClose(&lf);
@@ -0,0 +1,68 @@
+/* faToTwoBit - convert fasta files to .2bit format one sequence at a time. */
+#include "common.h"
+#include "options.h"
+#include "linefile.h"
+#include "dnautil.h"
+#include "dnaseq.h"
+#include "fa.h"
+#include "twoBit.h"
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "faToTwoBit - convert fasta files to .2bit format\n"
+      "usage:\n"
+      "   faToTwoBit in.fa [in2.fa ...] out.2bit\n"
+      "Sequences are packed and written out one at a time, so only the\n"
+      "largest sequence needs to fit in memory.  Packed data is staged in a\n"
+      "temporary file in the same directory as out.2bit.\n"
+      "options:\n"
+      "   -noMask - ignore lower case, don't record masked regions\n"
+      "   -long - use 64 bit offsets in the index.  This is done automatically\n"
+      "           if the output is bigger than 4Gb\n"
+  );
+}
+
+static struct optionSpec options[] = {
+    {"noMask", OPTION_BOOLEAN},
+    {"long", OPTION_BOOLEAN},
+    {NULL, 0},
+};
+
+void faToTwoBit(int inCount, char *inFiles[], char *outFile, boolean doMask,
+	boolean force64)
+/* faToTwoBit - convert fasta files to .2bit format one sequence at a time. */
+{
+  struct twoBitWriter *tbw = twoBitWriterOpen(outFile, force64);
+  struct dnaSeq seq;
+  int i;
+  long long seqCount = 0, baseCount = 0;
+
+  ZeroVar(&seq);
+  for (i=0; i<inCount; ++i)
+    {
+      struct lineFile *lf = lineFileOpen(inFiles[i], TRUE);
+      while (faMixedSpeedReadNext(lf, &seq.dna, &seq.size, &seq.name))
+        {
+          twoBitWriterAdd(tbw, &seq, doMask);
+          ++seqCount;
+          baseCount += seq.size;
+        }
+      lineFileClose(&lf);
+    }
+  twoBitWriterClose(&tbw);
+  verbose(1, "%lld sequences, %lld bases\n", seqCount, baseCount);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc < 3)
+    usage();
+  dnaUtilOpen();
+  faToTwoBit(argc-2, argv+1, argv[argc-1], !optionExists("noMask"),
+      optionExists("long"));
+  return 0;
+}
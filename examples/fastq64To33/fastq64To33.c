@@ -31,6 +31,8 @@
 #include "options.h"
 #include "linefile.h"
 #include "fastq.h"
+#include "blockGz.h"
+#include "readPack.h"
 
 
 
@@ -47,8 +49,11 @@ void usage()
       "usage:\n"
       "\tfastq64to33 [required options] \n"
       "\n**required** options:\n"
-      "\t-input=FILE\tFile name holding the fastq reads to be converted\n"
+      "\t-input=FILE\tFile name holding the fastq or readPack reads to be converted\n"
       "\t-output=NAME\tFilename to output\n"
+      "\noptions:\n"
+      "\t-threads=NUM\tNumber of compression threads (DEFAULT 4)\n"
+      "\t-bgzf\tWrite BGZF rather than plain gzip so the output can be indexed\n"
   );
 }//end usage()
 
@@ -57,6 +62,8 @@ static struct optionSpec options[] = {
     /* Structure holding command line options */
     {"input",OPTION_STRING},
     {"output",OPTION_STRING},
+    {"threads",OPTION_INT},
+    {"bgzf",OPTION_BOOLEAN},
     {NULL, 0}
 }; //end options()
 
@@ -64,17 +71,23 @@ static struct optionSpec options[] = {
  * Main function, takes filenames for paired qseq reads
  * and outputs three files.
  */
-int fastq64To33(char *inread, char *outread){
-  struct lineFile *lf;
-  lf = lineFileOpen(inread,TRUE);
-  gzFile *zout = gzopen(outread,"wb");
+int fastq64To33(char *inread, char *outread, int threads, boolean bgzf){
+  struct lineFile *lf = NULL;
+  struct readPack *rp = NULL;
+  if(readPackIsFile(inread))
+    rp = readPackOpen(inread);
+  else
+    lf = lineFileOpen(inread,TRUE);
+  struct blockGz *zout = bgzf ? blockGzOpenBgzf(outread,-1,threads) : blockGzOpen(outread,-1,threads);
   struct fastqItem *fq = allocFastqItem();
-  while(fastqItemNext(lf,fq)){
+  while(rp != NULL ? readPackNext(rp,fq) : fastqItemNext(lf,fq)){
     convPhred64ToPhred33(fq);
-    gzPrintFastqItem(zout,fq);
+    blockGzPrintFastqItem(zout,fq);
   }
-  gzclose(zout);
+  blockGzClose(&zout);
   freeFastqItem(fq);
+  lineFileClose(&lf);
+  readPackClose(&rp);
   return(0);
 }
 
@@ -105,7 +118,7 @@ int main(int argc, char *argv[])
     sprintf(newOut,"%s.gz",output);
   }
 
-  fastq64To33(input, newOut);
+  fastq64To33(input, newOut, optionInt("threads",4), optionExists("bgzf"));
 
   return(0);
 } //end main()
@@ -31,6 +31,7 @@
 #include "options.h"
 #include "linefile.h"
 #include "fastq.h"
+#include "fastqPipeline.h"
 
 
 
@@ -38,6 +39,8 @@
 Global variables
  */
 #define DEF_MIN_LEN (30)
+#define DEF_THREADS (4)
+#define DEF_GZ_LEVEL (6)
 
 
 void usage()
@@ -50,6 +53,8 @@ void usage()
       "Options:\n"
       "\t-help\tPrints this message.\n"
       "\t-minLen=NUM\tIf at least one sequence is shorter than NUM after cleanup, don't print either (-1 to disable removal) (DEFAULT 30).\n"
+      "\t-threads=NUM\tNumber of cleanup threads, and of compression threads per output (DEFAULT 4).\n"
+      "\t-gzLevel=NUM\tgzip compression level of the outputs, 1-9 (DEFAULT 6).\n"
   );
 }//end usage()
 
@@ -58,45 +63,32 @@ static struct optionSpec options[] = {
     /* Structure holding command line options */
     {"help",OPTION_STRING},
     {"minLen",OPTION_INT},
+    {"threads",OPTION_INT},
+    {"gzLevel",OPTION_INT},
     {NULL, 0}
 }; //end options()
 
 
+static boolean cleanPair(struct fastqItem **fqs, int mateCount, void *context)
+/* Pipeline filter: clean up both reads, keep the pair if neither is too short. */
+{
+  int minlen = *(int *)context;
+  boolean trash1 = cleanAndThrowOutFastqItem(fqs[0],minlen);
+  boolean trash2 = cleanAndThrowOutFastqItem(fqs[1],minlen);
+  return(!(trash1 || trash2));
+}
+
 /**
- * Main function, takes filenames for paired qseq reads
- * and outputs three files.
+ * Main function, takes filenames for paired fastq reads
+ * and outputs two cleaned up gzipped files.
  */
-int fastqCleanup(char *inread1, char *inread2, char *outread1, char *outread2, const int minlen){
-  struct lineFile *lf1;
-  struct lineFile *lf2;
-  lf1 = lineFileOpen(inread1,TRUE);
-  lf2 = lineFileOpen(inread2,TRUE);
-  gzFile *zout1 = gzopen(outread1,"wb");
-  gzFile *zout2 = gzopen(outread2,"wb");
-
-  struct fastqItem *fq1 = allocFastqItem();
-  struct fastqItem *fq2 = allocFastqItem();
-
-  //loop over pairs of reads and clean up
-  while(fastqItemNext(lf1,fq1) && fastqItemNext(lf2,fq2)){
-
-    boolean trash1 = cleanAndThrowOutFastqItem(fq1,minlen);
-    boolean trash2 = cleanAndThrowOutFastqItem(fq2,minlen);
-
-    if((trash1 == TRUE) || (trash2 == TRUE))
-      continue;
-
-    gzPrintFastqItem(zout1,fq1);
-    gzPrintFastqItem(zout2,fq2);
-  }
+int fastqCleanup(char *inread1, char *inread2, char *outread1, char *outread2, int minlen,
+    const int threads, const int gzLevel){
+  char *inFiles[2] = {inread1, inread2};
+  char *outFiles[2] = {outread1, outread2};
 
-  //close and clean up
-  gzclose(zout1);
-  gzclose(zout2);
-  freeFastqItem(fq1);
-  freeFastqItem(fq2);
-  lineFileClose(&lf1);
-  lineFileClose(&lf2);
+  //loop over pairs of reads and clean up on worker threads, compressing in parallel
+  fastqPipelineRun(2, inFiles, outFiles, cleanPair, &minlen, threads, gzLevel, NULL);
   return(0);
 }
 
@@ -114,6 +106,8 @@ int main(int argc, char *argv[])
   }
 
   int minLen = optionInt("minLen", DEF_MIN_LEN);
+  int threads = optionInt("threads", DEF_THREADS);
+  int gzLevel = optionInt("gzLevel", DEF_GZ_LEVEL);
 
   input1 = argv[1];
   input2 = argv[2];
@@ -140,7 +134,7 @@ int main(int argc, char *argv[])
     sprintf(newOut2,"%s.gz",output2);
   }
 
-  fastqCleanup(input1, input2, newOut1, newOut2, minLen);
+  fastqCleanup(input1, input2, newOut1, newOut2, minLen, threads, gzLevel);
 
   return(0);
 } //end main()
@@ -0,0 +1,52 @@
+/* fastqReadPack - convert between fastq and the compact readPack format. */
+#include "common.h"
+#include "options.h"
+#include "linefile.h"
+#include "fastq.h"
+#include "readPack.h"
+
+#define DEFAULT_THREADS 4
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "fastqReadPack - convert between fastq and the compact readPack format\n"
+      "usage:\n"
+      "   fastqReadPack in.fq[.gz] out.rpk\n"
+      "   fastqReadPack in.rpk out.fq[.gz]\n"
+      "The direction is chosen by looking at the input file.  ReadPack files\n"
+      "store bases two bits each and keep names, qualities and non-ACGT bases\n"
+      "in separate compressed streams.  The conversion is lossless apart from\n"
+      "the text after the '+' line, which is dropped.\n"
+      "options:\n"
+      "   -threads=N - compression threads for .gz output, default %d\n",
+      DEFAULT_THREADS
+  );
+}
+
+static struct optionSpec options[] = {
+    {"threads", OPTION_INT},
+    {NULL, 0},
+};
+
+void fastqReadPack(char *input, char *output, int threads)
+/* fastqReadPack - convert between fastq and the compact readPack format. */
+{
+  bits64 count;
+  if (readPackIsFile(input))
+    count = readPackToFastq(input, output, threads);
+  else
+    count = readPackFromFastq(input, output);
+  verbose(1, "%llu reads\n", count);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 3)
+    usage();
+  fastqReadPack(argv[1], argv[2], optionInt("threads", DEFAULT_THREADS));
+  return 0;
+}
@@ -0,0 +1,337 @@
+/* fmiCheck - check fmi searches find the same things as sufa searches on
+ * random genomes and queries. */
+#include "common.h"
+#include "options.h"
+#include "portable.h"
+#include "sufa.h"
+#include "fmi.h"
+#include "sufMake.h"
+
+#define DEFAULT_GENOMES 40
+#define DEFAULT_MAX_SIZE 20000
+#define DEFAULT_QUERIES 200
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "fmiCheck - check fmi searches find the same things as sufa searches on\n"
+      "random genomes and queries\n"
+      "usage:\n"
+      "   fmiCheck tmpDir\n"
+      "Random genomes are indexed with sufMake as a sufa file and as an fmi file\n"
+      "with 32 or 64 bit samples at a random sample rate, both written in tmpDir\n"
+      "and read back with or without memory mapping.  Every fmi row is located\n"
+      "and compared with the full suffix array.  Then queries are searched\n"
+      "for with fmiFindExact, fmiFindLongestPrefix and fmiFindMany, and the\n"
+      "counts, matched sizes, located rows and fmiHits compared with the sufa\n"
+      "searches, and counts with a brute force scan.  Queries not starting\n"
+      "with n are compared with sufa, which doesn't index suffixes starting\n"
+      "with n, the rest only by brute force.  Genomes mix random DNA with\n"
+      "copies of earlier stretches, runs of n and single base repeats.\n"
+      "Queries are stretches of the genome in mixed case, with and without a\n"
+      "few changes, random bases, and the odd one that is empty, starts with\n"
+      "n or has a letter that never matches.\n"
+      "options:\n"
+      "   -genomes=N - number of random genomes, default %d\n"
+      "   -maxSize=N - most bases in a genome, default %d\n"
+      "   -queries=N - number of queries per genome, default %d\n"
+      "   -seed=N - random number seed, default 0\n",
+      DEFAULT_GENOMES, DEFAULT_MAX_SIZE, DEFAULT_QUERIES
+  );
+}
+
+static struct optionSpec options[] = {
+    {"genomes", OPTION_INT},
+    {"maxSize", OPTION_INT},
+    {"queries", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+static char randomBase()
+/* Return a random lower case base. */
+{
+return "acgt"[random() & 3];
+}
+
+static struct sufGenome *randomGenome(int maxSize)
+/* Return genome of random DNA with repeats on one or more chromosomes, laid
+ * out the way sufGenomeLoad does it. */
+{
+int size = 1 + random() % maxSize;
+int maxChroms = (random() % 2 ? 3 : 50);
+struct sufGenome *genome;
+AllocVar(genome);
+genome->chromCount = 1 + random() % min(size, maxChroms);
+AllocArray(genome->chromNames, genome->chromCount);
+AllocArray(genome->chromSizes, genome->chromCount);
+char *dna = genome->allDna = needLargeMem(size + genome->chromCount + 8);
+int chromIx, offset = 0, d = 0;
+for (chromIx = 0; chromIx < genome->chromCount; ++chromIx)
+    {
+    char name[16];
+    safef(name, sizeof(name), "chr%d", chromIx+1);
+    genome->chromNames[chromIx] = cloneString(name);
+    int chromSize = (size - offset) / (genome->chromCount - chromIx);
+    if (chromIx < genome->chromCount-1 && random() % 2)
+        chromSize = 1 + random() % chromSize;
+    genome->chromSizes[chromIx] = chromSize;
+    int i = 0;
+    while (i < chromSize)
+        {
+	int piece = 1 + random() % min(chromSize - i, 500);
+	int j;
+	switch (random() % 6)
+	    {
+	    case 0:	/* Copy of an earlier stretch with a few changes. */
+	        if (d > piece)
+		    {
+		    int start = random() % (d - piece);
+		    for (j=0; j<piece; ++j)
+			{
+			char c = dna[start + j];
+			dna[d+j] = (c == 0 || random() % 50 == 0 ? randomBase() : c);
+			}
+		    break;
+		    }
+		/* Else fall through to random. */
+	    default:	/* Random. */
+		for (j=0; j<piece; ++j)
+		    dna[d+j] = randomBase();
+	        break;
+	    case 1:	/* Run of n or of a single base. */
+	        {
+		char c = (random() % 2 ? 'n' : randomBase());
+		for (j=0; j<piece; ++j)
+		    dna[d+j] = c;
+		break;
+		}
+	    }
+	i += piece;
+	d += piece;
+	}
+    dna[d++] = 0;
+    offset += chromSize;
+    }
+memset(dna + d, 0, 8);
+genome->dnaSize = d;
+int i;
+for (i=0; i<d; ++i)
+    if (dna[i] != 0 && dna[i] != 'n')
+        genome->arraySize += 1;
+return genome;
+}
+
+static void randomQuery(struct sufGenome *genome, char *q, int size)
+/* Fill in q with size bases, usually from the genome. */
+{
+char *dna = genome->allDna;
+int i;
+switch (random() % 8)
+    {
+    default:	/* From genome, maybe with a change or two. */
+        {
+	bits64 pos = random() % genome->dnaSize;
+	boolean change = (random() % 3 == 0);
+	for (i=0; i<size; ++i)
+	    {
+	    /* Past the end of the chromosome carry on with random bases. */
+	    char c = (pos < genome->dnaSize ? dna[pos++] : 0);
+	    if (c == 0)
+	        pos = genome->dnaSize;
+	    if (c == 0 || (change && random() % 10 == 0))
+		c = randomBase();
+	    q[i] = (random() % 2 ? toupper(c) : c);
+	    }
+	break;
+	}
+    case 0:	/* Random. */
+        for (i=0; i<size; ++i)
+	    q[i] = randomBase();
+	break;
+    case 1:	/* Starting with n, or with a letter that never matches. */
+        for (i=0; i<size; ++i)
+	    q[i] = randomBase();
+	if (size > 0)
+	    q[random() % 2 ? 0 : random() % size] = "nNxR"[random() & 3];
+	break;
+    }
+}
+
+static bits64 bruteCount(struct sufGenome *genome, char *q, int qSize)
+/* Count places q occurs by looking at every position. */
+{
+char *dna = genome->allDna;
+bits64 i, count = 0;
+for (i=0; i<genome->dnaSize; ++i)
+    {
+    int j;
+    for (j=0; j<qSize && dna[i+j] == tolower(q[j]); ++j)
+        ;
+    if (j == qSize)
+        ++count;
+    }
+return count;
+}
+
+static void checkQuery(struct sufa *sufa, struct fmi *fmi, struct sufGenome *genome,
+	struct sufaQuery *aq, struct fmiQuery *fq, int genomeIx, int qIx)
+/* Search for one query with each method, and compare. */
+{
+char *q = aq->dna;
+int qSize = aq->size;
+bits32 arrayIx, count;
+int matchSize = sufaFindLongestPrefix(sufa, q, qSize, &arrayIx, &count);
+bits32 exactIx, exactCount = sufaFindExact(sufa, q, qSize, &exactIx);
+bits64 row, fCount;
+int fMatchSize = fmiFindLongestPrefix(fmi, q, qSize, &row, &fCount);
+bits64 exactRow, fExactCount = fmiFindExact(fmi, q, qSize, &exactRow);
+
+/* Each method should agree with itself. */
+if (fq->matchSize != fMatchSize || fq->row != row || fq->count != fCount)
+    errAbort("fmiFindMany and fmiFindLongestPrefix differ on query %d of genome %d: %.*s",
+	    qIx, genomeIx, qSize, q);
+if (fExactCount != (fMatchSize == qSize ? fCount : 0)
+    || (fExactCount > 0 && exactRow != row))
+    errAbort("fmiFindExact and fmiFindLongestPrefix differ on query %d of genome %d: %.*s",
+	    qIx, genomeIx, qSize, q);
+
+/* Counts and sizes should be what's in the genome. */
+if (fMatchSize > 0 && bruteCount(genome, q, fMatchSize) != fCount)
+    errAbort("fmi finds %llu of %d bases of query %d of genome %d, brute force %llu: %.*s",
+	    fCount, fMatchSize, qIx, genomeIx, bruteCount(genome, q, fMatchSize), qSize, q);
+if (fMatchSize < qSize && bruteCount(genome, q, fMatchSize+1) != 0)
+    errAbort("fmi misses longer prefix than %d of query %d of genome %d: %.*s",
+	    fMatchSize, qIx, genomeIx, qSize, q);
+
+/* Sufa doesn't index suffixes starting with n, so only compare the rest. */
+if (qSize > 0 && tolower(q[0]) == 'n')
+    {
+    if (matchSize != 0)
+        errAbort("sufa finds query %d of genome %d starting with n: %.*s",
+		qIx, genomeIx, qSize, q);
+    return;
+    }
+if (aq->matchSize != matchSize || aq->arrayIx != arrayIx || aq->count != count)
+    errAbort("sufaFindMany and sufaFindLongestPrefix differ on query %d of genome %d: %.*s",
+	    qIx, genomeIx, qSize, q);
+if (fMatchSize != matchSize || fCount != count || fExactCount != exactCount)
+    errAbort("Query %d of genome %d matches %d bases %llu times in fmi, "
+	     "%d bases %u times in sufa: %.*s",
+	     qIx, genomeIx, fMatchSize, fCount, matchSize, count, qSize, q);
+
+/* Rows are in the same order as the suffix array. */
+bits64 i;
+for (i=0; i<count; ++i)
+    if (fmiRowOffset(fmi, row + i) != sufa->array[arrayIx + i])
+        errAbort("Row %llu of query %d of genome %d is at %llu in fmi, %u in sufa",
+		row + i, qIx, genomeIx, fmiRowOffset(fmi, row + i), sufa->array[arrayIx + i]);
+struct sufaHit aHits[16];
+struct fmiHit fHits[16];
+int aHitCount = sufaHits(sufa, arrayIx, count, aHits, ArraySize(aHits));
+int fHitCount = fmiHits(fmi, row, fCount, fHits, ArraySize(fHits));
+if (aHitCount != fHitCount)
+    errAbort("Query %d of genome %d has %d sufaHits, %d fmiHits", qIx, genomeIx,
+	    aHitCount, fHitCount);
+for (i=0; i<aHitCount; ++i)
+    if (aHits[i].chromIx != fHits[i].chromIx || aHits[i].offset != fHits[i].offset)
+        errAbort("Hit %llu of query %d of genome %d is %s:%u in sufa, %s:%u in fmi",
+		i, qIx, genomeIx, sufa->chromNames[aHits[i].chromIx], aHits[i].offset,
+		fmi->chromNames[fHits[i].chromIx], fHits[i].offset);
+}
+
+static void checkGenome(char *tmpDir, int maxSize, int queryCount, int genomeIx)
+/* Index a random genome both ways, and check searches of it. */
+{
+struct sufGenome *genome = randomGenome(maxSize);
+int threads = 1 + random() % 4;
+boolean is64 = random() % 2;
+int sampleRate = (random() % 2 ? FMI_DEFAULT_SAMPLE_RATE : 1 + random() % 100);
+boolean aMap = random() % 2, fMap = random() % 2;
+verbose(2, "genome %d: %d chromosomes, %llu bases, %s bit samples every %d rows\n",
+	genomeIx, genome->chromCount, genome->dnaSize, (is64 ? "64" : "32"), sampleRate);
+
+/* Write and read back indexes. */
+char sufaName[PATH_LEN], fmiName[PATH_LEN];
+safef(sufaName, sizeof(sufaName), "%s/fmiCheck.sufa", tmpDir);
+safef(fmiName, sizeof(fmiName), "%s/fmiCheck.fmi", tmpDir);
+bits32 *array = sufArrayMake(genome, threads);
+sufaWrite(genome, array, sufaName);
+freeMem(array);
+void *full = sufArrayMakeFull(genome, is64, threads);
+fmiWrite(genome, full, is64, sampleRate, fmiName);
+struct sufa *sufa = sufaRead(sufaName, aMap);
+struct fmi *fmi = fmiRead(fmiName, fMap);
+if (fmi->header->textSize != genome->dnaSize)
+    errAbort("Genome %d has %llu bases with separators, fmi has %llu rows", genomeIx,
+	    genome->dnaSize, fmi->header->textSize);
+
+/* Locate every row. */
+bits64 row;
+for (row = 0; row < genome->dnaSize; ++row)
+    {
+    bits64 offset = (is64 ? ((bits64 *)full)[row] : ((bits32 *)full)[row]);
+    if (fmiRowOffset(fmi, row) != offset)
+        errAbort("Row %llu of genome %d is at %llu, fmiRowOffset says %llu", row, genomeIx,
+		offset, fmiRowOffset(fmi, row));
+    }
+freeMem(full);
+
+/* Make queries, search for them in batches, and check them one at a time. */
+char *qDna = needLargeMem(queryCount * 40);
+struct sufaQuery *aQueries;
+struct fmiQuery *fQueries;
+AllocArray(aQueries, queryCount);
+AllocArray(fQueries, queryCount);
+int qIx;
+for (qIx=0; qIx<queryCount; ++qIx)
+    {
+    char *q = qDna + qIx * 40;
+    int size = (random() % 50 == 0 ? 0 : 1 + random() % 40);
+    randomQuery(genome, q, size);
+    aQueries[qIx].dna = fQueries[qIx].dna = q;
+    aQueries[qIx].size = fQueries[qIx].size = size;
+    }
+sufaFindMany(sufa, aQueries, queryCount);
+fmiFindMany(fmi, fQueries, queryCount);
+for (qIx=0; qIx<queryCount; ++qIx)
+    checkQuery(sufa, fmi, genome, &aQueries[qIx], &fQueries[qIx], genomeIx, qIx);
+
+freeMem(aQueries);
+freeMem(fQueries);
+freeMem(qDna);
+sufaFree(&sufa);
+fmiFree(&fmi);
+remove(sufaName);
+remove(fmiName);
+sufGenomeFree(&genome);
+}
+
+void fmiCheck(char *tmpDir, int genomeCount, int maxSize, int queryCount)
+/* fmiCheck - check fmi searches find the same things as sufa searches on
+ * random genomes and queries. */
+{
+makeDirsOnPath(tmpDir);
+long startTime = clock1000();
+int i;
+for (i=0; i<genomeCount; ++i)
+    checkGenome(tmpDir, (i < genomeCount/4 ? min(maxSize, 100) : maxSize), queryCount, i);
+verbose(1, "%d genomes searched the same with fmi and sufa in %ld ms\n",
+	genomeCount, clock1000() - startTime);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 2)
+    usage();
+  srandom(optionInt("seed", 0));
+  int queryCount = optionInt("queries", DEFAULT_QUERIES);
+  if (queryCount < 1)
+    errAbort("Need at least one query");
+  fmiCheck(argv[1], optionInt("genomes", DEFAULT_GENOMES),
+  	optionInt("maxSize", DEFAULT_MAX_SIZE), queryCount);
+  return 0;
+}
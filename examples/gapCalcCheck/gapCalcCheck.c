@@ -0,0 +1,332 @@
+/* gapCalcCheck - check gapCalcCost gives exactly the costs the original
+ * code did, and time the two. */
+#include "common.h"
+#include "options.h"
+#include "portable.h"
+#include "linefile.h"
+#include "dystring.h"
+#include "gapCalc.h"
+#include "refGapCalc.h"
+#include <limits.h>
+
+#define DEFAULT_TABLES 200
+#define DEFAULT_RANDOM_GAPS 200000
+#define DEFAULT_BENCH_GAPS 20000000
+#define MAX_TABLE_SIZE 16
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "gapCalcCheck - check gapCalcCost gives exactly the costs the original\n"
+      "code did, and time the two\n"
+      "usage:\n"
+      "   gapCalcCheck now\n"
+      "The original code, kept in refGapCalc.c, interpolates by scanning the\n"
+      "long positions from the start.  Costs are compared for the built-in\n"
+      "tables and for random ones, including ones with fractional costs, costs\n"
+      "that go down, and positions too close together to bucket.  Each table is\n"
+      "checked at every gap up to 3000 in q, in t and split between both, at and\n"
+      "around every position and every bucket edge, and at random gaps up to\n"
+      "2^31.  Then both are timed on random gaps spread evenly over orders of\n"
+      "magnitude with the default table.\n"
+      "options:\n"
+      "   -tables=N - number of random tables, default %d\n"
+      "   -randomGaps=N - random gaps per table, default %d\n"
+      "   -benchGaps=N - gaps to time, default %d\n"
+      "   -seed=N - random number seed, default 0\n",
+      DEFAULT_TABLES, DEFAULT_RANDOM_GAPS, DEFAULT_BENCH_GAPS
+  );
+}
+
+static struct optionSpec options[] = {
+    {"tables", OPTION_INT},
+    {"randomGaps", OPTION_INT},
+    {"benchGaps", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+/* Built-in tables other than the default, as in gapCalc.c. */
+static char *originalGapCosts =
+    "tableSize 11\n"
+    "smallSize 111\n"
+    "position 1 2 3 11 111 2111 12111 32111 72111 152111 252111\n"
+    "qGap 350 425 450 600 900 2900 22900 57900 117900 217900 317900\n"
+    "tGap 350 425 450 600 900 2900 22900 57900 117900 217900 317900\n"
+    "bothGap 750 825 850 1000 1300 3300 23300 58300 118300 218300 318300\n";
+
+static char *rnaDnaGapCosts =
+"tablesize       12\n"
+"smallSize       111\n"
+"position        1       2       3       11     31   111   2111    12111   32111   72111   152111  252111\n"
+       "qGap    325     360     400     450     600  800   1100    3600    7600    15600   31600   56600\n"
+       "tGap    200     210     220     250     300  400   500      600     800    1200     2000   4000\n"
+"       bothGap 625     660     700     750     900  1100  1400    4000    8000    16000   32000   57000\n";
+
+static char *cheapGapCosts =
+    "tableSize 3\n"
+    "smallSize 100\n"
+    "position 1 100 1000\n"
+    "qGap 0 30 300\n"
+    "tGap 0 30 300\n"
+    "bothGap 0 30 300\n";
+
+static long long checkCount = 0;	/* Number of gaps compared. */
+
+static void checkGap(char *name, struct refGapCalc *ref, struct gapCalc *gc, int dq, int dt)
+/* Make sure both give same cost for gap. */
+{
+int refCost = refGapCalcCost(ref, dq, dt);
+int cost = gapCalcCost(gc, dq, dt);
+if (cost != refCost)
+    errAbort("%s table: gapCalcCost(%d, %d) is %d, original code gives %d",
+	    name, dq, dt, cost, refCost);
+++checkCount;
+}
+
+static void checkSize(char *name, struct refGapCalc *ref, struct gapCalc *gc, int x)
+/* Check gaps adding up to x in q, in t, and split between them. */
+{
+if (x < 0)
+    return;
+checkGap(name, ref, gc, x, 0);
+checkGap(name, ref, gc, 0, x);
+if (x >= 2)
+    {
+    checkGap(name, ref, gc, x - x/2, x/2);
+    checkGap(name, ref, gc, 1, x - 1);
+    }
+}
+
+static void checkAround(char *name, struct refGapCalc *ref, struct gapCalc *gc, long long x)
+/* Check gaps of size x and one or two either side, as long as they fit in an int. */
+{
+long long d;
+for (d = -2; d <= 2; ++d)
+    if (x + d >= 0 && x + d <= INT_MAX)
+        checkSize(name, ref, gc, x + d);
+}
+
+static int randomGapSize()
+/* Return random gap size, spread evenly over orders of magnitude up to 2^31. */
+{
+int bit = random() % 31;
+return (1 << bit) + random() % (1 << bit);
+}
+
+static void checkTable(char *name, char *spec, struct gapCalc *gc, int randomGaps)
+/* Check gc, made from spec, against the original code.  If gc is NULL make
+ * it from spec. */
+{
+struct refGapCalc *ref = refGapCalcFromString(spec);
+boolean ownGc = (gc == NULL);
+if (ownGc)
+    gc = gapCalcFromString(spec);
+
+/* Every small gap, and negative ones. */
+int i;
+for (i=0; i<=3000; ++i)
+    checkSize(name, ref, gc, i);
+checkGap(name, ref, gc, -1, 5);
+checkGap(name, ref, gc, 5, -2);
+checkGap(name, ref, gc, -3, -3);
+
+/* Positions in the table. */
+char *dupe = cloneString(spec);
+char *line = strstr(dupe, "position");
+char *words[MAX_TABLE_SIZE+1];
+*strchr(line, '\n') = 0;
+int wordCount = chopByWhite(line, words, ArraySize(words));
+for (i=1; i<wordCount; ++i)
+    checkAround(name, ref, gc, atoll(words[i]));
+freeMem(dupe);
+
+/* Powers of two and the edges of the buckets between them. */
+int bit, sub;
+for (bit = 0; bit < 31; ++bit)
+    {
+    long long base = 1LL << bit;
+    checkAround(name, ref, gc, base);
+    if (bit >= 8)
+        for (sub = 1; sub < 256; ++sub)
+	    checkAround(name, ref, gc, base + sub * (base >> 8));
+    }
+checkAround(name, ref, gc, INT_MAX);
+
+/* Random gaps. */
+for (i=0; i<randomGaps; ++i)
+    {
+    int x = randomGapSize();
+    checkGap(name, ref, gc, x, 0);
+    checkGap(name, ref, gc, 0, x);
+    if (x >= 2)
+	{
+	int dq = 1 + random() % (x - 1);
+	checkGap(name, ref, gc, dq, x - dq);
+	}
+    }
+
+refGapCalcFree(&ref);
+if (ownGc)
+    gapCalcFree(&gc);
+}
+
+static void addCosts(struct dyString *dy, char *tag, int *pos, int size)
+/* Add line of random costs for positions. */
+{
+dyStringPrintf(dy, "%s", tag);
+int style = random() % 4;
+double cost = random() % 1000;
+int i;
+for (i=0; i<size; ++i)
+    {
+    switch (style)
+        {
+	case 0:		/* Going up, whole numbers. */
+	    cost += random() % (1 + min(pos[i] / 4, 100000));
+	    dyStringPrintf(dy, " %d", (int)cost);
+	    break;
+	case 1:		/* Going up, with fractions. */
+	    cost += random() % (1 + min(pos[i] / 4, 100000)) + (random() % 1000) / 1000.0;
+	    dyStringPrintf(dy, " %.3f", cost);
+	    break;
+	case 2:		/* All over the place. */
+	    dyStringPrintf(dy, " %ld.%ld", random() % 1000000, random() % 100);
+	    break;
+	case 3:		/* Flat. */
+	    dyStringPrintf(dy, " %d", (int)cost);
+	    break;
+	}
+    }
+dyStringAppendC(dy, '\n');
+}
+
+static char *randomTable()
+/* Return random table in gapCalc file format. */
+{
+int size = 3 + random() % (MAX_TABLE_SIZE - 2);
+int pos[size];
+int style = random() % 3;
+long long p = 1;
+int i;
+for (i=0; i<size; ++i)
+    {
+    pos[i] = p;
+    long long step;
+    switch (style)
+        {
+	case 0:		/* Growing by a factor of up to ten. */
+	    step = 1 + random() % (p * 9 + 1);
+	    break;
+	case 1:		/* Close together. */
+	    step = 1 + random() % 4;
+	    break;
+	default:	/* Far apart with occasional close ones. */
+	    step = (random() % 3 == 0 ? 1 + random() % 3 : 1 + random() % (p * 20 + 1000));
+	    break;
+	}
+    p = min(p + step, INT_MAX - (size - i));
+    }
+struct dyString *dy = dyStringNew(0);
+dyStringPrintf(dy, "tableSize %d\n", size);
+/* The small tables are smallSize long, so keep it reasonable. */
+int smallIx = 1 + random() % (size - 2);
+while (smallIx > 1 && pos[smallIx] > 100000)
+    --smallIx;
+dyStringPrintf(dy, "smallSize %d\n", pos[smallIx]);
+dyStringPrintf(dy, "position");
+for (i=0; i<size; ++i)
+    dyStringPrintf(dy, " %d", pos[i]);
+dyStringAppendC(dy, '\n');
+addCosts(dy, "qGap", pos, size);
+addCosts(dy, "tGap", pos, size);
+addCosts(dy, "bothGap", pos, size);
+return dyStringCannibalize(&dy);
+}
+
+static void benchmark(int benchGaps)
+/* Time original and library code on the same random gaps. */
+{
+char *spec = gapCalcSampleFileContents();
+struct refGapCalc *ref = refGapCalcFromString(spec);
+struct gapCalc *gc = gapCalcFromString(spec);
+int *dqs, *dts;
+AllocArray(dqs, benchGaps);
+AllocArray(dts, benchGaps);
+int i;
+for (i=0; i<benchGaps; ++i)
+    {
+    int x = randomGapSize();
+    switch (random() % 3)
+        {
+	case 0:
+	    dqs[i] = x;
+	    break;
+	case 1:
+	    dts[i] = x;
+	    break;
+	default:
+	    dqs[i] = x/2 + 1;
+	    dts[i] = x - x/2;
+	    break;
+	}
+    }
+long long refSum = 0, sum = 0;
+long startTime = clock1000();
+for (i=0; i<benchGaps; ++i)
+    refSum += refGapCalcCost(ref, dqs[i], dts[i]);
+long refTime = clock1000() - startTime;
+startTime = clock1000();
+for (i=0; i<benchGaps; ++i)
+    sum += gapCalcCost(gc, dqs[i], dts[i]);
+long time = clock1000() - startTime;
+if (sum != refSum)
+    errAbort("Benchmark costs add up to %lld, original code gives %lld", sum, refSum);
+verbose(1, "%d random gaps: original code %ld ms, gapCalcCost %ld ms\n",
+	benchGaps, refTime, time);
+freeMem(dqs);
+freeMem(dts);
+refGapCalcFree(&ref);
+gapCalcFree(&gc);
+}
+
+void gapCalcCheck(int tables, int randomGaps, int benchGaps)
+/* gapCalcCheck - check gapCalcCost gives exactly the costs the original
+ * code did, and time the two. */
+{
+long startTime = clock1000();
+checkTable("default", gapCalcSampleFileContents(), gapCalcDefault(), randomGaps);
+checkTable("loose", gapCalcSampleFileContents(), gapCalcFromFile("loose"), randomGaps);
+checkTable("original", originalGapCosts, gapCalcOriginal(), randomGaps);
+checkTable("medium", originalGapCosts, gapCalcFromFile("medium"), randomGaps);
+checkTable("rnaDna", rnaDnaGapCosts, gapCalcRnaDna(), randomGaps);
+checkTable("cheap", cheapGapCosts, gapCalcCheap(), randomGaps);
+int i;
+for (i=0; i<tables; ++i)
+    {
+    char *spec = randomTable();
+    char name[32];
+    safef(name, sizeof(name), "random %d", i+1);
+    verbose(2, "%s:\n%s", name, spec);
+    checkTable(name, spec, NULL, randomGaps);
+    freeMem(spec);
+    }
+verbose(1, "%lld gaps in %d tables give the same costs both ways in %ld ms\n",
+	checkCount, tables + 6, clock1000() - startTime);
+if (benchGaps > 0)
+    benchmark(benchGaps);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 2 || !sameString(argv[1], "now"))
+    usage();
+  srandom(optionInt("seed", 0));
+  gapCalcCheck(optionInt("tables", DEFAULT_TABLES),
+  	optionInt("randomGaps", DEFAULT_RANDOM_GAPS),
+	optionInt("benchGaps", DEFAULT_BENCH_GAPS));
+  return 0;
+}
@@ -0,0 +1,223 @@
+/* refGapCalc - the original gapCalc code, which scans the table of long
+ * positions from the start for every gap too big for the small tables. */
+
+#include "common.h"
+#include "linefile.h"
+#include "refGapCalc.h"
+
+struct refGapCalc
+/* A structure that bundles together stuff to help us
+ * calculate gap costs quickly. */
+    {
+    int smallSize; /* Size of tables for doing quick lookup of small gaps. */
+    int *qSmall;   /* Table for small gaps in q; */
+    int *tSmall;   /* Table for small gaps in t. */
+    int *bSmall;   /* Table for small gaps in either. */
+    int *longPos;/* Table of positions to interpolate between for larger gaps. */
+    double *qLong; /* Values to interpolate between for larger gaps in q. */
+    double *tLong; /* Values to interpolate between for larger gaps in t. */
+    double *bLong; /* Values to interpolate between for larger gaps in both. */
+    int longCount;	/* Number of long positions overall in longPos. */
+    int lastPos;	/* Maximum position we have data on. */
+    double qLastPosVal;	/* Value at max pos. */
+    double tLastPosVal;	/* Value at max pos. */
+    double bLastPosVal;	/* Value at max pos. */
+    double qLastSlope;	/* What to add for each base after last. */
+    double tLastSlope;	/* What to add for each base after last. */
+    double bLastSlope;	/* What to add for each base after last. */
+    };
+
+static int interpolate(int x, int *s, double *v, int sCount)
+/* Find closest value to x in s, and then lookup corresponding
+ * value in v.  Interpolate where necessary. */
+{
+int i, ds, ss;
+double dv;
+for (i=0; i<sCount; ++i)
+    {
+    ss = s[i];
+    if (x == ss)
+        return v[i];
+    else if (x < ss)
+        {
+	ds = ss - s[i-1];
+	dv = v[i] - v[i-1];
+	return v[i-1] + dv * (x - s[i-1]) / ds;
+	}
+    }
+/* If get to here extrapolate from last two values */
+ds = s[sCount-1] - s[sCount-2];
+dv = v[sCount-1] - v[sCount-2];
+return v[sCount-2] + dv * (x - s[sCount-2]) / ds;
+}
+
+static double calcSlope(double y2, double y1, double x2, double x1)
+/* Calculate slope of line from x1/y1 to x2/y2 */
+{
+return (y2-y1)/(x2-x1);
+}
+
+static void readTaggedNumLine(struct lineFile *lf, char *tag,
+	int count, int *intOut,  double *floatOut)
+/* Read in a line that starts with tag and then has count numbers.
+ * Complain and die if tag is unexpected or other problem occurs.
+ * Put output as integers and/or floating point into intOut and
+ * floatOut. */
+{
+char *line;
+int i = 0;
+char *word;
+if (!lineFileNextReal(lf, &line))
+   lineFileUnexpectedEnd(lf);
+word = nextWord(&line);
+if (!sameWord(tag, word))
+    errAbort("Expecting %s got %s line %d of %s",
+             tag, word, lf->lineIx, lf->fileName);
+for (i = 0; i < count; ++i)
+    {
+    word = nextWord(&line);
+    if (word == NULL)
+        errAbort("Not enough numbers line %d of %s", lf->lineIx, lf->fileName);
+    if (!isdigit(word[0]))
+        errAbort("Expecting number got %s line %d of %s",
+	         word, lf->lineIx, lf->fileName);
+    if (intOut)
+	intOut[i] = atoi(word);
+    if (floatOut)
+        floatOut[i] = atof(word);
+    }
+word = nextWord(&line);
+if (word != NULL)
+        errAbort("Too many numbers line %d of %s", lf->lineIx, lf->fileName);
+}
+
+static struct refGapCalc *refGapCalcRead(struct lineFile *lf)
+/* Create refGapCalc from open file. */
+{
+int i, tableSize, startLong = -1;
+struct refGapCalc *gapCalc;
+int *gapInitPos;
+double *gapInitQGap;
+double *gapInitTGap;
+double *gapInitBothGap;
+
+AllocVar(gapCalc);
+
+/* Parse file. */
+readTaggedNumLine(lf, "tableSize", 1, &tableSize, NULL);
+readTaggedNumLine(lf, "smallSize", 1, &gapCalc->smallSize, NULL);
+AllocArray(gapInitPos,tableSize);
+AllocArray(gapInitQGap,tableSize);
+AllocArray(gapInitTGap,tableSize);
+AllocArray(gapInitBothGap,tableSize);
+readTaggedNumLine(lf, "position", tableSize, gapInitPos, NULL);
+readTaggedNumLine(lf, "qGap", tableSize, NULL, gapInitQGap);
+readTaggedNumLine(lf, "tGap", tableSize, NULL, gapInitTGap);
+readTaggedNumLine(lf, "bothGap", tableSize, NULL, gapInitBothGap);
+
+/* Set up precomputed interpolations for small gaps. */
+AllocArray(gapCalc->qSmall, gapCalc->smallSize);
+AllocArray(gapCalc->tSmall, gapCalc->smallSize);
+AllocArray(gapCalc->bSmall, gapCalc->smallSize);
+for (i=1; i<gapCalc->smallSize; ++i)
+    {
+    gapCalc->qSmall[i] = interpolate(i, gapInitPos, gapInitQGap, tableSize);
+    gapCalc->tSmall[i] = interpolate(i, gapInitPos, gapInitTGap, tableSize);
+    gapCalc->bSmall[i] = interpolate(i, gapInitPos, gapInitBothGap, tableSize);
+    }
+
+/* Set up to handle intermediate values. */
+for (i=0; i<tableSize; ++i)
+    {
+    if (gapCalc->smallSize == gapInitPos[i])
+	{
+	startLong = i;
+	break;
+	}
+    }
+if (startLong < 0)
+    errAbort("No position %d in refGapCalcRead()\n", gapCalc->smallSize);
+int count = gapCalc->longCount = tableSize - startLong;
+gapCalc->longPos = cloneMem(gapInitPos + startLong, count * sizeof(int));
+gapCalc->qLong = cloneMem(gapInitQGap + startLong, count * sizeof(double));
+gapCalc->tLong = cloneMem(gapInitTGap + startLong, count * sizeof(double));
+gapCalc->bLong = cloneMem(gapInitBothGap + startLong, count * sizeof(double));
+
+/* Set up to handle huge values. */
+gapCalc->lastPos = gapCalc->longPos[count-1];
+gapCalc->qLastPosVal = gapCalc->qLong[count-1];
+gapCalc->tLastPosVal = gapCalc->tLong[count-1];
+gapCalc->bLastPosVal = gapCalc->bLong[count-1];
+gapCalc->qLastSlope = calcSlope(gapCalc->qLastPosVal, gapCalc->qLong[count-2],
+			   gapCalc->lastPos, gapCalc->longPos[count-2]);
+gapCalc->tLastSlope = calcSlope(gapCalc->tLastPosVal, gapCalc->tLong[count-2],
+			   gapCalc->lastPos, gapCalc->longPos[count-2]);
+gapCalc->bLastSlope = calcSlope(gapCalc->bLastPosVal, gapCalc->bLong[count-2],
+			   gapCalc->lastPos, gapCalc->longPos[count-2]);
+freez(&gapInitPos);
+freez(&gapInitQGap);
+freez(&gapInitTGap);
+freez(&gapInitBothGap);
+return gapCalc;
+}
+
+struct refGapCalc *refGapCalcFromString(char *s)
+/* Return refGapCalc from description string in gapCalc file format. */
+{
+struct lineFile *lf = lineFileOnString("string", TRUE, cloneString(s));
+struct refGapCalc *gapCalc = refGapCalcRead(lf);
+lineFileClose(&lf);
+return gapCalc;
+}
+
+void refGapCalcFree(struct refGapCalc **pGapCalc)
+/* Free up resources associated with gapCalc. */
+{
+struct refGapCalc *gapCalc = *pGapCalc;
+if (gapCalc != NULL)
+    {
+    freeMem(gapCalc->qSmall);
+    freeMem(gapCalc->tSmall);
+    freeMem(gapCalc->bSmall);
+    freeMem(gapCalc->longPos);
+    freeMem(gapCalc->qLong);
+    freeMem(gapCalc->tLong);
+    freeMem(gapCalc->bLong);
+    freez(pGapCalc);
+    }
+}
+
+int refGapCalcCost(struct refGapCalc *gapCalc, int dq, int dt)
+/* Figure out gap costs the original way. */
+{
+if (dt < 0) dt = 0;
+if (dq < 0) dq = 0;
+if (dt == 0)
+    {
+    if (dq < gapCalc->smallSize)
+        return gapCalc->qSmall[dq];
+    else if (dq >= gapCalc->lastPos)
+        return gapCalc->qLastPosVal + gapCalc->qLastSlope * (dq-gapCalc->lastPos);
+    else
+        return interpolate(dq, gapCalc->longPos, gapCalc->qLong, gapCalc->longCount);
+    }
+else if (dq == 0)
+    {
+    if (dt < gapCalc->smallSize)
+        return gapCalc->tSmall[dt];
+    else if (dt >= gapCalc->lastPos)
+        return gapCalc->tLastPosVal + gapCalc->tLastSlope * (dt-gapCalc->lastPos);
+    else
+        return interpolate(dt, gapCalc->longPos, gapCalc->tLong, gapCalc->longCount);
+    }
+else
+    {
+    int both = dq + dt;
+    if (both < gapCalc->smallSize)
+        return gapCalc->bSmall[both];
+    else if (both >= gapCalc->lastPos)
+        return gapCalc->bLastPosVal + gapCalc->bLastSlope * (both-gapCalc->lastPos);
+    else
+        return interpolate(both, gapCalc->longPos, gapCalc->bLong, gapCalc->longCount);
+    }
+}
@@ -0,0 +1,19 @@
+/* refGapCalc - the original gapCalc code, which scans the table of long
+ * positions from the start for every gap too big for the small tables.
+ * gapCalcCheck checks the library gapCalc gives exactly the same costs. */
+
+#ifndef REFGAPCALC_H
+#define REFGAPCALC_H
+
+struct refGapCalc;	/* Opaque handle, see refGapCalc.c */
+
+struct refGapCalc *refGapCalcFromString(char *s);
+/* Return refGapCalc from description string in gapCalc file format. */
+
+void refGapCalcFree(struct refGapCalc **pGapCalc);
+/* Free up resources associated with gapCalc. */
+
+int refGapCalcCost(struct refGapCalc *gapCalc, int dq, int dt);
+/* Figure out gap costs the original way. */
+
+#endif /* REFGAPCALC_H */
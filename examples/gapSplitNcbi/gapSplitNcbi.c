@@ -42,53 +42,39 @@ void gapSplit(char *input, char *output)
   ZeroVar(&seq);
   while (faMixedSpeedReadNext(lf, &seq.dna, &seq.size, &seq.name))
   {
-    struct dyString *seqName = dyStringNew(0);
-    int pos = 0;
+    bits32 *gapStarts, *gapSizes;
+    int gapCount = findBlocksOfN(seq.dna, seq.size, &gapStarts, &gapSizes);
     int pieceCount = 1; //1 based for ncbi
-    int charLineCount = 0;
+    int pieceStart = 0;
+    int seqEnd = seq.size;
+    int i;
 
-    dyStringPrintf(seqName,"%s_%d", seq.name, pieceCount++);
-    fprintf(f,">%s\n", seqName->string);
-    while (pos < seq.size)
+    fprintf(f,">%s_%d\n", seq.name, pieceCount++);
+    for (i = 0; i < gapCount; ++i)
     {
-      int gapSize = 0;
-      int gapStart = 0;
-      fprintf(f,"%c",seq.dna[pos]);
-      ++charLineCount;
-      if (!(charLineCount % wrapSize)) { fprintf(f,"\n"); charLineCount = 0; }
-      ++pos;
-      gapStart = pos;	/*	remember where possible gap starts	*/
-      /* see if gap is entered */
-      if ('n' == seq.dna[pos] || 'N' == seq.dna[pos])
+      int gapStart = gapStarts[i];
+      int gapEnd = gapStart + gapSizes[i];
+      /* The first base always goes in the first piece, even if it is an N. */
+      if (gapStart == 0)
+        gapStart = 1;
+      if (gapEnd - gapStart < minGap)
+        continue;
+      if (gapEnd == seq.size)
       {
-        /*	enter gap, size it	*/
-        while (pos < seq.size &&
-            ('n' == seq.dna[pos] || 'N' == seq.dna[pos]))
-        {
-          ++gapSize;
-          ++pos;
-        }
-      }
-      /*	valid gap size to split here ?	*/
-      if ((gapSize >= minGap) && (pos < seq.size))
-      {
-        if (charLineCount % wrapSize) { fprintf(f,"\n"); charLineCount = 0; }
-        dyStringClear(seqName);
-        dyStringPrintf(seqName,"%s_%d", seq.name, pieceCount++);
-        fprintf(f,">%s\n", seqName->string);
-      }
-      else if (gapSize < minGap)
-      {
-        while (gapSize-- > 0)
-        {
-          fprintf(f,"%c",seq.dna[gapStart++]);
-          ++charLineCount;
-          if (!(charLineCount % wrapSize)) {fprintf(f,"\n"); charLineCount = 0;}
-        }
+        /* Gap at end of sequence is dropped. */
+        seqEnd = gapStart;
+        break;
       }
+      writeSeqWithBreaks(f, seq.dna + pieceStart, gapStart - pieceStart, wrapSize);
+      fprintf(f,">%s_%d\n", seq.name, pieceCount++);
+      pieceStart = gapEnd;
     }
-    if (charLineCount % wrapSize) { fprintf(f,"\n"); }
+    writeSeqWithBreaks(f, seq.dna + pieceStart, seqEnd - pieceStart, wrapSize);
+    freeMem(gapStarts);
+    freeMem(gapSizes);
   }
+  carefulClose(&f);
+  lineFileClose(&lf);
 }
 
 int main(int argc, char *argv[])
@@ -100,6 +86,8 @@ int main(int argc, char *argv[])
 
   minGap = optionInt("minGap", DEFAULT_GAP);
   wrapSize = optionInt("wrapSize", DEFAULT_WRAP_SIZE);
+  if (minGap < 1 || wrapSize < 1)
+    errAbort("minGap and wrapSize must be at least 1");
 
   verbose(2,"# minGap = %d\n", minGap);
   gapSplit(argv[1], argv[2]);
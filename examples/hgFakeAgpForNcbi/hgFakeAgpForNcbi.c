@@ -5,6 +5,7 @@
 #include "options.h"
 #include "dnaseq.h"
 #include "fa.h"
+#include "dnautil.h"
 #include <stdbool.h>
 
 
@@ -63,22 +64,6 @@ void agpContigLine(FILE *f, char *name, int seqStart, int seqEnd, int partIx, in
   fprintf(f, "+\n");
 }
 
-char *strNotChar(char *s, char c)
-/* Return pointer to first character in s that is *not* c, or NULL
- * if none such. */
-{
-  char x;
-  for (;;)
-  {
-    x = *s;
-    if (x == 0)
-      return NULL;
-    if (x != c)
-      return s;
-    ++s;
-  }
-}
-
 int agpGapLine(FILE *f, char *name, int seqStart, int seqEnd, int gapSize, int lineIx)
 /* Write out agp line for gap. */
 {
@@ -115,40 +100,32 @@ int agpGapLine(FILE *f, char *name, int seqStart, int seqEnd, int gapSize, int l
 void fakeAgpForNcbiFromSeq(struct dnaSeq *seq, FILE *f)
 /* Look through sequence and produce agp file. */
 {
-  //reset
   int partIx = 0;
   int contigIx = 0;
-  char *gapStart, *gapEnd, *contigStart;
-  char *dna, *seqStart, *seqEnd;
-  int gapSize;
+  int contigStart = 0;
   int offset = 0;
-  dna = seqStart = contigStart = seq->dna;
-  seqEnd = seqStart + seq->size;
-  for (;;)
+  bits32 *gapStarts, *gapSizes;
+  int gapCount = findBlocksOfN(seq->dna, seq->size, &gapStarts, &gapSizes);
+  int i;
+  for (i = 0; i < gapCount; ++i)
   {
-    gapStart = strchr(dna, 'n');
-    if (gapStart == NULL)
-    {
-      agpContigLine(f, seq->name, contigStart - seqStart + offset, seqEnd - seqStart + offset,
-          ++partIx, ++contigIx);
-      break;
-    }
-    gapEnd = strNotChar(gapStart, 'n');
-    if (gapEnd == NULL)
-      gapEnd = seqEnd;
-    gapSize = gapEnd - gapStart;
-    if (gapSize >= minContigGap || gapEnd == seqEnd)
+    int gapStart = gapStarts[i];
+    int gapEnd = gapStart + gapSizes[i];
+    if (gapSizes[i] >= minContigGap || gapEnd == seq->size)
     {
       if (gapStart != contigStart)
-        agpContigLine(f, seq->name, contigStart - seqStart + offset, gapStart - seqStart + offset,
+        agpContigLine(f, seq->name, contigStart + offset, gapStart + offset,
             ++partIx, ++contigIx);
-      offset += agpGapLine(f, seq->name, gapStart - seqStart + offset, gapEnd - seqStart + offset, gapSize, ++partIx);
-      if (gapEnd == seqEnd)
-        break;
+      offset += agpGapLine(f, seq->name, gapStart + offset, gapEnd + offset, gapSizes[i], ++partIx);
       contigStart = gapEnd;
     }
-    dna = gapEnd;
   }
+  /* Last contig, unless sequence ends in a gap. */
+  if (gapCount == 0 || gapStarts[gapCount-1] + gapSizes[gapCount-1] != seq->size)
+    agpContigLine(f, seq->name, contigStart + offset, seq->size + offset,
+        ++partIx, ++contigIx);
+  freeMem(gapStarts);
+  freeMem(gapSizes);
 }
 
 void hgFakeAgpForNcbi(char *faIn, char *agpOut)
@@ -25,6 +25,8 @@
 #include "dnaseq.h"
 #include "dnaLoad.h"
 #include "hash.h"
+#include "fa.h"
+#include "twoBit.h"
 
 
 
@@ -34,6 +36,21 @@
  *
  */ 
 
+#define REF_WINDOW_SIZE (1024*1024)
+/* Bases of reference fetched at a time when it can be read randomly. */
+
+struct refWindow
+/* The part of the reference the current reads align to. */
+    {
+    struct dnaLoad *dl;		/* Random access reference, or NULL if all in hash. */
+    struct hash *hash;		/* Whole targets keyed by name if not read a window at a time. */
+    struct hash *seen;		/* Targets windows have been read from. */
+    struct dnaSeq *seq;		/* Current window. */
+    int tid;			/* Target id of current window. */
+    int chromSize;		/* Size of current target. */
+    int start, end;		/* Range of current window in target. */
+    };
+
 
 
 
@@ -51,6 +68,9 @@ void usage()
       "\noptions:\n"
       "\t-fai=FILE\tIf a sam file is provided that does not have a header.\n"
       "\t-help\tWrites this help to the screen.\n"
+      "\nInput sorted by coordinate is fastest, since a .2bit or indexable fasta\n"
+      "reference is then read a window at a time.  If reads go back to an\n"
+      "earlier position, each target is instead loaded whole when first needed.\n"
       );
 }//end usage()
 
@@ -71,7 +91,7 @@ static struct optionSpec options[] = {
 
 
 
-inline unsigned short base2inx(const char base) {
+static inline unsigned short base2inx(const char base) {
   switch (base) {
   case 'A':
   case 'a':
@@ -96,7 +116,67 @@ inline unsigned short base2inx(const char base) {
 
 
 
-void addAlignScoreToBamAux(samfile_t *bamFileIn, samfile_t *bamFileOut, int sm[2*PSSM_DEPTH+1][5][5], int rsm[2*PSSM_DEPTH+1][5][5], struct hash* dnaHash){
+struct refWindow *refWindowOpen(char *fileName){
+  /* Open reference.  A .2bit or fasta file is read a window at a time as
+   * reads need it; anything else is loaded whole. */
+  struct refWindow *rw;
+  AllocVar(rw);
+  rw->tid = -1;
+  if(twoBitIsFile(fileName) || faIsIndexable(fileName)){
+    rw->dl = dnaLoadOpen(fileName);
+    rw->seen = hashNew(0);
+  }else{
+    struct dnaSeq *refList = dnaLoadAll(fileName);
+    rw->hash = dnaSeqHash(refList);
+  }
+  return rw;
+}
+
+void refWindowMustCover(struct refWindow *rw, int tid, char *name, int start, int end){
+  /* Make sure window covers start-end of target. */
+  if(tid == rw->tid && start >= rw->start && end <= rw->end)
+    return;
+  if(rw->hash == NULL){
+    /* Reading a window at a time only pays if reads are sorted.  Once
+     * they go backwards, load each target whole as it is needed. */
+    boolean backwards = (tid == rw->tid ? start < rw->start : hashLookup(rw->seen, name) != NULL);
+    if(backwards){
+      verbose(2, "Reads not sorted at %s:%d, loading whole targets\n", name, start+1);
+      freeDnaSeq(&rw->seq);
+      rw->hash = hashNew(0);
+    }
+  }
+  if(rw->hash != NULL){
+    rw->seq = (struct dnaSeq *) hashFindVal(rw->hash, name);
+    if(rw->seq == NULL){
+      if(rw->dl == NULL)
+        errAbort("%s not found in reference", name);
+      rw->seq = dnaLoadFetch(rw->dl, name, 0, dnaLoadSeqSize(rw->dl, name));
+      hashAdd(rw->hash, name, rw->seq);
+    }
+    rw->start = 0;
+    rw->end = rw->chromSize = rw->seq->size;
+  }else{
+    if(tid != rw->tid){
+      rw->chromSize = dnaLoadSeqSize(rw->dl, name);
+      hashStore(rw->seen, name);
+    }
+    freeDnaSeq(&rw->seq);
+    rw->start = min(start, rw->chromSize);
+    rw->end = min(max(end, start + REF_WINDOW_SIZE), rw->chromSize);
+    rw->seq = dnaLoadFetch(rw->dl, name, rw->start, rw->end);
+  }
+  rw->tid = tid;
+}
+
+char refWindowBase(struct refWindow *rw, unsigned int tpos){
+  /* Return reference base at tpos, or 'n' if off the end. */
+  if(tpos < rw->start || tpos >= rw->end)
+    return 'n';
+  return rw->seq->dna[tpos - rw->start];
+}
+
+void addAlignScoreToBamAux(samfile_t *bamFileIn, samfile_t *bamFileOut, int sm[2*PSSM_DEPTH+1][5][5], int rsm[2*PSSM_DEPTH+1][5][5], struct refWindow *rw){
 
   bam_header_t *header = bamFileIn->header;
   bam1_t *b;
@@ -104,9 +184,6 @@ void addAlignScoreToBamAux(samfile_t *bamFileIn, samfile_t *bamFileOut, int sm[2
   unsigned int *cigar;
   int (*currPSSMP)[5][5];
   uint8_t *packedQSeq;
-  int lastTID = -272823; //this number should never happen
-  struct dnaSeq *refSeq = NULL;
-  DNA *refDna;
   const int bamAuxAppendIntSize = sizeof(int)/sizeof(uint8_t);
 
   b = bam_init1();
@@ -120,12 +197,9 @@ void addAlignScoreToBamAux(samfile_t *bamFileIn, samfile_t *bamFileOut, int sm[2
     int alnScore = 0;
 
 
-    if(c->tid != lastTID){
-      //get the new reference fasta!
-      refSeq = (struct dnaSeq *) hashMustFindVal(dnaHash, header->target_name[c->tid]);
-      refDna = refSeq->dna;
-      lastTID = c->tid;
-    }
+    //get the reference under this read
+    cigar = bam1_cigar(b);
+    refWindowMustCover(rw, c->tid, header->target_name[c->tid], c->pos, bam_calend(c, cigar));
 
     //Determine if we should use forward or reverse PSSMP
     if(c->flag & BAM_FREVERSE){
@@ -140,7 +214,6 @@ void addAlignScoreToBamAux(samfile_t *bamFileIn, samfile_t *bamFileOut, int sm[2
     unsigned int tpos = c->pos;
     k = 0;
 
-    cigar = bam1_cigar(b);
     i = 0;
     int seqlen = c->l_qseq;
 
@@ -186,7 +259,7 @@ void addAlignScoreToBamAux(samfile_t *bamFileIn, samfile_t *bamFileOut, int sm[2
         end = i+l;
         for(;i<end;i++,tpos++){
           char qbase = bam_nt16_rev_table[bam1_seqi(packedQSeq, i)];
-          char rbase = refDna[tpos];
+          char rbase = refWindowBase(rw, tpos);
           //PSSM[position][reference base][query base]
           alnScore += currPSSMP[find_sm_depth(i,seqlen)][base2inx(rbase)][base2inx(qbase)];
         }
@@ -251,12 +324,11 @@ int main(int argc, char *argv[])
   }else{
     bamFileOut = samopen(outf,"wb",bamFileIn->header);
   }
-  //load our reference genome
-  struct dnaSeq *refList = dnaLoadAll(argv[2]);
-  struct hash *refListHash = dnaSeqHash(refList);
+  //open our reference genome, only the parts reads touch get loaded
+  struct refWindow *rw = refWindowOpen(argv[2]);
 
   //do the things here
-  addAlignScoreToBamAux(bamFileIn, bamFileOut, fpssmp->sm, rpssmp->sm, refListHash);
+  addAlignScoreToBamAux(bamFileIn, bamFileOut, fpssmp->sm, rpssmp->sm, rw);
 
 
   samclose(bamFileIn);
@@ -30,6 +30,8 @@
 #include "common.h"
 #include "options.h"
 #include "linefile.h"
+#include "fastq.h"
+#include "blockGz.h"
 
 
 
@@ -39,6 +41,8 @@ Global variables
 bool verboseOut = false;
 bool p33To64 = false;
 bool p64To33 = false;
+bool bgzf = false;
+int threads = 4;
 
 void usage()
 /* Explain usage and exit. */
@@ -54,6 +58,8 @@ void usage()
       "\noptions:\n"
       "\t-p33To64\tConvert reads from ascii phred+33 to ascii phred+64 (default, no, just output whatever is in the QSEQ)\n"
       "\t-p64To33\tConvert reads from ascii phred+64 to ascii phred+33 (default, no, just output whatever is in the QSEQ)\n"
+      "\t-threads=NUM\tNumber of compression threads per output file (default 4)\n"
+      "\t-bgzf\tWrite BGZF rather than plain gzip so the output can be indexed\n"
       "\t-verbose\tOutput verbose debug messages to stderr.\n\n"
   );
 }//end usage()
@@ -66,6 +72,8 @@ static struct optionSpec options[] = {
     {"prefix",OPTION_STRING},
     {"p33To64",OPTION_BOOLEAN},
     {"p64To33",OPTION_BOOLEAN},
+    {"threads",OPTION_INT},
+    {"bgzf",OPTION_BOOLEAN},
     {"verbose",OPTION_BOOLEAN},
     {NULL, 0}
 }; //end options()
@@ -74,36 +82,36 @@ static struct optionSpec options[] = {
 /**
  * Convert a phred33 string into a phred64 string, doing illumina's minimum 'B' score thing
  */
-inline void phred33ToPhred64( char * p33, int l )
+static void illuminaPhred33ToPhred64( char * p33, int l )
 {
-  int i;
-  for(i=0;i<l;i++)
-  {
-    p33[i] = p33[i]=='!'?'B':p33[i]+31;
+  phredShiftOffset(p33,l,33,64);
+  //phred 0 ('!') comes out as '@', illumina uses 'B' for it instead
+  char *s = memchr(p33,'@',l);
+  while(s != NULL){
+    *s = 'B';
+    s = memchr(s+1,'@',l - (s+1 - p33));
   }
 }
 
 /**
- * Convert a phred64 string into a phred64 string assuming illumina's minimum 'B' score thing
+ * Convert a phred64 string into a phred33 string assuming illumina's minimum 'B' score thing
  */
-inline void phred64ToPhred33( char * p64, int l)
+static void illuminaPhred64ToPhred33( char * p64, int l)
 {
-  int i;
-  for(i=0;i<l;i++)
-  {
-    p64[i] = p64[i]=='B'?'!':p64[i]-31;
+  char *s = memchr(p64,'B',l);
+  while(s != NULL){
+    *s = '@';
+    s = memchr(s+1,'B',l - (s+1 - p64));
   }
+  phredShiftOffset(p64,l,64,33);
 }
 
 
 
 
-int printFastqFromSplitQseq(gzFile *zfp, char *qseq[11]){
-  int i;
-  for(i=0;i<strlen(qseq[8]);i++){
-    if(qseq[8][i] == '.') qseq[8][i] = 'N';
-  }
-  gzprintf(zfp,"@%s_%s:%s:%s:%s:%s#%s/%s\n%s\n+\n%s\n",
+void printFastqFromSplitQseq(struct blockGz *zfp, char *qseq[11]){
+  subChar(qseq[8],'.','N');
+  blockGzPrintf(zfp,"@%s_%s:%s:%s:%s:%s#%s/%s\n%s\n+\n%s\n",
       qseq[0],qseq[1], // machine ID_Run number:
       qseq[2],qseq[3], // lane number: tile number
       qseq[4],qseq[5], //x coordinate: y coordinate
@@ -116,6 +124,14 @@ int printFastqFromSplitQseq(gzFile *zfp, char *qseq[11]){
 }
 
 
+static struct blockGz *openOutput(char *fileName)
+/* Open a gzip output compressed on worker threads. */
+{
+  if(bgzf)
+    return blockGzOpenBgzf(fileName,-1,threads);
+  return blockGzOpen(fileName,-1,threads);
+}
+
 /**
  * Main function, takes filenames for paired qseq reads
  * and outputs three files.
@@ -125,9 +141,9 @@ int qseqToFastq(char *inread1, char *inread2, char *outread1, char *outread2, ch
   struct lineFile *lf2;
   lf1 = lineFileOpen(inread1,TRUE);
   lf2 = lineFileOpen(inread2,TRUE);
-  gzFile *zout1 = gzopen(outread1,"wb");
-  gzFile *zout2 = gzopen(outread2,"wb");
-  gzFile *zouts = gzopen(outreads,"wb");
+  struct blockGz *zout1 = openOutput(outread1);
+  struct blockGz *zout2 = openOutput(outread2);
+  struct blockGz *zouts = openOutput(outreads);
   char *line1;
   char *line2;
   char *pscore1;
@@ -143,31 +159,33 @@ int qseqToFastq(char *inread1, char *inread2, char *outread1, char *outread2, ch
     int qc2 = atoi(split2[10]);
     if(qc1 == 1 && qc2 == 1){
       if(p33To64){
-        phred33ToPhred64(pscore1,strlen(pscore1));
-        phred33ToPhred64(pscore2,strlen(pscore2));
+        illuminaPhred33ToPhred64(pscore1,strlen(pscore1));
+        illuminaPhred33ToPhred64(pscore2,strlen(pscore2));
       }else if(p64To33){
-        phred64ToPhred33(pscore1,strlen(pscore1));
-        phred64ToPhred33(pscore2,strlen(pscore2));
+        illuminaPhred64ToPhred33(pscore1,strlen(pscore1));
+        illuminaPhred64ToPhred33(pscore2,strlen(pscore2));
       }
       printFastqFromSplitQseq(zout1, split1);
       printFastqFromSplitQseq(zout2, split2);
     }else if(qc1 == 1){
       if(p33To64)
-        phred33ToPhred64(pscore1,strlen(pscore1));
+        illuminaPhred33ToPhred64(pscore1,strlen(pscore1));
       else if(p64To33)
-        phred64ToPhred33(pscore1,strlen(pscore1));
+        illuminaPhred64ToPhred33(pscore1,strlen(pscore1));
       printFastqFromSplitQseq(zouts, split1);
     }else if(qc2 == 1){
       if(p33To64)
-        phred33ToPhred64(pscore2,strlen(pscore2));
+        illuminaPhred33ToPhred64(pscore2,strlen(pscore2));
       else if(p64To33)
-        phred64ToPhred33(pscore2,strlen(pscore2));
+        illuminaPhred64ToPhred33(pscore2,strlen(pscore2));
       printFastqFromSplitQseq(zouts, split2);
     }
   }
-  gzclose(zout1);
-  gzclose(zout2);
-  gzclose(zouts);
+  blockGzClose(&zout1);
+  blockGzClose(&zout2);
+  blockGzClose(&zouts);
+  lineFileClose(&lf1);
+  lineFileClose(&lf2);
   return 0;
 }
 
@@ -183,6 +201,8 @@ int main(int argc, char *argv[])
   verboseOut = optionExists("verbose");
   p33To64 = optionExists("p33To64");
   p64To33 = optionExists("p64To33");
+  bgzf = optionExists("bgzf");
+  threads = optionInt("threads",threads);
   read1 = optionVal("read1",NULL);
   read2 = optionVal("read2",NULL);
   prefix = optionVal("prefix",NULL);
@@ -19,6 +19,7 @@
 #include "options.h"
 #include "linefile.h"
 #include "fa.h"
+#include "dnautil.h"
 #include <math.h>
 
 #include "uthash.h"
@@ -151,13 +152,23 @@ void parseBegEndLstFile(char *chromBegEndLstFile){
 }
 
 
+void writePiece(char *seqName, DNA *seq, int start, int end, int *pCount){
+  /* Write out piece of sequence between split gaps, skipping any leading
+   * N's, if it is long enough. */
+  char tmpName[MAX_NAME_LEN+10];
+  start = findNextNonN(seq, start, end);
+  if(end - start >= MIN_SEQ_LEN){
+    safef(tmpName, sizeof(tmpName), "%s_%d", seqName, ++(*pCount));
+    faWriteNext(stdout, tmpName, seq+start, end-start);
+  }
+}
+
 void splitFaOnNsInBeginEndRegions(char *faFile){
   struct lineFile *lf = lineFileOpen(faFile,TRUE);
   DNA *seq;
-  int seqLen , i = 0;
+  int seqLen;
   char *seqName;
   struct chrom_to_begin_end_lst *s;
-  char tmpName[MAX_NAME_LEN+10];
 
   while(faMixedSpeedReadNext(lf, &seq, &seqLen, &seqName)){
     s = NULL; //double check s points to nothing
@@ -168,53 +179,52 @@ void splitFaOnNsInBeginEndRegions(char *faFile){
       faWriteNext(stdout, seqName, seq, seqLen);
     //case 2: deal with splits
     else{
-      int numSplits = 0;
+      bits32 *nStarts, *nSizes;
+      int nCount = findBlocksOfN(seq, seqLen, &nStarts, &nSizes);
+      boolean *split;
+      int splitAllFrom = nCount;
       struct begin_end_lst *bel;
+      int i;
+      AllocArray(split, nCount+1);
 
-      //replace all N regions overlapping start->end regions of bad bases
+      //split on all N runs overlapping start->end regions of bad bases
       for(bel = s->head; bel != NULL; bel = bel->next){
-        //get rid of N's of region starting before bel->begin but going to or past it
-        for(i=bel->begin; i>=0; i--){
-          if(seq[i] != '\0' && toupper(seq[i]) == 'N'){
-            seq[i] = '\0'; //swap all N's in the bad region with null terminators
-          }else{
-            break;
-          }
+        int begin = bel->begin;
+        int end = min(bel->end, seqLen);
+        if(begin < 0 || begin >= end)
+          continue;
+        //first N run that ends past begin
+        int lo = 0, hi = nCount;
+        while(lo < hi){
+          int mid = (lo + hi)/2;
+          if(nStarts[mid] + nSizes[mid] > begin)
+            hi = mid;
+          else
+            lo = mid + 1;
         }
-        
-        //now swap out termination char for all N's within the start->end block
-        for(i = bel->begin; i < bel->end; i++){
-          if(seq[i] == '\0')
-            continue;
-          else if(toupper(seq[i]) == 'N'){
-            seq[i] = '\0';
-          }
+        //if the region ends in a gap, split on every gap after it too
+        if(toupper(seq[end-1]) == 'N'){
+          if(lo < splitAllFrom)
+            splitAllFrom = lo;
+        }else{
+          for(i=lo; i<nCount && nStarts[i] < end; i++)
+            split[i] = TRUE;
         }
+      }
 
-        if(seq[bel->end-1] == '\0'){
-          //we need to look past bel->end until we see a non-N
-          for(i=bel->end;i<seqLen;i++){
-            if(seq[i] != '\0' && toupper(seq[i]) == 'N')
-              seq[i] = '\0';
-          }
-        }
-      }//end loop over bad regions
-
-      //Now all of the N's in and around bad regions are '\0'
-      //first skip any initial Ns
+      //write out pieces between the split gaps
       int count = 0;
-      int start;
-      for(start = 0; start < seqLen; start++){
-        if(seq[start] != '\0' && toupper(seq[start]) != 'N' ){
-          int length = strlen(seq+start); //finds length until next '\0' char
-          if(length >= MIN_SEQ_LEN){
-            sprintf(tmpName,"%s_%d",seqName,++count);
-            faWriteNext(stdout, tmpName, seq+start, length);
-          }
-          if(length > 0)
-            start += length-1; //incrememted by one by the loop
+      int start = 0;
+      for(i=0; i<nCount; i++){
+        if(split[i] || i >= splitAllFrom){
+          writePiece(seqName, seq, start, nStarts[i], &count);
+          start = nStarts[i] + nSizes[i];
         }
-      }//end loop over seq for printing
+      }
+      writePiece(seqName, seq, start, seqLen, &count);
+      freeMem(split);
+      freeMem(nStarts);
+      freeMem(nSizes);
     }//end deal with breaks
   }//end loop over fasta sequences
 
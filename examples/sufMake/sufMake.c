@@ -0,0 +1,51 @@
+/* sufMake - make a sufa or sufx suffix array index, or an fmi FM-index, for a genome. */
+#include "common.h"
+#include "options.h"
+#include "sufMake.h"
+#include "fmi.h"
+
+#define DEFAULT_THREADS 4
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "sufMake - make a sufa or sufx suffix array index, or an fmi FM-index,\n"
+      "for a genome\n"
+      "usage:\n"
+      "   sufMake genome.fa|genome.2bit out.sufa|out.sufx|out.fmi\n"
+      "The output type is chosen from the suffix of the output file.  All\n"
+      "bases but N's are indexed.  Genomes over 4 Gb only fit in fmi files.\n"
+      "Memory needed is about 5 bytes per base for sufa and fmi, and 9 for\n"
+      "sufx, with the array part doubled for fmi files of genomes over 4 Gb.\n"
+      "The fmi file itself is about 0.7 bytes per base.\n"
+      "options:\n"
+      "   -threads=N - number of sorting threads, default %d\n"
+      "   -sampleRate=N - fmi rows per offset sample, default %d\n",
+      DEFAULT_THREADS, FMI_DEFAULT_SAMPLE_RATE
+  );
+}
+
+static struct optionSpec options[] = {
+    {"threads", OPTION_INT},
+    {"sampleRate", OPTION_INT},
+    {NULL, 0},
+};
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 3)
+    usage();
+  int threads = optionInt("threads", DEFAULT_THREADS);
+  if (endsWith(argv[2], ".sufx"))
+    sufxMake(argv[1], argv[2], threads);
+  else if (endsWith(argv[2], ".sufa"))
+    sufaMake(argv[1], argv[2], threads);
+  else if (endsWith(argv[2], ".fmi"))
+    fmiMake(argv[1], argv[2], optionInt("sampleRate", FMI_DEFAULT_SAMPLE_RATE), threads);
+  else
+    errAbort("Output file %s must end in .sufa, .sufx or .fmi", argv[2]);
+  return 0;
+}
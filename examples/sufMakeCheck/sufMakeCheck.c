@@ -0,0 +1,377 @@
+/* sufMakeCheck - check the suffix and traverse arrays and files sufMake
+ * builds against a simple qsort based build. */
+#include "common.h"
+#include "options.h"
+#include "portable.h"
+#include "dystring.h"
+#include "obscure.h"
+#include "sufa.h"
+#include "sufx.h"
+#include "sufMake.h"
+
+#define DEFAULT_GENOMES 60
+#define DEFAULT_MAX_SIZE 50000
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "sufMakeCheck - check the suffix and traverse arrays and files sufMake\n"
+      "builds against a simple qsort based build\n"
+      "usage:\n"
+      "   sufMakeCheck tmpDir\n"
+      "Random genomes are written as fasta in tmpDir and loaded with\n"
+      "sufGenomeLoad.  Their suffix arrays, with and without n's and\n"
+      "separators, and traverse arrays are made with sufMake on one or more\n"
+      "threads, and compared with ones made by sorting every suffix with\n"
+      "qsort and scanning forward for each traverse entry.  The sufa and sufx\n"
+      "files are compared byte for byte with ones written from the simple\n"
+      "arrays, and read back with sufaRead and sufxRead.  Genomes mix random\n"
+      "DNA with copies of earlier stretches, runs of N, single base and\n"
+      "tandem repeats, in mixed case with other IUPAC letters, on one to\n"
+      "many chromosomes of one base and up.\n"
+      "options:\n"
+      "   -genomes=N - number of random genomes, default %d\n"
+      "   -maxSize=N - most bases in a genome, default %d\n"
+      "   -seed=N - random number seed, default 0\n",
+      DEFAULT_GENOMES, DEFAULT_MAX_SIZE
+  );
+}
+
+static struct optionSpec options[] = {
+    {"genomes", OPTION_INT},
+    {"maxSize", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+static char *sortDna;	/* Genome qsort is comparing suffixes of. */
+
+static int suffixCmp(const void *va, const void *vb)
+/* Compare suffixes as zero terminated strings, then by offset. */
+{
+bits64 a = *((bits64 *)va), b = *((bits64 *)vb);
+int diff = strcmp(sortDna + a, sortDna + b);
+if (diff == 0)
+    diff = (a < b ? -1 : 1);
+return diff;
+}
+
+static char randomBase()
+/* Return a random base in either case, usually acgt but sometimes n or
+ * another IUPAC letter. */
+{
+static char bases[] = "acgtACGT";
+static char others[] = "nNrYkx";
+if (random() % 100 == 0)
+    return others[random() % (sizeof(others) - 1)];
+return bases[random() % (sizeof(bases) - 1)];
+}
+
+static void randomChrom(char *dna, int size, int style)
+/* Fill in dna with size random bases with some repeats of a kind depending
+ * on style. */
+{
+int i = 0;
+while (i < size)
+    {
+    int left = size - i;
+    int piece = 1 + random() % min(left, 2000);
+    int j;
+    switch (random() % (style == 0 ? 1 : 6))
+        {
+	case 0:		/* Random. */
+	case 1:
+	    for (j=0; j<piece; ++j)
+	        dna[i+j] = randomBase();
+	    break;
+	case 2:		/* Copy of an earlier stretch with a few changes. */
+	    if (i < piece)
+	        piece = i;
+	    if (piece == 0)
+	        {
+		dna[i] = randomBase();
+		piece = 1;
+		break;
+		}
+	    int start = (i > piece ? random() % (i - piece) : 0);
+	    for (j=0; j<piece; ++j)
+	        dna[i+j] = (random() % 50 == 0 ? randomBase() : dna[start+j]);
+	    break;
+	case 3:		/* Run of N. */
+	    for (j=0; j<piece; ++j)
+	        dna[i+j] = 'N';
+	    break;
+	case 4:		/* Single base repeat. */
+	    {
+	    char c = randomBase();
+	    for (j=0; j<piece; ++j)
+	        dna[i+j] = c;
+	    break;
+	    }
+	case 5:		/* Tandem repeat of a few bases. */
+	    {
+	    char unit[8];
+	    int unitSize = 2 + random() % 6;
+	    for (j=0; j<unitSize; ++j)
+	        unit[j] = randomBase();
+	    for (j=0; j<piece; ++j)
+	        dna[i+j] = unit[j % unitSize];
+	    break;
+	    }
+	}
+    i += piece;
+    }
+}
+
+static struct sufGenome *randomGenome(char *tmpDir, int maxSize, char **retExpected)
+/* Write random genome to a fasta file and load it with sufGenomeLoad.
+ * Returns the genome, and in *retExpected its DNA as it should be in
+ * allDna. */
+{
+int style = random() % 3;
+int size = 1 + random() % maxSize;
+int maxChroms = (random() % 2 ? 5 : 200);
+int chromCount = 1 + random() % min(size, maxChroms);
+char faName[PATH_LEN];
+safef(faName, sizeof(faName), "%s/sufMakeCheck.fa", tmpDir);
+FILE *f = mustOpen(faName, "w");
+char *expected = needLargeMem(size + chromCount + 1);
+char *dna = needLargeMem(size + 1);
+int chromIx, e = 0, offset = 0;
+for (chromIx = 0; chromIx < chromCount; ++chromIx)
+    {
+    int chromSize = (size - offset) / (chromCount - chromIx);
+    if (chromIx < chromCount-1 && random() % 2)
+        chromSize = 1 + random() % chromSize;
+    randomChrom(dna, chromSize, style);
+    fprintf(f, ">chr%d\n", chromIx+1);
+    int i;
+    for (i=0; i<chromSize; ++i)
+        {
+	fputc(dna[i], f);
+	if (i % 60 == 59 || i == chromSize-1)
+	    fputc('\n', f);
+	char c = tolower(dna[i]);
+	expected[e++] = (strchr("acgt", c) != NULL ? c : 'n');
+	}
+    expected[e++] = 0;
+    offset += chromSize;
+    }
+carefulClose(&f);
+freeMem(dna);
+struct sufGenome *genome = sufGenomeLoad(faName);
+remove(faName);
+if (genome->chromCount != chromCount || genome->dnaSize != e
+    || memcmp(genome->allDna, expected, e) != 0)
+    errAbort("sufGenomeLoad didn't load %d chromosomes, %d bases with separators, as expected",
+	    chromCount, e);
+*retExpected = expected;
+return genome;
+}
+
+static bits64 *simpleArray(struct sufGenome *genome, boolean full, bits64 *retCount)
+/* Return suffix array made with qsort. */
+{
+char *dna = genome->allDna;
+bits64 *array = needLargeMem((genome->dnaSize + 1) * sizeof(bits64));
+bits64 i, count = 0;
+for (i=0; i<genome->dnaSize; ++i)
+    if (full || (dna[i] != 0 && dna[i] != 'n'))
+        array[count++] = i;
+sortDna = dna;
+qsort(array, count, sizeof(array[0]), suffixCmp);
+*retCount = count;
+return array;
+}
+
+static bits32 *simpleTraverse(struct sufGenome *genome, bits64 *array, bits64 count)
+/* Return traverse array made by scanning forward from each suffix for the
+ * next one no deeper. */
+{
+char *dna = genome->allDna;
+bits64 *depth = needLargeMem((count + 1) * sizeof(bits64));
+bits64 i, j;
+for (i=0; i<count; ++i)
+    {
+    bits64 shared = 0;
+    if (i > 0)
+	{
+	char *s = dna + array[i-1], *t = dna + array[i];
+	while (s[shared] != 0 && s[shared] == t[shared])
+	    ++shared;
+	}
+    depth[i] = shared;
+    }
+bits32 *traverse = needLargeMem((count + 1) * sizeof(bits32));
+for (i=0; i<count; ++i)
+    {
+    for (j=i+1; j<count && depth[j] > depth[i]; ++j)
+        ;
+    traverse[i] = j - i;
+    }
+freeMem(depth);
+return traverse;
+}
+
+static void compareArray(char *what, bits64 *expected, void *array, boolean is64, bits64 count,
+	int threads)
+/* Make sure array from sufMake is the same as the simple one. */
+{
+bits64 i;
+for (i=0; i<count; ++i)
+    {
+    bits64 val = (is64 ? ((bits64 *)array)[i] : ((bits32 *)array)[i]);
+    if (val != expected[i])
+        errAbort("%s on %d threads has %llu at %llu of %llu, qsort has %llu",
+		what, threads, val, i, count, expected[i]);
+    }
+}
+
+static void writeSimple(char *fileName, bits32 magic, struct sufGenome *genome,
+	bits64 *array, bits32 *traverse)
+/* Write sufa file, or sufx file if traverse is non-NULL, as laid out in
+ * sufa.h and sufx.h. */
+{
+bits64 count = genome->arraySize, i;
+struct dyString *names = dyStringNew(0);
+for (i=0; i<genome->chromCount; ++i)
+    dyStringAppendN(names, genome->chromNames[i], strlen(genome->chromNames[i]) + 1);
+while (names->stringSize % 4 != 0)
+    dyStringAppendC(names, 0);
+bits64 preDnaSize = sizeof(struct sufaFileHeader) + names->stringSize
+	+ genome->chromCount * sizeof(bits32);
+bits64 dnaDiskSize = genome->dnaSize;
+while ((preDnaSize + dnaDiskSize) % 4 != 0)
+    ++dnaDiskSize;
+
+struct sufaFileHeader header;
+ZeroVar(&header);
+header.magic = magic;
+header.chromCount = genome->chromCount;
+header.chromNamesSize = names->stringSize;
+header.arraySize = count;
+header.dnaDiskSize = dnaDiskSize;
+header.size = preDnaSize + dnaDiskSize + count * sizeof(bits32) * (traverse ? 2 : 1);
+FILE *f = mustOpen(fileName, "wb");
+mustWrite(f, &header, sizeof(header));
+mustWrite(f, names->string, names->stringSize);
+mustWrite(f, genome->chromSizes, genome->chromCount * sizeof(bits32));
+for (i=0; i<dnaDiskSize; ++i)
+    fputc(i < genome->dnaSize ? genome->allDna[i] : 0, f);
+for (i=0; i<count; ++i)
+    {
+    bits32 offset = array[i];
+    mustWrite(f, &offset, sizeof(offset));
+    }
+if (traverse != NULL)
+    mustWrite(f, traverse, count * sizeof(bits32));
+carefulClose(&f);
+dyStringFree(&names);
+}
+
+static void compareFiles(char *madeName, char *simpleName)
+/* Make sure two files are the same byte for byte. */
+{
+char *made, *simple;
+size_t madeSize, simpleSize;
+readInGulp(madeName, &made, &madeSize);
+readInGulp(simpleName, &simple, &simpleSize);
+if (madeSize != simpleSize)
+    errAbort("%s is %lld bytes, %s is %lld", madeName, (long long)madeSize,
+	    simpleName, (long long)simpleSize);
+size_t i;
+for (i=0; i<madeSize; ++i)
+    if (made[i] != simple[i])
+        errAbort("%s and %s differ at byte %lld", madeName, simpleName, (long long)i);
+freeMem(made);
+freeMem(simple);
+}
+
+static void checkGenome(char *tmpDir, int maxSize, int genomeIx)
+/* Check one random genome. */
+{
+char *expectedDna;
+struct sufGenome *genome = randomGenome(tmpDir, maxSize, &expectedDna);
+int threads = (genomeIx % 3 == 0 ? 1 : 1 + random() % 8);
+verbose(2, "genome %d: %d chromosomes, %llu bases, %llu indexed, %d threads\n", genomeIx,
+	genome->chromCount, genome->dnaSize, genome->arraySize, threads);
+
+/* Suffix and traverse arrays for sufa and sufx. */
+bits64 count;
+bits64 *expected = simpleArray(genome, FALSE, &count);
+if (count != genome->arraySize)
+    errAbort("Genome %d has %llu bases to index, sufGenomeLoad says %llu",
+	    genomeIx, count, genome->arraySize);
+bits32 *array = sufArrayMake(genome, threads);
+compareArray("sufArrayMake", expected, array, FALSE, count, threads);
+bits32 *expectedTraverse = simpleTraverse(genome, expected, count);
+bits32 *traverse = sufTraverseMake(genome, array, threads);
+if (memcmp(traverse, expectedTraverse, count * sizeof(bits32)) != 0)
+    errAbort("sufTraverseMake on %d threads differs from scanning in genome %d",
+	    threads, genomeIx);
+
+/* Files, byte for byte, and read back. */
+char madeName[PATH_LEN], simpleName[PATH_LEN];
+safef(madeName, sizeof(madeName), "%s/sufMakeCheck.made", tmpDir);
+safef(simpleName, sizeof(simpleName), "%s/sufMakeCheck.simple", tmpDir);
+sufaWrite(genome, array, madeName);
+writeSimple(simpleName, SUFA_MAGIC, genome, expected, NULL);
+compareFiles(madeName, simpleName);
+struct sufa *sufa = sufaRead(madeName, FALSE);
+if (sufa->header->arraySize != count || memcmp(sufa->array, array, count * sizeof(bits32)) != 0
+    || memcmp(sufa->allDna, expectedDna, genome->dnaSize) != 0)
+    errAbort("sufaRead doesn't give back what sufaWrite wrote in genome %d", genomeIx);
+sufaFree(&sufa);
+sufxWrite(genome, array, traverse, madeName);
+writeSimple(simpleName, SUFX_MAGIC, genome, expected, expectedTraverse);
+compareFiles(madeName, simpleName);
+struct sufx *sufx = sufxRead(madeName, FALSE);
+if (sufx->header->arraySize != count
+    || memcmp(sufx->traverse, traverse, count * sizeof(bits32)) != 0)
+    errAbort("sufxRead doesn't give back what sufxWrite wrote in genome %d", genomeIx);
+sufxFree(&sufx);
+remove(madeName);
+remove(simpleName);
+freeMem(expected);
+freeMem(expectedTraverse);
+freeMem(array);
+freeMem(traverse);
+
+/* Full arrays for fmi, both sizes. */
+expected = simpleArray(genome, TRUE, &count);
+void *full = sufArrayMakeFull(genome, FALSE, threads);
+compareArray("sufArrayMakeFull", expected, full, FALSE, count, threads);
+freeMem(full);
+full = sufArrayMakeFull(genome, TRUE, threads);
+compareArray("sufArrayMakeFull 64 bit", expected, full, TRUE, count, threads);
+freeMem(full);
+freeMem(expected);
+freeMem(expectedDna);
+sufGenomeFree(&genome);
+}
+
+void sufMakeCheck(char *tmpDir, int genomeCount, int maxSize)
+/* sufMakeCheck - check the suffix and traverse arrays and files sufMake
+ * builds against a simple qsort based build. */
+{
+makeDirsOnPath(tmpDir);
+long startTime = clock1000();
+int i;
+for (i=0; i<genomeCount; ++i)
+    checkGenome(tmpDir, (i < genomeCount/4 ? min(maxSize, 100) : maxSize), i);
+verbose(1, "%d genomes indexed the same as by qsort in %ld ms\n",
+	genomeCount, clock1000() - startTime);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 2)
+    usage();
+  srandom(optionInt("seed", 0));
+  sufMakeCheck(argv[1], optionInt("genomes", DEFAULT_GENOMES),
+  	optionInt("maxSize", DEFAULT_MAX_SIZE));
+  return 0;
+}
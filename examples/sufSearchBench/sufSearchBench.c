@@ -0,0 +1,277 @@
+/* sufSearchBench - time exact and prefix searches of sufa and sufx suffix arrays
+ * over a synthetic genome. */
+#include "common.h"
+#include "options.h"
+#include "portable.h"
+#include "sufa.h"
+#include "sufx.h"
+#include "sufMake.h"
+
+#define DEFAULT_GENOME_SIZE 4000000
+#define DEFAULT_CHROMS 8
+#define DEFAULT_QUERIES 1000000
+#define DEFAULT_QUERY_SIZE 25
+#define DEFAULT_THREADS 4
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "sufSearchBench - time exact and prefix searches of sufa and sufx suffix\n"
+      "arrays over a synthetic genome\n"
+      "usage:\n"
+      "   sufSearchBench tmpDir\n"
+      "Makes a random genome with some repeats in it, indexes it with sufMake,\n"
+      "writes it as sufa and sufx files in tmpDir, reads them back, and times\n"
+      "building the arrays and searching for queries one at a time and as a\n"
+      "batch.  Half the queries are taken from the genome and half are random.\n"
+      "Results of all the methods are checked against each other and some\n"
+      "against a brute force scan.\n"
+      "options:\n"
+      "   -genomeSize=N - bases in genome, default %d\n"
+      "   -chroms=N - number of chromosomes, default %d\n"
+      "   -queries=N - number of queries, default %d\n"
+      "   -querySize=N - size of each query, default %d\n"
+      "   -threads=N - number of sorting threads, default %d\n"
+      "   -seed=N - random number seed, default 0\n",
+      DEFAULT_GENOME_SIZE, DEFAULT_CHROMS, DEFAULT_QUERIES, DEFAULT_QUERY_SIZE,
+      DEFAULT_THREADS
+  );
+}
+
+static struct optionSpec options[] = {
+    {"genomeSize", OPTION_INT},
+    {"chroms", OPTION_INT},
+    {"queries", OPTION_INT},
+    {"querySize", OPTION_INT},
+    {"threads", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+static char *allDna;	/* Genome with zero after each chromosome. */
+
+static struct sufGenome *makeGenome(int genomeSize, int chromCount)
+/* Return genome of random bases with some copies of earlier stretches, and
+ * point allDna at its DNA. */
+{
+static char bases[4] = {'a', 'c', 'g', 't'};
+struct sufGenome *genome;
+AllocVar(genome);
+genome->chromCount = chromCount;
+AllocArray(genome->chromNames, chromCount);
+AllocArray(genome->chromSizes, chromCount);
+bits32 *chromSizes = genome->chromSizes;
+bits32 dnaSize = genomeSize + chromCount;
+allDna = genome->allDna = needLargeMem(dnaSize + 8);
+int chromIx;
+bits32 offset = 0;
+for (chromIx=0; chromIx<chromCount; ++chromIx)
+    {
+    char name[16];
+    safef(name, sizeof(name), "chr%d", chromIx+1);
+    genome->chromNames[chromIx] = cloneString(name);
+    bits32 size = genomeSize/chromCount;
+    if (chromIx == chromCount-1)
+        size = genomeSize - offset + chromIx;
+    chromSizes[chromIx] = size;
+    bits32 i;
+    for (i=0; i<size; ++i)
+	{
+	/* Every so often copy an earlier bit with a few changes, to get repeats. */
+	if (offset > 1000 && random() % 2000 == 0)
+	    {
+	    bits32 copySize = 50 + random() % 500;
+	    bits32 start = random() % (offset - copySize);
+	    if (copySize > size - i)
+	        copySize = size - i;
+	    bits32 j;
+	    for (j=0; j<copySize; ++j)
+		{
+	        char c = allDna[start + j];
+		if (c == 0 || random() % 50 == 0)
+		    c = bases[random() & 3];
+		allDna[offset + i + j] = c;
+		}
+	    i += copySize - 1;
+	    }
+	else
+	    allDna[offset + i] = bases[random() & 3];
+	}
+    offset += size;
+    allDna[offset++] = 0;
+    }
+memset(allDna + offset, 0, 8);
+genome->dnaSize = dnaSize;
+genome->arraySize = genomeSize;
+return genome;
+}
+
+static bits32 bruteCount(char *q, int qSize, bits32 genomeEnd)
+/* Count places q occurs by looking at every position. */
+{
+bits32 i, count = 0;
+for (i=0; i<genomeEnd; ++i)
+    if (allDna[i] == tolower(q[0]) && strncasecmp(allDna + i, q, qSize) == 0)
+        ++count;
+return count;
+}
+
+void sufSearchBench(char *tmpDir, int genomeSize, int chromCount, int queryCount, int querySize,
+	int threadCount)
+/* sufSearchBench - time exact and prefix searches of sufa and sufx suffix arrays
+ * over a synthetic genome. */
+{
+/* Make genome and index it. */
+struct sufGenome *genome = makeGenome(genomeSize, chromCount);
+bits32 dnaSize = genome->dnaSize;
+long startTime = clock1000();
+bits32 *array = sufArrayMake(genome, threadCount);
+verbose(1, "Sorted %llu suffixes on %d threads in %ld ms\n", genome->arraySize, threadCount,
+	clock1000() - startTime);
+startTime = clock1000();
+bits32 *traverse = sufTraverseMake(genome, array, threadCount);
+verbose(1, "Made traverse array in %ld ms\n", clock1000() - startTime);
+
+char sufaFile[PATH_LEN], sufxFile[PATH_LEN];
+safef(sufaFile, sizeof(sufaFile), "%s/sufSearchBench.sufa", tmpDir);
+safef(sufxFile, sizeof(sufxFile), "%s/sufSearchBench.sufx", tmpDir);
+sufaWrite(genome, array, sufaFile);
+sufxWrite(genome, array, traverse, sufxFile);
+freez(&array);
+freez(&traverse);
+struct sufa *sufa = sufaRead(sufaFile, FALSE);
+struct sufx *sufx = sufxRead(sufxFile, FALSE);
+
+/* Make queries, half from genome in mixed case, half random. */
+char *qDna = needLargeMem((bits64)queryCount * querySize);
+struct sufaQuery *aQueries;
+struct sufxQuery *xQueries;
+AllocArray(aQueries, queryCount);
+AllocArray(xQueries, queryCount);
+int qIx;
+for (qIx=0; qIx<queryCount; ++qIx)
+    {
+    char *q = qDna + (bits64)qIx * querySize;
+    int j;
+    if (qIx & 1)
+	{
+	for (j=0; j<querySize; ++j)
+	    q[j] = "ACGTacgt"[random() & 7];
+	}
+    else
+	{
+	bits32 start = random() % (dnaSize - querySize);
+	for (j=0; j<querySize; ++j)
+	    {
+	    char c = allDna[start + j];
+	    if (c == 0)
+	        c = 'a';
+	    q[j] = ((random() & 1) ? toupper(c) : c);
+	    }
+	}
+    aQueries[qIx].dna = xQueries[qIx].dna = q;
+    aQueries[qIx].size = xQueries[qIx].size = querySize;
+    }
+
+/* Time searches one at a time. */
+int *aSizes, *xSizes;
+bits32 *aStarts, *aCounts, *xStarts, *xCounts;
+AllocArray(aSizes, queryCount);
+AllocArray(aStarts, queryCount);
+AllocArray(aCounts, queryCount);
+AllocArray(xSizes, queryCount);
+AllocArray(xStarts, queryCount);
+AllocArray(xCounts, queryCount);
+startTime = clock1000();
+for (qIx=0; qIx<queryCount; ++qIx)
+    aSizes[qIx] = sufaFindLongestPrefix(sufa, aQueries[qIx].dna, querySize,
+    	&aStarts[qIx], &aCounts[qIx]);
+verbose(1, "sufa single: %d queries in %ld ms\n", queryCount, clock1000() - startTime);
+startTime = clock1000();
+for (qIx=0; qIx<queryCount; ++qIx)
+    xSizes[qIx] = sufxFindLongestPrefix(sufx, xQueries[qIx].dna, querySize,
+    	&xStarts[qIx], &xCounts[qIx]);
+verbose(1, "sufx single: %d queries in %ld ms\n", queryCount, clock1000() - startTime);
+
+/* Time searches in batches. */
+startTime = clock1000();
+sufaFindMany(sufa, aQueries, queryCount);
+verbose(1, "sufa batch: %d queries in %ld ms\n", queryCount, clock1000() - startTime);
+startTime = clock1000();
+sufxFindMany(sufx, xQueries, queryCount);
+verbose(1, "sufx batch: %d queries in %ld ms\n", queryCount, clock1000() - startTime);
+
+/* Time converting hits to chromosome positions. */
+struct sufaHit hits[16];
+bits64 hitTotal = 0;
+startTime = clock1000();
+for (qIx=0; qIx<queryCount; ++qIx)
+    hitTotal += sufaHits(sufa, aQueries[qIx].arrayIx, aQueries[qIx].count, hits, ArraySize(hits));
+verbose(1, "sufa hits: %llu hits in %d chromosomes in %ld ms\n", hitTotal, chromCount,
+	clock1000() - startTime);
+
+/* Check all agree. */
+int exactCount = 0;
+for (qIx=0; qIx<queryCount; ++qIx)
+    {
+    struct sufaQuery *aq = &aQueries[qIx];
+    struct sufxQuery *xq = &xQueries[qIx];
+    if (aSizes[qIx] != xSizes[qIx] || aStarts[qIx] != xStarts[qIx] || aCounts[qIx] != xCounts[qIx]
+        || aq->matchSize != aSizes[qIx] || aq->arrayIx != aStarts[qIx] || aq->count != aCounts[qIx]
+	|| xq->matchSize != aSizes[qIx] || xq->arrayIx != aStarts[qIx] || xq->count != aCounts[qIx])
+	errAbort("Search results differ on query %d %.*s", qIx, querySize, aq->dna);
+    if (aq->matchSize == querySize)
+        ++exactCount;
+    }
+verbose(1, "%d of %d queries matched exactly\n", exactCount, queryCount);
+
+/* Check some against brute force, including the hit positions. */
+int checkCount = min(queryCount, 50);
+for (qIx=0; qIx<checkCount; ++qIx)
+    {
+    struct sufaQuery *aq = &aQueries[qIx];
+    if (aq->matchSize > 0
+        && bruteCount(aq->dna, aq->matchSize, dnaSize) != aq->count)
+	errAbort("Wrong count for query %d", qIx);
+    if (aq->matchSize < querySize
+        && bruteCount(aq->dna, aq->matchSize+1, dnaSize) != 0)
+	errAbort("Longer prefix of query %d occurs", qIx);
+    struct sufxHit xHits[16];
+    int hitCount = sufxHits(sufx, xQueries[qIx].arrayIx, xQueries[qIx].count,
+    	xHits, ArraySize(xHits));
+    int hitIx;
+    for (hitIx=0; hitIx<hitCount; ++hitIx)
+	{
+	struct sufxHit *hit = &xHits[hitIx];
+	char *hitDna = sufx->allDna + sufx->chromOffsets[hit->chromIx] + hit->offset;
+	if (hit->offset + aq->matchSize > sufx->chromSizes[hit->chromIx]
+	    || strncasecmp(hitDna, aq->dna, aq->matchSize) != 0)
+	    errAbort("Bad hit for query %d", qIx);
+	}
+    }
+verbose(1, "Checked %d queries against brute force\n", checkCount);
+
+sufaFree(&sufa);
+sufxFree(&sufx);
+sufGenomeFree(&genome);
+remove(sufaFile);
+remove(sufxFile);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 2)
+    usage();
+  srandom(optionInt("seed", 0));
+  int genomeSize = optionInt("genomeSize", DEFAULT_GENOME_SIZE);
+  int chromCount = optionInt("chroms", DEFAULT_CHROMS);
+  if (chromCount < 1 || genomeSize < chromCount * 100)
+    errAbort("Need at least 100 bases per chromosome");
+  sufSearchBench(argv[1], genomeSize, chromCount,
+  	optionInt("queries", DEFAULT_QUERIES), optionInt("querySize", DEFAULT_QUERY_SIZE),
+	optionInt("threads", DEFAULT_THREADS));
+  return 0;
+}
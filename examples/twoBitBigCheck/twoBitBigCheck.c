@@ -0,0 +1,302 @@
+/* twoBitBigCheck - write and read back a synthetic .2bit file with sequences
+ * over 2^31 bases and offsets past 4Gb. */
+#include "common.h"
+#include "options.h"
+#include "hash.h"
+#include "portable.h"
+#include "dnautil.h"
+#include "dnaseq.h"
+#include "twoBit.h"
+#include <limits.h>
+
+#define DEFAULT_BIG_SIZE 3000000000LL
+#define DEFAULT_COPIES 6
+#define DEFAULT_FRAGS 2000
+#define SMALL_SIZE 10000
+#define BLOCK_COUNT 4
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "twoBitBigCheck - write and read back a synthetic .2bit file with sequences\n"
+      "over 2^31 bases and offsets past 4Gb\n"
+      "usage:\n"
+      "   twoBitBigCheck tmpDir\n"
+      "Writes tmpDir/twoBitBigCheck.2bit with the streaming writer.  It holds a\n"
+      "short sequence, several big ones with N and masked blocks on both sides of\n"
+      "2^31, and another short sequence that ends up past 4Gb in the file.  The\n"
+      "big sequences are made already packed, so no genome is needed on disk or\n"
+      "in memory.  The file is read back and random fragments, fragments around\n"
+      "the blocks, and sizes are checked against what was written.  With the\n"
+      "defaults this needs about 9Gb of disk in tmpDir for a few minutes.\n"
+      "options:\n"
+      "   -bigSize=N - bases in each big sequence, default %lld\n"
+      "   -copies=N - number of big sequences, default %d\n"
+      "   -frags=N - random fragments to check per sequence, default %d\n"
+      "   -seed=N - random number seed, default 0\n"
+      "   -keep - don't remove the .2bit file at the end\n",
+      DEFAULT_BIG_SIZE, DEFAULT_COPIES, DEFAULT_FRAGS
+  );
+}
+
+static struct optionSpec options[] = {
+    {"bigSize", OPTION_LONG_LONG},
+    {"copies", OPTION_INT},
+    {"frags", OPTION_INT},
+    {"seed", OPTION_INT},
+    {"keep", OPTION_BOOLEAN},
+    {NULL, 0},
+};
+
+static bits64 mix64(bits64 x)
+/* Scramble bits of x, splitmix64 finalizer. */
+{
+x ^= x >> 30;
+x *= 0xbf58476d1ce4e5b9ULL;
+x ^= x >> 27;
+x *= 0x94d049bb133111ebULL;
+x ^= x >> 31;
+return x;
+}
+
+static UBYTE packedByte(int copy, bits64 byteIx)
+/* Return packed byte byteIx of big sequence copy, so any part can be
+ * recomputed without keeping the sequence around. */
+{
+bits64 word = mix64(((bits64)(copy+1) << 40) + (byteIx >> 3));
+return word >> ((byteIx & 7) * 8);
+}
+
+static long long pivotPos(long long size)
+/* Return 2^31, or the middle of sequences too small to reach it. */
+{
+long long twoGig = 1LL << 31;
+return (size > twoGig + 200000 ? twoGig : size/2);
+}
+
+static void makeBlocks(int copy, long long size, bits32 *nStarts, bits32 *nSizes,
+	bits32 *maskStarts, bits32 *maskSizes)
+/* Fill in sorted, non-overlapping N and mask blocks for big sequence copy,
+ * with some near the start, some straddling 2^31 and some at the end. */
+{
+long long pivot = pivotPos(size);
+long long shift = copy * 7;
+long long nPos[BLOCK_COUNT] = {1000 + shift, pivot - 500 + shift, pivot + 100000 + shift,
+	size - 3000 - shift};
+long long maskPos[BLOCK_COUNT] = {0, pivot - 70000 - shift, pivot + 5000 + shift,
+	size - 1500 + shift/2};
+int i;
+for (i=0; i<BLOCK_COUNT; ++i)
+    {
+    nStarts[i] = nPos[i];
+    nSizes[i] = 1000 + i;
+    maskStarts[i] = maskPos[i];
+    maskSizes[i] = (i == BLOCK_COUNT-1 ? size - maskPos[i] : 60000 + i);
+    }
+}
+
+static void expectedFrag(int copy, long long size, long long start, long long end,
+	boolean doMask, char *dna)
+/* Put what twoBitReadSeqFragExt should return for big sequence copy in dna. */
+{
+bits32 nStarts[BLOCK_COUNT], nSizes[BLOCK_COUNT], maskStarts[BLOCK_COUNT], maskSizes[BLOCK_COUNT];
+long long i;
+int b;
+makeBlocks(copy, size, nStarts, nSizes, maskStarts, maskSizes);
+for (i=start; i<end; ++i)
+    {
+    UBYTE packed = packedByte(copy, i>>2);
+    char c = valToNt[(packed >> (6 - 2*(i&3))) & 3];
+    for (b=0; b<BLOCK_COUNT; ++b)
+	if (i >= nStarts[b] && i < (long long)nStarts[b] + nSizes[b])
+	    c = 'n';
+    if (doMask)
+	{
+	boolean masked = FALSE;
+	for (b=0; b<BLOCK_COUNT; ++b)
+	    if (i >= maskStarts[b] && i < (long long)maskStarts[b] + maskSizes[b])
+		masked = TRUE;
+	if (!masked)
+	    c = toupper(c);
+	}
+    dna[i-start] = c;
+    }
+}
+
+static void addBigSeq(struct twoBitWriter *tbw, int copy, long long size, UBYTE *packed)
+/* Fill in packed with big sequence copy and add it to tbw. */
+{
+struct twoBit twoBit;
+char name[32];
+bits32 nStarts[BLOCK_COUNT], nSizes[BLOCK_COUNT], maskStarts[BLOCK_COUNT], maskSizes[BLOCK_COUNT];
+bits64 i, packedSize = (size + 3)/4;
+for (i=0; i<packedSize; ++i)
+    packed[i] = packedByte(copy, i);
+makeBlocks(copy, size, nStarts, nSizes, maskStarts, maskSizes);
+safef(name, sizeof(name), "big%d", copy);
+ZeroVar(&twoBit);
+twoBit.name = name;
+twoBit.data = packed;
+twoBit.size = size;
+twoBit.nBlockCount = twoBit.maskBlockCount = BLOCK_COUNT;
+twoBit.nStarts = nStarts;
+twoBit.nSizes = nSizes;
+twoBit.maskStarts = maskStarts;
+twoBit.maskSizes = maskSizes;
+twoBitWriterAddTwoBit(tbw, &twoBit);
+}
+
+static struct dnaSeq *makeSmallSeq(char *name)
+/* Return a small random mixed case sequence with a few Ns. */
+{
+struct dnaSeq *seq;
+AllocVar(seq);
+seq->name = cloneString(name);
+seq->size = SMALL_SIZE;
+seq->dna = needMem(SMALL_SIZE + 1);
+int i;
+for (i=0; i<SMALL_SIZE; ++i)
+    seq->dna[i] = "ACGTacgtN"[random() % 9];
+return seq;
+}
+
+static void checkFrag(struct twoBitFile *tbf, char *name, long long start, long long end,
+	boolean doMask, char *expected)
+/* Read start-end of name and make sure it matches expected. */
+{
+long long fullSize;
+struct dnaSeq *seq = twoBitReadSeqFragExt(tbf, name, start, end, doMask, &fullSize);
+if (seq->size != end - start || memcmp(seq->dna, expected, seq->size) != 0)
+    errAbort("%s:%lld-%lld (doMask %d) read back wrong", name, start, end, doMask);
+dnaSeqFree(&seq);
+}
+
+static void checkSmall(struct twoBitFile *tbf, struct dnaSeq *seq, int fragCount)
+/* Check small sequence reads back the same in whole and in parts. */
+{
+char *expected = cloneString(seq->dna);
+int i;
+if (twoBitSeqSize(tbf, seq->name) != seq->size)
+    errAbort("Wrong size for %s", seq->name);
+checkFrag(tbf, seq->name, 0, seq->size, TRUE, expected);
+for (i=0; i<fragCount; ++i)
+    {
+    int start = random() % seq->size;
+    int end = start + 1 + random() % (seq->size - start);
+    checkFrag(tbf, seq->name, start, end, TRUE, expected + start);
+    }
+toLowerN(expected, seq->size);
+checkFrag(tbf, seq->name, 0, seq->size, FALSE, expected);
+freeMem(expected);
+}
+
+static void checkBig(struct twoBitFile *tbf, int copy, long long size, int fragCount)
+/* Check fragments of big sequence copy, at random and around its blocks. */
+{
+char name[32];
+bits32 nStarts[BLOCK_COUNT], nSizes[BLOCK_COUNT], maskStarts[BLOCK_COUNT], maskSizes[BLOCK_COUNT];
+int maxFrag = 20000;
+char *expected = needMem(2*maxFrag);
+long long pivot = pivotPos(size);
+int i;
+safef(name, sizeof(name), "big%d", copy);
+if (twoBitSeqSize(tbf, name) != size)
+    errAbort("Wrong size for %s: %lld", name, twoBitSeqSize(tbf, name));
+makeBlocks(copy, size, nStarts, nSizes, maskStarts, maskSizes);
+for (i=0; i<fragCount + 4*BLOCK_COUNT; ++i)
+    {
+    long long start;
+    if (i < BLOCK_COUNT)
+	start = (long long)nStarts[i] - 10;
+    else if (i < 2*BLOCK_COUNT)
+	start = (long long)nStarts[i-BLOCK_COUNT] + nSizes[i-BLOCK_COUNT] - 10;
+    else if (i < 3*BLOCK_COUNT)
+	start = (long long)maskStarts[i-2*BLOCK_COUNT] - 10;
+    else if (i < 4*BLOCK_COUNT)
+	start = (long long)maskStarts[i-3*BLOCK_COUNT] + maskSizes[i-3*BLOCK_COUNT] - 10;
+    else if (i & 1)
+	start = ((long long)random() << 16 ^ random()) % size;
+    else
+	start = pivot - maxFrag + random() % (2*maxFrag);
+    if (start < 0)
+	start = 0;
+    if (start >= size)
+	start = size - 1;
+    long long end = start + 1 + random() % maxFrag;
+    if (end > size)
+	end = size;
+    boolean doMask = (i & 2) != 0;
+    expectedFrag(copy, size, start, end, doMask, expected);
+    checkFrag(tbf, name, start, end, doMask, expected);
+    }
+freeMem(expected);
+}
+
+void twoBitBigCheck(char *tmpDir, long long bigSize, int copies, int fragCount, boolean keep)
+/* twoBitBigCheck - write and read back a synthetic .2bit file with sequences
+ * over 2^31 bases and offsets past 4Gb. */
+{
+char fileName[PATH_LEN];
+safef(fileName, sizeof(fileName), "%s/twoBitBigCheck.2bit", tmpDir);
+struct dnaSeq *first = makeSmallSeq("first"), *last = makeSmallSeq("last");
+UBYTE *packed = needHugeMem((bigSize + 3)/4);
+long startTime = clock1000();
+int copy;
+
+/* Write file, letting the writer decide it needs 64 bit offsets. */
+struct twoBitWriter *tbw = twoBitWriterOpen(fileName, FALSE);
+twoBitWriterAdd(tbw, first, TRUE);
+for (copy=0; copy<copies; ++copy)
+    addBigSeq(tbw, copy, bigSize, packed);
+twoBitWriterAdd(tbw, last, TRUE);
+twoBitWriterClose(&tbw);
+freeMem(packed);
+verbose(1, "Wrote %s with %d sequences of %lld bases in %ld ms\n", fileName, copies,
+	bigSize, clock1000() - startTime);
+
+/* Read it back. */
+startTime = clock1000();
+struct twoBitFile *tbf = twoBitOpen(fileName);
+bits64 lastOffset = ((struct twoBitIndex *)hashMustFindVal(tbf->hash, "last"))->offset;
+verbose(1, "File is version %u, last sequence at offset %llu\n", tbf->version, lastOffset);
+if (lastOffset > UINT_MAX && tbf->version != 1)
+    errAbort("File needs 64 bit offsets but is version %u", tbf->version);
+if (twoBitTotalSize(tbf) != 2*SMALL_SIZE + copies * bigSize)
+    errAbort("Wrong total size %lld", twoBitTotalSize(tbf));
+checkSmall(tbf, first, fragCount);
+checkSmall(tbf, last, fragCount);
+for (copy=0; copy<copies; ++copy)
+    checkBig(tbf, copy, bigSize, fragCount);
+twoBitClose(&tbf);
+verbose(1, "Checked sizes and %d fragments per sequence in %ld ms\n", fragCount,
+	clock1000() - startTime);
+if (bigSize > INT_MAX && lastOffset > UINT_MAX)
+    verbose(1, "Covered sequences over 2^31 bases and offsets over 4Gb\n");
+else
+    warn("Sizes too small to cover sequences over 2^31 bases and offsets over 4Gb");
+
+dnaSeqFree(&first);
+dnaSeqFree(&last);
+if (!keep)
+    remove(fileName);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+  optionInit(&argc, argv, options);
+  if (argc != 2)
+    usage();
+  dnaUtilOpen();
+  srandom(optionInt("seed", 0));
+  long long bigSize = optionLongLong("bigSize", DEFAULT_BIG_SIZE);
+  int copies = optionInt("copies", DEFAULT_COPIES);
+  if (bigSize < (1<<18) || bigSize > UINT_MAX)
+    errAbort("bigSize must be between %d and %u", 1<<18, UINT_MAX);
+  if (copies < 0 || copies > 1000)
+    errAbort("copies must be between 0 and 1000");
+  twoBitBigCheck(argv[1], bigSize, copies, optionInt("frags", DEFAULT_FRAGS),
+  	optionExists("keep"));
+  return 0;
+}
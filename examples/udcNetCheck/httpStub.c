@@ -0,0 +1,492 @@
+/* httpStub - a small http server on the loopback interface that serves one
+ * file, for checking udc and the net code against. */
+#include "common.h"
+#include "dystring.h"
+#include "portable.h"
+#include "httpStub.h"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <poll.h>
+
+struct stubConn
+/* A connection being served, with buffered input. */
+    {
+    struct httpStub *stub;	/* Server. */
+    int sd;			/* Socket. */
+    int connIx;			/* Connection number. */
+    char buf[16*1024];		/* Input buffer. */
+    int bufStart, bufEnd;	/* Unread part of buf. */
+    };
+
+static boolean connReadLine(struct stubConn *conn, char *line, int maxSize)
+/* Read a line into line, without the CR/LF.  Return FALSE at end of input. */
+{
+int size = 0;
+for (;;)
+    {
+    if (conn->bufStart == conn->bufEnd)
+        {
+	int rd = read(conn->sd, conn->buf, sizeof(conn->buf));
+	if (rd <= 0)
+	    return FALSE;
+	conn->bufStart = 0;
+	conn->bufEnd = rd;
+	}
+    char c = conn->buf[conn->bufStart++];
+    if (c == '\n')
+        break;
+    if (c != '\r' && size < maxSize-1)
+        line[size++] = c;
+    }
+line[size] = 0;
+return TRUE;
+}
+
+static boolean writeAll(int sd, void *vBuf, long long size)
+/* Write all of buf to sd.  Return FALSE if client has gone away. */
+{
+char *buf = vBuf;
+while (size > 0)
+    {
+    ssize_t wr = write(sd, buf, size);
+    if (wr <= 0)
+        return FALSE;
+    buf += wr;
+    size -= wr;
+    }
+return TRUE;
+}
+
+static void httpDate(time_t t, char *buf, int bufSize)
+/* Format t as an http date. */
+{
+struct tm tm;
+gmtime_r(&t, &tm);
+strftime(buf, bufSize, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+static boolean sendBody(struct stubConn *conn, int fd, long long start, long long size,
+	boolean chunked, struct httpStubRequest *req)
+/* Send size bytes of fd from start, as slowly as the rate setting says, and
+ * not at all while paused.  If chunked send it as chunks of varying size, but
+ * leave off the last chunk.  Return FALSE if client has gone away. */
+{
+struct httpStubShared *shared = conn->stub->shared;
+static char buf[64*1024];
+long long sent = 0;
+long startTime = clock1000();
+while (sent < size)
+    {
+    while (shared->paused)
+        sleep1000(10);
+    long long rate = shared->rate;
+    if (shared->rateVaries)
+        rate = rate * (conn->connIx % 4 + 1) / 4;
+    long long oneSize = min(size - sent, sizeof(buf));
+    if (chunked)
+        {
+	long long chunkSize = 1 + random() % 20000;
+        oneSize = min(oneSize, chunkSize);
+	}
+    if (rate > 0)
+	{
+	/* Send about 20 pieces a second, and wait until each is due. */
+	oneSize = min(oneSize, max(rate/20, 1));
+	long due = startTime + (sent + oneSize) * 1000 / rate;
+	long now = clock1000();
+	if (due > now)
+	    sleep1000(due - now);
+	}
+    if (pread(fd, buf, oneSize, start + sent) != oneSize)
+        errnoAbort("httpStub: can't read %s", conn->stub->fileName);
+    if (chunked)
+        {
+	char sizeLine[32];
+	safef(sizeLine, sizeof(sizeLine), "%llx\r\n", oneSize);
+	if (!writeAll(conn->sd, sizeLine, strlen(sizeLine)))
+	    return FALSE;
+	}
+    if (!writeAll(conn->sd, buf, oneSize))
+        return FALSE;
+    if (chunked && !writeAll(conn->sd, "\r\n", 2))
+        return FALSE;
+    sent += oneSize;
+    __sync_fetch_and_add(&shared->bytes, oneSize);
+    if (req != NULL)
+        req->sent = sent;
+    }
+return TRUE;
+}
+
+static void waitForClose(int sd)
+/* Wait a minute at most for client to close connection, ignoring whatever
+ * it sends. */
+{
+char buf[1024];
+struct pollfd pfd;
+pfd.fd = sd;
+pfd.events = POLLIN;
+long giveUp = clock1000() + 60*1000;
+while (clock1000() < giveUp)
+    {
+    if (poll(&pfd, 1, 1000) > 0 && read(sd, buf, sizeof(buf)) <= 0)
+        break;
+    }
+}
+
+static boolean everyNth(int n, int reqIx)
+/* Return TRUE if request is one of every nth. */
+{
+return n > 0 && (reqIx + 1) % n == 0;
+}
+
+static void serveConn(struct stubConn *conn)
+/* Answer requests on connection until client closes it or asks us to. */
+{
+struct httpStub *stub = conn->stub;
+struct httpStubShared *shared = stub->shared;
+int fd = mustOpenFd(stub->fileName, O_RDONLY);
+struct stat st;
+if (fstat(fd, &st) < 0)
+    errnoAbort("httpStub: can't stat %s", stub->fileName);
+long long fileSize = st.st_size;
+char lastModified[64];
+httpDate(st.st_mtime, lastModified, sizeof(lastModified));
+char *path = strrchr(stub->url + strlen("http://"), '/');
+char line[4096];
+int served = 0;
+srandom(conn->connIx);
+for (;;)
+    {
+    /* Read request line and the header lines we care about. */
+    if (!connReadLine(conn, line, sizeof(line)))
+        break;
+    if (line[0] == 0)
+        continue;
+    if (shared->keepAliveMax > 0 && served >= shared->keepAliveMax)
+        break;	/* Close without answering, as servers may do when keeping alive. */
+    char *s = line;
+    char *method = cloneString(nextWord(&s));
+    char *file = cloneString(nextWord(&s));
+    char *version = cloneString(nextWord(&s));
+    boolean keepAlive = (version != NULL && sameString(version, "HTTP/1.1"));
+    long long rangeStart = -1, rangeEnd = -1;
+    boolean gotHeader = TRUE;
+    for (;;)
+        {
+	if (!connReadLine(conn, line, sizeof(line)))
+	    {
+	    gotHeader = FALSE;
+	    break;
+	    }
+	if (line[0] == 0)
+	    break;
+	s = line;
+	char *name = nextWord(&s);
+	char *val = skipLeadingSpaces(s);
+	if (name == NULL || val == NULL)
+	    continue;
+	if (sameWord(name, "Range:") && startsWith("bytes=", val))
+	    {
+	    char *dash = strchr(val, '-');
+	    rangeStart = atoll(val + strlen("bytes="));
+	    if (dash != NULL && isdigit(dash[1]))
+	        rangeEnd = atoll(dash+1) + 1;
+	    }
+	else if (sameWord(name, "Connection:"))
+	    {
+	    if (strstrNoCase(val, "close") != NULL)
+	        keepAlive = FALSE;
+	    else if (strstrNoCase(val, "keep-alive") != NULL)
+	        keepAlive = TRUE;
+	    }
+	}
+    if (!gotHeader || method == NULL || file == NULL)
+	break;
+    served += 1;
+
+    /* Log it. */
+    boolean isHead = sameString(method, "HEAD");
+    int reqIx = __sync_fetch_and_add(&shared->requests, 1);
+    if (isHead)
+	__sync_fetch_and_add(&shared->heads, 1);
+    struct httpStubRequest *req = NULL;
+    if (reqIx < HTTP_STUB_MAX_LOG)
+        {
+	req = &shared->log[reqIx];
+	req->connIx = conn->connIx;
+	req->isHead = isHead;
+	req->start = rangeStart;
+	req->end = rangeEnd;
+	}
+    if (shared->latencyMs > 0)
+        sleep1000(shared->latencyMs);
+
+    /* Work out what to send. */
+    boolean http10 = shared->http10;
+    if (http10)
+        keepAlive = FALSE;
+    boolean chunked = shared->chunked && !http10;
+    boolean stall = everyNth(shared->stallEvery, reqIx);
+    boolean cut = everyNth(shared->cutEvery, reqIx);
+    struct dyString *dy = dyStringNew(512);
+    dyStringPrintf(dy, "HTTP/%s ", (http10 ? "1.0" : "1.1"));
+    long long start = 0, size = -1;
+    if (startsWith("/redirect/", file))
+        {
+	/* Redirect /redirect/N/x to /redirect/N-1/x, and /redirect/1/x to /x. */
+	int hops = atoi(file + strlen("/redirect/"));
+	char *rest = strchr(file + strlen("/redirect/"), '/');
+	char *base = (rest == NULL ? "" : rest);
+	char *host = stub->url + strlen("http://");
+	int hostSize = strchr(host, '/') - host;
+	dyStringPrintf(dy, "302 Found\r\nLocation: http://%.*s", hostSize, host);
+	if (hops > 1)
+	    dyStringPrintf(dy, "/redirect/%d%s\r\n", hops - 1, base);
+	else
+	    dyStringPrintf(dy, "%s\r\n", base);
+	size = 0;
+	}
+    else if (!sameString(file, path) || !(isHead || sameString(method, "GET")))
+        {
+	dyStringPrintf(dy, "404 Not Found\r\n");
+	size = 0;
+	}
+    else if (everyNth(shared->errorEvery, reqIx))
+        {
+	dyStringPrintf(dy, "503 Service Unavailable\r\n");
+	size = 0;
+	}
+    else if (rangeStart >= fileSize)
+        {
+	dyStringPrintf(dy, "416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\n",
+		fileSize);
+	size = 0;
+	}
+    else if (rangeStart >= 0)
+        {
+	long long end = (rangeEnd < 0 || rangeEnd > fileSize ? fileSize : rangeEnd);
+	start = rangeStart;
+	size = end - start;
+	dyStringPrintf(dy, "206 Partial Content\r\nContent-Range: bytes %lld-%lld/%lld\r\n",
+	    start, end-1, fileSize);
+	}
+    else
+        {
+	size = fileSize;
+	dyStringPrintf(dy, "200 OK\r\n");
+	}
+    if (size == 0)
+        chunked = FALSE;
+    if (chunked)
+	dyStringPrintf(dy, "Transfer-Encoding: chunked\r\n");
+    else if (!http10 || size == 0)
+	dyStringPrintf(dy, "Content-Length: %lld\r\n", size);
+    dyStringPrintf(dy, "Last-Modified: %s\r\nAccept-Ranges: bytes\r\n", lastModified);
+    if (!http10)
+	dyStringPrintf(dy, "Connection: %s\r\n", (keepAlive ? "keep-alive" : "close"));
+    dyStringPrintf(dy, "\r\n");
+    boolean ok = writeAll(conn->sd, dy->string, dy->stringSize);
+    dyStringFree(&dy);
+    if (ok && !isHead && (stall || cut))
+        {
+	/* Send half the body, then stop. */
+	sendBody(conn, fd, start, size/2, chunked, req);
+	if (stall)
+	    waitForClose(conn->sd);
+	ok = FALSE;
+	}
+    if (ok && !isHead)
+        ok = sendBody(conn, fd, start, size, chunked, req);
+    if (ok && chunked)
+        {
+	/* Last chunk, with a trailer on every other response. */
+	char *last = ((reqIx & 1) ? "0\r\nX-Stub-Trailer: yes\r\n\r\n" : "0\r\n\r\n");
+	ok = writeAll(conn->sd, last, strlen(last));
+	}
+    if (ok && req != NULL)
+        req->finished = TRUE;
+    freeMem(method);
+    freeMem(file);
+    freeMem(version);
+    if (!ok || !keepAlive)
+        break;
+    }
+close(fd);
+}
+
+static void serve(struct httpStub *stub, int listenSd)
+/* Accept connections, forking off a process to serve each. */
+{
+signal(SIGCHLD, SIG_IGN);
+for (;;)
+    {
+    int sd = accept(listenSd, NULL, NULL);
+    if (sd < 0)
+        {
+	if (errno == EINTR)
+	    continue;
+	errnoAbort("httpStub: accept failed");
+	}
+    int connIx = __sync_fetch_and_add(&stub->shared->connections, 1);
+    int pid = fork();
+    if (pid < 0)
+        errnoAbort("httpStub: can't fork");
+    if (pid == 0)
+        {
+	close(listenSd);
+	struct stubConn *conn;
+	AllocVar(conn);
+	conn->stub = stub;
+	conn->sd = sd;
+	conn->connIx = connIx;
+	serveConn(conn);
+	close(sd);
+	_exit(0);
+	}
+    close(sd);
+    }
+}
+
+static int runningPid = 0;	/* Process id of server still running, or 0. */
+static int ownerPid = 0;	/* Process that started it. */
+
+static void killRunningStub()
+/* Stop server at exit, so that an errAbort doesn't leave it running and
+ * holding on to our output.  Only the process that started it does this,
+ * not the ones forked off from it. */
+{
+if (runningPid != 0 && getpid() == ownerPid)
+    {
+    kill(-runningPid, SIGTERM);
+    waitpid(runningPid, NULL, 0);
+    runningPid = 0;
+    }
+}
+
+struct httpStub *httpStubStart(char *fileName)
+/* Start serving fileName on a free loopback port.  Call this before starting
+ * any threads, since the server is forked off. */
+{
+struct httpStub *stub;
+AllocVar(stub);
+stub->fileName = cloneString(fileName);
+stub->shared = mmap(NULL, sizeof(*stub->shared), PROT_READ|PROT_WRITE,
+	MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+if (stub->shared == MAP_FAILED)
+    errnoAbort("httpStub: can't map %lld bytes", (long long)sizeof(*stub->shared));
+
+/* Let the system pick a port. */
+int sd = socket(AF_INET, SOCK_STREAM, 0);
+if (sd < 0)
+    errnoAbort("httpStub: can't make socket");
+struct sockaddr_in sai;
+ZeroVar(&sai);
+sai.sin_family = AF_INET;
+sai.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+socklen_t saiSize = sizeof(sai);
+if (bind(sd, (struct sockaddr *)&sai, saiSize) < 0
+    || listen(sd, 256) < 0
+    || getsockname(sd, (struct sockaddr *)&sai, &saiSize) < 0)
+    errnoAbort("httpStub: can't listen on loopback");
+stub->port = ntohs(sai.sin_port);
+char *baseName = strrchr(fileName, '/');
+baseName = (baseName == NULL ? fileName : baseName + 1);
+char url[1024];
+safef(url, sizeof(url), "http://127.0.0.1:%d/%s", stub->port, baseName);
+stub->url = cloneString(url);
+
+/* Fork off server in a process group of its own, so it's easy to stop along
+ * with the processes serving connections. */
+fflush(stdout);
+fflush(stderr);
+int pid = fork();
+if (pid < 0)
+    errnoAbort("httpStub: can't fork");
+if (pid == 0)
+    {
+    setpgid(0, 0);
+    signal(SIGPIPE, SIG_IGN);
+    serve(stub, sd);
+    _exit(0);
+    }
+setpgid(pid, pid);
+close(sd);
+stub->pid = pid;
+if (ownerPid == 0)
+    atexit(killRunningStub);
+ownerPid = getpid();
+runningPid = pid;
+return stub;
+}
+
+char *httpStubRedirectUrl(struct httpStub *stub, int hops)
+/* Return url that redirects hops times before getting to the file.  Free
+ * it when done. */
+{
+char *host = stub->url + strlen("http://");
+char *file = strchr(host, '/');
+char url[1024];
+safef(url, sizeof(url), "http://%.*s/redirect/%d%s", (int)(file - host), host, hops, file);
+return cloneString(url);
+}
+
+int httpStubClosedPort()
+/* Return a loopback port that nothing is listening on. */
+{
+int sd = socket(AF_INET, SOCK_STREAM, 0);
+if (sd < 0)
+    errnoAbort("httpStub: can't make socket");
+struct sockaddr_in sai;
+ZeroVar(&sai);
+sai.sin_family = AF_INET;
+sai.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+socklen_t saiSize = sizeof(sai);
+if (bind(sd, (struct sockaddr *)&sai, saiSize) < 0
+    || getsockname(sd, (struct sockaddr *)&sai, &saiSize) < 0)
+    errnoAbort("httpStub: can't bind to loopback");
+close(sd);
+return ntohs(sai.sin_port);
+}
+
+void httpStubClearSettings(struct httpStub *stub)
+/* Go back to serving as fast as possible with no failures. */
+{
+struct httpStubShared *shared = stub->shared;
+shared->latencyMs = 0;
+shared->rate = 0;
+shared->rateVaries = shared->paused = FALSE;
+shared->http10 = shared->chunked = FALSE;
+shared->keepAliveMax = 0;
+shared->errorEvery = shared->stallEvery = shared->cutEvery = 0;
+}
+
+void httpStubClearStats(struct httpStub *stub)
+/* Zero out statistics.  Only call when nothing is being fetched. */
+{
+struct httpStubShared *shared = stub->shared;
+shared->connections = shared->requests = shared->heads = 0;
+shared->bytes = 0;
+memset(shared->log, 0, sizeof(shared->log));
+}
+
+void httpStubStop(struct httpStub **pStub)
+/* Stop server and the processes serving its connections. */
+{
+struct httpStub *stub = *pStub;
+if (stub != NULL)
+    {
+    kill(-stub->pid, SIGTERM);
+    waitpid(stub->pid, NULL, 0);
+    if (stub->pid == runningPid)
+        runningPid = 0;
+    munmap(stub->shared, sizeof(*stub->shared));
+    freeMem(stub->fileName);
+    freeMem(stub->url);
+    freez(pStub);
+    }
+}
@@ -0,0 +1,80 @@
+/* httpStub - a small http server on the loopback interface that serves one
+ * file, for checking udc and the net code against.  It understands GET and
+ * HEAD with byte ranges, keep-alive and pipelined requests, and redirects
+ * urls of the form /redirect/N/file.  It can be made slow or flaky in
+ * various ways.  The server runs in a child process and forks a process for each
+ * connection.  Settings and statistics are kept in memory shared with those
+ * processes, so settings can be changed and statistics read while it runs. */
+
+#ifndef HTTPSTUB_H
+#define HTTPSTUB_H
+
+#define HTTP_STUB_MAX_LOG 20000
+/* Requests beyond this many aren't logged, though they are still counted. */
+
+struct httpStubRequest
+/* Record of one request. */
+    {
+    int connIx;			/* Connection request came on, counting from 0. */
+    boolean isHead;		/* Set for a HEAD request. */
+    long long start;		/* Start of byte range asked for, -1 if none. */
+    long long end;		/* End (exclusive) of byte range, -1 if open ended or none. */
+    long long sent;		/* Bytes of body sent so far. */
+    boolean finished;		/* Set when whole body has been sent. */
+    };
+
+struct httpStubShared
+/* Settings and statistics shared with the server processes. */
+    {
+    /* Settings. */
+    int latencyMs;		/* Milliseconds to wait before each response. */
+    long long rate;		/* Bytes per second on each connection, 0 for no limit. */
+    boolean rateVaries;		/* If set connections get from a quarter to all of rate in turn. */
+    boolean paused;		/* While set no body data is sent. */
+    boolean http10;		/* Answer as HTTP/1.0, without Content-Length, and close. */
+    boolean chunked;		/* Send bodies with chunked transfer encoding. */
+    int keepAliveMax;		/* If non-zero close connection, unanswered, on request after this many. */
+    int errorEvery;		/* If non-zero answer every nth request with 503. */
+    int stallEvery;		/* If non-zero stop half way through every nth response. */
+    int cutEvery;		/* If non-zero close connection half way through every nth response. */
+
+    /* Statistics. */
+    int connections;		/* Connections accepted. */
+    int requests;		/* Requests of all sorts. */
+    int heads;			/* HEAD requests. */
+    long long bytes;		/* Body bytes sent. */
+    struct httpStubRequest log[HTTP_STUB_MAX_LOG];	/* First requests. */
+    };
+
+struct httpStub
+/* A running server. */
+    {
+    char *fileName;		/* File being served. */
+    char *url;			/* Url of file on server. */
+    int port;			/* Port server is listening on. */
+    int pid;			/* Process id of server. */
+    struct httpStubShared *shared;	/* Settings and statistics. */
+    };
+
+struct httpStub *httpStubStart(char *fileName);
+/* Start serving fileName on a free loopback port.  Call this before starting
+ * any threads, since the server is forked off.  The server is stopped at
+ * exit if httpStubStop hasn't been called, as when a check fails. */
+
+char *httpStubRedirectUrl(struct httpStub *stub, int hops);
+/* Return url that redirects hops times before getting to the file.  Free
+ * it when done. */
+
+int httpStubClosedPort();
+/* Return a loopback port that nothing is listening on. */
+
+void httpStubClearSettings(struct httpStub *stub);
+/* Go back to serving as fast as possible with no failures. */
+
+void httpStubClearStats(struct httpStub *stub);
+/* Zero out statistics.  Only call when nothing is being fetched. */
+
+void httpStubStop(struct httpStub **pStub);
+/* Stop server and the processes serving its connections. */
+
+#endif /* HTTPSTUB_H */
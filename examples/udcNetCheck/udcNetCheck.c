@@ -0,0 +1,750 @@
+/* udcNetCheck - check udc and netAsync against a local http server. */
+#include "common.h"
+#include "options.h"
+#include "portable.h"
+#include "bits.h"
+#include "pthreadWrap.h"
+#include "udc.h"
+#include "netAsync.h"
+#include "httpStub.h"
+
+#define DEFAULT_SIZE (48*1024*1024)
+#define DEFAULT_READ_SIZE (64*1024)
+#define DEFAULT_LATENCY 20
+#define DEFAULT_READ_DELAY 1
+#define DEFAULT_RATE (16*1024*1024)
+
+void usage()
+/* Explain usage and exit. */
+{
+  errAbort(
+      "udcNetCheck - check udc and netAsync against a local http server\n"
+      "usage:\n"
+      "   udcNetCheck check tmpDir\n"
+      "Makes a file of random bytes in tmpDir, serves it from a small http\n"
+      "server on the loopback interface, and reads it through udc with the\n"
+      "cache in tmpDir, or with netAsync.  Everything read is checked against\n"
+      "the file, and so is everything the cache says it has.  Check is one of:\n"
+      "   readAhead - read sequentially with and without read-ahead, checking\n"
+      "          the number of requests and that data is fetched further and\n"
+      "          further ahead up to the limit, then close a handle while it\n"
+      "          is fetching ahead and read everything again\n"
+      "   parallel - make holes in the cache then fill them in from several\n"
+      "          connections of different speeds, checking that blocks are\n"
+      "          written out of order and the bitmap never claims a block\n"
+      "          before its data is written\n"
+      "   netAsync - fetch ranges with netAsync while the server answers as\n"
+      "          HTTP/1.0, drops kept-alive connections, sends chunked bodies,\n"
+      "          fails with 503, stalls and cuts off responses, redirects, or\n"
+      "          isn't there at all\n"
+      "options:\n"
+      "   -size=N - size of file, default %d\n"
+      "   -readSize=N - size of each read, default %d\n"
+      "   -aheadMax=N - read-ahead limit, default %d\n"
+      "   -latency=N - milliseconds server waits before each response, default %d\n"
+      "   -readDelay=N - milliseconds to wait between sequential reads, default %d\n"
+      "   -rate=N - bytes per second per connection when closing while fetching\n"
+      "          ahead, and most per connection when fetching in parallel, default %d\n"
+      "   -threads=N - connections to fetch on in parallel, default %d\n"
+      "   -seed=N - random number seed, default 0\n",
+      DEFAULT_SIZE, DEFAULT_READ_SIZE, UDC_READ_AHEAD_DEFAULT_MAX, DEFAULT_LATENCY,
+      DEFAULT_READ_DELAY, DEFAULT_RATE, UDC_FETCH_THREADS_DEFAULT
+  );
+}
+
+static struct optionSpec options[] = {
+    {"size", OPTION_INT},
+    {"readSize", OPTION_INT},
+    {"aheadMax", OPTION_INT},
+    {"latency", OPTION_INT},
+    {"readDelay", OPTION_INT},
+    {"rate", OPTION_INT},
+    {"threads", OPTION_INT},
+    {"seed", OPTION_INT},
+    {NULL, 0},
+};
+
+static char *source;		/* Contents of file being served. */
+static bits64 sourceSize;	/* Size of source. */
+
+static char *makeSource(char *tmpDir, bits64 size)
+/* Fill in source with random bytes, write it to a file in tmpDir, and
+ * return the file name. */
+{
+char fileName[PATH_LEN];
+safef(fileName, sizeof(fileName), "%s/udcNetCheck.dat", tmpDir);
+sourceSize = size;
+source = needHugeMem(size);
+bits64 i;
+for (i=0; i<size; ++i)
+    source[i] = random();
+FILE *f = mustOpen(fileName, "wb");
+mustWrite(f, source, size);
+carefulClose(&f);
+return cloneString(fileName);
+}
+
+static char *freshCacheDir(char *tmpDir, char *name)
+/* Return name of an empty cache directory in tmpDir. */
+{
+char dir[PATH_LEN], cmd[2*PATH_LEN];
+safef(dir, sizeof(dir), "%s/udcNetCheck.%s", tmpDir, name);
+safef(cmd, sizeof(cmd), "rm -rf %s", dir);
+mustSystem(cmd);
+makeDirsOnPath(dir);
+return cloneString(dir);
+}
+
+struct cacheView
+/* The files udc keeps a url's cache in. */
+    {
+    char *bitmapName;		/* Bitmap of blocks in cache. */
+    char *sparseName;		/* Cached data. */
+    };
+
+static struct cacheView *cacheViewNew(char *url, char *cacheDir)
+/* Find cache files for url. */
+{
+struct slName *list = udcFileCacheFiles(url, cacheDir);
+struct cacheView *cv;
+AllocVar(cv);
+struct slName *el;
+for (el = list; el != NULL; el = el->next)
+    {
+    if (endsWith(el->name, "/bitmap"))
+        cv->bitmapName = cloneString(el->name);
+    else if (endsWith(el->name, "/sparseData"))
+        cv->sparseName = cloneString(el->name);
+    }
+if (cv->bitmapName == NULL || cv->sparseName == NULL)
+    errAbort("Can't find cache files for %s in %s", url, cacheDir);
+slFreeList(&list);
+return cv;
+}
+
+static void cacheViewFree(struct cacheView **pCv)
+/* Free up cacheView. */
+{
+struct cacheView *cv = *pCv;
+if (cv != NULL)
+    {
+    freeMem(cv->bitmapName);
+    freeMem(cv->sparseName);
+    freez(pCv);
+    }
+}
+
+#define bitmapHeaderSize 64	/* Size of header before bits in bitmap file. */
+
+static Bits *cacheBits(struct cacheView *cv, bits32 *retBlockSize, int *retBlockCount)
+/* Read in bits of cache bitmap.  Blocks past the end of the bitmap file,
+ * which udc hasn't written yet, come back clear. */
+{
+int blockSize = 0;
+int fd = mustOpenFd(cv->bitmapName, O_RDONLY);
+if (pread(fd, &blockSize, sizeof(blockSize), sizeof(bits32)) != sizeof(blockSize)
+    || blockSize <= 0)
+    errAbort("Can't read block size from %s", cv->bitmapName);
+int blockCount = (sourceSize + blockSize - 1) / blockSize;
+Bits *b = bitAlloc(blockCount);
+int gotSize = pread(fd, b, bitToByteSize(blockCount), bitmapHeaderSize);
+if (gotSize < 0)
+    errnoAbort("Can't read %s", cv->bitmapName);
+mustCloseFd(&fd);
+*retBlockSize = blockSize;
+*retBlockCount = blockCount;
+return b;
+}
+
+static bits64 cachedEnd(struct cacheView *cv, bits64 start)
+/* Return end of data cached without a break from start. */
+{
+bits32 blockSize;
+int blockCount;
+Bits *b = cacheBits(cv, &blockSize, &blockCount);
+int endBlock = bitFindClear(b, start/blockSize, blockCount);
+bitFree(&b);
+bits64 end = (bits64)endBlock * blockSize;
+return max(start, min(end, sourceSize));
+}
+
+static int checkCache(struct cacheView *cv)
+/* Check that every block the bitmap says is cached matches source, and
+ * return the number of blocks cached. */
+{
+bits32 blockSize;
+int blockCount;
+Bits *b = cacheBits(cv, &blockSize, &blockCount);
+char *buf = needMem(blockSize);
+int fd = mustOpenFd(cv->sparseName, O_RDONLY);
+int i, cachedCount = 0;
+for (i=0; i<blockCount; ++i)
+    {
+    if (bitReadOne(b, i))
+        {
+	bits64 start = (bits64)i * blockSize;
+	int size = min(blockSize, sourceSize - start);
+	if (pread(fd, buf, size, start) != size || memcmp(buf, source + start, size) != 0)
+	    errAbort("Block %d at %llu is marked as cached in %s but its data is wrong",
+		    i, start, cv->bitmapName);
+	++cachedCount;
+	}
+    }
+mustCloseFd(&fd);
+freeMem(buf);
+bitFree(&b);
+return cachedCount;
+}
+
+static void checkRead(struct udcFile *udc, bits64 start, bits64 size, char *buf)
+/* Read size bytes from start and check them against source. */
+{
+udcSeek(udc, start);
+bits64 gotSize = udcRead(udc, buf, size);
+if (gotSize != size)
+    errAbort("Got %llu bytes reading %llu at %llu", gotSize, size, start);
+if (memcmp(buf, source + start, size) != 0)
+    errAbort("Wrong data reading %llu bytes at %llu", size, start);
+}
+
+struct seqReadStats
+/* What happened during a sequential read. */
+    {
+    long millis;		/* Time taken. */
+    bits64 firstAhead;		/* Data cached ahead after the first sequential read. */
+    bits64 maxAhead;		/* Most data seen cached ahead of read. */
+    bits64 firstFull;		/* Read position when maxAhead first reached aheadMax. */
+    bits32 blockSize;		/* Size of cache blocks. */
+    };
+
+static void readSequential(char *url, char *cacheDir, int readSize, int readDelay,
+	bits64 aheadMax, struct seqReadStats *stats)
+/* Read all of url in pieces of readSize, checking data and how far ahead of
+ * the reader the cache extends. */
+{
+long startTime = clock1000();
+ZeroVar(stats);
+struct udcFile *udc = udcFileOpen(url, cacheDir);
+struct cacheView *cv = cacheViewNew(url, cacheDir);
+char *buf = needLargeMem(readSize);
+int blockCount;
+Bits *b = cacheBits(cv, &stats->blockSize, &blockCount);
+bitFree(&b);
+bits64 pos;
+for (pos = 0; pos < sourceSize; pos += readSize)
+    {
+    bits64 size = min(readSize, sourceSize - pos);
+    checkRead(udc, pos, size, buf);
+    if (readDelay > 0)
+	sleep1000(readDelay);
+    bits64 ahead = cachedEnd(cv, pos + size) - (pos + size);
+    if (pos == readSize)
+        stats->firstAhead = ahead;
+    if (ahead > stats->maxAhead)
+        {
+	verbose(2, "%llu cached ahead at %llu\n", ahead, pos + size);
+	stats->maxAhead = ahead;
+	if (aheadMax > 0 && ahead >= aheadMax && stats->firstFull == 0)
+	    stats->firstFull = pos + size;
+	}
+    }
+udcFileClose(&udc);
+freeMem(buf);
+checkCache(cv);
+cacheViewFree(&cv);
+stats->millis = clock1000() - startTime;
+}
+
+static int getCount(struct httpStub *stub)
+/* Return number of GET requests server has had. */
+{
+return stub->shared->requests - stub->shared->heads;
+}
+
+static void *closeThread(void *v)
+/* Close udcFile. */
+{
+struct udcFile **pUdc = v;
+udcFileClose(pUdc);
+return NULL;
+}
+
+static void checkCloseWhileAhead(struct httpStub *stub, char *tmpDir, bits64 aheadMax,
+	int readSize)
+/* Read until read-ahead windows are full size, stop the server sending, and
+ * close the handle while the next window is arriving.  Everything cached must
+ * be right, and reading it all again must work. */
+{
+char *url = stub->url;
+stub->shared->rate = optionInt("rate", DEFAULT_RATE);
+udcSetReadAheadMax(aheadMax);
+char *cacheDir = freshCacheDir(tmpDir, "close");
+struct udcFile *udc = udcFileOpen(url, cacheDir);
+struct cacheView *cv = cacheViewNew(url, cacheDir);
+char *buf = needLargeMem(aheadMax);
+bits64 pos;
+for (pos = 0; pos < 2*aheadMax; pos += readSize)
+    checkRead(udc, pos, readSize, buf);
+
+/* Closing waits for the piece of window being fetched, so while the server
+ * is paused it can only finish if nothing is being fetched. */
+stub->shared->paused = TRUE;
+sleep1000(100);
+pthread_t thread;
+pthreadCreate(&thread, NULL, closeThread, &udc);
+sleep1000(200);
+boolean inFlight = (udc != NULL);
+bits64 ahead = cachedEnd(cv, pos) - pos;
+int cachedCount = checkCache(cv);
+stub->shared->paused = FALSE;
+pthreadJoin(thread);
+if (!inFlight)
+    warn("Nothing was being fetched ahead at close, try a lower -rate");
+verbose(1, "Closed %s fetch ahead with %llu cached ahead, %d blocks cached\n",
+	(inFlight ? "during" : "after"), ahead, cachedCount);
+cachedCount = checkCache(cv);
+verbose(1, "%d blocks cached once closed\n", cachedCount);
+
+stub->shared->rate = 0;
+udc = udcFileOpen(url, cacheDir);
+int i;
+for (i=0; i<200; ++i)
+    {
+    bits64 size = 1 + random() % aheadMax;
+    bits64 start = ((bits64)random() * RAND_MAX + random()) % (sourceSize - size);
+    checkRead(udc, start, size, buf);
+    }
+for (pos = 0; pos < sourceSize; pos += readSize)
+    checkRead(udc, pos, min(readSize, sourceSize - pos), buf);
+udcFileClose(&udc);
+cachedCount = checkCache(cv);
+verbose(1, "Read everything again after closing, %d blocks cached\n", cachedCount);
+cacheViewFree(&cv);
+freeMem(buf);
+}
+
+static void checkReadAhead(struct httpStub *stub, char *tmpDir)
+/* Check sequential reads with and without read-ahead, and closing a handle
+ * while it's fetching ahead. */
+{
+char *url = stub->url;
+int readSize = optionInt("readSize", DEFAULT_READ_SIZE);
+int readDelay = optionInt("readDelay", DEFAULT_READ_DELAY);
+bits64 aheadMax = optionInt("aheadMax", UDC_READ_AHEAD_DEFAULT_MAX);
+if (aheadMax < 4*readSize || aheadMax * 3 > sourceSize)
+    errAbort("aheadMax must be at least 4 times readSize and under a third of size");
+udcSetFetchThreads(1);
+stub->shared->latencyMs = optionInt("latency", DEFAULT_LATENCY);
+
+/* Without read-ahead each read is a request. */
+struct seqReadStats off, on;
+udcSetReadAheadMax(0);
+httpStubClearStats(stub);
+readSequential(url, freshCacheDir(tmpDir, "off"), readSize, readDelay, 0, &off);
+int offGets = getCount(stub);
+verbose(1, "Without read-ahead: %d requests, %d connections, %llu most cached ahead, %ld ms\n",
+	offGets, stub->shared->connections, off.maxAhead, off.millis);
+if (stub->shared->heads != 1)
+    errAbort("Expected 1 HEAD request, got %d", stub->shared->heads);
+if (off.maxAhead > 0)
+    errAbort("Data was fetched ahead with read-ahead off");
+
+/* With it, data is streamed ahead in windows that start small and double
+ * up to the limit, and the window in flight can be up to a window past the
+ * one being read.  Each window's end is rounded up to a cache block.  Try the limit given and a smaller one. */
+bits64 limit;
+for (limit = aheadMax; limit >= aheadMax/4; limit /= 4)
+    {
+    udcSetReadAheadMax(limit);
+    httpStubClearStats(stub);
+    char name[64];
+    safef(name, sizeof(name), "on%llu", limit);
+    readSequential(url, freshCacheDir(tmpDir, name), readSize, readDelay, limit, &on);
+    int onGets = getCount(stub);
+    verbose(1, "With read-ahead up to %llu: %d requests, %d connections, %llu cached ahead "
+	    "at start, %llu most, first full window at %llu, %ld ms\n",
+	    limit, onGets, stub->shared->connections, on.firstAhead, on.maxAhead,
+	    on.firstFull, on.millis);
+    if (stub->shared->heads != 1)
+	errAbort("Expected 1 HEAD request, got %d", stub->shared->heads);
+    bits64 windows = sourceSize / limit + 10;
+    if (onGets > windows)
+	errAbort("Read-ahead made %d requests, expected no more than %llu", onGets, windows);
+    if (onGets * 4 > offGets)
+	errAbort("Read-ahead made %d requests, not many fewer than %d without it",
+		onGets, offGets);
+    if (on.firstAhead > min(limit, 4*readSize + 1024*1024))
+	errAbort("Read-ahead started with %llu cached ahead, window didn't start small",
+		on.firstAhead);
+    if (on.maxAhead < limit)
+	errAbort("Window never grew to %llu, most cached ahead was %llu", limit, on.maxAhead);
+    if (on.maxAhead > 2*(limit + on.blockSize))
+	errAbort("%llu cached ahead, more than twice the %llu limit", on.maxAhead, limit);
+    }
+
+checkCloseWhileAhead(stub, tmpDir, aheadMax, readSize);
+}
+
+struct cacheWatch
+/* Watches a cache being filled from another thread. */
+    {
+    struct cacheView *cv;	/* Cache files. */
+    boolean done;		/* Set when watcher should stop. */
+    int *seenAt;		/* Poll each block's data was first seen at, -1 if cached at start. */
+    int blockCount;		/* Number of blocks. */
+    bits32 blockSize;		/* Size of each block. */
+    int polls;			/* Number of times cache was looked at. */
+    };
+
+static void cacheWatchPoll(struct cacheWatch *cw)
+/* Look for blocks that have arrived in the sparse file, and make sure that
+ * every block the bitmap claims has arrived.  The bitmap is read first, so
+ * any bit in it must be for data that was already written. */
+{
+bits32 blockSize;
+int blockCount;
+Bits *b = cacheBits(cw->cv, &blockSize, &blockCount);
+char *buf = needMem(blockSize);
+int fd = mustOpenFd(cw->cv->sparseName, O_RDONLY);
+int i;
+cw->polls += 1;
+for (i=0; i<blockCount; ++i)
+    {
+    if (cw->seenAt[i] == 0)
+        {
+	bits64 start = (bits64)i * blockSize;
+	int size = min(blockSize, sourceSize - start);
+	if (pread(fd, buf, size, start) == size && memcmp(buf, source + start, size) == 0)
+	    cw->seenAt[i] = cw->polls;
+	else if (bitReadOne(b, i))
+	    errAbort("Bitmap claims block %d at %llu before its data is written", i, start);
+	}
+    }
+mustCloseFd(&fd);
+freeMem(buf);
+bitFree(&b);
+}
+
+static void *cacheWatchThread(void *v)
+/* Poll cache until told to stop. */
+{
+struct cacheWatch *cw = v;
+while (!cw->done)
+    {
+    cacheWatchPoll(cw);
+    sleep1000(5);
+    }
+cacheWatchPoll(cw);
+return NULL;
+}
+
+static int countOutOfOrder(struct cacheWatch *cw)
+/* Return number of blocks that arrived before some block earlier in file. */
+{
+int i, maxSeen = 0, count = 0;
+for (i=0; i<cw->blockCount; ++i)
+    {
+    int seen = cw->seenAt[i];
+    if (seen > 0)
+        {
+	if (seen < maxSeen)
+	    ++count;
+	maxSeen = max(maxSeen, seen);
+	}
+    }
+return count;
+}
+
+static void checkParallel(struct httpStub *stub, char *tmpDir)
+/* Fill a cache with holes in it in parallel from connections of different
+ * speeds, while watching the cache from another thread. */
+{
+char *url = stub->url;
+int threads = optionInt("threads", UDC_FETCH_THREADS_DEFAULT);
+if (threads < 2)
+    errAbort("threads must be at least 2");
+udcSetFetchThreads(threads);
+udcSetReadAheadMax(0);
+stub->shared->rate = optionInt("rate", DEFAULT_RATE);
+stub->shared->rateVaries = TRUE;
+char *cacheDir = freshCacheDir(tmpDir, "parallel");
+struct udcFile *udc = udcFileOpen(url, cacheDir);
+struct cacheView *cv = cacheViewNew(url, cacheDir);
+
+/* Make some holes. */
+char *buf = needHugeMem(sourceSize);
+int i;
+for (i=0; i<50; ++i)
+    {
+    bits64 size = 1 + random() % (64*1024);
+    bits64 start = ((bits64)random() * RAND_MAX + random()) % (sourceSize - size);
+    checkRead(udc, start, size, buf);
+    }
+int startCount = checkCache(cv);
+
+/* Fill in the rest with one big read while watching. */
+struct cacheWatch cw;
+ZeroVar(&cw);
+cw.cv = cv;
+Bits *b = cacheBits(cv, &cw.blockSize, &cw.blockCount);
+AllocArray(cw.seenAt, cw.blockCount);
+for (i=0; i<cw.blockCount; ++i)
+    if (bitReadOne(b, i))
+        cw.seenAt[i] = -1;
+bitFree(&b);
+httpStubClearStats(stub);
+pthread_t thread;
+pthreadCreate(&thread, NULL, cacheWatchThread, &cw);
+long startTime = clock1000();
+checkRead(udc, 0, sourceSize, buf);
+long millis = clock1000() - startTime;
+cw.done = TRUE;
+pthreadJoin(thread);
+udcFileClose(&udc);
+int outOfOrder = countOutOfOrder(&cw);
+int endCount = checkCache(cv);
+verbose(1, "Filled %d blocks around %d cached ones in %ld ms on %d connections, "
+	"%d requests, %d blocks written before earlier ones, cache polled %d times\n",
+	endCount - startCount, startCount, millis, stub->shared->connections,
+	getCount(stub), outOfOrder, cw.polls);
+if (endCount != cw.blockCount)
+    errAbort("Only %d of %d blocks cached after reading everything", endCount, cw.blockCount);
+for (i=0; i<cw.blockCount; ++i)
+    if (cw.seenAt[i] == 0)
+        errAbort("Block %d never arrived", i);
+if (stub->shared->connections < threads)
+    errAbort("Only %d connections used, expected %d", stub->shared->connections, threads);
+if (outOfOrder == 0)
+    errAbort("Blocks all arrived in order, try a lower -rate");
+
+/* The sparse file must now be the same as the source. */
+int fd = mustOpenFd(cv->sparseName, O_RDONLY);
+if (pread(fd, buf, sourceSize, 0) != sourceSize || memcmp(buf, source, sourceSize) != 0)
+    errAbort("%s differs from source", cv->sparseName);
+mustCloseFd(&fd);
+freeMem(cw.seenAt);
+cacheViewFree(&cv);
+freeMem(buf);
+}
+
+struct asyncCheck
+/* A netAsync request and what came back. */
+    {
+    long long start, size;	/* Range asked for, start is -1 for whole file. */
+    boolean done;		/* Set when callback has been called. */
+    int status;			/* Status that came back. */
+    char *error;		/* Error that came back. */
+    int tries;			/* Number of tries. */
+    boolean dataOk;		/* Set if body matched source. */
+    };
+
+static void asyncCheckDone(struct netAsyncResult *result, void *context)
+/* Record result and check body against source. */
+{
+struct asyncCheck *ac = context;
+if (ac->done)
+    errAbort("Callback called twice for %lld bytes at %lld", ac->size, ac->start);
+ac->done = TRUE;
+ac->status = result->status;
+ac->error = cloneString(result->error);
+ac->tries = result->tries;
+if (result->status == 200 || result->status == 206)
+    {
+    long long start = max(ac->start, 0);
+    long long size = (ac->start < 0 ? sourceSize : min(ac->size, sourceSize - start));
+    ac->dataOk = (result->body->stringSize == size
+	&& memcmp(result->body->string, source + start, size) == 0);
+    }
+}
+
+struct asyncCase
+/* A run of netAsync requests against the server set up some way. */
+    {
+    char *name;			/* What's being checked. */
+    int count;			/* Number of ranges to fetch. */
+    boolean wholeFile;		/* Fetch whole file too? */
+    int timeoutMs, retries;	/* Passed to netAsyncNew. */
+    int expectStatus;		/* Status every request should end with, 0 for a good range,
+				 * -1 for no response. */
+    int requestsEach;		/* Requests server should see for each try, 0 if any. */
+    boolean expectRetries;	/* Should some requests need more than one try? */
+    };
+
+static void runAsyncCase(struct httpStub *stub, char *url, struct asyncCase *ac)
+/* Fetch ranges of url with netAsync and check results. */
+{
+httpStubClearStats(stub);
+int count = ac->count + (ac->wholeFile ? 1 : 0);
+struct asyncCheck *checks;
+AllocArray(checks, count);
+struct netAsync *na = netAsyncNew(0, 4, ac->timeoutMs, ac->retries);
+int i;
+for (i=0; i<count; ++i)
+    {
+    struct asyncCheck *check = &checks[i];
+    if (i == ac->count)
+	check->start = -1;
+    else
+        {
+	check->size = 1 + random() % (256*1024);
+	check->start = ((bits64)random() * RAND_MAX + random()) % (sourceSize - check->size);
+	}
+    netAsyncAdd(na, url, check->start, check->size, asyncCheckDone, check);
+    }
+long startTime = clock1000();
+netAsyncRun(na);
+long millis = clock1000() - startTime;
+netAsyncFree(&na);
+
+int tries = 0, retried = 0;
+for (i=0; i<count; ++i)
+    {
+    struct asyncCheck *check = &checks[i];
+    if (!check->done)
+        errAbort("%s: request %d never finished", ac->name, i);
+    if (ac->expectStatus == 0)
+        {
+	int goodStatus = (check->start < 0 ? 200 : 206);
+	if (check->status != goodStatus || !check->dataOk)
+	    errAbort("%s: got status %d%s%s for %lld bytes at %lld after %d tries",
+		    ac->name, check->status, (check->error ? ", " : ""),
+		    (check->error ? check->error : (check->status == goodStatus ? ", bad data" : "")),
+		    check->size, check->start, check->tries);
+	}
+    else if (check->status != max(ac->expectStatus, 0))
+	errAbort("%s: expected status %d, got %d%s%s", ac->name, max(ac->expectStatus, 0),
+		check->status, (check->error ? ", " : ""), (check->error ? check->error : ""));
+    else if (ac->expectStatus < 0 && (check->error == NULL || check->tries != ac->retries + 1))
+        errAbort("%s: expected an error after %d tries, got %s after %d", ac->name,
+		ac->retries + 1, naForNull(check->error), check->tries);
+    tries += check->tries;
+    if (check->tries > 1)
+        ++retried;
+    freeMem(check->error);
+    }
+verbose(1, "%s: %d requests in %ld ms, %d retried, %d tries, server saw %d requests on "
+	"%d connections\n", ac->name, count, millis, retried, tries, stub->shared->requests,
+	stub->shared->connections);
+if (ac->expectRetries && retried == 0)
+    errAbort("%s: nothing needed retrying", ac->name);
+if (!ac->expectRetries && ac->expectStatus >= 0 && retried > 0)
+    errAbort("%s: %d requests retried", ac->name, retried);
+if (ac->requestsEach > 0 && stub->shared->requests != tries * ac->requestsEach)
+    errAbort("%s: server saw %d requests, expected %d", ac->name, stub->shared->requests,
+	    tries * ac->requestsEach);
+freeMem(checks);
+}
+
+static void checkNetAsync(struct httpStub *stub, char *tmpDir)
+/* Fetch ranges with netAsync from a server misbehaving in various ways. */
+{
+struct httpStubShared *shared = stub->shared;
+char *url = stub->url;
+struct asyncCase ac;
+
+/* Plain keep-alive, where the connections should be reused. */
+httpStubClearSettings(stub);
+ac = (struct asyncCase){"keep-alive", 200, TRUE, 0, 0, 0, 1, FALSE};
+runAsyncCase(stub, url, &ac);
+if (shared->connections > 4)
+    errAbort("%s: %d connections for at most 4 at once", ac.name, shared->connections);
+
+/* HTTP/1.0 without Content-Length, body ends when connection closes. */
+httpStubClearSettings(stub);
+shared->http10 = TRUE;
+ac = (struct asyncCase){"HTTP/1.0", 100, TRUE, 0, 0, 0, 1, FALSE};
+runAsyncCase(stub, url, &ac);
+if (shared->connections != shared->requests)
+    errAbort("%s: %d connections for %d requests", ac.name, shared->connections,
+	    shared->requests);
+
+/* Server closes kept-alive connections when the next request comes.  These
+ * are sent again without counting as a try. */
+httpStubClearSettings(stub);
+shared->keepAliveMax = 2;
+ac = (struct asyncCase){"short keep-alive", 200, FALSE, 0, 0, 0, 1, FALSE};
+runAsyncCase(stub, url, &ac);
+
+httpStubClearSettings(stub);
+shared->chunked = TRUE;
+ac = (struct asyncCase){"chunked", 200, TRUE, 0, 0, 0, 1, FALSE};
+runAsyncCase(stub, url, &ac);
+
+/* Failures that are retried. */
+httpStubClearSettings(stub);
+shared->errorEvery = 3;
+ac = (struct asyncCase){"503 errors", 100, FALSE, 0, 10, 0, 1, TRUE};
+runAsyncCase(stub, url, &ac);
+
+httpStubClearSettings(stub);
+shared->stallEvery = 5;
+ac = (struct asyncCase){"stalls", 50, FALSE, 300, 10, 0, 1, TRUE};
+runAsyncCase(stub, url, &ac);
+
+httpStubClearSettings(stub);
+shared->cutEvery = 5;
+ac = (struct asyncCase){"cut connections", 100, FALSE, 0, 10, 0, 1, TRUE};
+runAsyncCase(stub, url, &ac);
+
+httpStubClearSettings(stub);
+shared->chunked = TRUE;
+shared->keepAliveMax = 3;
+shared->cutEvery = 7;
+shared->errorEvery = 11;
+shared->stallEvery = 13;
+ac = (struct asyncCase){"all of those", 200, TRUE, 300, 10, 0, 1, TRUE};
+runAsyncCase(stub, url, &ac);
+
+/* Redirects, which don't count as tries, up to the limit of 5. */
+httpStubClearSettings(stub);
+char *redirectUrl = httpStubRedirectUrl(stub, 3);
+ac = (struct asyncCase){"3 redirects", 50, FALSE, 0, 0, 0, 4, FALSE};
+runAsyncCase(stub, redirectUrl, &ac);
+freeMem(redirectUrl);
+redirectUrl = httpStubRedirectUrl(stub, 6);
+ac = (struct asyncCase){"6 redirects", 20, FALSE, 0, 0, 302, 6, FALSE};
+runAsyncCase(stub, redirectUrl, &ac);
+freeMem(redirectUrl);
+
+/* Errors that aren't retried. */
+char badUrl[1024];
+safef(badUrl, sizeof(badUrl), "%s.missing", url);
+ac = (struct asyncCase){"not found", 20, FALSE, 0, 0, 404, 1, FALSE};
+runAsyncCase(stub, badUrl, &ac);
+
+/* Nothing listening, which is retried then reported. */
+safef(badUrl, sizeof(badUrl), "http://127.0.0.1:%d/udcNetCheck.dat", httpStubClosedPort());
+ac = (struct asyncCase){"refused", 10, FALSE, 0, 2, -1, 0, FALSE};
+runAsyncCase(stub, badUrl, &ac);
+}
+
+void udcNetCheck(char *check, char *tmpDir)
+/* udcNetCheck - check udc and netAsync against a local http server. */
+{
+makeDirsOnPath(tmpDir);
+char *fileName = makeSource(tmpDir, optionInt("size", DEFAULT_SIZE));
+struct httpStub *stub = httpStubStart(fileName);
+verbose(2, "Serving %s as %s\n", fileName, stub->url);
+udcSetCacheTimeout(0);
+if (sameString(check, "readAhead"))
+    checkReadAhead(stub, tmpDir);
+else if (sameString(check, "parallel"))
+    checkParallel(stub, tmpDir);
+else if (sameString(check, "netAsync"))
+    checkNetAsync(stub, tmpDir);
+else
+    usage();
+httpStubStop(&stub);
+verbose(1, "%s check passed\n", check);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+optionInit(&argc, argv, options);
+if (argc != 3)
+    usage();
+srandom(optionInt("seed", 0));
+udcNetCheck(argv[1], argv[2]);
+return 0;
+}
@@ -244,6 +244,13 @@ struct axt *axtAffine2Level(bioSeq *query, bioSeq *target, struct axtScoreScheme
    
 */
 
+struct axt *axtAffineSimd(bioSeq *query, bioSeq *target, struct axtScoreScheme *ss);
+/* Return alignment if any of query and target using scoring scheme.  This
+ * gives the same alignment as axtAffine2Level, but computes several query
+ * positions at once with SIMD instructions where the compiler supports them.
+ * Scores are kept in 8 or 16 bits while they fit, which makes short
+ * alignments faster still.  Memory used is about 24*Q*sqrt(T) bytes. */
+
 void axtAddBlocksToBoxInList(struct cBlock **pList, struct axt *axt);
 /* Add blocks (gapless subalignments) from (non-NULL!) axt to block list. 
  * Note: list will be in reverse order of axt blocks. */
@@ -60,8 +60,16 @@ struct bptFile
     bits64 itemCount;		/* Number of items indexed. */
     boolean isSwapped;		/* If TRUE need to byte swap everything. */
     bits64 rootOffset;		/* Offset of root block. */
+    struct hash *nodeCache;	/* Decoded nodes keyed by offset, NULL until needed. */
+    struct dlList *nodeLru;	/* Cached nodes, most recently used first. */
+    int nodeCacheCount;		/* Number of nodes in cache. */
+    int nodeCacheMax;		/* Most nodes to cache. */
+    struct bptNode *uncachedNode;	/* Last node read when cache is off. */
     };
 
+#define BPT_NODE_CACHE_DEFAULT 256
+/* Default number of decoded nodes cached per bptFile. */
+
 struct bptFile *bptFileOpen(char *fileName);
 /* Open up index file - reading header and verifying things. */
 
@@ -84,6 +92,24 @@ boolean bptFileFind(struct bptFile *bpt, void *key, int keySize, void *val, int
 *     valSize - size of memory buffer that will hold val.  Should match bpt->valSize.
 */
 
+int bptFileFindMany(struct bptFile *bpt, int keyCount, void *keys, int keySize,
+	void *vals, int valSize, boolean *found);
+/* Find values associated with many keys at once, going down the tree just
+ * once for all of them.  Returns number of keys found.
+*  Parameters:
+*     bpt - file handle returned by bptFileOpen
+*     keyCount - number of keys
+*     keys - keyCount keys, each keySize bytes and zero padded, sorted by memcmp
+*     keySize - size of each key.  Must be no more than bpt->keySize
+*     vals - where to put values, room for keyCount of them
+*     valSize - size of each value.  Should match bpt->valSize.
+*     found - set to TRUE or FALSE for each key
+*/
+
+void bptFileSetNodeCacheSize(struct bptFile *bpt, int maxNodes);
+/* Set the number of decoded nodes kept in memory for bpt.  Zero turns the
+ * node cache off. */
+
 void bptFileTraverse(struct bptFile *bpt, void *context,
     void (*callback)(void *context, void *key, int keySize, void *val, int valSize) );
 /* Traverse bPlusTree on file, calling supplied callback function at each
@@ -108,6 +134,33 @@ void bptFileBulkIndexToOpenFile(void *itemArray, int itemSize, bits64 itemCount,
 /* Create a b+ tree index from a sorted array, writing output starting at current position
  * of an already open file.  See bptFileCreate for explanation of parameters. */
 
+struct bptBuilder;	/* Opaque handle, see bPlusTree.c */
+
+#define BPT_BUILDER_DEFAULT_MEM (512LL*1024*1024)
+/* Default memory bptBuilder uses for sorting. */
+
+struct bptBuilder *bptBuilderNew(bits32 blockSize, bits32 keySize, bits32 valSize,
+	char *tmpDir, bits64 maxMem);
+/* Start building a b+ tree from key/value pairs that can be added in any
+ * order.  Pairs are sorted in memory maxMem bytes at a time (zero for
+ * BPT_BUILDER_DEFAULT_MEM) and spilled to temporary files in tmpDir (NULL
+ * for $TMPDIR or /tmp). */
+
+void bptBuilderAdd(struct bptBuilder *bb, void *key, int keySize, void *val);
+/* Add a key/value pair.  Key is zero padded out to the builder's key size,
+ * and val is the builder's value size. */
+
+bits64 bptBuilderWriteToOpenFile(struct bptBuilder *bb, FILE *f);
+/* Sort and merge everything added, and write b+ tree starting at the
+ * current position of f, which needs to be seekable.  The format is the
+ * same as bptFileBulkIndexToOpenFile's.  Returns number of items. */
+
+void bptBuilderWrite(struct bptBuilder *bb, char *fileName);
+/* Sort and merge everything added, and write b+ tree to fileName. */
+
+void bptBuilderFree(struct bptBuilder **pBb);
+/* Free up builder and close its temporary files. */
+
 #define bptFileHeaderSize 32
 #define bptBlockHeaderSize 4
 
@@ -0,0 +1,74 @@
+/* blockGz - write gzip files using several threads.  Output is cut into
+ * blocks that are deflated independently by a pool of worker threads and
+ * then written out in order, each as a complete gzip member.  A file made
+ * of several concatenated members is a standard gzip file, so gzip -dc,
+ * zcat and zlib's gzread all read the result as a single stream.
+ *
+ * Optionally the members follow the BGZF conventions used by samtools and
+ * tabix - 64k blocks, a BC extra field holding the member size, and an
+ * empty member as end of file marker - so the output can be indexed. */
+
+#ifndef BLOCKGZ_H
+#define BLOCKGZ_H
+
+#define BLOCKGZ_DEFAULT_BLOCK_SIZE (1024*1024)
+/* Uncompressed bytes per gzip member.  Big enough that the extra member
+ * headers and the lost dictionary cost well under one percent. */
+
+#define BGZF_BLOCK_SIZE 0xff00
+/* Uncompressed bytes per BGZF member, as in samtools, leaving room for
+ * incompressible data to fit in the 64k BGZF limit. */
+
+#define BGZF_MAX_BLOCK_SIZE 0x10000
+/* Largest compressed BGZF member including header and trailer. */
+
+#define BGZF_HEADER_SIZE 18
+/* Size of gzip header with BGZF extra field. */
+
+struct blockGz;	/* Opaque handle, see blockGz.c */
+
+struct blockGz *blockGzOpen(char *fileName, int level, int threadCount);
+/* Open fileName for parallel gzip output at the given zlib compression
+ * level (-1 for zlib default).  If threadCount is 0 compression is done
+ * on the calling thread. fileName may be "stdout". */
+
+struct blockGz *blockGzOpenBgzf(char *fileName, int level, int threadCount);
+/* Like blockGzOpen, but write BGZF so the output can be indexed by
+ * samtools/tabix and read with random access. */
+
+struct blockGz *blockGzOpenFile(FILE *f, char *name, int level, int threadCount,
+	int blockSize, boolean bgzf);
+/* Like blockGzOpen, but on an already open FILE, and with control over the
+ * number of uncompressed bytes in each gzip member.  If bgzf is set the
+ * output is BGZF and blockSize may be at most BGZF_BLOCK_SIZE.  The FILE
+ * is not closed by blockGzClose. */
+
+void blockGzWrite(struct blockGz *bg, void *buf, size_t size);
+/* Add size bytes from buf to the output stream. */
+
+void blockGzPutc(struct blockGz *bg, char c);
+/* Add a single character to the output stream. */
+
+void blockGzPuts(struct blockGz *bg, char *s);
+/* Add a zero terminated string to the output stream. */
+
+void blockGzPrintf(struct blockGz *bg, char *format, ...)
+/* Format and add to output stream. */
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+;
+
+void blockGzWriteSeqWithBreaks(struct blockGz *bg, char *letters, int letterCount,
+	int maxPerLine);
+/* Write out letters with newlines every maxPerLine, like writeSeqWithBreaks. */
+
+void blockGzFlush(struct blockGz *bg);
+/* End the current block, and wait until everything written so far has
+ * been compressed and written out. */
+
+void blockGzClose(struct blockGz **pBg);
+/* Compress and write any remaining data, stop worker threads, close
+ * file and free up resources. */
+
+#endif /* BLOCKGZ_H */
@@ -0,0 +1,121 @@
+/* chainBin - binary indexed chain files.  These hold the same information
+ * as text chain files, but take about half the space, and can
+ * find the chains overlapping a target range without reading the whole
+ * file.  Use chainBinWrite or chainBinMake to create one, and
+ * chainBinRead to memory map it.  Chains come back as the usual struct
+ * chain, with the blocks decoded only on request.
+ *
+ * Chains are sorted by target and tStart.  The chains of each target
+ * double as an implicit binary interval tree: chain i is a node at the
+ * level given by the number of trailing one bits in i, and holds the
+ * biggest tEnd in its subtree, so searches can skip subtrees that end
+ * before the range.  Blocks are stored as variable length integers,
+ * giving the gap on each side before a block and then its size. */
+
+#ifndef CHAINBIN_H
+#define CHAINBIN_H
+
+#ifndef CHAIN_H
+#include "chain.h"
+#endif
+
+struct chainBinFileHeader
+/* Binary chain file header.  A chainBin file starts with this fixed 64 byte
+ * structure.  It is followed by the following sections, each padded with
+ * zeroes to an 8 byte boundary:
+ *    sequence name strings - zero terminated, targets and queries together.
+ *    sequence sizes (32 bits each)
+ *    targets - a struct chainBinTarget for each target with chains.
+ *    chains - a struct chainBinChain for each chain, sorted by target and tStart.
+ *    blocks - encoded blocks of all chains. */
+    {
+    bits32 magic;	 /* Always CHAINBIN_MAGIC */
+    bits16 majorVersion; /* This version changes when backward compatibility breaks. */
+    bits16 minorVersion; /* This version changes whenever a feature is added. */
+    bits64 size;	 /* Total size to memmap, including header. */
+    bits32 seqCount;	 /* Number of sequences. */
+    bits32 seqNamesSize; /* Size of names of all sequences, padded to 8 byte boundary. */
+    bits32 targetCount;	 /* Number of targets with chains. */
+    bits32 reserved32;	 /* Zero for now. */
+    bits64 chainCount;	 /* Number of chains. */
+    bits64 blocksSize;	 /* Size of encoded blocks, padded to 8 byte boundary. */
+    bits64 reserved[2];	 /* All zeroes for now. */
+    };
+
+struct chainBinTarget
+/* Where the chains of one target are. */
+    {
+    bits32 seqIx;	/* Index of target in sequence names. */
+    bits32 rootLevel;	/* Level of root of interval tree. */
+    bits64 firstChain;	/* Index of first chain. */
+    bits64 chainCount;	/* Number of chains. */
+    };
+
+struct chainBinChain
+/* A chain without its blocks. */
+    {
+    double score;	/* Total score for chain. */
+    bits64 blockOffset;	/* Offset of encoded blocks in blocks section. */
+    bits32 tSeqIx;	/* Index of target in sequence names. */
+    bits32 tStart, tEnd;	/* Range covered in target. */
+    bits32 maxEnd;	/* Biggest tEnd in this chain's subtree. */
+    bits32 qSeqIx;	/* Index of query in sequence names. */
+    bits32 qStart, qEnd;	/* Range covered in query. */
+    bits32 blockCount;	/* Number of blocks. */
+    bits32 id;		/* ID of chain in file. */
+    char qStrand;	/* Query strand. */
+    char pad[3];	/* Zero. */
+    };
+
+struct chainBin
+/* Binary chain file in memory. */
+    {
+    struct chainBin *next;
+    boolean isMapped;	/* True if memory mapped. */
+    struct chainBinFileHeader *header;	/* File header. */
+    char **seqNames;	/* Name of each sequence. */
+    bits32 *seqSizes;	/* Size of each sequence.  No deallocation required (in memmap) */
+    struct chainBinTarget *targets;	/* Targets, in order of their chains. */
+    struct chainBinChain *chains;	/* Chains sorted by target and tStart. */
+    UBYTE *blocks;	/* Encoded blocks. */
+    struct hash *targetHash;	/* Targets keyed by name. */
+    };
+
+void chainBinWrite(struct chain *chainList, char *fileName);
+/* Write chains to a binary chain file. */
+
+void chainBinMake(char *chainFile, char *chainBinFile);
+/* Convert a text chain file to a binary one.  Only the chain headers,
+ * not the blocks, are kept in memory while doing it.  The blocks go to
+ * a temporary file in $TMPDIR or /tmp. */
+
+struct chainBin *chainBinRead(char *fileName, boolean memoryMap);
+/* Read in a binary chain file.  Does this via memory mapping if you like,
+ * which lets processes share the file, and is faster for a few reads. */
+
+void chainBinFree(struct chainBin **pCb);
+/* Free up resources associated with binary chain file. */
+
+bits64 chainBinOverlaps(struct chainBin *cb, char *tName, int start, int end,
+	bits64 **retIxs);
+/* Find chains overlapping tName:start-end.  Returns how many there are, and
+ * puts their indexes in cb->chains, in order of tStart, in *retIxs, which
+ * should be freeMem'd when done.  *RetIxs is NULL if there are none. */
+
+struct chain *chainBinLoad(struct chainBin *cb, bits64 ix);
+/* Return chain at ix in cb->chains, without its blocks.  ChainFree when done. */
+
+void chainBinLoadBlocks(struct chainBin *cb, bits64 ix, struct chain *chain);
+/* Decode blocks of chain at ix in cb->chains into chain->blockList, which
+ * should be empty. */
+
+struct chain *chainBinLoadOverlapping(struct chainBin *cb, char *tName, int start, int end);
+/* Return list of chains, with blocks, overlapping tName:start-end, sorted
+ * by tStart. */
+
+/** Stuff to define chainBin files **/
+#define CHAINBIN_MAGIC 0x2C8B1E47	/* Magic number at start of chainBin file */
+#define CHAINBIN_MAJOR_VERSION 0
+#define CHAINBIN_MINOR_VERSION 0
+
+#endif /* CHAINBIN_H */
@@ -39,4 +39,31 @@ struct chain *chainBlocks(
  * the chains will need some cleanup at the end.  Use the chainConnect
  * module to help with this.  See hg/mouseStuff/axtChain for example usage. */
 
+struct chainBlockJob
+/* One set of blocks to chain with chainBlocksMany, typically all the blocks
+ * for a query/target pair on one strand. */
+    {
+    struct chainBlockJob *next;
+    char *qName;			/* Info on query sequence */
+    int qSize;
+    char qStrand;
+    char *tName;			/* Info on target. */
+    int tSize;
+    struct cBlock *blockList;		/* Unordered ungapped alignments.  Eaten up. */
+    ConnectCost connectCost;		/* Calculate cost to connect nodes. */
+    GapCost gapCost;			/* Cost for non-overlapping nodes. */
+    void *gapData;			/* Passed through to connect/gapCosts */
+    struct chain *chainList;		/* Resulting chains, sorted by score. */
+    int blockCount;			/* Used internally for scheduling. */
+    };
+
+void chainBlocksMany(struct chainBlockJob *jobList, int threadCount);
+/* Run chainBlocks on each job, putting the chains in job->chainList.
+ * Jobs are spread over threadCount threads, biggest first, each thread
+ * with its own scratch memory.  The chains are the same as from calling
+ * chainBlocks on each job in turn.  Chain ids are left zero, so writing the
+ * chains out in job order on the calling thread numbers them as the serial
+ * path would.  The cost functions must be safe to call from several
+ * threads at once, as chainConnectCost and gapCalcCost are. */
+
 #endif /* CHAINBLOCK_H */
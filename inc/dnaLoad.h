@@ -31,6 +31,16 @@ int dnaLoadCurSize(struct dnaLoad *dl);
 void dnaLoadClose(struct dnaLoad **pDl);
 /* Free up resources associated with dnaLoad. */
 
+long long dnaLoadSeqSize(struct dnaLoad *dl, char *seqName);
+/* Return size of named sequence in a .2bit or fasta file opened with
+ * dnaLoadOpen.  Aborts if the sequence isn't there. */
+
+struct dnaSeq *dnaLoadFetch(struct dnaLoad *dl, char *seqName, int start, int end);
+/* Return part of named sequence from a .2bit or fasta file opened with
+ * dnaLoadOpen, reading only what is needed.  Fasta files are indexed with
+ * a .fai file, which is built if need be.  If end is 0 fetch to the end of
+ * the sequence.  DNA is mixed case.  This is independent of dnaLoadNext. */
+
 struct dnaSeq *dnaLoadAll(char *fileName);
 /* Return list of all DNA referenced in file.  File
  * can be either a single fasta file, a single .2bit
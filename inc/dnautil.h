@@ -232,6 +232,28 @@ int  dnaOrAaScoreMatch(char *a, char *b, int size, int matchScore, int mismatchS
 void writeSeqWithBreaks(FILE *f, char *letters, int letterCount, int maxPerLine);
 /* Write out letters with newlines every maxLine. */
 
+void writeSeqWithBreaksAt(FILE *f, char *letters, int letterCount, int maxPerLine,
+	int *pLineSize);
+/* Write out letters with newlines every maxPerLine, continuing a line that
+ * already has *pLineSize letters on it, and update *pLineSize.  This lets
+ * a wrapped sequence be written a piece at a time. */
+
+void writeCharWithBreaksAt(FILE *f, char c, int count, int maxPerLine, int *pLineSize);
+/* Write out count copies of c, wrapping lines like writeSeqWithBreaksAt. */
+
+int findNextN(DNA *dna, int start, int size);
+/* Return position of first N or n at or after start, or size if none. */
+
+int findNextNonN(DNA *dna, int start, int size);
+/* Return position of first base that isn't N or n at or after start, or
+ * size if none. */
+
+int findBlocksOfN(DNA *dna, int size, bits32 **retStarts, bits32 **retSizes);
+/* Find runs of N's (or n's) in dna, the same blocks a .2bit file stores
+ * as nBlocks.  Returns number of blocks and sets *retStarts and *retSizes
+ * to arrays of block starts and sizes in order, or to NULL if there are no
+ * blocks.  Free arrays with freeMem. */
+
 int tailPolyASizeLoose(DNA *dna, int size);
 /* Return size of PolyA at end (if present).  This allows a few non-A's as 
  * noise to be trimmed too, but skips first two aa for taa stop codon. 
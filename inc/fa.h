@@ -123,7 +123,81 @@ void faWrite(char *fileName, char *startLine, DNA *dna, int dnaSize);
 void faWriteNext(FILE *f, char *startLine, DNA *dna, int dnaSize);
 /* Write next sequence to fa file. */
 
+struct blockGz;
+void faWriteNextBlockGz(struct blockGz *bg, char *startLine, DNA *dna, int dnaSize);
+/* Write next sequence to a multi-threaded gzip fa stream. */
+
 void faWriteAll(char *fileName, bioSeq *seqList);
 /* Write out all sequences in list to file. */
 
+/* ------------- Random access through a samtools style .fai index. ------------- */
+
+#define FAI_CACHE_BLOCK_SIZE (64*1024)
+/* Bases of decoded sequence in each block of the fetch cache. */
+
+#define FAI_DEFAULT_CACHE_BLOCKS 64
+/* Default number of blocks kept in fetch cache. */
+
+struct faIndexEntry
+/* Location of a sequence in an indexed fasta file.  Same fields as
+ * a line of a samtools .fai file. */
+    {
+    struct faIndexEntry *next;	/* Next in list. */
+    char *name;			/* Sequence name. */
+    bits64 size;		/* Number of bases. */
+    bits64 offset;		/* Offset of first base in file. */
+    int lineBases;		/* Bases per full line. */
+    int lineBytes;		/* Bytes per full line including line ending. */
+    int ix;			/* Position in list. */
+    };
+
+struct faIndex
+/* An open fasta file with an index for random access. */
+    {
+    struct faIndex *next;	/* Next in list. */
+    char *fileName;		/* Name of fasta file. */
+    int fd;			/* Open fasta file. */
+    struct faIndexEntry *entryList;	/* Sequences in file order. */
+    struct hash *hash;		/* faIndexEntry values keyed by name. */
+    struct dlList *cacheList;	/* Cached blocks, most recently used at head. */
+    struct hash *cacheHash;	/* dlNodes of cached blocks keyed by entry and block. */
+    int cacheCount;		/* Number of blocks in cache. */
+    int cacheMax;		/* Maximum number of blocks in cache. */
+    long long cacheHits, cacheMisses;	/* Cache statistics. */
+    };
+
+boolean faIndexBuild(char *faName, char *faiName);
+/* Scan fasta file faName and write a samtools compatible index to faiName.
+ * Aborts if the file can't be indexed because line lengths vary within a
+ * sequence.  Returns FALSE without aborting if faiName can't be written. */
+
+struct faIndex *faIndexOpen(char *faName);
+/* Open fasta file for random access.  Reads faName.fai, first building
+ * it if it is missing or older than faName.  If the index can't be
+ * written it is kept in memory only. */
+
+void faIndexClose(struct faIndex **pFai);
+/* Close file and free up index and cache. */
+
+void faIndexSetCacheSize(struct faIndex *fai, int blockCount);
+/* Set maximum number of FAI_CACHE_BLOCK_SIZE blocks kept in fetch cache. */
+
+struct faIndexEntry *faIndexFind(struct faIndex *fai, char *seqName);
+/* Return index entry for sequence, or NULL if not in file. */
+
+long long faIndexSeqSize(struct faIndex *fai, char *seqName);
+/* Return size of sequence.  Aborts if sequence not in file. */
+
+void faIndexFetch(struct faIndex *fai, struct faIndexEntry *entry,
+	bits64 start, bits64 end, DNA *dna);
+/* Copy bases start to end of entry into dna, which must have room for
+ * end-start bases.  Case is as in file.  No zero terminator is added. */
+
+struct dnaSeq *faIndexReadSeqFrag(struct faIndex *fai, char *seqName, int start, int end);
+/* Read part of a sequence, like twoBitReadSeqFrag.  If end is 0 read to
+ * end of sequence.  Case is as in file.  Free with freeDnaSeq. */
+
+boolean faIsIndexable(char *fileName);
+/* Return TRUE if fileName looks like an uncompressed fasta file. */
+
 #endif /* FA_H */
@@ -36,25 +36,34 @@ struct fastqItem {
 };
 
 /* Function Prototypes */
-inline void convPhred33ToPhred64( struct fastqItem * );
-inline void convPhred64ToPhred33( struct fastqItem * );
-inline void phred33ToPhred64( char *, int );
-inline void phred64ToPhred33( char *, int );
-inline int  phred64ToPhred( char );
-inline int  phred33ToPhred( char );
-inline double phredToDouble( int );
-inline double phred33ToDouble( char );
-inline double phred64ToDouble( char );
-inline int doubleToPhred( double );
-inline char phredToPhred33( int );
-inline char phredToPhred64( int );
+void convPhred33ToPhred64( struct fastqItem * );
+void convPhred64ToPhred33( struct fastqItem * );
+void phred33ToPhred64( char *, int );
+void phred64ToPhred33( char *, int );
+int  phred64ToPhred( char );
+int  phred33ToPhred( char );
+double phredToDouble( int );
+double phred33ToDouble( char );
+double phred64ToDouble( char );
+int doubleToPhred( double );
+char phredToPhred33( int );
+char phredToPhred64( int );
+boolean phredShiftOffset(char *qual, int len, int fromOffset, int toOffset);
+extern const double phredProbTable[MAX_PHRED+1];
+double fastqMeanQuality(char *qual, int len, int offset);
+double fastqExpectedErrors(char *qual, int len, int offset);
+int fastqSlidingWindowTrim(char *qual, int len, int offset, int window, int minQual);
 boolean fastqItemNext(struct lineFile *, struct fastqItem *);
 struct fastqItem * allocFastqItem();
 void freeFastqItem(struct fastqItem * fq);
-inline void reverseComplementFastqItem(struct fastqItem *fq);
-inline void printFastqItem(FILE *fp, struct fastqItem *fq);
-inline void gzPrintFastqItem(gzFile *fp, struct fastqItem *fq);
-inline boolean cleanAndThrowOutFastqItem(struct fastqItem *fq, const int minlen);
+void reverseComplementFastqItem(struct fastqItem *fq);
+void printFastqItem(FILE *fp, struct fastqItem *fq);
+void gzPrintFastqItem(gzFile *fp, struct fastqItem *fq);
+struct dyString;
+void fastqItemToDyString(struct dyString *dy, struct fastqItem *fq);
+struct blockGz;
+void blockGzPrintFastqItem(struct blockGz *bg, struct fastqItem *fq);
+boolean cleanAndThrowOutFastqItem(struct fastqItem *fq, const int minlen);
 
 #endif
 
@@ -0,0 +1,42 @@
+/* fastqPipeline - multi-threaded read/filter/write pipeline for single or
+ * paired end fastq files.
+ *
+ * Each input file gets its own reader thread that parses records into
+ * batches.  Compressed inputs are decompressed by the lineFile gzip -dc
+ * child process, so decompression runs in parallel with parsing.  Inputs
+ * may also be readPack files, which are detected by their magic number.  A pool
+ * of worker threads takes matching batches from each mate, runs a filter
+ * callback on every read (or read pair) and formats the survivors.
+ * Batches are then handed, in input order, to a multi-threaded blockGz
+ * writer for each output.  Reads from the two mates stay in sync because
+ * batch N of one mate is only ever processed together with batch N of
+ * the other. */
+
+#ifndef FASTQPIPELINE_H
+#define FASTQPIPELINE_H
+
+#include "fastq.h"
+
+#define FASTQ_PIPE_MAX_MATES 2
+/* Maximum number of input files processed in step. */
+
+#define FASTQ_PIPE_BATCH_SIZE 1024
+/* Number of reads from each mate handled as a unit. */
+
+typedef boolean (*fastqPipeFilter)(struct fastqItem **mates, int mateCount, void *context);
+/* Called on a worker thread with a read (mateCount 1) or read pair
+ * (mateCount 2).  May modify the reads in place.  Return TRUE to keep
+ * them, FALSE to drop them all.  Must be thread safe. */
+
+long long fastqPipelineRun(int mateCount, char **inFiles, char **outFiles,
+	fastqPipeFilter filter, void *context, int threadCount, int gzLevel,
+	long long *retReadCount);
+/* Read mateCount fastq(.gz) or readPack files in step, run filter over each read or
+ * read pair and write the ones it keeps to the corresponding gzipped
+ * outFiles.  Filter may be NULL to keep everything.  Processing stops
+ * when the shortest input runs out.  threadCount sets both the number of
+ * filter threads and the number of compression threads for each output.
+ * gzLevel is the zlib compression level.  Returns number of reads (pairs)
+ * written, and optionally number read in retReadCount. */
+
+#endif /* FASTQPIPELINE_H */
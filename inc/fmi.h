@@ -0,0 +1,141 @@
+/* fmi - FM-index for genome.  This is a compressed alternative to sufa and
+ * sufx suffix arrays, taking about 0.7 bytes per base rather than 5 to 9.
+ * Use fmiMake (see sufMake.h) to create one of these, and the routines here
+ * to access it.  When memory mapped, processes on the same machine share one
+ * copy of the index.  See comment by fmiFileHeader for file format.
+ *
+ * The index is built over the genome laid out as in sufa files: lower case
+ * bases, with n for anything but acgt, and a zero after each chromosome.
+ * Rows are suffixes of this text in the same order as a sufa array, except
+ * that there is a row for every position, n's and zeroes included.  Rows
+ * of suffixes sharing a prefix are contiguous, so like the suffix array
+ * searches, searches here find a range of rows. */
+
+#ifndef FMI_H
+#define FMI_H
+
+#define FMI_ALPHABET_SIZE 6	/* Zero, a, c, g, n, and t. */
+#define FMI_BLOCK_SIZE 256	/* Rows per block of the Burrows-Wheeler transform. */
+
+struct fmiFileHeader
+/* FM-index binary file header.  An fmi file starts with this fixed 128 byte
+ * structure.  It is followed by the following sections, each padded with
+ * zeroes to an 8 byte boundary:
+ *    chromosome name strings - zero terminated.
+ *    chromosome sizes (32 bits each)
+ *    chromosome starts - a struct fmiChromStart for each chromosome, sorted by row.
+ *    transform blocks - struct fmiBlock for each FMI_BLOCK_SIZE rows, plus a final
+ *                       one so counts for the end are there.
+ *    samples - offset of every sampleRate'th row, sampleSize bytes each. */
+    {
+    bits32 magic;	 /* Always FMI_MAGIC */
+    bits16 majorVersion; /* This version changes when backward compatibility breaks. */
+    bits16 minorVersion; /* This version changes whenever a feature is added. */
+    bits64 size;	 /* Total size to memmap, including header. */
+    bits32 chromCount;	 /* Total count of chromosomes/contigs in file. */
+    bits32 chromNamesSize;	/* Size of names of all contigs, padded to 8 byte boundary. */
+    bits64 textSize;	 /* Number of rows: all bases plus a zero after each chromosome. */
+    bits64 symbolCounts[FMI_ALPHABET_SIZE];	/* Number of each symbol in text. */
+    bits32 sampleRate;	 /* Rows per offset sample. */
+    bits32 sampleSize;	 /* Bytes per offset sample, 4 or 8. */
+    bits64 reserved[5];	 /* All zeroes for now. */
+    };
+
+struct fmiChromStart
+/* Row of the suffix starting a chromosome.  Locating a row goes back through
+ * the text until it gets to a sampled row or to one of these. */
+    {
+    bits64 row;		/* Row of suffix. */
+    bits64 offset;	/* Offset of chromosome start in text. */
+    };
+
+struct fmiBlock
+/* FMI_BLOCK_SIZE rows of the Burrows-Wheeler transform, that is the symbol
+ * before the suffix of each row.  Symbols are 0 to 5 for zero, a, c, g, n,
+ * and t, split into three bit planes.  Counts make it quick to find how many
+ * of a symbol come before a row. */
+    {
+    bits64 counts[FMI_ALPHABET_SIZE-1];		/* Number of a c g n t before block. */
+    bits64 planes[FMI_BLOCK_SIZE/64][3];	/* Bits of symbols, 64 rows per word. */
+    };
+
+struct fmi
+/* FM-index in memory. */
+    {
+    struct fmi *next;
+    boolean isMapped;	/* True if memory mapped. */
+    struct fmiFileHeader *header;	/* File header. */
+    char **chromNames;	/* Name of each chromosome. */
+    bits32 *chromSizes;    /* Size of each chromosome.  No deallocation required (in memmap) */
+    bits64 *chromOffsets;  /* Offset of each chromosome in text. */
+    struct offsetIndex *chromIndex;	/* Finds chromosome from offset. */
+    struct fmiChromStart *chromStarts;	/* Chromosome start rows, sorted by row. */
+    struct fmiBlock *blocks;	/* The transform. */
+    void *samples;	/* Sampled offsets, bits32 or bits64. */
+    bits64 symbolStarts[FMI_ALPHABET_SIZE];	/* First row of suffixes starting with each symbol. */
+    };
+
+struct fmi *fmiRead(char *fileName, boolean memoryMap);
+/* Read in an fmi from a file.  Does this via memory mapping if you like, which
+ * lets processes share the index, and is faster for a few reads. */
+
+void fmiFree(struct fmi **pFmi);
+/* Free up resources associated with index. */
+
+int fmiOffsetToChromIx(struct fmi *fmi, bits64 tOffset);
+/* Figure out index of chromosome containing tOffset */
+
+bits64 fmiRowOffset(struct fmi *fmi, bits64 row);
+/* Return offset in text of suffix of row. */
+
+/* Searching.  Queries are DNA in either case.  Searches find the range of
+ * rows holding suffixes that start with the query or its longest prefix
+ * that occurs.  Searches go backwards from the end of the query, so finding
+ * the longest prefix takes a binary search on its size, where the suffix
+ * arrays get it for free. */
+
+bits64 fmiFindExact(struct fmi *fmi, char *q, int qSize, bits64 *retRow);
+/* Find suffixes that start with all of q.  Returns how many there are, and
+ * puts first row in *retRow. */
+
+int fmiFindLongestPrefix(struct fmi *fmi, char *q, int qSize,
+	bits64 *retRow, bits64 *retCount);
+/* Find the longest prefix of q that occurs in the genome.  Returns its
+ * size, and puts the range of rows starting with it in *retRow and
+ * *retCount.  Returns zero and sets both to zero if not even the first base
+ * occurs. */
+
+struct fmiQuery
+/* A query for fmiFindMany, with room for the result. */
+    {
+    char *dna;		/* Query sequence. */
+    int size;		/* Size of query. */
+    int matchSize;	/* Returned size of longest prefix found, size if exact match. */
+    bits64 row;		/* Returned first row starting with prefix. */
+    bits64 count;	/* Returned number of rows starting with prefix. */
+    };
+
+void fmiFindMany(struct fmi *fmi, struct fmiQuery *queries, int queryCount);
+/* Find longest prefix matches for many queries, filling in the result
+ * fields of each.  Queries are searched in order of their reversed
+ * sequence, and each search starts from the interval for the end it shares
+ * with the one before. */
+
+struct fmiHit
+/* Position of a match in the genome. */
+    {
+    int chromIx;	/* Index in chromNames. */
+    bits32 offset;	/* Offset within chromosome. */
+    };
+
+int fmiHits(struct fmi *fmi, bits64 row, bits64 count, struct fmiHit *hits, int maxHits);
+/* Convert up to maxHits rows starting at row to chromosome positions.
+ * Returns number converted. */
+
+/** Stuff to define FMI files **/
+#define FMI_MAGIC 0x6F3A1C52	/* Magic number at start of FMI file */
+#define FMI_MAJOR_VERSION 0
+#define FMI_MINOR_VERSION 0
+#define FMI_DEFAULT_SAMPLE_RATE 32	/* Default rows per offset sample. */
+
+#endif /* FMI_H */
@@ -16,6 +16,10 @@ struct lm *lmInit(int blockSize);
 void lmCleanup(struct lm **pLm);
 /* Clean up a local memory pool. */
 
+void lmReset(struct lm *lm);
+/* Free everything allocated from pool, but keep the pool and its first
+ * block of memory for reuse. */
+
 void *lmAlloc(struct lm *lm, size_t size);
 /* Allocate memory from local pool. */
 
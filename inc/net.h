@@ -207,6 +207,12 @@ int netOpenHttpExt(char *url, char *method, char *optionalHeader);
 /* Return a file handle that will read the url.  optionalHeader
  * may by NULL or may contain cookies and other info. */
 
+void netHttpRequestHeader(struct dyString *dy, char *url, struct netParsedUrl *npu,
+	char *proxyUrl, struct netParsedUrl *pxy,
+	char *method, char *protocol, char *agent, char *optionalHeader);
+/* Append the request line and header for url to dy, including the final
+ * blank line.  If proxyUrl is non-NULL the request goes via proxy pxy. */
+
 int netHttpConnect(char *url, char *method, char *protocol, char *agent, char *optionalHeader);
 /* Parse URL, connect to associated server on port, and send most of
  * the request to the server.  If specified in the url send user name
@@ -256,6 +262,43 @@ boolean netSkipHttpHeaderLinesHandlingRedirect(int sd, char *url, int *redirecte
  * The logic to this routine is also complicated a little to make it work in a pipe, which means we
  * can't attach a lineFile since filling the lineFile buffer reads in more than just the http header. */
 
+#define NET_POOL_MAX_IDLE_PER_HOST 8
+/* Default number of idle keep-alive connections kept per server. */
+
+#define NET_POOL_IDLE_SECONDS 15
+/* Default time idle keep-alive connections are kept. */
+
+#define NET_POOL_PIPELINE_DEPTH 16
+/* Most range requests sent on a connection ahead of reading the responses. */
+
+#define NET_POOL_MAX_SLURP (64*1024*1024)
+/* netLineFileMayOpen reads files up to this size over a pooled connection and
+ * streams bigger ones over a connection of their own. */
+
+boolean netHttpPoolGetRanges(char *url, int rangeCount, bits64 *starts, bits64 *sizes,
+	void **bufs, bits64 *gotSizes);
+/* Fetch rangeCount byte ranges of http(s) url into bufs over a pooled keep-alive
+ * connection, pipelining the requests.  Each bufs[i] must have room for
+ * sizes[i] bytes.  The amount actually fetched, which may be less near the end
+ * of the file, is put in gotSizes.  Redirects are followed.  Warns and returns
+ * FALSE on failure. */
+
+long long netHttpPoolGetRange(char *url, bits64 start, bits64 size, void *buf);
+/* Fetch size bytes at start of http(s) url into buf over a pooled keep-alive
+ * connection.  Returns number of bytes fetched, which may be less than size
+ * near the end of the file, or -1 after a warning on failure. */
+
+int netHttpPoolHead(char *url, struct hash *hash);
+/* Like netUrlHead, but over a pooled keep-alive connection, so a following
+ * netHttpPoolGetRange to the same server needn't connect again. */
+
+void netHttpPoolSetLimits(int maxIdlePerHost, int idleSeconds);
+/* Set the most idle connections kept per server, and how long they are kept.
+ * A maxIdlePerHost of 0 turns connection reuse off. */
+
+void netHttpPoolCloseIdle();
+/* Close all idle pooled connections. */
+
 boolean netGetFtpInfo(char *url, long long *retSize, time_t *retTime);
 /* Return date in UTC and size of ftp url file */
 
@@ -0,0 +1,66 @@
+/* netAsync - fetch many http(s) urls at once from a single thread.  Requests
+ * are queued up with netAsyncAdd, then netAsyncRun drives all the
+ * connections with non-blocking sockets and epoll (poll on systems without
+ * epoll), calling a callback as each request finishes.  Limits on the
+ * number of requests in flight, overall and per server, keep from swamping
+ * servers.  Requests that time out, fail to connect, or get a 5xx or 429
+ * status are retried with a growing delay.  Connections are kept alive and
+ * reused for later requests to the same server.  Redirects are followed.
+ *
+ * Host names are looked up with the blocking resolver the first time a
+ * host is seen, and remembered after that. */
+
+#ifndef NETASYNC_H
+#define NETASYNC_H
+
+#ifndef DYSTRING_H
+#include "dystring.h"
+#endif
+
+#define NET_ASYNC_DEFAULT_IN_FLIGHT 256
+/* Default limit on requests in flight at once. */
+
+#define NET_ASYNC_DEFAULT_PER_HOST 16
+/* Default limit on connections to one server. */
+
+#define NET_ASYNC_DEFAULT_TIMEOUT 30000
+/* Default milliseconds a request can go without progress before it fails. */
+
+#define NET_ASYNC_DEFAULT_RETRIES 3
+/* Default number of times a failed request is retried. */
+
+struct netAsyncResult
+/* Outcome of a request, passed to its callback. */
+    {
+    char *url;			/* Url as requested. */
+    long long rangeStart;	/* Start of byte range or -1 if whole url. */
+    long long rangeSize;	/* Size of byte range. */
+    int status;			/* Http status, or 0 if no response. */
+    char *error;		/* Why there was no response, or NULL. */
+    struct dyString *body;	/* Response body.  Callback may keep it, setting this to NULL. */
+    int tries;			/* Number of times request was sent. */
+    };
+
+typedef void (*netAsyncCallback)(struct netAsyncResult *result, void *context);
+/* Called from netAsyncRun when a request is done, successfully or not.  It
+ * may call netAsyncAdd to queue up more requests. */
+
+struct netAsync;	/* Opaque handle, see netAsync.c */
+
+struct netAsync *netAsyncNew(int maxInFlight, int maxPerHost, int timeoutMs, int retries);
+/* Return a new fetch engine.  Zero for any parameter picks the default. */
+
+void netAsyncFree(struct netAsync **pNa);
+/* Close connections and free up engine.  Requests still queued are
+ * dropped without calling their callbacks. */
+
+void netAsyncAdd(struct netAsync *na, char *url, long long rangeStart, long long rangeSize,
+	netAsyncCallback callback, void *context);
+/* Queue up a GET of url, or of rangeSize bytes from rangeStart if rangeStart
+ * is not -1.  Url must be http or https. */
+
+void netAsyncRun(struct netAsync *na);
+/* Run until all queued requests, including ones added by callbacks, are
+ * done. */
+
+#endif /* NETASYNC_H */
@@ -0,0 +1,33 @@
+/* offsetIndex - find which of many sequences laid end to end, as in the
+ * allDna of a sufa or sufx, contains a given offset.  The sequence starts are
+ * kept in Eytzinger (breadth first binary tree) order, so the first few
+ * levels of the search share cache lines and the rest can be prefetched.
+ * Lookups take O(log n) time, without data dependent branches. */
+
+#ifndef OFFSETINDEX_H
+#define OFFSETINDEX_H
+
+struct offsetIndex
+/* Index of sequence start offsets. */
+    {
+    int count;		/* Number of sequences. */
+    bits64 *starts;	/* Starts in Eytzinger order, from index 1. */
+    int *seqIxs;	/* Sequence index for each element of starts. */
+    };
+
+struct offsetIndex *offsetIndexNew(bits64 *starts, int count);
+/* Make index from the start offsets of count sequences, which must be in
+ * increasing order. */
+
+struct offsetIndex *offsetIndexNew32(bits32 *starts, int count);
+/* Make index from 32 bit start offsets, which must be in increasing order. */
+
+void offsetIndexFree(struct offsetIndex **pOi);
+/* Free up offset index. */
+
+int offsetIndexFind(struct offsetIndex *oi, bits64 offset);
+/* Return index of last sequence starting at or before offset, or -1 if
+ * offset is before the first one.  The caller checks offset is not past
+ * the end of the sequence if need be. */
+
+#endif /* OFFSETINDEX_H */
@@ -0,0 +1,129 @@
+/* readPack - compact binary container for sequencing reads.
+ *
+ * Reads are stored in independent blocks of up to READPACK_BLOCK_READS
+ * reads.  Within a block the bases of all reads are packed together two
+ * bits per base with the same code as .2bit files.  Anything other than
+ * upper case ACGT - N's mostly - is kept as a list of runs, like the
+ * nBlocks of a .2bit, so the round trip is lossless.  Read lengths, names
+ * and qualities are kept in separate zlib compressed streams.  Quality
+ * lengths are stored as a difference from the sequence length, so reads
+ * where the two disagree survive the round trip too.  Names are
+ * split into alternating runs of digits and non-digits, and each piece is
+ * stored as a match or numeric delta against the previous read's name
+ * where possible.
+ *
+ * File layout, all numbers in the byte order of the machine that wrote
+ * it, detected on reading via the magic number:
+ *    bits32 magic, version, blockCount, reserved
+ *    bits64 readCount, indexOffset
+ *    blocks
+ *    index - for each block: bits64 offset, firstRead; bits32 readCount, size
+ * A block is:
+ *    bits32 readCount, baseCount, qualCount
+ *    bits32 compressed and uncompressed sizes of each of the
+ *           length, name, exception and quality streams
+ *    (baseCount+3)/4 bytes of packed bases
+ *    the four compressed streams
+ * Blocks can be located through the index and decoded independently, so
+ * random access and decoding on several threads are both easy. */
+
+#ifndef READPACK_H
+#define READPACK_H
+
+#include "fastq.h"
+
+#define READPACK_MAGIC 0x5250414b	/* "RPAK" */
+#define READPACK_SWAPPED_MAGIC 0x4b415052
+#define READPACK_BLOCK_READS (64*1024)	/* Maximum reads per block. */
+#define READPACK_BLOCK_BASES (16*1024*1024)	/* Start a new block after this many bases. */
+
+struct readPackIndex
+/* Where to find a block. */
+    {
+    bits64 offset;		/* Offset of block in file. */
+    bits64 firstRead;		/* Index of first read in block. */
+    bits32 readCount;		/* Number of reads in block. */
+    bits32 size;		/* Size of block in file. */
+    };
+
+struct readPackBlock
+/* A decoded block of reads. */
+    {
+    struct readPackBlock *next;	/* Next in list. */
+    int readCount;		/* Number of reads. */
+    bits64 firstRead;		/* Index of first read in file. */
+    int *lengths;		/* Length of each read. */
+    bits64 *starts;		/* Start of each read in bases. */
+    int *qualLengths;		/* Length of each quality string, usually same as lengths. */
+    bits64 *qualStarts;		/* Start of each read in quals. */
+    char **names;		/* Name of each read, pointing into nameBuf. */
+    char *nameBuf;		/* Zero terminated names, one after another. */
+    char *bases;		/* Bases of all reads, not zero terminated. */
+    char *quals;		/* Qualities of all reads, not zero terminated. */
+    bits64 qualCount;		/* Total size of quals. */
+    };
+
+struct readPack
+/* An open readPack file. */
+    {
+    struct readPack *next;	/* Next in list. */
+    char *fileName;		/* Name of file, for error messages. */
+    int fd;			/* File descriptor, read with pread. */
+    boolean isSwapped;		/* Need to byte swap numbers? */
+    bits32 version;		/* File format version. */
+    bits32 blockCount;		/* Number of blocks. */
+    bits64 readCount;		/* Total number of reads. */
+    struct readPackIndex *index;	/* Array of blockCount index entries. */
+    int nextBlock;		/* Next block for readPackNext to load. */
+    struct readPackBlock *block;	/* Current block for readPackNext. */
+    int blockReadIx;		/* Next read in current block. */
+    };
+
+struct readPackWriter;	/* Opaque handle for writing, see readPack.c */
+
+boolean readPackIsFile(char *fileName);
+/* Return TRUE if fileName starts with the readPack magic number. */
+
+struct readPack *readPackOpen(char *fileName);
+/* Open a readPack file and read its index.  Squawk and die on error. */
+
+void readPackClose(struct readPack **pRp);
+/* Close readPack file and free up resources. */
+
+struct readPackBlock *readPackBlockLoad(struct readPack *rp, int blockIx);
+/* Read and decode a block.  This is safe to call from several threads at
+ * once as long as readPackNext is not being called on rp at the same time.
+ * Free with readPackBlockFree. */
+
+void readPackBlockFree(struct readPackBlock **pBlock);
+/* Free up a decoded block. */
+
+void readPackBlockToFastqItem(struct readPackBlock *block, int readIx,
+	struct fastqItem *fq);
+/* Copy a read from block into fq, which should be from allocFastqItem. */
+
+boolean readPackNext(struct readPack *rp, struct fastqItem *fq);
+/* Get next read into fq, a drop in replacement for fastqItemNext.
+ * Returns FALSE at end of file. */
+
+void readPackSeek(struct readPack *rp, bits64 readIx);
+/* Arrange for next readPackNext to return read number readIx (0 based). */
+
+struct readPackWriter *readPackWriterOpen(char *fileName);
+/* Create a readPack file for writing. */
+
+void readPackWriterAdd(struct readPackWriter *rpw, struct fastqItem *fq);
+/* Add a read.  The whole of seq and score are stored, even if their
+ * lengths differ. */
+
+void readPackWriterClose(struct readPackWriter **pRpw);
+/* Write last block and index, close file and free up writer. */
+
+bits64 readPackFromFastq(char *fastqName, char *packName);
+/* Convert fastq(.gz) file to readPack.  Returns number of reads. */
+
+bits64 readPackToFastq(char *packName, char *fastqName, int gzThreads);
+/* Convert readPack to fastq.  If fastqName ends in .gz it is compressed
+ * with gzThreads worker threads.  Returns number of reads. */
+
+#endif /* READPACK_H */
@@ -0,0 +1,87 @@
+/* sufMake - build suffix arrays for a genome and write them as the sufa and
+ * sufx files that sufaRead and sufxRead load, or as fmi FM-index files.
+ *
+ * Suffixes are first bucketed by their first few bases.  The buckets are
+ * then sorted independently on several threads with multikey quicksort.
+ * Building the traverse array for sufx files takes a parallel pass to find
+ * how many bases each suffix shares with the one before it, and then a
+ * single stack based pass over the array.
+ *
+ * Memory use is the genome at one byte per base, plus the suffix array at
+ * 4 bytes per indexed base, plus for sufx the traverse array at the same
+ * size again, plus 13 megabytes of bucket counts.  Each thread also needs
+ * 8 bytes per suffix of the biggest bucket, which is small except for
+ * genomes with huge simple repeats.  So a 3 Gb genome takes about 15 Gb for
+ * a sufa and 27 Gb for a sufx.
+ *
+ * Sufa and sufx files hold 32 bit offsets, so genomes over 4 Gb can only
+ * be made into fmi files, which use a 64 bit suffix array while building.
+ *
+ * Sorting is fast for typical genomes, but each bucket costs time
+ * proportional to its size times the length of the repeats in it. */
+
+#ifndef SUFMAKE_H
+#define SUFMAKE_H
+
+#define SUF_MAKE_MAX_32 0xFFFFFFFFLL
+/* Genomes with more DNA than this, counting separators, need 64 bit arrays,
+ * so can't go in sufa or sufx files. */
+
+struct sufGenome
+/* A genome laid out the way it is in sufa and sufx files. */
+    {
+    int chromCount;		/* Number of chromosomes. */
+    char **chromNames;		/* Name of each chromosome. */
+    bits32 *chromSizes;		/* Size of each chromosome. */
+    char *allDna;		/* Lower case DNA with a zero after each chromosome.
+                                 * Bases other than acgt are n.  Followed by 8 zeroes. */
+    bits64 dnaSize;		/* Size of allDna counting separators, but not padding. */
+    bits64 arraySize;		/* Number of bases indexed.  All but the n's. */
+    };
+
+struct sufGenome *sufGenomeLoad(char *dnaFile);
+/* Load up a genome from a fasta, .2bit or .nib file, or a file listing such
+ * files, via dnaLoad. */
+
+void sufGenomeFree(struct sufGenome **pGenome);
+/* Free up genome. */
+
+bits32 *sufArrayMake(struct sufGenome *genome, int threadCount);
+/* Return suffix array for genome.  Suffixes compare as zero terminated
+ * strings, with ties broken by offset.  ThreadCount 0 or 1 sorts on the
+ * calling thread.  FreeMem result when done. */
+
+void *sufArrayMakeFull(struct sufGenome *genome, boolean is64, int threadCount);
+/* Like sufArrayMake, but with a suffix for every position of allDna, n's and
+ * separators included, as an FM-index needs.  Array size is genome->dnaSize.
+ * The array is bits64 if is64 is set, otherwise bits32. */
+
+bits32 *sufTraverseMake(struct sufGenome *genome, bits32 *array, int threadCount);
+/* Return traverse array, as described in sufx.h, for suffix array made by
+ * sufArrayMake.  FreeMem result when done. */
+
+void sufaWrite(struct sufGenome *genome, bits32 *array, char *fileName);
+/* Write genome and its suffix array as a sufa file. */
+
+void sufxWrite(struct sufGenome *genome, bits32 *array, bits32 *traverse, char *fileName);
+/* Write genome with its suffix and traverse arrays as a sufx file. */
+
+void sufaMake(char *dnaFile, char *sufaFile, int threadCount);
+/* Make a sufa file from a fasta, .2bit or .nib file.  Aborts if the genome
+ * is over SUF_MAKE_MAX_32. */
+
+void sufxMake(char *dnaFile, char *sufxFile, int threadCount);
+/* Make a sufx file from a fasta, .2bit or .nib file.  Aborts if the genome
+ * is over SUF_MAKE_MAX_32. */
+
+void fmiWrite(struct sufGenome *genome, void *array, boolean is64, int sampleRate,
+	char *fileName);
+/* Write genome as an FM-index file, given the array from sufArrayMakeFull.
+ * Every sampleRate'th row gets its offset stored. */
+
+void fmiMake(char *dnaFile, char *fmiFile, int sampleRate, int threadCount);
+/* Make an FM-index file from a fasta, .2bit or .nib file.  SampleRate 0
+ * picks the default.  Making it takes as much memory as a sufa, though the
+ * result is much smaller. */
+
+#endif /* SUFMAKE_H */
@@ -1,5 +1,5 @@
-/* sufa - suffix array for genome.  Use sufaMake utility to create one of these, and
- * the routines here to access it.  See comment by sufaFileHeader for file format. */
+/* sufa - suffix array for genome.  Use sufaMake (see sufMake.h) to create one of these,
+ * and the routines here to access it.  See comment by sufaFileHeader for file format. */
 /* This file is copyright 2008 Jim Kent, but license is hereby
  * granted for all use - public, private or commercial. */
 
@@ -37,6 +37,7 @@ struct sufa
     char **chromNames;	/* Name of each chromosome. */
     bits32 *chromSizes;    /* Size of each chromosome.  No deallocation required (in memmap) */
     bits32 *chromOffsets;  /* Offset of each chromosome's DNA */
+    struct offsetIndex *chromIndex;	/* Finds chromosome from offset. */
     char *allDna;	/* All DNA from each contig/chromosome with zero separators. */
     bits32 *array;	/* Alphabetized offsets into allDna. */
     };
@@ -52,6 +53,48 @@ void sufaFree(struct sufa **pSufa);
 int sufaOffsetToChromIx(struct sufa *sufa, bits32 tOffset);
 /* Figure out index of chromosome containing tOffset */
 
+/* Searching.  Queries are DNA in either case.  Searches find the interval
+ * of sufa->array holding suffixes that start with the query or its longest
+ * prefix that occurs. */
+
+bits32 sufaFindExact(struct sufa *sufa, char *q, int qSize, bits32 *retArrayIx);
+/* Find suffixes that start with all of q.  Returns how many there are, and
+ * puts index of first one in sufa->array in *retArrayIx. */
+
+int sufaFindLongestPrefix(struct sufa *sufa, char *q, int qSize,
+	bits32 *retArrayIx, bits32 *retCount);
+/* Find the longest prefix of q that occurs in the genome.  Returns its
+ * size, and puts the range of suffixes starting with it in *retArrayIx and
+ * *retCount.  Returns zero and sets both to zero if not even the first base
+ * occurs. */
+
+struct sufaQuery
+/* A query for sufaFindMany, with room for the result. */
+    {
+    char *dna;		/* Query sequence. */
+    int size;		/* Size of query. */
+    int matchSize;	/* Returned size of longest prefix found, size if exact match. */
+    bits32 arrayIx;	/* Returned index in array of first suffix starting with prefix. */
+    bits32 count;	/* Returned number of suffixes starting with prefix. */
+    };
+
+void sufaFindMany(struct sufa *sufa, struct sufaQuery *queries, int queryCount);
+/* Find longest prefix matches for many queries, filling in the result
+ * fields of each.  Queries are searched in sorted order, and each search
+ * starts from the interval it shares with the one before, so queries with
+ * common prefixes cost much less than searching them one at a time. */
+
+struct sufaHit
+/* Position of a match in the genome. */
+    {
+    int chromIx;	/* Index in chromNames. */
+    bits32 offset;	/* Offset within chromosome. */
+    };
+
+int sufaHits(struct sufa *sufa, bits32 arrayIx, bits32 count, struct sufaHit *hits, int maxHits);
+/* Convert up to maxHits suffixes starting at arrayIx in sufa->array to
+ * chromosome positions.  Returns number converted. */
+
 /** Stuff to define SUFA files **/
 #define SUFA_MAGIC 0x6727B283	/* Magic number at start of SUFA file */
 #define SUFA_MAJOR_VERSION 0	
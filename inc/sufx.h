@@ -1,7 +1,6 @@
-/* sufx - suffix array with traversal extension for genome.  Use sufxMake utility to 
- * create one of these files , and the routines here to access it.  See comment by 
- * sufxFileHeader for file format. See src/shortReads/sufxMake/sufx.doc as well for
- * an explanation of the data structures, particularly the traverse array. */
+/* sufx - suffix array with traversal extension for genome.  Use sufxMake (see
+ * sufMake.h) to create one of these files, and the routines here to access it.  See
+ * comment by sufxFileHeader for file format, including the traverse array. */
 /* This file is copyright 2008 Jim Kent, but license is hereby
  * granted for all use - public, private or commercial. */
 
@@ -17,7 +16,13 @@ struct sufxFileHeader
  *                     and after (to make some end conditions easier).  Padded if need be with
  *                     additional zeroes to 4 base boundary.
  *    suffix array -   32 bits for each indexed base. Alphabetical offsets into DNA
- *    traverse array - Also 32 bits per indexed base. Helper info to traverse array like a tree. */
+ *    traverse array - Also 32 bits per indexed base. Helper info to traverse array like a tree.
+ * Suffixes compare as zero terminated strings, with ties broken by offset.  Call the
+ * number of bases a suffix shares with the one before it in the array its depth,
+ * with the first suffix having depth 0.  Then traverse[i] is the distance from i to
+ * the next suffix with depth no greater than that of i, or to the end of the array
+ * if there is none.  For a suffix starting a group that shares d bases, this is the
+ * size of the group. */
     {
     bits32 magic;	 /* Always SUFX_MAGIC */
     bits16 majorVersion; /* This version changes when backward compatibility breaks. */
@@ -40,6 +45,7 @@ struct sufx
     char **chromNames;	/* Name of each chromosome. */
     bits32 *chromSizes;    /* Size of each chromosome.  No deallocation required (in memmap) */
     bits32 *chromOffsets;  /* Offset of each chromosome's DNA */
+    struct offsetIndex *chromIndex;	/* Finds chromosome from offset. */
     char *allDna;	/* All DNA from each contig/chromosome with zero separators. */
     bits32 *array;	/* Alphabetized offsets into allDna. */
     bits32 *traverse;	/* Offsets to position in array where current prefix changes. */
@@ -56,6 +62,47 @@ void sufxFree(struct sufx **pSufx);
 int sufxOffsetToChromIx(struct sufx *sufx, bits32 tOffset);
 /* Figure out index of chromosome containing tOffset */
 
+/* Searching.  Queries are DNA in either case.  Searches find the interval
+ * of sufx->array holding suffixes that start with the query or its longest
+ * prefix that occurs. */
+
+bits32 sufxFindExact(struct sufx *sufx, char *q, int qSize, bits32 *retArrayIx);
+/* Find suffixes that start with all of q.  Returns how many there are, and
+ * puts index of first one in sufx->array in *retArrayIx. */
+
+int sufxFindLongestPrefix(struct sufx *sufx, char *q, int qSize,
+	bits32 *retArrayIx, bits32 *retCount);
+/* Find the longest prefix of q that occurs in the genome.  Returns its
+ * size, and puts the range of suffixes starting with it in *retArrayIx and
+ * *retCount.  Returns zero and sets both to zero if not even the first base
+ * occurs. */
+
+struct sufxQuery
+/* A query for sufxFindMany, with room for the result. */
+    {
+    char *dna;		/* Query sequence. */
+    int size;		/* Size of query. */
+    int matchSize;	/* Returned size of longest prefix found, size if exact match. */
+    bits32 arrayIx;	/* Returned index in array of first suffix starting with prefix. */
+    bits32 count;	/* Returned number of suffixes starting with prefix. */
+    };
+
+void sufxFindMany(struct sufx *sufx, struct sufxQuery *queries, int queryCount);
+/* Find longest prefix matches for many queries, filling in the result
+ * fields of each.  Queries are searched in sorted order, and each search
+ * starts from the interval it shares with the one before. */
+
+struct sufxHit
+/* Position of a match in the genome. */
+    {
+    int chromIx;	/* Index in chromNames. */
+    bits32 offset;	/* Offset within chromosome. */
+    };
+
+int sufxHits(struct sufx *sufx, bits32 arrayIx, bits32 count, struct sufxHit *hits, int maxHits);
+/* Convert up to maxHits suffixes starting at arrayIx in sufx->array to
+ * chromosome positions.  Returns number converted. */
+
 /** Stuff to define SUFX files **/
 #define SUFX_MAGIC 0x600BA3A1	/* Magic number at start of SUFX file */
 #define SUFX_MAJOR_VERSION 0	
@@ -26,7 +26,7 @@ struct twoBitIndex
     {
     struct twoBitIndex *next;	/* Next in list. */
     char *name;			/* Name - allocated in hash */
-    bits32 offset;		/* Offset in file. */
+    bits64 offset;		/* Offset in file. */
     };
 
 struct twoBitFile
@@ -36,7 +36,7 @@ struct twoBitFile
     char *fileName;	/* Name of this file, for error reporting. */
     FILE *f;		/* Open file. */
     boolean isSwapped;	/* Is byte-swapping needed. */
-    bits32 version;	/* Version of .2bit file */
+    bits32 version;	/* Version of .2bit file, 1 if index has 64 bit offsets. */
     bits32 seqCount;	/* Number of sequences. */
     bits32 reserved;	/* Reserved, always zero for now. */
     struct twoBitIndex *indexList;	/* List of sequence. */
@@ -73,30 +73,61 @@ struct twoBitFile *twoBitOpenExternalBptIndex(char *twoBitName, char *bptName);
 void twoBitClose(struct twoBitFile **pTbf);
 /* Free up resources associated with twoBitFile. */
 
-int twoBitSeqSize(struct twoBitFile *tbf, char *name);
+long long twoBitSeqSize(struct twoBitFile *tbf, char *name);
 /* Return size of sequence in two bit file in bases. */
 
 long long twoBitTotalSize(struct twoBitFile *tbf);
 /* Return total size of all sequences in two bit file. */
 
 struct dnaSeq *twoBitReadSeqFragExt(struct twoBitFile *tbf, char *name,
-                                    int fragStart, int fragEnd, boolean doMask, int *retFullSize);
+	long long fragStart, long long fragEnd, boolean doMask, long long *retFullSize);
 /* Read part of sequence from .2bit file.  To read full
  * sequence call with start=end=0.  Sequence will be lower
  * case if doMask is false, mixed case (repeats in lower)
  * if doMask is true. */
 
 struct dnaSeq *twoBitReadSeqFrag(struct twoBitFile *tbf, char *name,
-	int fragStart, int fragEnd);
+	long long fragStart, long long fragEnd);
 /* Read part of sequence from .2bit file.  To read full
  * sequence call with start=end=0.  Note that sequence will
  * be mixed case, with repeats in lower case and rest in
  * upper case. */
 
 struct dnaSeq *twoBitReadSeqFragLower(struct twoBitFile *tbf, char *name,
-	int fragStart, int fragEnd);
+	long long fragStart, long long fragEnd);
 /* Same as twoBitReadSeqFrag, but sequence is returned in lower case. */
 
+#define TWOBIT_REGION_BATCH (64*1024)
+/* Number of regions twoBitReadRegions sorts and reads at a time. */
+
+#define TWOBIT_REGION_MERGE_GAP (16*1024)
+/* Regions whose packed bases are closer than this many bytes are fetched
+ * with a single read. */
+
+#define TWOBIT_REGION_MAX_READ (8*1024*1024)
+/* Stop merging regions into a read once it gets this big. */
+
+struct twoBitRegion
+/* A region to fetch with twoBitReadRegions. */
+    {
+    char *name;			/* Sequence name. */
+    long long start, end;	/* Range, both zero for whole sequence. */
+    };
+
+typedef void (*twoBitRegionHandler)(struct dnaSeq *seq, int regionIx, void *context);
+/* Called by twoBitReadRegions for each region in turn.  The handler
+ * owns seq and should free it with freeDnaSeq. */
+
+void twoBitReadRegions(struct twoBitFile *tbf, struct twoBitRegion *regions, int regionCount,
+	boolean doMask, twoBitRegionHandler handler, void *context);
+/* Fetch many regions at once.  Regions are read in order of position in
+ * the file, and reads of regions that are close together are merged, so
+ * this is much faster than calling twoBitReadSeqFragExt for each region
+ * when there are lots of them.  Handler is called with each sequence, in
+ * the same order as the regions array, and is responsible for freeing
+ * it.  As with twoBitReadSeqFrag a region with start and end both zero is
+ * the whole sequence. */
+
 struct dnaSeq *twoBitLoadAll(char *spec);
 /* Return list of all sequences matching spec, which is in
  * the form:
@@ -135,7 +166,32 @@ void twoBitWriteOne(struct twoBit *twoBit, FILE *f);
 
 void twoBitWriteHeader(struct twoBit *twoBitList, FILE *f);
 /* Write out header portion of twoBit file, including initial
- * index */
+ * index.  Version 1 of the format is written only if needed. */
+
+void twoBitWriteHeaderExt(struct twoBit *twoBitList, FILE *f, boolean useLong);
+/* Write out header portion of twoBit file, including initial
+ * index.  If useLong is set, or the file is too big for 32 bit
+ * offsets, write version 1 of the format with 64 bit offsets. */
+
+struct twoBitWriter;	/* Opaque handle for streaming output, see twoBit.c */
+
+struct twoBitWriter *twoBitWriterOpen(char *fileName, boolean force64);
+/* Start writing a .2bit file.  Sequences are added one at a time with
+ * twoBitWriterAdd, so memory use does not grow with the size of the genome.
+ * The 64 bit offset format (version 1) is used if force64 is set or if the
+ * file ends up too big for 32 bit offsets.  fileName may be "stdout". */
+
+void twoBitWriterAdd(struct twoBitWriter *tbw, struct dnaSeq *seq, boolean doMask);
+/* Pack seq and add it to the file being written.  If doMask is true
+ * interpret lower-case letters as masked. */
+
+void twoBitWriterAddTwoBit(struct twoBitWriter *tbw, struct twoBit *twoBit);
+/* Add an already packed sequence to the file being written.  This
+ * handles sequences too big for a dnaSeq. */
+
+void twoBitWriterClose(struct twoBitWriter **pTbw);
+/* Write header and index followed by the sequence data, close file
+ * and free up writer. */
 
 boolean twoBitIsFile(char *fileName);
 /* Return TRUE if file is in .2bit format. */
@@ -188,7 +244,7 @@ void twoBitSpecFree(struct twoBitSpec **specPtr);
 void twoBitOutNBeds(struct twoBitFile *tbf, char *seqName, FILE *outF);
 /* output a series of bed3's that enumerate the number of N's in a sequence*/
 
-int twoBitSeqSizeNoNs(struct twoBitFile *tbf, char *seqName);
+long long twoBitSeqSizeNoNs(struct twoBitFile *tbf, char *seqName);
 /* return the length of the sequence, not counting N's */
 
 #endif /* TWOBIT_H */
@@ -18,7 +18,12 @@
  * level.
  *    
  * The bitmap file contains time stamp and size data as well as an array with one bit
- * for each block of the file that has been fetched.  Currently the block size is 8K. */
+ * for each block of the file that has been fetched.  Currently the block size is 8K. 
+ *
+ * On top of this there is a size-limited in-memory cache of recently used blocks, 
+ * shared by all open handles on the same URL, so repeated small random reads, such 
+ * as B+ tree lookups, don't need to go back to the sparse file.  Plain file names
+ * without a protocol skip both caches. */
 
 #ifndef UDC_H
 #define UDC_H
@@ -135,6 +140,38 @@ void udcSetCacheTimeout(int timeout);
 time_t udcUpdateTime(struct udcFile *udc);
 /* return udc->updateTime */
 
+#define UDC_MEM_CACHE_DEFAULT_SIZE (16*1024*1024)
+/* Default limit on memory used by the in-memory block cache. */
+
+void udcSetMemCacheSize(bits64 maxBytes);
+/* Set the limit on memory used by the in-memory block cache shared by all
+ * udcFiles.  Zero turns the memory cache off for files opened afterwards. */
+
+void udcMemCacheStats(bits64 *retHits, bits64 *retMisses, bits64 *retSize);
+/* Return number of memory cache lookups that hit and missed, and the
+ * number of bytes currently in the cache.  Any of the return parameters
+ * may be NULL. */
+
+#define UDC_READ_AHEAD_DEFAULT_MAX (8*1024*1024)
+/* Default limit on how far ahead udc fetches for sequential reads. */
+
+void udcSetReadAheadMax(bits64 maxBytes);
+/* Set the biggest amount udc will fetch ahead of a handle that is reading
+ * sequentially.  Zero turns read-ahead off. */
+
+#define UDC_FETCH_THREADS_DEFAULT 4
+/* Default number of connections used at once to fill large gaps in cache. */
+
+void udcSetFetchThreads(int threadCount);
+/* Set the number of connections udc uses at once to fill large gaps in
+ * the cache from http(s).  One turns parallel fetching off. */
+
+boolean udcPreloadMany(int count, struct udcFile **files, bits64 *offsets, bits64 *sizes);
+/* Make sure count ranges, each in the corresponding file, are in cache.
+ * Everything missing from http(s) files is fetched at once over many
+ * connections, other files are filled a range at a time.  Returns FALSE if
+ * any range couldn't be fetched, in which case udcRead will try again. */
+
 #ifdef PROGRESS_METER
 off_t remoteFileSize(char *url);
 /* fetch remote file size from given URL */
@@ -0,0 +1,847 @@
+/* axtAffineSimd - affine gap local alignment that fills in the dynamic
+ * programming matrix several query positions at a time using the
+ * vector unit.  It gives exactly the same alignment as axtAffine2Level,
+ * which it is meant to replace where speed matters.
+ *
+ * The matrix has a row for each target base and a column for each query
+ * base.  Each cell has a match, delete and insert score, as in
+ * axtAffine2Level.  The match and delete scores of a row depend only on
+ * the previous row, so they are computed a vector at a time.  The insert
+ * scores are a running maximum along the row, which is done as a
+ * prefix-maximum scan.
+ *
+ * The forward pass is tried first with 8 bit scores, then 16 bit, then
+ * 32 bit, moving on as soon as the scoring scheme or the scores so far
+ * don't fit.  The narrow passes do four or two times as many cells per
+ * instruction.  Their scores are clamped at a floor well above the most
+ * negative value the lanes hold, so penalties never wrap around.  Clamping
+ * only changes scores below the floor, and those never make a difference:
+ * the best score is above it, and so is every score the traceback passes
+ * through, along with whatever beats it.  For the same reason the rows
+ * the narrow passes save for the traceback can hold clamped scores.
+ * Short alignments, such as reads
+ * against a genomic region, fit in 16 bits with the default scoring
+ * schemes; only simple schemes with small scores fit in 8.
+ *
+ * The forward pass keeps only every kth row of scores.  The traceback
+ * recomputes the back pointers one stripe of k rows at a time, starting
+ * from the saved row above the stripe, and only as far right as the
+ * current query position. */
+
+#include "common.h"
+#include "axt.h"
+
+#define WORST ((int)0xC0000000)	/* Approximately minus infinity, same as axtAffine2Level. */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define AXT_SIMD
+#ifdef __AVX2__
+#define VEC_BYTES 32
+#define VEC_LANES 8
+#else
+#define VEC_BYTES 16
+#define VEC_LANES 4
+#endif
+#define SHORT_LANES (VEC_BYTES/2)
+#define BYTE_LANES VEC_BYTES
+typedef int vecInt __attribute__ ((vector_size (VEC_BYTES)));
+typedef int vecIntU __attribute__ ((vector_size (VEC_BYTES), aligned(4), may_alias));
+typedef short vecShort __attribute__ ((vector_size (VEC_BYTES)));
+typedef short vecShortU __attribute__ ((vector_size (VEC_BYTES), aligned(2), may_alias));
+typedef signed char vecByte __attribute__ ((vector_size (VEC_BYTES)));
+typedef signed char vecByteU __attribute__ ((vector_size (VEC_BYTES), aligned(1), may_alias));
+#endif /* __GNUC__ */
+
+INLINE int maxInt(int a, int b)
+/* Return larger of a and b. */
+{
+return (a > b ? a : b);
+}
+
+INLINE char backMatch(int d, int m, int i)
+/* Return back pointer for match given diagonal delete, match and insert
+ * scores.  Ties go to delete, then match, then insert, and a local
+ * alignment starts here only if all are negative. */
+{
+char dir;
+int best;
+if (d >= m && d >= i)
+    {
+    dir = 'd';
+    best = d;
+    }
+else if (m >= i)
+    {
+    dir = 'm';
+    best = m;
+    }
+else
+    {
+    dir = 'i';
+    best = i;
+    }
+if (0 > best)
+    dir = 's';
+return dir;
+}
+
+INLINE char backGap(int d, int m, int i)
+/* Return back pointer for delete or insert given the delete, match
+ * and insert scores with the gap penalties already subtracted. */
+{
+if (d >= m && d >= i)
+    return 'd';
+else if (m >= i)
+    return 'm';
+else
+    return 'i';
+}
+
+#ifdef AXT_SIMD
+
+INLINE vecInt vecLoad(int *p)
+/* Load vector from possibly unaligned p. */
+{
+return *(vecIntU *)p;
+}
+
+INLINE void vecStore(int *p, vecInt v)
+/* Store vector at possibly unaligned p. */
+{
+*(vecIntU *)p = v;
+}
+
+INLINE vecInt vecSelect(vecInt mask, vecInt a, vecInt b)
+/* Return a where mask is set, b elsewhere. */
+{
+return (a & mask) | (b & ~mask);
+}
+
+INLINE vecInt vecMax(vecInt a, vecInt b)
+/* Return lane by lane maximum. */
+{
+return vecSelect(a > b, a, b);
+}
+
+INLINE void vecStoreBack(char *p, vecInt v)
+/* Store low byte of each lane at p. */
+{
+int i;
+for (i=0; i<VEC_LANES; ++i)
+    p[i] = v[i];
+}
+
+/* Shuffle masks that move lanes of the first vector up k places, filling
+ * in from the second one, which is zero, and vectors with v in the lanes
+ * filled in.  The compiler turns shuffles like this into byte shifts, and
+ * the fill is then just an or. */
+#define SHIFT_IX(i, k, n) ((i) < (k) ? (n) : (i) - (k))
+#define FILL_IX(i, k, v) ((i) < (k) ? (v) : 0)
+#define LANES4(f, b, k, n) f(b, k, n), f(b+1, k, n), f(b+2, k, n), f(b+3, k, n)
+#define LANES8(f, b, k, n) LANES4(f, b, k, n), LANES4(f, b+4, k, n)
+#define MASK4(f, k, n) {LANES4(f, 0, k, n)}
+#define MASK8(f, k, n) {LANES8(f, 0, k, n)}
+#define MASK16(f, k, n) {LANES8(f, 0, k, n), LANES8(f, 8, k, n)}
+#define MASK32(f, k, n) {LANES8(f, 0, k, n), LANES8(f, 8, k, n), LANES8(f, 16, k, n), \
+	LANES8(f, 24, k, n)}
+
+#define SHORT_LOW (-(1 << 14))	/* Floor of 16 bit scores. */
+#define BYTE_LOW (-(1 << 6))	/* Floor of 8 bit scores. */
+
+INLINE vecInt vecPrefixMax(vecInt x)
+/* Return running maximum of lanes of x from lane 0 up, with WORST below
+ * lane 0. */
+{
+vecInt zero = {0};
+#if VEC_LANES == 8
+static const vecInt shift1 = MASK8(SHIFT_IX, 1, 8), fill1 = MASK8(FILL_IX, 1, WORST);
+static const vecInt shift2 = MASK8(SHIFT_IX, 2, 8), fill2 = MASK8(FILL_IX, 2, WORST);
+static const vecInt shift4 = MASK8(SHIFT_IX, 4, 8), fill4 = MASK8(FILL_IX, 4, WORST);
+x = vecMax(x, __builtin_shuffle(x, zero, shift1) | fill1);
+x = vecMax(x, __builtin_shuffle(x, zero, shift2) | fill2);
+x = vecMax(x, __builtin_shuffle(x, zero, shift4) | fill4);
+#else
+static const vecInt shift1 = MASK4(SHIFT_IX, 1, 4), fill1 = MASK4(FILL_IX, 1, WORST);
+static const vecInt shift2 = MASK4(SHIFT_IX, 2, 4), fill2 = MASK4(FILL_IX, 2, WORST);
+x = vecMax(x, __builtin_shuffle(x, zero, shift1) | fill1);
+x = vecMax(x, __builtin_shuffle(x, zero, shift2) | fill2);
+#endif
+return x;
+}
+
+INLINE vecInt vecBroadcastLast(vecInt x)
+/* Return vector with all lanes set to the last lane of x. */
+{
+static const vecInt last = {VEC_LANES-1, VEC_LANES-1, VEC_LANES-1, VEC_LANES-1
+#if VEC_LANES == 8
+	, 7, 7, 7, 7
+#endif
+	};
+return __builtin_shuffle(x, last);
+}
+
+INLINE vecShort shortMax(vecShort a, vecShort b)
+/* Return lane by lane maximum. */
+{
+vecShort mask = (a > b);
+return (a & mask) | (b & ~mask);
+}
+
+INLINE vecByte byteMax(vecByte a, vecByte b)
+/* Return lane by lane maximum. */
+{
+vecByte mask = (a > b);
+return (a & mask) | (b & ~mask);
+}
+
+INLINE vecShort shortPrefixMax(vecShort x, vecShort *steps)
+/* Return running maximum of lanes of x from lane 0 up, where a lane k
+ * places down counts for steps[log2(k)] less, with SHORT_LOW below lane 0. */
+{
+vecShort zero = {0};
+#if SHORT_LANES == 16
+static const vecShort shift1 = MASK16(SHIFT_IX, 1, 16), fill1 = MASK16(FILL_IX, 1, SHORT_LOW);
+static const vecShort shift2 = MASK16(SHIFT_IX, 2, 16), fill2 = MASK16(FILL_IX, 2, SHORT_LOW);
+static const vecShort shift4 = MASK16(SHIFT_IX, 4, 16), fill4 = MASK16(FILL_IX, 4, SHORT_LOW);
+static const vecShort shift8 = MASK16(SHIFT_IX, 8, 16), fill8 = MASK16(FILL_IX, 8, SHORT_LOW);
+#else
+static const vecShort shift1 = MASK8(SHIFT_IX, 1, 8), fill1 = MASK8(FILL_IX, 1, SHORT_LOW);
+static const vecShort shift2 = MASK8(SHIFT_IX, 2, 8), fill2 = MASK8(FILL_IX, 2, SHORT_LOW);
+static const vecShort shift4 = MASK8(SHIFT_IX, 4, 8), fill4 = MASK8(FILL_IX, 4, SHORT_LOW);
+#endif
+x = shortMax(x, (__builtin_shuffle(x, zero, shift1) | fill1) - steps[0]);
+x = shortMax(x, (__builtin_shuffle(x, zero, shift2) | fill2) - steps[1]);
+x = shortMax(x, (__builtin_shuffle(x, zero, shift4) | fill4) - steps[2]);
+#if SHORT_LANES == 16
+x = shortMax(x, (__builtin_shuffle(x, zero, shift8) | fill8) - steps[3]);
+#endif
+return x;
+}
+
+INLINE vecByte bytePrefixMax(vecByte x, vecByte *steps)
+/* Return running maximum of lanes of x from lane 0 up, where a lane k
+ * places down counts for steps[log2(k)] less, with BYTE_LOW below lane 0. */
+{
+vecByte zero = {0};
+#if BYTE_LANES == 32
+static const vecByte shift1 = MASK32(SHIFT_IX, 1, 32), fill1 = MASK32(FILL_IX, 1, BYTE_LOW);
+static const vecByte shift2 = MASK32(SHIFT_IX, 2, 32), fill2 = MASK32(FILL_IX, 2, BYTE_LOW);
+static const vecByte shift4 = MASK32(SHIFT_IX, 4, 32), fill4 = MASK32(FILL_IX, 4, BYTE_LOW);
+static const vecByte shift8 = MASK32(SHIFT_IX, 8, 32), fill8 = MASK32(FILL_IX, 8, BYTE_LOW);
+static const vecByte shift16 = MASK32(SHIFT_IX, 16, 32);
+static const vecByte fill16 = MASK32(FILL_IX, 16, BYTE_LOW);
+#else
+static const vecByte shift1 = MASK16(SHIFT_IX, 1, 16), fill1 = MASK16(FILL_IX, 1, BYTE_LOW);
+static const vecByte shift2 = MASK16(SHIFT_IX, 2, 16), fill2 = MASK16(FILL_IX, 2, BYTE_LOW);
+static const vecByte shift4 = MASK16(SHIFT_IX, 4, 16), fill4 = MASK16(FILL_IX, 4, BYTE_LOW);
+static const vecByte shift8 = MASK16(SHIFT_IX, 8, 16), fill8 = MASK16(FILL_IX, 8, BYTE_LOW);
+#endif
+x = byteMax(x, (__builtin_shuffle(x, zero, shift1) | fill1) - steps[0]);
+x = byteMax(x, (__builtin_shuffle(x, zero, shift2) | fill2) - steps[1]);
+x = byteMax(x, (__builtin_shuffle(x, zero, shift4) | fill4) - steps[2]);
+x = byteMax(x, (__builtin_shuffle(x, zero, shift8) | fill8) - steps[3]);
+#if BYTE_LANES == 32
+x = byteMax(x, (__builtin_shuffle(x, zero, shift16) | fill16) - steps[4]);
+#endif
+return x;
+}
+
+#endif /* AXT_SIMD */
+
+static int affineRow(int n, int *subst, int colZeroD, char colZeroBack,
+	int *mp, int *dp, int *ip, int *m, int *d, int *in,
+	int gapOpen, int gapExtend, char *bm, char *bd, char *bi)
+/* Compute columns 0 through n of a row of match, delete and insert scores
+ * into m, d and in from the previous row in mp, dp and ip.  Subst has the
+ * score of pairing each query base with this row's target base, indexed
+ * by column.  If bm is non-NULL the back pointers for the row are put in
+ * bm, bd and bi.  Returns best score in columns 1 through n. */
+{
+int doubleGap = gapExtend;
+int rowBest = WORST;
+int c = 1;
+#ifdef AXT_SIMD
+int i;
+#endif
+
+/* Column 0 is a delete coming down from the row 0 column 0 origin. */
+m[0] = WORST;
+d[0] = colZeroD;
+in[0] = WORST;
+if (bm != NULL)
+    {
+    bm[0] = 'x';
+    bd[0] = colZeroBack;
+    bi[0] = 'x';
+    }
+
+/* Match and delete scores depend only on the previous row. */
+#ifdef AXT_SIMD
+    {
+    vecInt zero = {0}, vOpen = zero + gapOpen, vExtend = zero + gapExtend;
+    vecInt vDouble = zero + doubleGap, vBest = zero + WORST;
+    for (; c + VEC_LANES - 1 <= n; c += VEC_LANES)
+	{
+	vecInt dd = vecLoad(dp+c-1), dm = vecLoad(mp+c-1), di = vecLoad(ip+c-1);
+	vecInt best = vecMax(vecMax(dd, dm), di);
+	vecInt vm = vecMax(best, zero) + vecLoad(subst+c);
+	vecInt ud = vecLoad(dp+c) - vExtend, um = vecLoad(mp+c) - vOpen;
+	vecInt ui = vecLoad(ip+c) - vDouble;
+	vecInt vd = vecMax(vecMax(ud, um), ui);
+	vecStore(m+c, vm);
+	vecStore(d+c, vd);
+	vBest = vecMax(vBest, vecMax(vm, vd));
+	if (bm != NULL)
+	    {
+	    vecInt dir = vecSelect((dd >= dm) & (dd >= di), zero + 'd',
+		vecSelect(dm >= di, zero + 'm', zero + 'i'));
+	    vecStoreBack(bm+c, vecSelect(zero > best, zero + 's', dir));
+	    vecStoreBack(bd+c, vecSelect((ud >= um) & (ud >= ui), zero + 'd',
+		vecSelect(um >= ui, zero + 'm', zero + 'i')));
+	    }
+	}
+    for (i=0; i<VEC_LANES; ++i)
+	rowBest = maxInt(rowBest, vBest[i]);
+    }
+#endif /* AXT_SIMD */
+for (; c <= n; ++c)
+    {
+    int dd = dp[c-1], dm = mp[c-1], di = ip[c-1];
+    int ud = dp[c] - gapExtend, um = mp[c] - gapOpen, ui = ip[c] - doubleGap;
+    m[c] = maxInt(maxInt(maxInt(dd, dm), di), 0) + subst[c];
+    d[c] = maxInt(maxInt(ud, um), ui);
+    rowBest = maxInt(rowBest, maxInt(m[c], d[c]));
+    if (bm != NULL)
+	{
+	bm[c] = backMatch(dd, dm, di);
+	bd[c] = backGap(ud, um, ui);
+	}
+    }
+
+/* Insert scores are a running maximum along the row:
+ *     in[c] = max(a[c], in[c-1] - gapExtend)
+ * where a[c] comes from the delete and match scores to the left.  Adding
+ * c*gapExtend to both sides turns this into a plain prefix maximum. */
+c = 1;
+#ifdef AXT_SIMD
+    {
+    vecInt zero = {0}, vOpen = zero + gapOpen, vDouble = zero + doubleGap;
+    vecInt worst = zero + WORST, carry = worst, vBest = worst;
+    vecInt step = zero + VEC_LANES*gapExtend, ramp;
+    for (i=0; i<VEC_LANES; ++i)
+	ramp[i] = (i+1)*gapExtend;
+    for (; c + VEC_LANES - 1 <= n; c += VEC_LANES)
+	{
+	vecInt a = vecMax(vecLoad(d+c-1) - vDouble, vecLoad(m+c-1) - vOpen);
+	vecInt x = vecMax(vecPrefixMax(a + ramp), carry);
+	vecInt vi = x - ramp;
+	carry = vecBroadcastLast(x);
+	vecStore(in+c, vi);
+	vBest = vecMax(vBest, vi);
+	ramp += step;
+	}
+    for (i=0; i<VEC_LANES; ++i)
+	rowBest = maxInt(rowBest, vBest[i]);
+    }
+#endif /* AXT_SIMD */
+for (; c <= n; ++c)
+    {
+    in[c] = maxInt(maxInt(d[c-1] - doubleGap, m[c-1] - gapOpen), in[c-1] - gapExtend);
+    rowBest = maxInt(rowBest, in[c]);
+    }
+
+if (bm != NULL)
+    {
+    c = 1;
+#ifdef AXT_SIMD
+	{
+	vecInt zero = {0}, vOpen = zero + gapOpen, vExtend = zero + gapExtend;
+	vecInt vDouble = zero + doubleGap;
+	for (; c + VEC_LANES - 1 <= n; c += VEC_LANES)
+	    {
+	    vecInt ld = vecLoad(d+c-1) - vDouble, lm = vecLoad(m+c-1) - vOpen;
+	    vecInt li = vecLoad(in+c-1) - vExtend;
+	    vecStoreBack(bi+c, vecSelect((ld >= lm) & (ld >= li), zero + 'd',
+		vecSelect(lm >= li, zero + 'm', zero + 'i')));
+	    }
+	}
+#endif /* AXT_SIMD */
+    for (; c <= n; ++c)
+	bi[c] = backGap(d[c-1] - doubleGap, m[c-1] - gapOpen, in[c-1] - gapExtend);
+    }
+return rowBest;
+}
+
+static int *profileForBase(int **profiles, char *q, int qSize, char base,
+	struct axtScoreScheme *ss)
+/* Return scores of pairing each query base with target base, indexed
+ * by column, making it if need be. */
+{
+int *profile = profiles[(UBYTE)base];
+if (profile == NULL)
+    {
+    int c;
+    AllocArray(profile, qSize+1);
+    for (c=1; c<=qSize; ++c)
+	profile[c] = ss->matrix[(int)q[c-1]][(int)base];
+    profiles[(UBYTE)base] = profile;
+    }
+return profile;
+}
+
+static void initRowZero(int qSize, int *m, int *d, int *in, int gapOpen, int gapExtend)
+/* Fill in row 0, which is the origin followed by an insert along the query. */
+{
+int c;
+m[0] = 0;
+d[0] = in[0] = WORST;
+for (c=1; c<=qSize; ++c)
+    {
+    m[c] = d[c] = WORST;
+    in[c] = (c == 1 ? -gapOpen : in[c-1] - gapExtend);
+    }
+}
+
+static char rowZeroBack(int c, char dir)
+/* Return back pointer of row 0 for given state. */
+{
+if (dir == 'i' && c > 0)
+    return (c == 1 ? 'm' : 'i');
+return 'x';
+}
+
+struct bestCell
+/* Where the forward pass found the best score. */
+    {
+    int score;		/* Best score. */
+    int r, c;		/* First cell with best score in row major order. */
+    char dir;		/* Back pointer of that cell. */
+    };
+
+static void wideForward(char *q, int qSize, char *t, int tSize, struct axtScoreScheme *ss,
+	int **profiles, int stripe, int *rowBuf, int *saved, struct bestCell *best)
+/* Do forward pass with 32 bit scores, using rowBuf for six rows of scores
+ * and saving every stripe'th row in saved, whose row 0 is filled in. */
+{
+int width = qSize + 1;
+int gapOpen = ss->gapOpen, gapExtend = ss->gapExtend;
+int *mp = rowBuf, *dp = mp + width, *ip = dp + width;
+int *m = ip + width, *d = m + width, *in = d + width;
+int r, c, bestbest = WORST, bestr = 0, bestc = 0;
+char bestdir = 0;
+memcpy(rowBuf, saved, 3L * width * sizeof(int));
+for (r=1; r<=tSize; ++r)
+    {
+    int *subst = profileForBase(profiles, q, qSize, t[r-1], ss);
+    int colZeroD = (r == 1 ? -gapOpen : dp[0] - gapExtend);
+    int rowBest = affineRow(qSize, subst, colZeroD, 0, mp, dp, ip, m, d, in,
+	    gapOpen, gapExtend, NULL, NULL, NULL);
+    if (rowBest > bestbest)
+	{
+	for (c=1; c<=qSize; ++c)
+	    {
+	    if (m[c] == rowBest)
+		{
+		bestdir = backMatch(dp[c-1], mp[c-1], ip[c-1]);
+		break;
+		}
+	    if (d[c] == rowBest)
+		{
+		bestdir = backGap(dp[c] - gapExtend, mp[c] - gapOpen, ip[c] - gapExtend);
+		break;
+		}
+	    if (in[c] == rowBest)
+		{
+		bestdir = backGap(d[c-1] - gapExtend, m[c-1] - gapOpen, in[c-1] - gapExtend);
+		break;
+		}
+	    }
+	bestbest = rowBest;
+	bestr = r;
+	bestc = c;
+	}
+    if (r % stripe == 0)
+	{
+	int *s = saved + 3L * width * (r/stripe);
+	memcpy(s, m, width * sizeof(int));
+	memcpy(s + width, d, width * sizeof(int));
+	memcpy(s + 2*width, in, width * sizeof(int));
+	}
+    /* This row becomes previous row. */
+    mp = m;
+    dp = d;
+    ip = in;
+    m = (m == rowBuf ? rowBuf + 3*width : rowBuf);
+    d = m + width;
+    in = d + width;
+    }
+best->score = bestbest;
+best->r = bestr;
+best->c = bestc;
+best->dir = bestdir;
+}
+
+#ifdef AXT_SIMD
+
+static void substRange(char *q, int qSize, char *t, int tSize, struct axtScoreScheme *ss,
+	int *retMin, int *retMax)
+/* Return lowest and highest score of pairing a query base with a target base. */
+{
+boolean inQ[256], inT[256];
+int i, j, lo = 0, hi = 0;
+boolean any = FALSE;
+zeroBytes(inQ, sizeof(inQ));
+zeroBytes(inT, sizeof(inT));
+for (i=0; i<qSize; ++i)
+    inQ[(UBYTE)q[i]] = TRUE;
+for (i=0; i<tSize; ++i)
+    inT[(UBYTE)t[i]] = TRUE;
+for (i=0; i<256; ++i)
+    {
+    if (!inQ[i])
+        continue;
+    for (j=0; j<256; ++j)
+        {
+	if (!inT[j])
+	    continue;
+	int score = ss->matrix[(int)(char)i][(int)(char)j];
+	if (!any || score < lo)
+	    lo = score;
+	if (!any || score > hi)
+	    hi = score;
+	any = TRUE;
+	}
+    }
+*retMin = lo;
+*retMax = hi;
+}
+
+/* The forward pass in narrow lanes, made for each lane size.  Cells are
+ * computed as in affineRow, but with every score clamped at low, and with
+ * the insert scan done by shifting rather than with a ramp, since the ramp
+ * would grow past what the lanes hold. */
+#define NARROW_FORWARD(name, lane, vec, vecU, lanes, low, vecMaxOf, prefixMax) \
+static boolean name(char *q, int qSize, char *t, int tSize, struct axtScoreScheme *ss, \
+	int minSubst, int maxSubst, int **profiles, int stripe, int *saved, \
+	struct bestCell *best) \
+/* Do forward pass as wideForward does with narrow scores.  Returns FALSE \
+ * if the scoring scheme doesn't fit, or if the scores get too big. */ \
+{ \
+int half = -(low), top = 2*half - 1; \
+int gapOpen = ss->gapOpen, gapExtend = ss->gapExtend; \
+if (gapOpen < 0 || gapOpen > half || gapExtend < 0 || gapExtend * lanes > half \
+    || minSubst <= low || maxSubst >= half) \
+    return FALSE; \
+int width = qSize + 1; \
+lane *narrowProfiles[256]; \
+zeroBytes(narrowProfiles, sizeof(narrowProfiles)); \
+lane *rowBuf = needLargeMem(6L * width * sizeof(lane)); \
+lane *mp = rowBuf, *dp = mp + width, *ip = dp + width; \
+lane *m = ip + width, *d = m + width, *in = d + width; \
+vec zero = {0}, vLow = zero + (lane)low, vOpen = zero + (lane)gapOpen; \
+vec vExtend = zero + (lane)gapExtend; \
+vec steps[5], ramp; \
+int i, r, c, bestbest = WORST, bestr = 0, bestc = 0, colZeroD = low; \
+char bestdir = 0; \
+boolean fits = TRUE; \
+for (i=0; i<5; ++i) \
+    steps[i] = zero + (lane)min(gapExtend << i, half); \
+for (i=0; i<lanes; ++i) \
+    ramp[i] = (i+1)*gapExtend; \
+\
+/* Row zero, as initRowZero makes it. */ \
+mp[0] = 0; \
+dp[0] = ip[0] = low; \
+for (c=1; c<=qSize; ++c) \
+    { \
+    mp[c] = dp[c] = low; \
+    ip[c] = maxInt((c == 1 ? -gapOpen : ip[c-1] - gapExtend), low); \
+    } \
+\
+for (r=1; r<=tSize; ++r) \
+    { \
+    UBYTE base = t[r-1]; \
+    lane *subst = narrowProfiles[base]; \
+    if (subst == NULL) \
+        { \
+	int *profile = profileForBase(profiles, q, qSize, base, ss); \
+	subst = narrowProfiles[base] = needLargeMem(width * sizeof(lane)); \
+	for (c=1; c<=qSize; ++c) \
+	    subst[c] = profile[c]; \
+	} \
+    colZeroD = maxInt((r == 1 ? -gapOpen : colZeroD - gapExtend), low); \
+    m[0] = in[0] = low; \
+    d[0] = colZeroD; \
+\
+    /* Match and delete. */ \
+    vec vBest = vLow; \
+    for (c=1; c + lanes - 1 <= qSize; c += lanes) \
+	{ \
+	vec dd = *(vecU *)(dp+c-1), dm = *(vecU *)(mp+c-1), di = *(vecU *)(ip+c-1); \
+	vec vm = vecMaxOf(vecMaxOf(vecMaxOf(dd, dm), di), zero) + *(vecU *)(subst+c); \
+	vec vd = vecMaxOf(vecMaxOf(*(vecU *)(dp+c) - vExtend, *(vecU *)(mp+c) - vOpen), \
+		*(vecU *)(ip+c) - vExtend); \
+	vd = vecMaxOf(vd, vLow); \
+	*(vecU *)(m+c) = vm; \
+	*(vecU *)(d+c) = vd; \
+	vBest = vecMaxOf(vBest, vecMaxOf(vm, vd)); \
+	} \
+    int rowBest = low; \
+    for (; c <= qSize; ++c) \
+        { \
+	m[c] = maxInt(maxInt(maxInt(dp[c-1], mp[c-1]), ip[c-1]), 0) + subst[c]; \
+	d[c] = maxInt(maxInt(maxInt(dp[c] - gapExtend, mp[c] - gapOpen), \
+		ip[c] - gapExtend), low); \
+	rowBest = maxInt(rowBest, maxInt(m[c], d[c])); \
+	} \
+\
+    /* Insert, carrying the last lane of each vector into the next. */ \
+    vec carry = vLow; \
+    for (c=1; c + lanes - 1 <= qSize; c += lanes) \
+	{ \
+	vec a = vecMaxOf(vecMaxOf(*(vecU *)(d+c-1) - vExtend, *(vecU *)(m+c-1) - vOpen), \
+		vLow); \
+	vec x = vecMaxOf(prefixMax(a, steps), carry - ramp); \
+	*(vecU *)(in+c) = x; \
+	vBest = vecMaxOf(vBest, x); \
+	carry = zero + x[lanes-1]; \
+	} \
+    for (; c <= qSize; ++c) \
+        { \
+	in[c] = maxInt(maxInt(maxInt(d[c-1] - gapExtend, m[c-1] - gapOpen), \
+		in[c-1] - gapExtend), low); \
+	rowBest = maxInt(rowBest, in[c]); \
+	} \
+    for (i=0; i<lanes; ++i) \
+	rowBest = maxInt(rowBest, vBest[i]); \
+\
+    /* The next row can be up to maxSubst more than this one. */ \
+    if (rowBest > top - maxSubst) \
+        { \
+	fits = FALSE; \
+	break; \
+	} \
+    if (rowBest > bestbest) \
+	{ \
+	for (c=1; c<=qSize; ++c) \
+	    { \
+	    if (m[c] == rowBest) \
+		{ \
+		bestdir = backMatch(dp[c-1], mp[c-1], ip[c-1]); \
+		break; \
+		} \
+	    if (d[c] == rowBest) \
+		{ \
+		bestdir = backGap(dp[c] - gapExtend, mp[c] - gapOpen, ip[c] - gapExtend); \
+		break; \
+		} \
+	    if (in[c] == rowBest) \
+		{ \
+		bestdir = backGap(d[c-1] - gapExtend, m[c-1] - gapOpen, in[c-1] - gapExtend); \
+		break; \
+		} \
+	    } \
+	bestbest = rowBest; \
+	bestr = r; \
+	bestc = c; \
+	} \
+    if (r % stripe == 0) \
+	{ \
+	int *s = saved + 3L * width * (r/stripe); \
+	for (c=0; c<=qSize; ++c) \
+	    { \
+	    s[c] = m[c]; \
+	    s[width + c] = d[c]; \
+	    s[2*width + c] = in[c]; \
+	    } \
+	} \
+    mp = m; \
+    dp = d; \
+    ip = in; \
+    m = (m == rowBuf ? rowBuf + 3*width : rowBuf); \
+    d = m + width; \
+    in = d + width; \
+    } \
+for (i=0; i<ArraySize(narrowProfiles); ++i) \
+    freeMem(narrowProfiles[i]); \
+freeMem(rowBuf); \
+if (fits) \
+    { \
+    best->score = bestbest; \
+    best->r = bestr; \
+    best->c = bestc; \
+    best->dir = bestdir; \
+    } \
+return fits; \
+}
+
+NARROW_FORWARD(byteForward, signed char, vecByte, vecByteU, BYTE_LANES, BYTE_LOW, byteMax,
+	bytePrefixMax)
+NARROW_FORWARD(shortForward, short, vecShort, vecShortU, SHORT_LANES, SHORT_LOW, shortMax,
+	shortPrefixMax)
+
+#endif /* AXT_SIMD */
+
+struct axt *axtAffineSimd(bioSeq *query, bioSeq *target, struct axtScoreScheme *ss)
+/* Return alignment if any of query and target using scoring scheme.  This
+ * gives the same alignment as axtAffine2Level, but computes several query
+ * positions at once with SIMD instructions where the compiler supports them.
+ * Memory used is about 24*Q*sqrt(T) bytes. */
+{
+struct axt *axt;
+char *q = query->dna, *t = target->dna;
+int qSize = query->size, tSize = target->size;
+int width = qSize + 1;
+int gapOpen = ss->gapOpen, gapExtend = ss->gapExtend;
+int *profiles[256];
+int *rowBuf, *saved;
+char *backs;
+int stripe, stripeCount, r, c, i;
+int bestbest, bestr, bestc;
+char bestdir, dir;
+struct bestCell best;
+int loadedStripe = -1, loadedWidth = 0;
+char *btq, *btt;
+
+AllocVar(axt);
+axt->qName = cloneString(query->name);
+axt->tName = cloneString(target->name);
+axt->qStrand = '+';
+axt->tStrand = '+';
+if (qSize == 0 || tSize == 0)
+    {
+    axt->qSym = cloneString("");
+    axt->tSym = cloneString("");
+    return axt;
+    }
+
+/* Every stripe'th row of scores is saved on the forward pass, and the
+ * back pointers of a stripe are recomputed on the way back. */
+stripe = sqrt(4.0*tSize);
+if (stripe < 1)
+    stripe = 1;
+stripeCount = tSize/stripe + 1;
+zeroBytes(profiles, sizeof(profiles));
+rowBuf = needLargeMem(6L * width * sizeof(int));
+saved = needHugeMem(3L * width * stripeCount * sizeof(int));
+backs = needHugeMem(3L * width * stripe);
+
+/* Forward pass finds the best score, keeping the first of equals in row
+ * major order, and where it came from. */
+initRowZero(qSize, saved, saved + width, saved + 2*width, gapOpen, gapExtend);
+    {
+    boolean done = FALSE;
+#ifdef AXT_SIMD
+    int minSubst, maxSubst;
+    substRange(q, qSize, t, tSize, ss, &minSubst, &maxSubst);
+    done = byteForward(q, qSize, t, tSize, ss, minSubst, maxSubst, profiles, stripe,
+	    saved, &best)
+	|| shortForward(q, qSize, t, tSize, ss, minSubst, maxSubst, profiles, stripe,
+	    saved, &best);
+#endif /* AXT_SIMD */
+    if (!done)
+	wideForward(q, qSize, t, tSize, ss, profiles, stripe, rowBuf, saved, &best);
+    }
+bestbest = best.score;
+bestr = best.r;
+bestc = best.c;
+bestdir = best.dir;
+
+if (bestbest <= 0)  /* null alignment */
+    bestr = bestc = 0;
+r = bestr;
+c = bestc;
+dir = bestdir;
+axt->qEnd = bestc;
+axt->tEnd = bestr;
+axt->qSym = btq = needLargeMem(qSize + tSize + 1);
+axt->tSym = btt = needLargeMem(qSize + tSize + 1);
+
+/* Trace back from best cell, recomputing back pointers a stripe at a time. */
+for (;;)
+    {
+    char *bm = NULL, *bd = NULL, *bi = NULL;
+    int rowIx = 0;
+    if (r == 0 && c == 0)
+	break;
+    if (dir == 'x')
+	errAbort("unexpected error backtracing");
+    if (dir == 's')
+	break;
+    if (r > 0)
+	{
+	int s = (r-1)/stripe;
+	if (s != loadedStripe)
+	    {
+	    /* Recompute rows from just after saved row to r, up to column c. */
+	    int *mp, *dp, *ip, *m, *d, *in, *other;
+	    int *start = saved + 3L * width * s;
+	    int firstRow = s*stripe + 1;
+	    loadedWidth = c + 1;
+	    mp = start;
+	    dp = start + width;
+	    ip = start + 2*width;
+	    m = rowBuf;
+	    d = m + width;
+	    in = d + width;
+	    other = rowBuf + 3*width;
+	    for (i=firstRow; i<=r; ++i)
+		{
+		int *subst = profileForBase(profiles, q, qSize, t[i-1], ss);
+		int colZeroD = (i == 1 ? -gapOpen : dp[0] - gapExtend);
+		char *b = backs + 3L * loadedWidth * (i - firstRow);
+		affineRow(c, subst, colZeroD, (i == 1 ? 'm' : 'd'), mp, dp, ip, m, d, in,
+			gapOpen, gapExtend, b, b + loadedWidth, b + 2*loadedWidth);
+		mp = m;
+		dp = d;
+		ip = in;
+		m = (m == rowBuf ? other : rowBuf);
+		d = m + width;
+		in = d + width;
+		}
+	    loadedStripe = s;
+	    }
+	rowIx = r - (s*stripe + 1);
+	bm = backs + 3L * loadedWidth * rowIx;
+	bd = bm + loadedWidth;
+	bi = bd + loadedWidth;
+	}
+    if (dir == 'm')
+	{
+	*btq++ = q[c-1];
+	*btt++ = t[r-1];
+	dir = (r > 0 ? bm[c] : rowZeroBack(c, 'm'));
+	--r;
+	--c;
+	}
+    else if (dir == 'd')
+	{
+	*btq++ = '-';
+	*btt++ = t[r-1];
+	dir = (r > 0 ? bd[c] : rowZeroBack(c, 'd'));
+	--r;
+	}
+    else
+	{
+	*btq++ = q[c-1];
+	*btt++ = '-';
+	dir = (r > 0 ? bi[c] : rowZeroBack(c, 'i'));
+	--c;
+	}
+    axt->symCount += 1;
+    }
+axt->qStart = c;
+axt->tStart = r;
+reverseBytes(axt->qSym, axt->symCount);
+reverseBytes(axt->tSym, axt->symCount);
+axt->qSym[axt->symCount] = 0;
+axt->tSym[axt->symCount] = 0;
+axt->score = bestbest;
+
+for (i=0; i<ArraySize(profiles); ++i)
+    freeMem(profiles[i]);
+freeMem(rowBuf);
+freeMem(saved);
+freeMem(backs);
+return axt;
+}
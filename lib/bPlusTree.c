@@ -46,6 +46,9 @@
 
 #include "common.h"
 #include "sig.h"
+#include "hash.h"
+#include "dlist.h"
+#include "portable.h"
 #include "udc.h"
 #include "bPlusTree.h"
 
@@ -85,13 +88,19 @@ udcMustReadOne(udc, reserved32);
 
 /* Save position of root block of b+ tree. */
 bpt->rootOffset = udcTell(udc);
+bpt->nodeCacheMax = BPT_NODE_CACHE_DEFAULT;
 
 return bpt;
 }
 
+static void bptNodeCacheFree(struct bptFile *bpt);
+
 void bptFileDetach(struct bptFile **pBpt)
 /* Detach and free up cirTree file opened with cirTreeFileAttach. */
 {
+struct bptFile *bpt = *pBpt;
+if (bpt != NULL)
+    bptNodeCacheFree(bpt);
 freez(pBpt);
 }
 
@@ -113,53 +122,250 @@ if (bpt != NULL)
     }
 }
 
-static boolean rFind(struct bptFile *bpt, bits64 blockStart, void *key, void *val)
-/* Find value corresponding to key.  If found copy value to memory pointed to by val and return 
- * true. Otherwise return false. */
+/* Decoded nodes are kept in a cache on the bptFile, so the upper levels of
+ * the tree, which every lookup passes through, are only read once.  The
+ * least recently used node is dropped when the cache is full. */
+
+struct bptNode
+/* A node of the tree read into memory. */
+    {
+    bits64 offset;		/* Position in file, also cache key. */
+    boolean isLeaf;		/* Leaf or index node? */
+    int count;			/* Number of items. */
+    int itemSize;		/* Size of key plus value or child offset. */
+    UBYTE *items;		/* Items as they are in file. */
+    bits64 *childOffsets;	/* Child offsets of index node, byte swapped if need be. */
+    struct dlNode *lruNode;	/* Place in bpt->nodeLru. */
+    };
+
+static void bptNodeFree(struct bptNode **pNode)
+/* Free up a node. */
 {
-/* Seek to start of block. */
-udcSeek(bpt->udc, blockStart);
+struct bptNode *node = *pNode;
+if (node != NULL)
+    {
+    freeMem(node->items);
+    freeMem(node->childOffsets);
+    freeMem(node->lruNode);
+    freez(pNode);
+    }
+}
 
-/* Read block header. */
-UBYTE isLeaf;
-UBYTE reserved;
-bits16 i, childCount;
-udcMustReadOne(bpt->udc, isLeaf);
-udcMustReadOne(bpt->udc, reserved);
+static void bptNodeKey(bits64 offset, char key[32])
+/* Make hash key for node at offset. */
+{
+safef(key, 32, "%llx", offset);
+}
+
+static void bptNodeRemove(struct bptFile *bpt, struct bptNode *node)
+/* Remove node from cache and free it. */
+{
+char key[32];
+bptNodeKey(node->offset, key);
+hashRemove(bpt->nodeCache, key);
+dlRemove(node->lruNode);
+bpt->nodeCacheCount -= 1;
+bptNodeFree(&node);
+}
+
+static void bptNodeCacheFree(struct bptFile *bpt)
+/* Free up all cached nodes. */
+{
+if (bpt->nodeLru != NULL)
+    {
+    while (!dlEmpty(bpt->nodeLru))
+        bptNodeRemove(bpt, bpt->nodeLru->head->val);
+    freeDlList(&bpt->nodeLru);
+    }
+hashFree(&bpt->nodeCache);
+bptNodeFree(&bpt->uncachedNode);
+}
+
+void bptFileSetNodeCacheSize(struct bptFile *bpt, int maxNodes)
+/* Set the number of decoded nodes kept in memory for bpt.  Zero turns the
+ * node cache off. */
+{
+bpt->nodeCacheMax = max(0, maxNodes);
+while (bpt->nodeCacheCount > bpt->nodeCacheMax)
+    bptNodeRemove(bpt, bpt->nodeLru->tail->val);
+}
+
+static struct bptNode *bptNodeRead(struct bptFile *bpt, bits64 offset)
+/* Read node at offset with a single read past its header. */
+{
+struct udcFile *udc = bpt->udc;
 boolean isSwapped = bpt->isSwapped;
-childCount = udcReadBits16(bpt->udc, isSwapped);
+struct bptNode *node;
+AllocVar(node);
+node->offset = offset;
+udcSeek(udc, offset);
+UBYTE isLeaf, reserved;
+udcMustReadOne(udc, isLeaf);
+udcMustReadOne(udc, reserved);
+node->isLeaf = isLeaf;
+node->count = udcReadBits16(udc, isSwapped);
+node->itemSize = bpt->keySize + (isLeaf ? bpt->valSize : sizeof(bits64));
+node->items = needLargeMem((size_t)node->count * node->itemSize + 1);
+udcMustRead(udc, node->items, (bits64)node->count * node->itemSize);
+if (!isLeaf)
+    {
+    int i;
+    AllocArray(node->childOffsets, node->count);
+    for (i=0; i<node->count; ++i)
+	{
+	bits64 childOffset;
+	memcpy(&childOffset, node->items + i*node->itemSize + bpt->keySize, sizeof(childOffset));
+	node->childOffsets[i] = (isSwapped ? byteSwap64(childOffset) : childOffset);
+	}
+    }
+return node;
+}
 
-UBYTE keyBuf[bpt->keySize];   /* Place to put a key, buffered on stack. */
+static struct bptNode *bptNodeGet(struct bptFile *bpt, bits64 offset)
+/* Return node at offset from cache, reading it if need be.  The node is
+ * only good until the next call, since it may be dropped from the cache
+ * to make room for another. */
+{
+if (bpt->nodeCacheMax == 0)
+    {
+    /* No cache, but still need to free the last node sometime. */
+    bptNodeFree(&bpt->uncachedNode);
+    bpt->uncachedNode = bptNodeRead(bpt, offset);
+    return bpt->uncachedNode;
+    }
+if (bpt->nodeCache == NULL)
+    {
+    bpt->nodeCache = hashNew(0);
+    bpt->nodeLru = newDlList();
+    }
+char key[32];
+bptNodeKey(offset, key);
+struct bptNode *node = hashFindVal(bpt->nodeCache, key);
+if (node != NULL)
+    {
+    dlRemove(node->lruNode);
+    dlAddHead(bpt->nodeLru, node->lruNode);
+    return node;
+    }
+while (bpt->nodeCacheCount >= bpt->nodeCacheMax)
+    bptNodeRemove(bpt, bpt->nodeLru->tail->val);
+node = bptNodeRead(bpt, offset);
+hashAdd(bpt->nodeCache, key, node);
+node->lruNode = dlAddValHead(bpt->nodeLru, node);
+bpt->nodeCacheCount += 1;
+return node;
+}
 
-if (isLeaf)
+static int bptLeafFind(struct bptFile *bpt, struct bptNode *node, void *key)
+/* Return index of key in leaf node, or -1 if it's not there. */
+{
+int keySize = bpt->keySize;
+int startIx = 0, endIx = node->count;
+while (startIx < endIx)
     {
-    for (i=0; i<childCount; ++i)
+    int midIx = (startIx + endIx) >> 1;
+    int diff = memcmp(key, node->items + midIx*node->itemSize, keySize);
+    if (diff == 0)
+        return midIx;
+    if (diff < 0)
+        endIx = midIx;
+    else
+        startIx = midIx + 1;
+    }
+return -1;
+}
+
+static int bptChildFor(struct bptFile *bpt, struct bptNode *node, void *key)
+/* Return index of child of index node that key belongs under. */
+{
+int keySize = bpt->keySize;
+int i;
+for (i=1; i<node->count; ++i)
+    if (memcmp(key, node->items + i*node->itemSize, keySize) < 0)
+        break;
+return i-1;
+}
+
+static boolean rFind(struct bptFile *bpt, bits64 blockStart, void *key, void *val)
+/* Find value corresponding to key.  If found copy value to memory pointed to by val and return 
+ * true. Otherwise return false. */
+{
+struct bptNode *node = bptNodeGet(bpt, blockStart);
+if (node->isLeaf)
+    {
+    int ix = bptLeafFind(bpt, node, key);
+    if (ix < 0)
+        return FALSE;
+    memcpy(val, node->items + ix*node->itemSize + bpt->keySize, bpt->valSize);
+    return TRUE;
+    }
+else
+    return rFind(bpt, node->childOffsets[bptChildFor(bpt, node, key)], key, val);
+}
+
+static int rFindMany(struct bptFile *bpt, bits64 blockStart, UBYTE *keys, int startIx,
+	int endIx, UBYTE *vals, boolean *found)
+/* Look up keys startIx to endIx, which are sorted and all belong under
+ * node at blockStart.  Returns number found. */
+{
+int keySize = bpt->keySize, valSize = bpt->valSize;
+struct bptNode *node = bptNodeGet(bpt, blockStart);
+int foundCount = 0;
+if (node->isLeaf)
+    {
+    /* Merge keys with items in leaf. */
+    int i, itemIx = 0;
+    for (i=startIx; i<endIx; ++i)
         {
-	udcMustRead(bpt->udc, keyBuf, bpt->keySize);
-	udcMustRead(bpt->udc, val, bpt->valSize);
-	if (memcmp(key, keyBuf, bpt->keySize) == 0)
-	    return TRUE;
+	UBYTE *key = keys + (size_t)i*keySize;
+	int diff = -1;
+	while (itemIx < node->count
+	       && (diff = memcmp(key, node->items + itemIx*node->itemSize, keySize)) > 0)
+	    ++itemIx;
+	if (itemIx < node->count && diff == 0)
+	    {
+	    memcpy(vals + (size_t)i*valSize, node->items + itemIx*node->itemSize + keySize,
+		    valSize);
+	    found[i] = TRUE;
+	    ++foundCount;
+	    }
 	}
-    return FALSE;
     }
 else
     {
-    /* Read and discard first key. */
-    udcMustRead(bpt->udc, keyBuf, bpt->keySize);
-
-    /* Scan info for first file offset. */
-    bits64 fileOffset = udcReadBits64(bpt->udc, isSwapped);
-
-    /* Loop through remainder. */
-    for (i=1; i<childCount; ++i)
-	{
-	udcMustRead(bpt->udc, keyBuf, bpt->keySize);
-	if (memcmp(key, keyBuf, bpt->keySize) < 0)
-	    break;
-	fileOffset = udcReadBits64(bpt->udc, isSwapped);
+    /* Split keys between children, then descend into the children that
+     * have any.  The node may be gone from the cache by the time we're back
+     * from the first child, so work out all the splits first. */
+    int count = node->count;
+    bits64 *childOffsets;
+    int *childEnds;
+    AllocArray(childOffsets, count);
+    AllocArray(childEnds, count);
+    int i, keyIx = startIx;
+    for (i=0; i<count; ++i)
+        {
+	childOffsets[i] = node->childOffsets[i];
+	if (i == count-1)
+	    keyIx = endIx;
+	else
+	    {
+	    UBYTE *nextKey = node->items + (i+1)*node->itemSize;
+	    while (keyIx < endIx && memcmp(keys + (size_t)keyIx*keySize, nextKey, keySize) < 0)
+		++keyIx;
+	    }
+	childEnds[i] = keyIx;
+	}
+    keyIx = startIx;
+    for (i=0; i<count; ++i)
+        {
+	if (childEnds[i] > keyIx)
+	    foundCount += rFindMany(bpt, childOffsets[i], keys, keyIx, childEnds[i], vals, found);
+	keyIx = childEnds[i];
 	}
-    return rFind(bpt, fileOffset, key, val);
+    freeMem(childOffsets);
+    freeMem(childEnds);
     }
+return foundCount;
 }
 
 void rTraverse(struct bptFile *bpt, bits64 blockStart, void *context, 
@@ -215,7 +421,7 @@ boolean bptFileFind(struct bptFile *bpt, void *key, int keySize, void *val, int
  * buffer and zero-extend it. */
 if (keySize > bpt->keySize)
     return FALSE;
-char keyBuf[keySize];
+char keyBuf[bpt->keySize];
 if (keySize != bpt->keySize)
     {
     memcpy(keyBuf, key, keySize);
@@ -232,6 +438,48 @@ if (valSize != bpt->valSize)
 return rFind(bpt, bpt->rootOffset, key, val);
 }
 
+int bptFileFindMany(struct bptFile *bpt, int keyCount, void *keys, int keySize,
+	void *vals, int valSize, boolean *found)
+/* Find values associated with many keys at once, going down the tree just
+ * once for all of them.  Returns number of keys found.
+*  Parameters:
+*     bpt - file handle returned by bptFileOpen
+*     keyCount - number of keys
+*     keys - keyCount keys, each keySize bytes and zero padded, sorted by memcmp
+*     keySize - size of each key.  Must be no more than bpt->keySize
+*     vals - where to put values, room for keyCount of them
+*     valSize - size of each value.  Should match bpt->valSize.
+*     found - set to TRUE or FALSE for each key
+*/
+{
+if (valSize != bpt->valSize)
+    errAbort("Value size mismatch between bptFileFindMany (valSize=%d) and %s (valSize=%d)",
+    	valSize, bpt->fileName, bpt->valSize);
+if (keySize > bpt->keySize)
+    errAbort("Key size %d passed to bptFileFindMany bigger than %d in %s",
+	keySize, bpt->keySize, bpt->fileName);
+int i;
+memset(found, 0, keyCount * sizeof(found[0]));
+if (keyCount == 0)
+    return 0;
+for (i=1; i<keyCount; ++i)
+    if (memcmp((char *)keys + (size_t)(i-1)*keySize, (char *)keys + (size_t)i*keySize, keySize) > 0)
+        errAbort("Keys passed to bptFileFindMany for %s aren't sorted", bpt->fileName);
+
+/* Pad keys out to size in file if need be. */
+UBYTE *paddedKeys = keys;
+if (keySize != bpt->keySize)
+    {
+    paddedKeys = needLargeZeroedMem((size_t)keyCount * bpt->keySize);
+    for (i=0; i<keyCount; ++i)
+        memcpy(paddedKeys + (size_t)i*bpt->keySize, (char *)keys + (size_t)i*keySize, keySize);
+    }
+int foundCount = rFindMany(bpt, bpt->rootOffset, paddedKeys, 0, keyCount, vals, found);
+if (paddedKeys != keys)
+    freeMem(paddedKeys);
+return foundCount;
+}
+
 void bptFileTraverse(struct bptFile *bpt, void *context,
     void (*callback)(void *context, void *key, int keySize, void *val, int valSize) )
 /* Traverse bPlusTree on file, calling supplied callback function at each
@@ -438,3 +686,419 @@ bptFileBulkIndexToOpenFile(itemArray, itemSize, itemCount, blockSize, fetchKey,
 carefulClose(&f);
 }
 
+
+
+/* This section of code builds b+ trees too big to sort in memory.  Key/value
+ * pairs are added in any order, sorted in memory a buffer full at a time,
+ * and each sorted run spilled to a temporary file.  At the end the runs are
+ * merged and the tree written in one pass.  All node offsets follow from
+ * the item count, so the leaves are written as the merge produces them,
+ * after a gap left for the index levels.  The keys the index levels need
+ * are saved to a temporary file per level on the way, and written into the
+ * gap at the end. */
+
+struct bptBuilder
+/* Builds a b+ tree from unsorted key/value pairs with bounded memory. */
+    {
+    bits32 blockSize;		/* Number of children per node. */
+    bits32 keySize;		/* Size of keys. */
+    bits32 valSize;		/* Size of values. */
+    int recSize;		/* Size of key plus value. */
+    char *tmpDir;		/* Where to put temporary files. */
+    char *buf;			/* Pairs not yet sorted, one after another. */
+    char *sortBuf;		/* Scratch space for sorting. */
+    bits64 bufMax;		/* Number of pairs buf holds. */
+    bits64 bufCount;		/* Number of pairs in buf. */
+    bits64 itemCount;		/* Total number of pairs added. */
+    struct bptRun *runList;	/* Sorted runs spilled to disk. */
+    };
+
+struct bptRun
+/* A sorted run in a temporary file. */
+    {
+    struct bptRun *next;	/* Next in list. */
+    FILE *f;			/* Open, already deleted, temporary file. */
+    bits64 count;		/* Number of pairs in run. */
+    bits64 readCount;		/* Number of pairs read back so far. */
+    int ix;			/* Position in list of runs, to break ties. */
+    char *rec;			/* Current pair while merging. */
+    };
+
+static FILE *bptTempFile(char *tmpDir, char *base)
+/* Return a temporary file opened for reading and writing.  It is already
+ * deleted, so goes away when closed. */
+{
+char *fileName = rTempName(tmpDir, base, ".tmp");
+FILE *f = mustOpen(fileName, "w+b");
+remove(fileName);
+return f;
+}
+
+struct bptBuilder *bptBuilderNew(bits32 blockSize, bits32 keySize, bits32 valSize,
+	char *tmpDir, bits64 maxMem)
+/* Start building a b+ tree from key/value pairs that can be added in any
+ * order.  Pairs are sorted in memory maxMem bytes at a time (zero for
+ * BPT_BUILDER_DEFAULT_MEM) and spilled to temporary files in tmpDir (NULL
+ * for $TMPDIR or /tmp). */
+{
+if (blockSize < 2 || blockSize > 0xFFFF)
+    errAbort("bptBuilderNew: block size %u out of range", blockSize);
+if (tmpDir == NULL)
+    tmpDir = getenv("TMPDIR");
+if (tmpDir == NULL)
+    tmpDir = "/tmp";
+if (maxMem == 0)
+    maxMem = BPT_BUILDER_DEFAULT_MEM;
+struct bptBuilder *bb;
+AllocVar(bb);
+bb->blockSize = blockSize;
+bb->keySize = keySize;
+bb->valSize = valSize;
+bb->recSize = keySize + valSize;
+bb->tmpDir = cloneString(tmpDir);
+bb->bufMax = max(maxMem / 2 / bb->recSize, blockSize);
+bb->buf = needLargeMem(bb->bufMax * bb->recSize);
+return bb;
+}
+
+static void bptSortRecs(char *recs, char *scratch, bits64 count, int recSize, int keySize)
+/* Sort count records of recSize bytes by their first keySize bytes.  This
+ * is a bottom-up merge sort, so is stable, starting with insertion sorted
+ * runs of a few records. */
+{
+const bits64 firstRun = 16;
+bits64 runStart, i, j;
+char tmp[recSize];
+for (runStart = 0; runStart < count; runStart += firstRun)
+    {
+    bits64 runEnd = min(runStart + firstRun, count);
+    for (i = runStart+1; i < runEnd; ++i)
+        {
+	memcpy(tmp, recs + i*recSize, recSize);
+	for (j = i; j > runStart && memcmp(recs + (j-1)*recSize, tmp, keySize) > 0; --j)
+	    memcpy(recs + j*recSize, recs + (j-1)*recSize, recSize);
+	memcpy(recs + j*recSize, tmp, recSize);
+	}
+    }
+char *src = recs, *dest = scratch;
+bits64 width;
+for (width = firstRun; width < count; width *= 2)
+    {
+    for (runStart = 0; runStart < count; runStart += 2*width)
+        {
+	bits64 a = runStart, aEnd = min(runStart + width, count);
+	bits64 b = aEnd, bEnd = min(runStart + 2*width, count);
+	char *d = dest + runStart*recSize;
+	while (a < aEnd && b < bEnd)
+	    {
+	    if (memcmp(src + b*recSize, src + a*recSize, keySize) < 0)
+	        memcpy(d, src + (b++)*recSize, recSize);
+	    else
+	        memcpy(d, src + (a++)*recSize, recSize);
+	    d += recSize;
+	    }
+	if (a < aEnd)
+	    memcpy(d, src + a*recSize, (aEnd - a)*recSize);
+	if (b < bEnd)
+	    memcpy(d, src + b*recSize, (bEnd - b)*recSize);
+	}
+    char *swap = src;
+    src = dest;
+    dest = swap;
+    }
+if (src != recs)
+    memcpy(recs, src, count*recSize);
+}
+
+static void bptBuilderSortBuf(struct bptBuilder *bb)
+/* Sort pairs in buffer. */
+{
+if (bb->sortBuf == NULL)
+    bb->sortBuf = needLargeMem(bb->bufMax * bb->recSize);
+bptSortRecs(bb->buf, bb->sortBuf, bb->bufCount, bb->recSize, bb->keySize);
+}
+
+static void bptBuilderSpill(struct bptBuilder *bb)
+/* Sort buffer and write it out as a run. */
+{
+struct bptRun *run;
+AllocVar(run);
+bptBuilderSortBuf(bb);
+run->f = bptTempFile(bb->tmpDir, "bptRun");
+run->count = bb->bufCount;
+mustWrite(run->f, bb->buf, bb->bufCount * bb->recSize);
+slAddHead(&bb->runList, run);
+bb->bufCount = 0;
+verbose(2, "bptBuilder: spilled run of %llu items\n", run->count);
+}
+
+void bptBuilderAdd(struct bptBuilder *bb, void *key, int keySize, void *val)
+/* Add a key/value pair.  Key is zero padded out to the builder's key size,
+ * and val is the builder's value size. */
+{
+if (keySize > bb->keySize)
+    errAbort("bptBuilderAdd: key size %d bigger than %u", keySize, bb->keySize);
+if (bb->bufCount == bb->bufMax)
+    bptBuilderSpill(bb);
+char *rec = bb->buf + bb->bufCount * bb->recSize;
+memcpy(rec, key, keySize);
+memset(rec + keySize, 0, bb->keySize - keySize);
+memcpy(rec + bb->keySize, val, bb->valSize);
+bb->bufCount += 1;
+bb->itemCount += 1;
+}
+
+static boolean bptRunNext(struct bptRun *run, int recSize)
+/* Read next pair of run into run->rec.  Return FALSE at end. */
+{
+if (run->readCount >= run->count)
+    return FALSE;
+mustRead(run->f, run->rec, recSize);
+run->readCount += 1;
+return TRUE;
+}
+
+struct bptMerger
+/* Source of pairs in sorted order, either from memory or merged from runs. */
+    {
+    struct bptBuilder *bb;	/* Builder we're for. */
+    bits64 memIx;		/* Next pair in bb->buf if there are no runs. */
+    struct bptRun **heap;	/* Runs that still have pairs, smallest first. */
+    int heapSize;		/* Number of runs in heap. */
+    };
+
+static boolean bptRunLess(struct bptMerger *m, int a, int b)
+/* Return TRUE if heap element a comes before b.  Ties go to earlier run,
+ * to keep pairs with the same key in the order they were added. */
+{
+struct bptRun *ra = m->heap[a], *rb = m->heap[b];
+int diff = memcmp(ra->rec, rb->rec, m->bb->keySize);
+if (diff != 0)
+    return diff < 0;
+return ra->ix < rb->ix;
+}
+
+static void bptHeapDown(struct bptMerger *m, int ix)
+/* Move heap element at ix down to where it belongs. */
+{
+for (;;)
+    {
+    int smallest = ix, left = 2*ix+1, right = left+1;
+    if (left < m->heapSize && bptRunLess(m, left, smallest))
+        smallest = left;
+    if (right < m->heapSize && bptRunLess(m, right, smallest))
+        smallest = right;
+    if (smallest == ix)
+        break;
+    struct bptRun *swap = m->heap[ix];
+    m->heap[ix] = m->heap[smallest];
+    m->heap[smallest] = swap;
+    ix = smallest;
+    }
+}
+
+static char *bptMergerNext(struct bptMerger *m, char *recBuf)
+/* Return next pair in sorted order, copied into recBuf. */
+{
+struct bptBuilder *bb = m->bb;
+if (m->heap == NULL)
+    {
+    memcpy(recBuf, bb->buf + (m->memIx++) * bb->recSize, bb->recSize);
+    return recBuf;
+    }
+struct bptRun *run = m->heap[0];
+memcpy(recBuf, run->rec, bb->recSize);
+if (!bptRunNext(run, bb->recSize))
+    m->heap[0] = m->heap[--m->heapSize];
+bptHeapDown(m, 0);
+return recBuf;
+}
+
+static void bptMergerInit(struct bptMerger *m, struct bptBuilder *bb)
+/* Get ready to return pairs in order.  If everything fit in memory, just
+ * sort it there, otherwise spill the last of it and merge the runs. */
+{
+ZeroVar(m);
+m->bb = bb;
+if (bb->runList == NULL)
+    {
+    bptBuilderSortBuf(bb);
+    return;
+    }
+if (bb->bufCount > 0)
+    bptBuilderSpill(bb);
+freez(&bb->buf);
+freez(&bb->sortBuf);
+slReverse(&bb->runList);
+int runCount = slCount(bb->runList);
+AllocArray(m->heap, runCount);
+struct bptRun *run;
+int ix = 0;
+for (run = bb->runList; run != NULL; run = run->next)
+    {
+    rewind(run->f);
+    run->ix = ix++;
+    run->rec = needMem(bb->recSize);
+    run->readCount = 0;
+    if (bptRunNext(run, bb->recSize))
+	m->heap[m->heapSize++] = run;
+    }
+for (ix = m->heapSize/2 - 1; ix >= 0; --ix)
+    bptHeapDown(m, ix);
+verbose(2, "bptBuilder: merging %d runs\n", runCount);
+}
+
+static bits64 bptPower(bits64 x, int y)
+/* Return x to the y power, with y small. */
+{
+bits64 val = 1;
+int i;
+for (i=0; i<y; ++i)
+    val *= x;
+return val;
+}
+
+bits64 bptBuilderWriteToOpenFile(struct bptBuilder *bb, FILE *f)
+/* Sort and merge everything added, and write b+ tree starting at the
+ * current position of f, which needs to be seekable.  The format is the
+ * same as bptFileBulkIndexToOpenFile's.  Returns number of items. */
+{
+bits32 blockSize = bb->blockSize, keySize = bb->keySize, valSize = bb->valSize;
+bits64 itemCount = bb->itemCount;
+bits32 magic = bptSig;
+bits32 reserved = 0;
+writeOne(f, magic);
+writeOne(f, blockSize);
+writeOne(f, keySize);
+writeOne(f, valSize);
+writeOne(f, itemCount);
+writeOne(f, reserved);
+writeOne(f, reserved);
+bits64 indexOffset = ftell(f);
+
+/* Figure out where everything goes. */
+int levels = 1, level;
+bits64 n = itemCount;
+while (n > blockSize)
+    {
+    n = (n + blockSize - 1) / blockSize;
+    levels += 1;
+    }
+bits64 bytesInIndexBlock = bptBlockHeaderSize + blockSize * (keySize + sizeof(bits64));
+bits64 bytesInLeafBlock = bptBlockHeaderSize + blockSize * (keySize + valSize);
+bits64 leafOffset = indexOffset;
+for (level = levels-1; level > 0; --level)
+    {
+    bits64 nodeSizePer = bptPower(blockSize, level + 1);
+    leafOffset += (itemCount + nodeSizePer - 1) / nodeSizePer * bytesInIndexBlock;
+    }
+
+/* Write leaves, saving keys index levels need. */
+FILE *levelKeys[levels];
+bits64 levelSlotSize[levels];
+for (level = 1; level < levels; ++level)
+    {
+    levelKeys[level] = bptTempFile(bb->tmpDir, "bptKeys");
+    levelSlotSize[level] = bptPower(blockSize, level);
+    }
+struct bptMerger merger;
+bptMergerInit(&merger, bb);
+fseek(f, leafOffset, SEEK_SET);
+char recBuf[bb->recSize];
+UBYTE isLeaf = TRUE;
+UBYTE nodeReserved = 0;
+bits16 countOne = 0;
+bits64 i;
+for (i=0; i<itemCount; ++i)
+    {
+    if (i % blockSize == 0)
+        {
+	countOne = min(blockSize, itemCount - i);
+	writeOne(f, isLeaf);
+	writeOne(f, nodeReserved);
+	writeOne(f, countOne);
+	}
+    char *rec = bptMergerNext(&merger, recBuf);
+    mustWrite(f, rec, bb->recSize);
+    if (i % blockSize == countOne - 1 && countOne < blockSize)
+	repeatCharOut(f, 0, (blockSize - countOne) * bb->recSize);
+    for (level = 1; level < levels && i % levelSlotSize[level] == 0; ++level)
+        mustWrite(levelKeys[level], rec, keySize);
+    }
+if (itemCount == 0)
+    {
+    /* An empty leaf for the root, so lookups find nothing rather than
+     * reading past the end. */
+    writeOne(f, isLeaf);
+    writeOne(f, nodeReserved);
+    writeOne(f, countOne);
+    repeatCharOut(f, 0, blockSize * bb->recSize);
+    }
+bits64 endOffset = ftell(f);
+
+/* Go back and write index levels into the gap, root first. */
+fseek(f, indexOffset, SEEK_SET);
+isLeaf = FALSE;
+char keyBuf[keySize];
+for (level = levels-1; level > 0; --level)
+    {
+    FILE *kf = levelKeys[level];
+    bits64 slotSizePer = levelSlotSize[level];
+    bits64 keyCount = (itemCount + slotSizePer - 1) / slotSizePer;
+    bits64 nodeCount = (keyCount + blockSize - 1) / blockSize;
+    bits64 nextChild = ftell(f) + nodeCount * bytesInIndexBlock;
+    bits64 bytesInNextLevelBlock = (level == 1 ? bytesInLeafBlock : bytesInIndexBlock);
+    rewind(kf);
+    bits64 k;
+    for (k = 0; k < keyCount; k += countOne)
+        {
+	countOne = min(blockSize, keyCount - k);
+	writeOne(f, isLeaf);
+	writeOne(f, nodeReserved);
+	writeOne(f, countOne);
+	int j;
+	for (j=0; j<countOne; ++j)
+	    {
+	    mustRead(kf, keyBuf, keySize);
+	    mustWrite(f, keyBuf, keySize);
+	    writeOne(f, nextChild);
+	    nextChild += bytesInNextLevelBlock;
+	    }
+	repeatCharOut(f, 0, (blockSize - countOne) * (keySize + sizeof(bits64)));
+	}
+    carefulClose(&levelKeys[level]);
+    }
+if (ftell(f) != leafOffset)
+    internalErr();
+fseek(f, endOffset, SEEK_SET);
+freeMem(merger.heap);
+return itemCount;
+}
+
+void bptBuilderWrite(struct bptBuilder *bb, char *fileName)
+/* Sort and merge everything added, and write b+ tree to fileName. */
+{
+FILE *f = mustOpen(fileName, "wb");
+bptBuilderWriteToOpenFile(bb, f);
+carefulClose(&f);
+}
+
+void bptBuilderFree(struct bptBuilder **pBb)
+/* Free up builder and close its temporary files. */
+{
+struct bptBuilder *bb = *pBb;
+if (bb != NULL)
+    {
+    struct bptRun *run;
+    for (run = bb->runList; run != NULL; run = run->next)
+        {
+	carefulClose(&run->f);
+	freeMem(run->rec);
+	}
+    slFreeList(&bb->runList);
+    freeMem(bb->buf);
+    freeMem(bb->sortBuf);
+    freeMem(bb->tmpDir);
+    freez(pBb);
+    }
+}
@@ -0,0 +1,426 @@
+/* blockGz - write gzip files using several threads.  Output is cut into
+ * blocks that are deflated independently by a pool of worker threads and
+ * then written out in order, each as a complete gzip member.  A file made
+ * of several concatenated members is a standard gzip file, so gzip -dc,
+ * zcat and zlib's gzread all read the result as a single stream.
+ *
+ * Optionally the members follow the BGZF conventions used by samtools and
+ * tabix - 64k blocks, a BC extra field holding the member size, and an
+ * empty member as end of file marker - so the output can be indexed. */
+
+#include "common.h"
+#include "pthreadWrap.h"
+#include "synQueue.h"
+#include "blockGz.h"
+#include <zlib.h>
+
+struct gzBlock
+/* A block of output on its way through the compressors. */
+    {
+    struct gzBlock *next;	/* Next in list. */
+    long long ix;		/* Position of block in output stream. */
+    char *data;			/* Uncompressed data, blockSize bytes allocated. */
+    size_t size;		/* Number of bytes used in data. */
+    char *zData;		/* Compressed data. */
+    size_t zAlloc;		/* Bytes allocated for zData. */
+    size_t zSize;		/* Bytes used in zData. */
+    };
+
+struct blockGz
+/* A gzip output stream compressed by several threads. */
+    {
+    char *name;			/* File name, for error messages. */
+    FILE *f;			/* Output file. */
+    boolean ownFile;		/* If TRUE close f at end. */
+    boolean bgzf;		/* If TRUE write BGZF rather than plain gzip members. */
+    int level;			/* zlib compression level. */
+    int blockSize;		/* Uncompressed bytes per block. */
+    int threadCount;		/* Number of compression threads, may be 0. */
+    pthread_t *threads;		/* Compression threads. */
+    struct synQueue *todo;	/* Blocks waiting to be compressed. */
+    struct gzBlock *cur;	/* Block currently being filled, may be NULL. */
+    long long nextIx;		/* Index of next block to be queued. */
+    long long writeIx;		/* Index of next block to be written. */
+    pthread_mutex_t mutex;	/* Protects everything below. */
+    pthread_cond_t cond;	/* Signalled as blocks are written. */
+    struct gzBlock *doneList;	/* Blocks compressed but not yet written. */
+    struct gzBlock *freeList;	/* Blocks available for reuse. */
+    int inFlight;		/* Number of blocks allocated and not yet written. */
+    int maxInFlight;		/* Limit on above to bound memory use. */
+    };
+
+static struct gzBlock *gzBlockNew(int blockSize)
+/* Allocate a new block with room for blockSize bytes of data. */
+{
+struct gzBlock *block;
+AllocVar(block);
+block->data = needLargeMem(blockSize);
+return block;
+}
+
+static void gzBlockFreeList(struct gzBlock **pList)
+/* Free a list of blocks. */
+{
+struct gzBlock *block, *next;
+for (block = *pList; block != NULL; block = next)
+    {
+    next = block->next;
+    freeMem(block->data);
+    freeMem(block->zData);
+    freeMem(block);
+    }
+*pList = NULL;
+}
+
+static void writeLe16(char *p, bits32 x)
+/* Write low 16 bits of x to p little endian. */
+{
+p[0] = x & 0xff;
+p[1] = (x >> 8) & 0xff;
+}
+
+static void writeLe32(char *p, bits32 x)
+/* Write x to p little endian. */
+{
+writeLe16(p, x);
+writeLe16(p+2, x >> 16);
+}
+
+static void deflateInto(struct blockGz *bg, struct gzBlock *block, int windowBits,
+	int headerSize, int trailerSize)
+/* Deflate block->data into block->zData, leaving room for headerSize bytes
+ * in front and trailerSize after.  Sets zSize to total including both. */
+{
+z_stream zs;
+ZeroVar(&zs);
+int err = deflateInit2(&zs, bg->level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+if (err != Z_OK)
+    errAbort("deflateInit2 failed (%d) compressing %s", err, bg->name);
+size_t bound = deflateBound(&zs, block->size) + headerSize + trailerSize;
+if (block->zAlloc < bound)
+    {
+    freeMem(block->zData);
+    block->zAlloc = bound;
+    block->zData = needLargeMem(bound);
+    }
+zs.next_in = (Bytef *)block->data;
+zs.avail_in = block->size;
+zs.next_out = (Bytef *)block->zData + headerSize;
+zs.avail_out = block->zAlloc - headerSize - trailerSize;
+err = deflate(&zs, Z_FINISH);
+if (err != Z_STREAM_END)
+    errAbort("deflate failed (%d) compressing %s", err, bg->name);
+block->zSize = headerSize + zs.total_out + trailerSize;
+deflateEnd(&zs);
+}
+
+static void compressBlock(struct blockGz *bg, struct gzBlock *block)
+/* Compress block->data into block->zData as a complete gzip member. */
+{
+if (bg->bgzf)
+    {
+    /* Raw deflate with the BGZF header and gzip trailer done by hand. */
+    static char header[BGZF_HEADER_SIZE] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff,
+					    6, 0, 'B', 'C', 2, 0, 0, 0};
+    deflateInto(bg, block, -15, BGZF_HEADER_SIZE, 8);
+    if (block->zSize > BGZF_MAX_BLOCK_SIZE)
+        errAbort("BGZF block too big compressing %s", bg->name);
+    memcpy(block->zData, header, BGZF_HEADER_SIZE);
+    writeLe16(block->zData + 16, block->zSize - 1);
+    char *trailer = block->zData + block->zSize - 8;
+    writeLe32(trailer, crc32(crc32(0L, NULL, 0), (Bytef *)block->data, block->size));
+    writeLe32(trailer + 4, block->size);
+    }
+else
+    {
+    /* Window bits of 15+16 asks zlib for a gzip rather than zlib wrapper. */
+    deflateInto(bg, block, 15+16, 0, 0);
+    }
+}
+
+static void writeReadyBlocks(struct blockGz *bg)
+/* Write out, in order, any blocks that have finished compressing.  Call
+ * with mutex locked. */
+{
+boolean wroteAny = FALSE;
+for (;;)
+    {
+    struct gzBlock *block, **pPrev = &bg->doneList;
+    for (block = bg->doneList; block != NULL; block = block->next)
+        {
+	if (block->ix == bg->writeIx)
+	    break;
+	pPrev = &block->next;
+	}
+    if (block == NULL)
+        break;
+    *pPrev = block->next;
+    mustWrite(bg->f, block->zData, block->zSize);
+    bg->writeIx += 1;
+    bg->inFlight -= 1;
+    slAddHead(&bg->freeList, block);
+    wroteAny = TRUE;
+    }
+if (wroteAny)
+    pthreadCondBroadcast(&bg->cond);
+}
+
+static void *compressThread(void *v)
+/* Compress blocks from the todo queue until we get a NULL one. */
+{
+struct blockGz *bg = v;
+struct gzBlock *block;
+while ((block = synQueueGet(bg->todo)) != NULL)
+    {
+    compressBlock(bg, block);
+    pthreadMutexLock(&bg->mutex);
+    slAddHead(&bg->doneList, block);
+    writeReadyBlocks(bg);
+    pthreadMutexUnlock(&bg->mutex);
+    }
+return NULL;
+}
+
+struct blockGz *blockGzOpenFile(FILE *f, char *name, int level, int threadCount,
+	int blockSize, boolean bgzf)
+/* Like blockGzOpen, but on an already open FILE, and with control over the
+ * number of uncompressed bytes in each gzip member.  If bgzf is set the
+ * output is BGZF and blockSize may be at most BGZF_BLOCK_SIZE.  The FILE
+ * is not closed by blockGzClose. */
+{
+struct blockGz *bg;
+if (blockSize <= 0)
+    errAbort("blockGz block size must be positive, got %d", blockSize);
+if (bgzf && blockSize > BGZF_BLOCK_SIZE)
+    errAbort("BGZF block size must be at most %d, got %d", BGZF_BLOCK_SIZE, blockSize);
+if (threadCount < 0)
+    threadCount = 0;
+AllocVar(bg);
+bg->name = cloneString(name);
+bg->f = f;
+bg->bgzf = bgzf;
+bg->level = level;
+bg->blockSize = blockSize;
+bg->threadCount = threadCount;
+bg->maxInFlight = 2*threadCount + 2;
+pthreadMutexInit(&bg->mutex);
+pthreadCondInit(&bg->cond);
+if (threadCount > 0)
+    {
+    int i;
+    bg->todo = synQueueNew();
+    AllocArray(bg->threads, threadCount);
+    for (i=0; i<threadCount; ++i)
+        pthreadCreate(&bg->threads[i], NULL, compressThread, bg);
+    }
+return bg;
+}
+
+struct blockGz *blockGzOpen(char *fileName, int level, int threadCount)
+/* Open fileName for parallel gzip output at the given zlib compression
+ * level (-1 for zlib default).  If threadCount is 0 compression is done
+ * on the calling thread. fileName may be "stdout". */
+{
+FILE *f = mustOpen(fileName, "wb");
+struct blockGz *bg = blockGzOpenFile(f, fileName, level, threadCount,
+	BLOCKGZ_DEFAULT_BLOCK_SIZE, FALSE);
+bg->ownFile = TRUE;
+return bg;
+}
+
+struct blockGz *blockGzOpenBgzf(char *fileName, int level, int threadCount)
+/* Like blockGzOpen, but write BGZF so the output can be indexed by
+ * samtools/tabix and read with random access. */
+{
+FILE *f = mustOpen(fileName, "wb");
+struct blockGz *bg = blockGzOpenFile(f, fileName, level, threadCount,
+	BGZF_BLOCK_SIZE, TRUE);
+bg->ownFile = TRUE;
+return bg;
+}
+
+static struct gzBlock *nextFreeBlock(struct blockGz *bg)
+/* Get a block to fill, waiting for the writers to catch up if too many
+ * are already in flight. */
+{
+struct gzBlock *block;
+pthreadMutexLock(&bg->mutex);
+while (bg->inFlight >= bg->maxInFlight)
+    pthreadCondWait(&bg->cond, &bg->mutex);
+bg->inFlight += 1;
+block = bg->freeList;
+if (block != NULL)
+    bg->freeList = block->next;
+pthreadMutexUnlock(&bg->mutex);
+if (block == NULL)
+    block = gzBlockNew(bg->blockSize);
+block->next = NULL;
+block->size = 0;
+return block;
+}
+
+static void queueBlock(struct blockGz *bg, struct gzBlock *block)
+/* Send block off to be compressed and written. */
+{
+block->ix = bg->nextIx++;
+if (bg->threadCount == 0)
+    {
+    compressBlock(bg, block);
+    pthreadMutexLock(&bg->mutex);
+    slAddHead(&bg->doneList, block);
+    writeReadyBlocks(bg);
+    pthreadMutexUnlock(&bg->mutex);
+    }
+else
+    synQueuePut(bg->todo, block);
+}
+
+void blockGzWrite(struct blockGz *bg, void *buf, size_t size)
+/* Add size bytes from buf to the output stream. */
+{
+char *s = buf;
+while (size > 0)
+    {
+    if (bg->cur == NULL)
+        bg->cur = nextFreeBlock(bg);
+    struct gzBlock *block = bg->cur;
+    size_t oneSize = bg->blockSize - block->size;
+    if (oneSize > size)
+        oneSize = size;
+    memcpy(block->data + block->size, s, oneSize);
+    block->size += oneSize;
+    s += oneSize;
+    size -= oneSize;
+    if (block->size == bg->blockSize)
+        {
+	bg->cur = NULL;
+	queueBlock(bg, block);
+	}
+    }
+}
+
+void blockGzPutc(struct blockGz *bg, char c)
+/* Add a single character to the output stream. */
+{
+struct gzBlock *block = bg->cur;
+if (block != NULL && block->size + 1 < bg->blockSize)
+    block->data[block->size++] = c;
+else
+    blockGzWrite(bg, &c, 1);
+}
+
+void blockGzPuts(struct blockGz *bg, char *s)
+/* Add a zero terminated string to the output stream. */
+{
+blockGzWrite(bg, s, strlen(s));
+}
+
+void blockGzPrintf(struct blockGz *bg, char *format, ...)
+/* Format and add to output stream. */
+{
+char buf[1024];
+va_list args;
+va_start(args, format);
+int size = vsnprintf(buf, sizeof(buf), format, args);
+va_end(args);
+if (size < 0)
+    errAbort("blockGzPrintf: can't format \"%s\"", format);
+if ((size_t)size < sizeof(buf))
+    blockGzWrite(bg, buf, size);
+else
+    {
+    char *big = needLargeMem(size+1);
+    va_start(args, format);
+    vsnprintf(big, size+1, format, args);
+    va_end(args);
+    blockGzWrite(bg, big, size);
+    freeMem(big);
+    }
+}
+
+void blockGzWriteSeqWithBreaks(struct blockGz *bg, char *letters, int letterCount,
+	int maxPerLine)
+/* Write out letters with newlines every maxPerLine, like writeSeqWithBreaks. */
+{
+int lettersLeft = letterCount;
+int lineSize;
+while (lettersLeft > 0)
+    {
+    lineSize = lettersLeft;
+    if (lineSize > maxPerLine)
+        lineSize = maxPerLine;
+    blockGzWrite(bg, letters, lineSize);
+    blockGzPutc(bg, '\n');
+    letters += lineSize;
+    lettersLeft -= lineSize;
+    }
+}
+
+void blockGzFlush(struct blockGz *bg)
+/* End the current block, and wait until everything written so far has
+ * been compressed and written out. */
+{
+if (bg->cur != NULL)
+    {
+    struct gzBlock *block = bg->cur;
+    bg->cur = NULL;
+    if (block->size > 0)
+	queueBlock(bg, block);
+    else
+	{
+	pthreadMutexLock(&bg->mutex);
+	bg->inFlight -= 1;
+	slAddHead(&bg->freeList, block);
+	pthreadMutexUnlock(&bg->mutex);
+	}
+    }
+pthreadMutexLock(&bg->mutex);
+while (bg->writeIx < bg->nextIx)
+    pthreadCondWait(&bg->cond, &bg->mutex);
+pthreadMutexUnlock(&bg->mutex);
+if (fflush(bg->f) != 0)
+    errnoAbort("Couldn't flush %s", bg->name);
+}
+
+void blockGzClose(struct blockGz **pBg)
+/* Compress and write any remaining data, stop worker threads, close
+ * file and free up resources. */
+{
+struct blockGz *bg = *pBg;
+if (bg == NULL)
+    return;
+blockGzFlush(bg);
+if (bg->bgzf)
+    {
+    /* BGZF ends with an empty member as end of file marker. */
+    static char eofMarker[28] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0,
+				 'B', 'C', 2, 0, 0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    mustWrite(bg->f, eofMarker, sizeof(eofMarker));
+    }
+else if (bg->nextIx == 0)
+    {
+    /* Write a single empty member so that the output is a valid gzip
+     * file rather than zero bytes. */
+    struct gzBlock *block = nextFreeBlock(bg);
+    queueBlock(bg, block);
+    blockGzFlush(bg);
+    }
+if (bg->threadCount > 0)
+    {
+    int i;
+    for (i=0; i<bg->threadCount; ++i)
+        synQueuePut(bg->todo, NULL);
+    for (i=0; i<bg->threadCount; ++i)
+        pthreadJoin(bg->threads[i]);
+    freeMem(bg->threads);
+    synQueueFree(&bg->todo);
+    }
+if (bg->ownFile)
+    carefulClose(&bg->f);
+gzBlockFreeList(&bg->freeList);
+gzBlockFreeList(&bg->doneList);
+pthreadCondDestroy(&bg->cond);
+pthreadMutexDestroy(&bg->mutex);
+freeMem(bg->name);
+freez(pBg);
+}
@@ -0,0 +1,653 @@
+/* chainBin - binary indexed chain files.  See chainBin.h for file format
+ * and how the index works. */
+
+#include "common.h"
+#include <sys/mman.h>
+#include "hash.h"
+#include "obscure.h"
+#include "portable.h"
+#include "linefile.h"
+#include "chain.h"
+#include "chainBin.h"
+
+static void *pointerOffset(void *pt, bits64 offset)
+/* A little wrapper around pointer arithmetic in terms of bytes. */
+{
+char *s = pt;
+return s + offset;
+}
+
+static bits64 padded(bits64 size)
+/* Return size rounded up to an 8 byte boundary. */
+{
+return (size + 7) & ~7LL;
+}
+
+static void writePadded(FILE *f, void *data, bits64 size)
+/* Write data followed by zeroes out to an 8 byte boundary. */
+{
+static char zeroes[8];
+mustWrite(f, data, size);
+mustWrite(f, zeroes, (8 - size % 8) % 8);
+}
+
+/* Blocks are stored as unsigned variable length integers, 7 bits to a byte
+ * with the high bit set on all but the last byte.  Gaps can in principle
+ * be negative, so they are zigzag encoded: 0, -1, 1, -2 ... go to 0, 1, 2, 3 ... */
+
+INLINE bits32 zigzag(int x)
+/* Return x zigzag encoded. */
+{
+return ((bits32)x << 1) ^ (bits32)(x >> 31);
+}
+
+INLINE int unzigzag(bits32 x)
+/* Return x zigzag decoded. */
+{
+return (int)(x >> 1) ^ -(int)(x & 1);
+}
+
+INLINE UBYTE *varIntDecode(UBYTE *p, bits32 *retVal)
+/* Decode variable length integer at p into *retVal and return pointer
+ * past it. */
+{
+bits32 val = 0;
+int shift = 0;
+UBYTE b;
+do  {
+    b = *p++;
+    val |= (bits32)(b & 0x7f) << shift;
+    shift += 7;
+    } while (b & 0x80);
+*retVal = val;
+return p;
+}
+
+struct chainBinBuilder
+/* Chains and sequences being collected for a binary chain file. */
+    {
+    struct hash *seqHash;	/* Sequence index keyed by name. */
+    struct slName *seqList;	/* Sequence names, last first. */
+    int seqCount;		/* Number of sequences. */
+    bits32 *seqSizes;		/* Size of each sequence. */
+    int seqAlloc;		/* Allocated size of seqSizes. */
+    struct chainBinChain *chains;	/* Chain headers in input order. */
+    bits64 chainCount;		/* Number of chains. */
+    bits64 chainAlloc;		/* Allocated size of chains. */
+    UBYTE *blocks;		/* Encoded blocks not yet spilled. */
+    bits64 blocksSize;		/* Used size of blocks. */
+    bits64 blocksAlloc;		/* Allocated size of blocks. */
+    FILE *spillFile;		/* Deleted temp file for blocks, or NULL to keep in memory. */
+    bits64 spillSize;		/* Size of blocks in spillFile. */
+    };
+
+/* Blocks are spilled to the temp file in pieces about this big. */
+#define CHAINBIN_SPILL_SIZE (1024*1024)
+
+static struct chainBinBuilder *builderNew(boolean spill)
+/* Return new, empty builder.  If spill is set encoded blocks go to a temp
+ * file in $TMPDIR or /tmp rather than staying in memory. */
+{
+struct chainBinBuilder *builder;
+AllocVar(builder);
+builder->seqHash = hashNew(0);
+if (spill)
+    {
+    char *tmpDir = getenv("TMPDIR");
+    if (tmpDir == NULL)
+        tmpDir = "/tmp";
+    char *fileName = rTempName(tmpDir, "chainBin", ".tmp");
+    builder->spillFile = mustOpen(fileName, "w+b");
+    remove(fileName);
+    }
+return builder;
+}
+
+static void builderFree(struct chainBinBuilder **pBuilder)
+/* Free up builder. */
+{
+struct chainBinBuilder *builder = *pBuilder;
+if (builder != NULL)
+    {
+    hashFree(&builder->seqHash);
+    slFreeList(&builder->seqList);
+    freeMem(builder->seqSizes);
+    freeMem(builder->chains);
+    freeMem(builder->blocks);
+    carefulClose(&builder->spillFile);
+    freez(pBuilder);
+    }
+}
+
+static bits32 builderSeqIx(struct chainBinBuilder *builder, char *name, int size)
+/* Return index of sequence, adding it if it's new. */
+{
+struct hashEl *hel = hashLookup(builder->seqHash, name);
+if (hel != NULL)
+    {
+    int seqIx = ptToInt(hel->val);
+    if (builder->seqSizes[seqIx] != size)
+        errAbort("%s has size %d in one chain and %u in another",
+		name, size, builder->seqSizes[seqIx]);
+    return seqIx;
+    }
+if (builder->seqCount >= builder->seqAlloc)
+    {
+    int newAlloc = max(1024, 2*builder->seqAlloc);
+    ExpandArray(builder->seqSizes, builder->seqAlloc, newAlloc);
+    builder->seqAlloc = newAlloc;
+    }
+hashAddInt(builder->seqHash, name, builder->seqCount);
+slNameAddHead(&builder->seqList, name);
+builder->seqSizes[builder->seqCount] = size;
+return builder->seqCount++;
+}
+
+static void builderAddVarInt(struct chainBinBuilder *builder, bits32 val)
+/* Add variable length integer to encoded blocks. */
+{
+if (builder->blocksSize + 5 > builder->blocksAlloc)
+    {
+    bits64 newAlloc = max(64*1024, 2*builder->blocksAlloc);
+    builder->blocks = needHugeMemResize(builder->blocks, newAlloc);
+    builder->blocksAlloc = newAlloc;
+    }
+UBYTE *p = builder->blocks + builder->blocksSize;
+while (val >= 0x80)
+    {
+    *p++ = (val & 0x7f) | 0x80;
+    val >>= 7;
+    }
+*p++ = val;
+builder->blocksSize = p - builder->blocks;
+}
+
+static void builderAdd(struct chainBinBuilder *builder, struct chain *chain)
+/* Add chain and its blocks to builder.  Gives chain an id if it has none,
+ * as chainWrite does. */
+{
+if (chain->id == 0)
+    chainIdNext(chain);
+if (builder->chainCount >= builder->chainAlloc)
+    {
+    bits64 newAlloc = max(1024, 2*builder->chainAlloc);
+    builder->chains = needHugeMemResize(builder->chains, newAlloc * sizeof(builder->chains[0]));
+    builder->chainAlloc = newAlloc;
+    }
+struct chainBinChain *c = &builder->chains[builder->chainCount++];
+ZeroVar(c);
+c->score = chain->score;
+c->blockOffset = builder->spillSize + builder->blocksSize;
+c->tSeqIx = builderSeqIx(builder, chain->tName, chain->tSize);
+c->tStart = chain->tStart;
+c->tEnd = chain->tEnd;
+c->qSeqIx = builderSeqIx(builder, chain->qName, chain->qSize);
+c->qStart = chain->qStart;
+c->qEnd = chain->qEnd;
+c->id = chain->id;
+c->qStrand = chain->qStrand;
+
+int tPos = chain->tStart, qPos = chain->qStart;
+struct cBlock *b;
+for (b = chain->blockList; b != NULL; b = b->next)
+    {
+    int size = b->qEnd - b->qStart;
+    if (b->tEnd - b->tStart != size)
+        errAbort("Block of chain %d is %d bases in target but %d in query",
+		chain->id, b->tEnd - b->tStart, size);
+    builderAddVarInt(builder, zigzag(b->tStart - tPos));
+    builderAddVarInt(builder, zigzag(b->qStart - qPos));
+    builderAddVarInt(builder, size);
+    tPos = b->tEnd;
+    qPos = b->qEnd;
+    c->blockCount += 1;
+    }
+if (builder->spillFile != NULL && builder->blocksSize >= CHAINBIN_SPILL_SIZE)
+    {
+    mustWrite(builder->spillFile, builder->blocks, builder->blocksSize);
+    builder->spillSize += builder->blocksSize;
+    builder->blocksSize = 0;
+    }
+}
+
+static void builderWriteBlocks(struct chainBinBuilder *builder, FILE *f)
+/* Write out encoded blocks, padded to an 8 byte boundary, copying back
+ * any that were spilled. */
+{
+FILE *spill = builder->spillFile;
+if (spill == NULL)
+    {
+    writePadded(f, builder->blocks, builder->blocksSize);
+    return;
+    }
+mustWrite(spill, builder->blocks, builder->blocksSize);
+builder->spillSize += builder->blocksSize;
+builder->blocksSize = 0;
+if (fflush(spill) != 0 || fseek(spill, 0, SEEK_SET) != 0)
+    errnoAbort("Couldn't rewind chainBin temp file");
+UBYTE *buf = needLargeMem(CHAINBIN_SPILL_SIZE);
+bits64 left = builder->spillSize;
+while (left > 0)
+    {
+    size_t size = min(left, CHAINBIN_SPILL_SIZE);
+    mustRead(spill, buf, size);
+    mustWrite(f, buf, size);
+    left -= size;
+    }
+freeMem(buf);
+static char zeroes[8];
+mustWrite(f, zeroes, (8 - builder->spillSize % 8) % 8);
+}
+
+static int chainBinChainCmp(const void *va, const void *vb)
+/* Compare to sort on target, tStart, then order added. */
+{
+const struct chainBinChain *a = va, *b = vb;
+if (a->tSeqIx != b->tSeqIx)
+    return (a->tSeqIx < b->tSeqIx ? -1 : 1);
+if (a->tStart != b->tStart)
+    return (a->tStart < b->tStart ? -1 : 1);
+if (a->blockOffset != b->blockOffset)
+    return (a->blockOffset < b->blockOffset ? -1 : 1);
+return 0;
+}
+
+static int indexChains(struct chainBinChain *chains, bits64 chainCount)
+/* Fill in maxEnd for chains of one target, which are sorted by tStart, and
+ * return level of root of the tree they make.  The subtree of chain i at
+ * level k covers i - 2^k + 1 to i + 2^k - 1, which can go past the last
+ * chain. */
+{
+bits64 i;
+bits32 *suffixMax = needHugeMem((chainCount + 1) * sizeof(bits32));
+suffixMax[chainCount] = 0;
+for (i = chainCount; i > 0; --i)
+    suffixMax[i-1] = max(suffixMax[i], chains[i-1].tEnd);
+for (i = 0; i < chainCount; i += 2)
+    chains[i].maxEnd = chains[i].tEnd;
+int level;
+for (level = 1; (1LL << level) <= chainCount; ++level)
+    {
+    bits64 half = 1LL << (level-1);
+    for (i = (1LL << level) - 1; i < chainCount; i += 1LL << (level+1))
+	{
+	bits32 maxEnd = max(chains[i].tEnd, chains[i-half].maxEnd);
+	bits64 right = i + half;
+	/* Right subtree may be partly or wholly past the end. */
+	bits32 rightEnd = (right < chainCount ? chains[right].maxEnd : suffixMax[i+1]);
+	chains[i].maxEnd = max(maxEnd, rightEnd);
+	}
+    }
+freeMem(suffixMax);
+return level - 1;
+}
+
+static void builderWrite(struct chainBinBuilder *builder, char *fileName)
+/* Sort and index chains in builder and write them to file. */
+{
+struct chainBinChain *chains = builder->chains;
+bits64 chainCount = builder->chainCount;
+qsort(chains, chainCount, sizeof(chains[0]), chainBinChainCmp);
+
+/* Make a target for each run of chains on the same sequence and index it. */
+struct chainBinTarget *targets;
+int targetCount = 0;
+bits64 i, start;
+AllocArray(targets, builder->seqCount);
+for (start = 0; start < chainCount; start = i)
+    {
+    for (i = start+1; i < chainCount && chains[i].tSeqIx == chains[start].tSeqIx; ++i)
+        ;
+    struct chainBinTarget *target = &targets[targetCount++];
+    target->seqIx = chains[start].tSeqIx;
+    target->firstChain = start;
+    target->chainCount = i - start;
+    target->rootLevel = indexChains(chains + start, i - start);
+    }
+
+/* Fill in header. */
+struct chainBinFileHeader header;
+ZeroVar(&header);
+header.magic = CHAINBIN_MAGIC;
+header.majorVersion = CHAINBIN_MAJOR_VERSION;
+header.minorVersion = CHAINBIN_MINOR_VERSION;
+slReverse(&builder->seqList);
+struct dyString *names = dyStringNew(0);
+struct slName *seq;
+for (seq = builder->seqList; seq != NULL; seq = seq->next)
+    dyStringAppendN(names, seq->name, strlen(seq->name) + 1);
+header.seqCount = builder->seqCount;
+header.seqNamesSize = padded(names->stringSize);
+header.targetCount = targetCount;
+header.chainCount = chainCount;
+bits64 blocksSize = builder->spillSize + builder->blocksSize;
+header.blocksSize = padded(blocksSize);
+header.size = sizeof(header) + header.seqNamesSize
+	+ padded(builder->seqCount * sizeof(bits32))
+	+ targetCount * sizeof(struct chainBinTarget)
+	+ chainCount * sizeof(struct chainBinChain)
+	+ header.blocksSize;
+
+/* Write it all out. */
+FILE *f = mustOpen(fileName, "wb");
+mustWrite(f, &header, sizeof(header));
+writePadded(f, names->string, names->stringSize);
+writePadded(f, builder->seqSizes, builder->seqCount * sizeof(bits32));
+mustWrite(f, targets, targetCount * sizeof(targets[0]));
+mustWrite(f, chains, chainCount * sizeof(chains[0]));
+builderWriteBlocks(builder, f);
+carefulClose(&f);
+verbose(2, "Wrote %llu chains on %d targets, %llu bytes of blocks, to %s\n",
+	chainCount, targetCount, blocksSize, fileName);
+dyStringFree(&names);
+freeMem(targets);
+}
+
+void chainBinWrite(struct chain *chainList, char *fileName)
+/* Write chains to a binary chain file. */
+{
+struct chainBinBuilder *builder = builderNew(FALSE);
+struct chain *chain;
+for (chain = chainList; chain != NULL; chain = chain->next)
+    builderAdd(builder, chain);
+builderWrite(builder, fileName);
+builderFree(&builder);
+}
+
+void chainBinMake(char *chainFile, char *chainBinFile)
+/* Convert a text chain file to a binary one.  Only the chain headers,
+ * not the blocks, are kept in memory while doing it.  The blocks go to
+ * a temporary file in $TMPDIR or /tmp. */
+{
+struct lineFile *lf = lineFileOpen(chainFile, TRUE);
+struct chainBinBuilder *builder = builderNew(TRUE);
+struct chain *chain;
+while ((chain = chainRead(lf)) != NULL)
+    {
+    builderAdd(builder, chain);
+    chainFree(&chain);
+    }
+lineFileClose(&lf);
+builderWrite(builder, chainBinFile);
+builderFree(&builder);
+}
+
+struct chainBin *chainBinRead(char *fileName, boolean memoryMap)
+/* Read in a binary chain file.  Does this via memory mapping if you like,
+ * which lets processes share the file, and is faster for a few reads. */
+{
+/* Open file (low level), read in header, and check it. */
+int fd = open(fileName, O_RDONLY);
+if (fd < 0)
+    errnoAbort("Can't open %s", fileName);
+struct chainBinFileHeader h;
+if (read(fd, &h, sizeof(h)) < sizeof(h))
+    errnoAbort("Couldn't read header of file %s", fileName);
+if (h.magic != CHAINBIN_MAGIC)
+    errAbort("%s does not seem to be a chainBin file.", fileName);
+if (h.majorVersion > CHAINBIN_MAJOR_VERSION)
+    errAbort("%s is a newer, incompatible version of chainBin format. "
+             "This program works on version %d and below. "
+	     "%s is version %d.",  fileName, CHAINBIN_MAJOR_VERSION, fileName, h.majorVersion);
+
+/* Make sure the file is all there and the sections add up, so nothing
+ * points past the end of it. */
+struct stat status;
+if (fstat(fd, &status) < 0)
+    errnoAbort("Couldn't stat %s", fileName);
+if (h.size != status.st_size)
+    errAbort("%s is %lld bytes but its header says %llu, it may be truncated.",
+	    fileName, (long long)status.st_size, h.size);
+bits64 sectionsSize = sizeof(h) + (bits64)h.seqNamesSize + padded(sizeof(bits32) * (bits64)h.seqCount)
+	+ sizeof(struct chainBinTarget) * (bits64)h.targetCount
+	+ sizeof(struct chainBinChain) * h.chainCount + h.blocksSize;
+if (h.chainCount > h.size || h.blocksSize > h.size || sectionsSize != h.size)
+    errAbort("%s is corrupt, its sections don't add up to its size.", fileName);
+
+struct chainBin *cb;
+verbose(2, "chainBin file %s size %lld\n", fileName, h.size);
+
+/* Get a pointer to data in memory, via memory map, or allocation and read. */
+struct chainBinFileHeader *header;
+if (memoryMap)
+    {
+    header = mmap(NULL, h.size, PROT_READ, MAP_FILE|MAP_SHARED, fd, 0);
+    if (header == (void*)(-1))
+	errnoAbort("Couldn't mmap %s, sorry", fileName);
+    }
+else
+    {
+    header = needHugeMem(h.size);
+    if (lseek(fd, 0, SEEK_SET) < 0)
+	errnoAbort("Couldn't seek back to start of chainBin file %s.  "
+		   "ChainBin files must be random access files, not pipes and the like"
+		   , fileName);
+    if (read(fd, header, h.size) < h.size)
+        errnoAbort("Couldn't read all of chainBin file %s.", fileName);
+    }
+close(fd);
+
+/* Allocate wrapper structure and fill it in. */
+AllocVar(cb);
+cb->header = header;
+cb->isMapped = memoryMap;
+
+/* Make an array for easy access to sequence names. */
+int seqCount = header->seqCount;
+char **seqNames = AllocArray(cb->seqNames, seqCount);
+char *s = pointerOffset(header, sizeof(*header) );
+char *namesEnd = s + header->seqNamesSize;
+int i;
+for (i=0; i<seqCount; ++i)
+    {
+    char *e = memchr(s, 0, namesEnd - s);
+    if (e == NULL)
+        errAbort("%s is corrupt, sequence names run past their section.", fileName);
+    seqNames[i] = s;
+    s = e + 1;
+    }
+
+/* Point to the sections. */
+bits64 mapOffset = sizeof(*header) + header->seqNamesSize;
+cb->seqSizes = pointerOffset(header, mapOffset);
+mapOffset += padded(sizeof(bits32) * seqCount);
+cb->targets = pointerOffset(header, mapOffset);
+mapOffset += sizeof(struct chainBinTarget) * header->targetCount;
+cb->chains = pointerOffset(header, mapOffset);
+mapOffset += sizeof(struct chainBinChain) * header->chainCount;
+cb->blocks = pointerOffset(header, mapOffset);
+mapOffset += header->blocksSize;
+assert(mapOffset == header->size);	/* Sanity check */
+
+/* Hash targets by name. */
+cb->targetHash = hashNew(digitsBaseTwo(header->targetCount));
+for (i=0; i<header->targetCount; ++i)
+    hashAdd(cb->targetHash, seqNames[cb->targets[i].seqIx], &cb->targets[i]);
+verbose(2, "chainBin has %llu chains on %u targets\n", header->chainCount,
+	header->targetCount);
+return cb;
+}
+
+void chainBinFree(struct chainBin **pCb)
+/* Free up resources associated with binary chain file. */
+{
+struct chainBin *cb = *pCb;
+if (cb != NULL)
+    {
+    freeMem(cb->seqNames);
+    hashFree(&cb->targetHash);
+    if (cb->isMapped)
+	munmap((void *)cb->header, cb->header->size);
+    else
+	freeMem(cb->header);
+    freez(pCb);
+    }
+}
+
+struct chainBinVisit
+/* A subtree waiting to be visited in a search of the interval tree. */
+    {
+    bits64 ix;		/* Index of subtree root. */
+    int level;		/* Level of subtree root. */
+    boolean loDone;	/* True if lower subtree already visited. */
+    };
+
+static void ixAdd(bits64 **pIxs, bits64 *pCount, bits64 *pAlloc, bits64 ix)
+/* Add ix to dynamically allocated array. */
+{
+if (*pCount >= *pAlloc)
+    {
+    bits64 newAlloc = max(64, 2 * *pAlloc);
+    ExpandArray(*pIxs, *pAlloc, newAlloc);
+    *pAlloc = newAlloc;
+    }
+(*pIxs)[(*pCount)++] = ix;
+}
+
+bits64 chainBinOverlaps(struct chainBin *cb, char *tName, int start, int end,
+	bits64 **retIxs)
+/* Find chains overlapping tName:start-end.  Returns how many there are, and
+ * puts their indexes in cb->chains, in order of tStart, in *retIxs, which
+ * should be freeMem'd when done.  *RetIxs is NULL if there are none. */
+{
+bits64 *ixs = NULL;
+bits64 ixCount = 0, ixAlloc = 0;
+/* Positions in the file are unsigned, so don't let negative ones wrap. */
+if (start < 0)
+    start = 0;
+if (end < 0)
+    end = 0;
+struct chainBinTarget *target = hashFindVal(cb->targetHash, tName);
+if (target != NULL)
+    {
+    bits64 firstChain = target->firstChain;
+    struct chainBinChain *chains = cb->chains + firstChain;
+    bits64 chainCount = target->chainCount;
+    struct chainBinVisit stack[128], *visit;
+    int stackSize = 0;
+
+    /* Walk the tree in order, so results come out sorted, skipping
+     * subtrees with nothing ending after start and the part of the array
+     * starting at or after end. */
+    visit = &stack[stackSize++];
+    visit->level = target->rootLevel;
+    visit->ix = (1LL << visit->level) - 1;
+    visit->loDone = FALSE;
+    while (stackSize > 0)
+	{
+	struct chainBinVisit v = stack[--stackSize];
+	bits64 half = (v.level > 0 ? 1LL << (v.level-1) : 0);
+	if (v.level <= 3)
+	    {
+	    /* Small subtree, just scan it. */
+	    bits64 i = v.ix >> v.level << v.level;
+	    bits64 iEnd = min(i + (1LL << (v.level+1)) - 1, chainCount);
+	    for (; i < iEnd && chains[i].tStart < end; ++i)
+	        {
+		if (chains[i].tEnd > start)
+		    {
+		    ixAdd(&ixs, &ixCount, &ixAlloc, firstChain + i);
+		    }
+		}
+	    }
+	else if (!v.loDone)
+	    {
+	    /* Come back to this node after the lower subtree, which may be
+	     * past the end of the array, but then will have things in range. */
+	    bits64 lo = v.ix - half;
+	    visit = &stack[stackSize++];
+	    *visit = v;
+	    visit->loDone = TRUE;
+	    if (lo >= chainCount || chains[lo].maxEnd > start)
+	        {
+		visit = &stack[stackSize++];
+		visit->ix = lo;
+		visit->level = v.level - 1;
+		visit->loDone = FALSE;
+		}
+	    }
+	else if (v.ix < chainCount && chains[v.ix].tStart < end)
+	    {
+	    /* Check this node, then go on to upper subtree. */
+	    if (chains[v.ix].tEnd > start)
+		ixAdd(&ixs, &ixCount, &ixAlloc, firstChain + v.ix);
+	    visit = &stack[stackSize++];
+	    visit->ix = v.ix + half;
+	    visit->level = v.level - 1;
+	    visit->loDone = FALSE;
+	    }
+	}
+    }
+*retIxs = ixs;
+return ixCount;
+}
+
+struct chain *chainBinLoad(struct chainBin *cb, bits64 ix)
+/* Return chain at ix in cb->chains, without its blocks.  ChainFree when done. */
+{
+if (ix >= cb->header->chainCount)
+    errAbort("chainBinLoad: chain %llu out of range, there are %llu",
+	    ix, cb->header->chainCount);
+struct chainBinChain *c = &cb->chains[ix];
+struct chain *chain;
+AllocVar(chain);
+chain->score = c->score;
+chain->tName = cloneString(cb->seqNames[c->tSeqIx]);
+chain->tSize = cb->seqSizes[c->tSeqIx];
+chain->tStart = c->tStart;
+chain->tEnd = c->tEnd;
+chain->qName = cloneString(cb->seqNames[c->qSeqIx]);
+chain->qSize = cb->seqSizes[c->qSeqIx];
+chain->qStrand = c->qStrand;
+chain->qStart = c->qStart;
+chain->qEnd = c->qEnd;
+chain->id = c->id;
+return chain;
+}
+
+void chainBinLoadBlocks(struct chainBin *cb, bits64 ix, struct chain *chain)
+/* Decode blocks of chain at ix in cb->chains into chain->blockList, which
+ * should be empty. */
+{
+if (ix >= cb->header->chainCount)
+    errAbort("chainBinLoadBlocks: chain %llu out of range, there are %llu",
+	    ix, cb->header->chainCount);
+if (chain->blockList != NULL)
+    errAbort("chainBinLoadBlocks: chain %d already has blocks", chain->id);
+struct chainBinChain *c = &cb->chains[ix];
+UBYTE *p = cb->blocks + c->blockOffset;
+int tPos = c->tStart, qPos = c->qStart;
+bits32 i, dt, dq, size;
+for (i=0; i<c->blockCount; ++i)
+    {
+    struct cBlock *b;
+    p = varIntDecode(p, &dt);
+    p = varIntDecode(p, &dq);
+    p = varIntDecode(p, &size);
+    AllocVar(b);
+    b->tStart = tPos + unzigzag(dt);
+    b->tEnd = tPos = b->tStart + size;
+    b->qStart = qPos + unzigzag(dq);
+    b->qEnd = qPos = b->qStart + size;
+    slAddHead(&chain->blockList, b);
+    }
+slReverse(&chain->blockList);
+}
+
+struct chain *chainBinLoadOverlapping(struct chainBin *cb, char *tName, int start, int end)
+/* Return list of chains, with blocks, overlapping tName:start-end, sorted
+ * by tStart. */
+{
+struct chain *chainList = NULL;
+bits64 *ixs, i;
+bits64 count = chainBinOverlaps(cb, tName, start, end, &ixs);
+for (i=0; i<count; ++i)
+    {
+    struct chain *chain = chainBinLoad(cb, ixs[i]);
+    chainBinLoadBlocks(cb, ixs[i], chain);
+    slAddHead(&chainList, chain);
+    }
+slReverse(&chainList);
+freeMem(ixs);
+return chainList;
+}
@@ -6,40 +6,55 @@
 #include "common.h"
 #include "localmem.h"
 #include "linefile.h"
-#include "dlist.h"
+#include "pthreadWrap.h"
 #include "chainBlock.h"
 
-
-struct kdBranch
-/* A kd-tree. That is a binary tree which partitions the children
- * into higher and lower one dimension at a time.  We're just doing
- * one in two dimensions, so it alternates between q and t dimensions. */
-    {
-    struct kdBranch *lo;      /* Pointer to children with lower coordinates. */
-    struct kdBranch *hi;      /* Pointer to children with higher coordinates. */
-    struct kdLeaf *leaf;      /* Extra info for leaves on tree. */
-    int cutCoord;	      /* Coordinate (in some dimension) to cut on */
-    double maxScore;	      /* Max score of any leaf below us. */
-    int maxQ;		      /* Maximum qEnd of any leaf below us. */
-    int maxT;		      /* Maximum tEnd of any leaf below us. */
-    };
+#define chainBlockLmSize (1024*1024)	/* Scratch memory block size for chainBlocksMany threads. */
 
 struct kdLeaf
 /* A leaf in our kdTree. */
     {
     struct kdLeaf *next;	/* Next in list. */
     struct cBlock *cb;	        /* Start position and score from user. */
-    struct kdBranch *bestPred;	/* Best predecessor. */
+    struct kdLeaf *bestPred;	/* Best predecessor. */
     double totalScore;		/* Total score of chain up to here. */
     bool hit;			/* This hit? Used by system internally. */
     };
 
+struct kdNode
+/* A node of a kd-tree. That is a binary tree which partitions the children
+ * into higher and lower one dimension at a time.  We're just doing
+ * one in two dimensions, so it alternates between q and t dimensions.
+ * The nodes live in one array in depth first order, so there are no
+ * pointers to follow.  A subtree with n leaves takes 2n-1 nodes, and puts
+ * n/2 of them on the lo side.  The lo child comes right after its parent,
+ * and the hi child right after the lo child's subtree. */
+    {
+    double maxScore;	      /* Max score of any leaf below us. */
+    int maxQ;		      /* Maximum qEnd of any leaf below us. */
+    int maxT;		      /* Maximum tEnd of any leaf below us. */
+    int cutCoord;	      /* Coordinate (in some dimension) to cut on */
+    int leafIx;		      /* Index in tree->leaves for leaf nodes. */
+    };
+
 struct kdTree
 /* The whole tree.  */
     {
-    struct kdBranch *root;	/* Pointer to root of kd-tree. */
+    struct kdNode *nodes;	/* Nodes, starting with root. */
+    struct kdLeaf **leaves;	/* Leaves in tree order. */
+    int leafCount;		/* Number of leaves. */
     };
 
+struct kdVisit
+/* A subtree waiting to be visited in a search of the kd-tree. */
+    {
+    int nodeIx;		/* Index of subtree root in tree->nodes. */
+    int leafCount;	/* Number of leaves in subtree. */
+    int dim;		/* Dimension subtree root splits on. */
+    };
+
+#define kdMaxVisits 128	/* Plenty of room for a stack of subtrees to visit. */
+
 
 static int kdLeafCmpQ(const void *va, const void *vb)
 /* Compare to sort based on query start. */
@@ -68,136 +83,96 @@ else if (diff > 0) return 1;
 else return 0;
 }
 
-static int medianVal(struct dlList *list, int medianIx, int dim)
-/* Return value of median block in list on given dimension 
- * Mark blocks up to median as hit. */
-{
-struct dlNode *node = list->head;
-struct kdLeaf *leaf = NULL;
-int i;
-
-for (i=0; i<medianIx; ++i)
-    {
-    leaf = node->val;
-    leaf->hit = TRUE;  
-    node = node->next;
-    }
-return (dim == 0 ? leaf->cb->qStart : leaf->cb->tStart);
-}
-
-static int splitList(struct dlList *oldList, struct dlList *newList)
-/* Peel off members of oldList that are not hit onto new list. */
+static void kdBuild(struct kdTree *tree, int nodeIx, int leafCount,
+	struct kdLeaf **lists[2], int dim, struct kdLeaf **buf)
+/* Build up kd-tree recursively from leaves sorted in each dimension,
+ * putting the subtree root at nodeIx. */
 {
-struct dlNode *node, *next;
-struct kdLeaf *leaf;
-int newCount = 0;
-dlListInit(newList);
-for (node = oldList->head; !dlEnd(node); node = next)
+struct kdNode *node = &tree->nodes[nodeIx];
+node->maxScore = 0;
+if (leafCount == 1)
     {
-    next = node->next;
-    leaf = node->val;
-    if (!leaf->hit)
-	{
-	dlRemove(node);
-	dlAddTail(newList, node);
-	++newCount;
-	}
-    }
-return newCount;
-}
-
-static void clearHits(struct dlList *list)
-/* Clear hit flags of all blocks on list. */
-{
-struct dlNode *node;
-for (node = list->head; !dlEnd(node); node = node->next)
-    {
-    struct kdLeaf *leaf = node->val;
-    leaf->hit = FALSE;
-    }
-}
-
-
-static struct kdBranch *kdBuild(int nodeCount, struct dlList *lists[2], int dim,
-	struct lm *lm)
-/* Build up kd-tree recursively. */
-{
-struct kdBranch *branch;
-lmAllocVar(lm, branch);
-if (nodeCount == 1)
-    {
-    struct kdLeaf *leaf = lists[0]->head->val;
-    branch->leaf = leaf;
-    branch->maxQ = leaf->cb->qEnd;
-    branch->maxT = leaf->cb->tEnd;
+    struct kdLeaf *leaf = lists[0][0];
+    node->leafIx = tree->leafCount;
+    tree->leaves[tree->leafCount++] = leaf;
+    node->maxQ = leaf->cb->qEnd;
+    node->maxT = leaf->cb->tEnd;
     }
 else
     {
-    int newCount;
-    struct dlList *newLists[2];
-    struct dlList newQ, newT;
+    int loCount = leafCount/2;
+    int hiIx = nodeIx + 2*loCount;
     int nextDim = 1-dim;
-
-    /* Subdivide lists along median.  */
-    newLists[0] = &newQ;
-    newLists[1] = &newT;
-    clearHits(lists[0]);
-    branch->cutCoord = medianVal(lists[dim], nodeCount/2, dim);
-    newCount = splitList(lists[0], newLists[0]);
-    splitList(lists[1], newLists[1]);
+    struct kdLeaf **dimList = lists[dim], **otherList = lists[nextDim];
+    struct kdLeaf **hiLists[2];
+    int i, lo = 0, hi = loCount;
+
+    /* Subdivide lists along median.  The dimension we cut on is already
+     * in order.  The other one is split keeping each side in order. */
+    for (i=0; i<leafCount; ++i)
+        dimList[i]->hit = (i < loCount);
+    node->cutCoord = (dim == 0 ? dimList[loCount-1]->cb->qStart 
+    			       : dimList[loCount-1]->cb->tStart);
+    for (i=0; i<leafCount; ++i)
+        {
+	struct kdLeaf *leaf = otherList[i];
+	if (leaf->hit)
+	    buf[lo++] = leaf;
+	else
+	    buf[hi++] = leaf;
+	}
+    memcpy(otherList, buf, leafCount * sizeof(buf[0]));
+    hiLists[dim] = dimList + loCount;
+    hiLists[nextDim] = otherList + loCount;
 
     /* Recurse on each side. */
-    branch->lo = kdBuild(nodeCount - newCount, lists, nextDim, lm);
-    branch->hi = kdBuild(newCount, newLists, nextDim, lm);
-    branch->maxQ = max(branch->lo->maxQ, branch->hi->maxQ);
-    branch->maxT = max(branch->lo->maxT, branch->hi->maxT);
+    kdBuild(tree, nodeIx+1, loCount, lists, nextDim, buf);
+    kdBuild(tree, hiIx, leafCount - loCount, hiLists, nextDim, buf);
+    node->maxQ = max(tree->nodes[nodeIx+1].maxQ, tree->nodes[hiIx].maxQ);
+    node->maxT = max(tree->nodes[nodeIx+1].maxT, tree->nodes[hiIx].maxT);
     }
-return branch;
 }
 
 static struct kdTree *kdTreeMake(struct kdLeaf *leafList, struct lm *lm)
-/* Make a kd-tree containing leafList. */
+/* Make a kd-tree containing leafList, which is sorted by tStart. */
 {
 struct kdLeaf *leaf;
-int nodeCount = slCount(leafList);
+int leafCount = slCount(leafList);
 struct kdTree *tree;
-struct dlList qList, tList,*lists[2];
-struct dlNode *qNodes, *tNodes;
+struct kdLeaf **qList, **tList, **buf, **lists[2];
 int i;
 
 /* Build lists sorted in each dimension. This
  * will let us quickly find medians while constructing
  * the kd-tree. */
-dlListInit(&qList);
-dlListInit(&tList);
-AllocArray(qNodes, nodeCount);
-AllocArray(tNodes, nodeCount);
+AllocArray(qList, leafCount);
+AllocArray(tList, leafCount);
+AllocArray(buf, leafCount);
 for (i=0 , leaf=leafList; leaf != NULL; leaf = leaf->next, ++i)
-    {
-    qNodes[i].val = tNodes[i].val = leaf;
-    dlAddTail(&qList, &qNodes[i]);
-    dlAddTail(&tList, &tNodes[i]);
-    }
+    qList[i] = tList[i] = leaf;
 /* Just sort qList since tList is sorted because it was
  * constructed from sorted leafList. */
-dlSort(&qList, kdLeafCmpQ); 
-lists[0] = &qList;
-lists[1] = &tList;
+qsort(qList, leafCount, sizeof(qList[0]), kdLeafCmpQ);
+lists[0] = qList;
+lists[1] = tList;
 
 /* Allocate master data structure and call recursive builder. */
 lmAllocVar(lm, tree);
-tree->root = kdBuild(nodeCount, lists, 0, lm);
+lmAllocArray(lm, tree->nodes, 2*leafCount - 1);
+lmAllocArray(lm, tree->leaves, leafCount);
+kdBuild(tree, 0, leafCount, lists, 0, buf);
 
 /* Clean up and go home. */
-freeMem(qNodes);
-freeMem(tNodes);
+freeMem(qList);
+freeMem(tList);
+freeMem(buf);
 return tree;
 }
 
 struct predScore
 /* Predecessor and score we get merging with it. */
     {
-    struct kdBranch *pred;	/* Predecessor. */
+    struct kdLeaf *pred;	/* Predecessor. */
     double score;		/* Score of us plus predecessor. */
     };
 
@@ -206,77 +181,118 @@ static struct predScore bestPredecessor(
 	ConnectCost connectCost,    /* Cost to connect two leafs. */
 	GapCost gapCost,	    /* Lower bound on gap cost. */
 	void *gapData,		    /* Data to pass to Gap/Connect cost */
-	int dim,		    /* Dimension level of tree splits on. */
-	struct kdBranch *branch,    /* Subtree to explore */
+	struct kdTree *tree,	    /* Tree to explore */
 	struct predScore bestSoFar) /* Best predecessor so far. */
 /* Find the highest scoring predecessor to this leaf, and
  * thus iteratively the highest scoring subchain that ends
  * in this leaf. */
 {
-struct kdLeaf *leaf;
-double maxScore = branch->maxScore + lonely->cb->score;
-
-/* If best score in this branch of tree wouldn't be enough
- * don't bother exploring it. First try without calculating
- * gap score in case gap score is a little expensive to calculate. */
-if (maxScore < bestSoFar.score)
-    return bestSoFar;
-maxScore -= gapCost(lonely->cb->qStart - branch->maxQ, 
-	lonely->cb->tStart - branch->maxT, gapData);
-if (maxScore < bestSoFar.score)
-    return bestSoFar;
-
-
-/* If it's a terminal branch, then calculate score to connect
- * with it. */
-else if ((leaf = branch->leaf) != NULL)
+struct kdVisit stack[kdMaxVisits], *visit;
+struct cBlock *cb = lonely->cb;
+int qStart = cb->qStart, tStart = cb->tStart;
+int stackSize = 0;
+
+visit = &stack[stackSize++];
+visit->nodeIx = 0;
+visit->leafCount = tree->leafCount;
+visit->dim = 0;
+while (stackSize > 0)
     {
-    if (leaf->cb->qStart < lonely->cb->qStart 
-     && leaf->cb->tStart < lonely->cb->tStart)
+    visit = &stack[--stackSize];
+    int nodeIx = visit->nodeIx, leafCount = visit->leafCount, dim = visit->dim;
+    struct kdNode *node = &tree->nodes[nodeIx];
+    double maxScore = node->maxScore + cb->score;
+
+    /* If best score in this branch of tree wouldn't be enough
+     * don't bother exploring it. First try without calculating
+     * gap score in case gap score is a little expensive to calculate. */
+    if (maxScore < bestSoFar.score)
+	continue;
+    maxScore -= gapCost(qStart - node->maxQ, tStart - node->maxT, gapData);
+    if (maxScore < bestSoFar.score)
+	continue;
+
+    /* If it's a terminal branch, then calculate score to connect
+     * with it. */
+    if (leafCount == 1)
 	{
-	double score = leaf->totalScore + lonely->cb->score - 
-		connectCost(leaf->cb, lonely->cb, gapData);
-	if (score > bestSoFar.score)
-	   {
-	   bestSoFar.score = score;
-	   bestSoFar.pred = branch;
-	   }
+	struct kdLeaf *leaf = tree->leaves[node->leafIx];
+	if (leaf->cb->qStart < qStart && leaf->cb->tStart < tStart)
+	    {
+	    double score = leaf->totalScore + cb->score - 
+		    connectCost(leaf->cb, cb, gapData);
+	    if (score > bestSoFar.score)
+	       {
+	       bestSoFar.score = score;
+	       bestSoFar.pred = leaf;
+	       }
+	    }
 	}
-    return bestSoFar;
-    }
 
-/* Otherwise explore sub-trees that could harbor predecessors. */
-else
-    {
-    int newDim = 1-dim;
-    int dimCoord = (dim == 0 ? lonely->cb->qStart : lonely->cb->tStart);
-    
-    /* Explore hi branch first as it is more likely to have high
-     * scores.  However only explore it if it can have things starting
-     * before us. */
-    if (dimCoord > branch->cutCoord)
-         bestSoFar = bestPredecessor(lonely, connectCost, gapCost, gapData,
-	 	newDim, branch->hi, bestSoFar);
-    bestSoFar = bestPredecessor(lonely, connectCost, gapCost, gapData,
-    	newDim, branch->lo, bestSoFar);
-    return bestSoFar;
+    /* Otherwise explore sub-trees that could harbor predecessors. 
+     * Explore hi branch first as it is more likely to have high
+     * scores, so push it last.  However only explore it if it can have
+     * things starting before us. */
+    else
+	{
+	int loCount = leafCount/2;
+	int nextDim = 1-dim;
+	int dimCoord = (dim == 0 ? qStart : tStart);
+	visit = &stack[stackSize++];
+	visit->nodeIx = nodeIx + 1;
+	visit->leafCount = loCount;
+	visit->dim = nextDim;
+	if (dimCoord > node->cutCoord)
+	    {
+	    visit = &stack[stackSize++];
+	    visit->nodeIx = nodeIx + 2*loCount;
+	    visit->leafCount = leafCount - loCount;
+	    visit->dim = nextDim;
+	    }
+	}
     }
+return bestSoFar;
 }
 
-static void updateScoresOnWay(struct kdBranch *branch, 
-	int dim, struct kdLeaf *leaf)
+static void updateScoresOnWay(struct kdTree *tree, struct kdLeaf *leaf)
 /* Traverse kd-tree to find leaf.  Update all maxScores on the way
  * to reflect leaf->totalScore. */
 {
-int newDim = 1-dim;
-int dimCoord = (dim == 0 ? leaf->cb->qStart : leaf->cb->tStart);
-if (branch->maxScore < leaf->totalScore) branch->maxScore = leaf->totalScore;
-if (branch->leaf == NULL)
+struct kdVisit stack[kdMaxVisits], *visit;
+int qStart = leaf->cb->qStart, tStart = leaf->cb->tStart;
+double totalScore = leaf->totalScore;
+int stackSize = 0;
+
+visit = &stack[stackSize++];
+visit->nodeIx = 0;
+visit->leafCount = tree->leafCount;
+visit->dim = 0;
+while (stackSize > 0)
     {
-    if (dimCoord <= branch->cutCoord)
-	updateScoresOnWay(branch->lo, newDim, leaf);
-    if (dimCoord >= branch->cutCoord)
-	updateScoresOnWay(branch->hi, newDim, leaf);
+    visit = &stack[--stackSize];
+    int nodeIx = visit->nodeIx, leafCount = visit->leafCount, dim = visit->dim;
+    struct kdNode *node = &tree->nodes[nodeIx];
+    if (node->maxScore < totalScore) node->maxScore = totalScore;
+    if (leafCount > 1)
+	{
+	int loCount = leafCount/2;
+	int nextDim = 1-dim;
+	int dimCoord = (dim == 0 ? qStart : tStart);
+	if (dimCoord <= node->cutCoord)
+	    {
+	    visit = &stack[stackSize++];
+	    visit->nodeIx = nodeIx + 1;
+	    visit->leafCount = loCount;
+	    visit->dim = nextDim;
+	    }
+	if (dimCoord >= node->cutCoord)
+	    {
+	    visit = &stack[stackSize++];
+	    visit->nodeIx = nodeIx + 2*loCount;
+	    visit->leafCount = leafCount - loCount;
+	    visit->dim = nextDim;
+	    }
+	}
     }
 }
 
@@ -286,22 +302,17 @@ static void findBestPredecessors(struct kdTree *tree, struct kdLeaf *leafList,
 {
 static struct predScore noBest;
 struct kdLeaf *leaf;
-double bestScore = 0;
 
 for (leaf = leafList; leaf != NULL; leaf = leaf->next)
     {
     struct predScore best;
-    best = bestPredecessor(leaf, connectCost, gapCost, gapData, 0, tree->root, noBest);
+    best = bestPredecessor(leaf, connectCost, gapCost, gapData, tree, noBest);
     if (best.score > leaf->totalScore)
         {
 	leaf->totalScore = best.score;
 	leaf->bestPred = best.pred;
 	}
-    updateScoresOnWay(tree->root, 0, leaf);
-    if (bestScore < leaf->totalScore)
-        {
-	bestScore = leaf->totalScore;
-	}
+    updateScoresOnWay(tree, leaf);
     }
 }
 
@@ -371,12 +382,12 @@ for (leaf = leafList; leaf != NULL; leaf = leaf->next)
 		if (details)
 		    {
 		    struct cBlock *b = lf->cb;
-		    struct cBlock *a = lf->bestPred->leaf->cb;
+		    struct cBlock *a = lf->bestPred->cb;
 		    fprintf(details, " gap %d\t%d\n", 
 			b->tStart - a->tEnd, b->qStart - a->qEnd);
 		    }
 		}
-	    lf = lf->bestPred->leaf;
+	    lf = lf->bestPred;
 	    if (lf->hit)
 	        break;
 	    }
@@ -386,48 +397,38 @@ slReverse(&chainList);
 return chainList;
 }
 
-struct chain *chainBlocks(
+static struct chain *chainBlocksLm(
 	char *qName, int qSize, char qStrand,	/* Info on query sequence */
 	char *tName, int tSize, 		/* Info on target. */
 	struct cBlock **pBlockList, 		/* Unordered ungapped alignments. */
 	ConnectCost connectCost, 		/* Calculate cost to connect nodes. */
 	GapCost gapCost, 			/* Cost for non-overlapping nodes. */
 	void *gapData, 				/* Passed through to connect/gapCosts */
-	FILE *details)				/* NULL except for debugging */
-/* Create list of chains from list of blocks.  The blockList will get
- * eaten up as the blocks are moved from the list to the chain. 
- * The list of chains returned is sorted by score. 
- *
- * The details FILE may be NULL, and is where additional information
- * about the chaining is put.
- *
- * Note that the connectCost needs to adjust for possibly partially 
- * overlapping blocks, and that these need to be taken out of the
- * resulting chains in general.  This can get fairly complex.  Also
- * the chains will need some cleanup at the end.  Use the chainConnect
- * module to help with this.  See hg/mouseStuff/axtChain for example usage. */
+	FILE *details,				/* NULL except for debugging */
+	struct lm *lm)				/* Memory for tree, branches and leaves. */
+/* Do the work of chainBlocks using lm for scratch memory. */
 {
 struct kdTree *tree;
-struct kdLeaf *leafList = NULL, *leaf;
+struct kdLeaf *leafList = NULL, *leaf, *leaves;
 struct cBlock *block;
 struct chain *chainList = NULL, *chain;
-struct lm *lm;
 
 /* Empty lists will be problematic later, so deal with them here. */
 if (*pBlockList == NULL)
    return NULL;
 
-/* Make a leaf for each block. */
-lm = lmInit(0);  /* Memory for tree, branches and leaves. */
+/* Make a leaf for each block, all in one array. */
+lmAllocArray(lm, leaves, slCount(*pBlockList));
+leaf = leaves;
 for (block = *pBlockList; block != NULL; block = block->next)
     {
     /* Watch out for 0-length blocks in input: */
     if (block->tStart == block->tEnd)
 	continue;
-    lmAllocVar(lm, leaf);
     leaf->cb = block;
     leaf->totalScore = block->score;
     slAddHead(&leafList, leaf);
+    ++leaf;
     }
 
 /* Figure out chains. */
@@ -441,10 +442,117 @@ chainList = peelChains(qName, qSize, qStrand, tName, tSize, leafList, details);
 for (chain = chainList; chain != NULL; chain = chain->next)
     chain->score = scoreBlocks(chain->blockList, connectCost, gapData);
 slSort(&chainList,  chainCmpScore);
+*pBlockList = NULL;
+return chainList;
+}
 
-/* Clean up and go home. */
+struct chain *chainBlocks(
+	char *qName, int qSize, char qStrand,	/* Info on query sequence */
+	char *tName, int tSize, 		/* Info on target. */
+	struct cBlock **pBlockList, 		/* Unordered ungapped alignments. */
+	ConnectCost connectCost, 		/* Calculate cost to connect nodes. */
+	GapCost gapCost, 			/* Cost for non-overlapping nodes. */
+	void *gapData, 				/* Passed through to connect/gapCosts */
+	FILE *details)				/* NULL except for debugging */
+/* Create list of chains from list of blocks.  The blockList will get
+ * eaten up as the blocks are moved from the list to the chain. 
+ * The list of chains returned is sorted by score. 
+ *
+ * The details FILE may be NULL, and is where additional information
+ * about the chaining is put.
+ *
+ * Note that the connectCost needs to adjust for possibly partially 
+ * overlapping blocks, and that these need to be taken out of the
+ * resulting chains in general.  This can get fairly complex.  Also
+ * the chains will need some cleanup at the end.  Use the chainConnect
+ * module to help with this.  See hg/mouseStuff/axtChain for example usage. */
+{
+if (*pBlockList == NULL)
+   return NULL;
+struct lm *lm = lmInit(0);
+struct chain *chainList = chainBlocksLm(qName, qSize, qStrand, tName, tSize,
+	pBlockList, connectCost, gapCost, gapData, details, lm);
 lmCleanup(&lm);
-*pBlockList = NULL;
 return chainList;
 }
 
+struct chainBlockPool
+/* Hands out jobs to chainBlocksMany threads. */
+    {
+    struct chainBlockJob **jobs;	/* Jobs, biggest first. */
+    int jobCount;			/* Number of jobs. */
+    int nextJob;			/* Index of next job to hand out. */
+    pthread_mutex_t mutex;		/* Protects nextJob. */
+    };
+
+static void *chainBlockThread(void *v)
+/* Chain jobs from pool until there are none left. */
+{
+struct chainBlockPool *pool = v;
+struct lm *lm = lmInit(chainBlockLmSize);
+for (;;)
+    {
+    pthreadMutexLock(&pool->mutex);
+    int jobIx = pool->nextJob++;
+    pthreadMutexUnlock(&pool->mutex);
+    if (jobIx >= pool->jobCount)
+        break;
+    struct chainBlockJob *job = pool->jobs[jobIx];
+    job->chainList = chainBlocksLm(job->qName, job->qSize, job->qStrand,
+    	job->tName, job->tSize, &job->blockList,
+	job->connectCost, job->gapCost, job->gapData, NULL, lm);
+    lmReset(lm);
+    }
+lmCleanup(&lm);
+return NULL;
+}
+
+static int jobCmpSizeDesc(const void *va, const void *vb)
+/* Compare to sort jobs biggest first. */
+{
+const struct chainBlockJob *a = *((struct chainBlockJob **)va);
+const struct chainBlockJob *b = *((struct chainBlockJob **)vb);
+return b->blockCount - a->blockCount;
+}
+
+void chainBlocksMany(struct chainBlockJob *jobList, int threadCount)
+/* Run chainBlocks on each job, putting the chains in job->chainList.
+ * Jobs are spread over threadCount threads, biggest first, each thread
+ * with its own scratch memory.  The chains are the same as from calling
+ * chainBlocks on each job in turn.  Chain ids are left zero, so writing the
+ * chains out in job order on the calling thread numbers them as the serial
+ * path would.  The cost functions must be safe to call from several
+ * threads at once, as chainConnectCost and gapCalcCost are. */
+{
+int jobCount = slCount(jobList);
+if (jobCount == 0)
+    return;
+struct chainBlockPool pool;
+ZeroVar(&pool);
+AllocArray(pool.jobs, jobCount);
+struct chainBlockJob *job;
+int i = 0;
+for (job = jobList; job != NULL; job = job->next)
+    {
+    job->blockCount = slCount(job->blockList);
+    pool.jobs[i++] = job;
+    }
+qsort(pool.jobs, jobCount, sizeof(pool.jobs[0]), jobCmpSizeDesc);
+pool.jobCount = jobCount;
+pthreadMutexInit(&pool.mutex);
+threadCount = min(threadCount, jobCount);
+if (threadCount <= 1)
+    chainBlockThread(&pool);
+else
+    {
+    pthread_t *threads;
+    AllocArray(threads, threadCount);
+    for (i=0; i<threadCount; ++i)
+        pthreadCreate(&threads[i], NULL, chainBlockThread, &pool);
+    for (i=0; i<threadCount; ++i)
+        pthreadJoin(threads[i]);
+    freeMem(threads);
+    }
+pthreadMutexDestroy(&pool.mutex);
+freeMem(pool.jobs);
+}
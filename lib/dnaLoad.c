@@ -29,6 +29,8 @@ struct dnaLoad
     int curStart;		/* Start offset within current parent sequence. */
     int curEnd;			/* End offset  within current parent sequence. */
     int curSize;		/* Size of current parent sequence. */
+    struct twoBitFile *fetchTwoBit;	/* Random access .2bit for dnaLoadFetch. */
+    struct faIndex *fetchFa;	/* Random access fasta for dnaLoadFetch. */
     };
 
 struct dnaLoadStack *dnaLoadStackNew(char *fileName)
@@ -88,6 +90,8 @@ struct dnaLoad *dl = *pDl;
 if (dl != NULL)
     {
     dnaLoadStackFreeList(&dl->stack);
+    twoBitClose(&dl->fetchTwoBit);
+    faIndexClose(&dl->fetchFa);
     freeMem(dl->topFileName);
     freez(pDl);
     }
@@ -298,3 +302,39 @@ int dnaLoadCurSize(struct dnaLoad *dl)
 return dl->curSize;
 }
 
+
+static void dnaLoadOpenFetch(struct dnaLoad *dl)
+/* Open top file for random access if not already. */
+{
+if (dl->fetchTwoBit != NULL || dl->fetchFa != NULL)
+    return;
+if (twoBitIsFile(dl->topFileName))
+    dl->fetchTwoBit = twoBitOpen(dl->topFileName);
+else if (faIsIndexable(dl->topFileName))
+    dl->fetchFa = faIndexOpen(dl->topFileName);
+else
+    errAbort("%s must be a .2bit or uncompressed fasta file for random access",
+	    dl->topFileName);
+}
+
+long long dnaLoadSeqSize(struct dnaLoad *dl, char *seqName)
+/* Return size of named sequence in a .2bit or fasta file opened with
+ * dnaLoadOpen.  Aborts if the sequence isn't there. */
+{
+dnaLoadOpenFetch(dl);
+if (dl->fetchTwoBit != NULL)
+    return twoBitSeqSize(dl->fetchTwoBit, seqName);
+return faIndexSeqSize(dl->fetchFa, seqName);
+}
+
+struct dnaSeq *dnaLoadFetch(struct dnaLoad *dl, char *seqName, int start, int end)
+/* Return part of named sequence from a .2bit or fasta file opened with
+ * dnaLoadOpen, reading only what is needed.  Fasta files are indexed with
+ * a .fai file, which is built if need be.  If end is 0 fetch to the end of
+ * the sequence.  DNA is mixed case.  This is independent of dnaLoadNext. */
+{
+dnaLoadOpenFetch(dl);
+if (dl->fetchTwoBit != NULL)
+    return twoBitReadSeqFrag(dl->fetchTwoBit, seqName, start, end);
+return faIndexReadSeqFrag(dl->fetchFa, seqName, start, end);
+}
@@ -14,6 +14,9 @@
 
 #include "common.h"
 #include "dnautil.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 struct codonTable
@@ -858,6 +861,120 @@ while (lettersLeft > 0)
     }
 }
 
+void writeSeqWithBreaksAt(FILE *f, char *letters, int letterCount, int maxPerLine,
+	int *pLineSize)
+/* Write out letters with newlines every maxPerLine, continuing a line that
+ * already has *pLineSize letters on it, and update *pLineSize.  This lets
+ * a wrapped sequence be written a piece at a time. */
+{
+int lineSize = *pLineSize;
+while (letterCount > 0)
+    {
+    int oneSize = min(letterCount, maxPerLine - lineSize);
+    mustWrite(f, letters, oneSize);
+    letters += oneSize;
+    letterCount -= oneSize;
+    lineSize += oneSize;
+    if (lineSize >= maxPerLine)
+        {
+	fputc('\n', f);
+	lineSize = 0;
+	}
+    }
+*pLineSize = lineSize;
+}
+
+void writeCharWithBreaksAt(FILE *f, char c, int count, int maxPerLine, int *pLineSize)
+/* Write out count copies of c, wrapping lines like writeSeqWithBreaksAt. */
+{
+char buf[4096];
+memset(buf, c, min(count, sizeof(buf)));
+while (count > 0)
+    {
+    int oneSize = min(count, sizeof(buf));
+    writeSeqWithBreaksAt(f, buf, oneSize, maxPerLine, pLineSize);
+    count -= oneSize;
+    }
+}
+
+#define isNChar(c) (((c) | 0x20) == 'n')
+/* TRUE for N or n.  No other character maps to 'n' when 0x20 is or'd in. */
+
+#ifdef __SSE2__
+static int nMask16(DNA *dna)
+/* Return bit mask of the N's and n's in the 16 bases at dna. */
+{
+__m128i v = _mm_or_si128(_mm_loadu_si128((__m128i *)dna), _mm_set1_epi8(0x20));
+return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('n')));
+}
+#endif
+
+int findNextN(DNA *dna, int start, int size)
+/* Return position of first N or n at or after start, or size if none. */
+{
+int i = start;
+#ifdef __SSE2__
+for (; i + 16 <= size; i += 16)
+    {
+    int mask = nMask16(dna+i);
+    if (mask != 0)
+        return i + __builtin_ctz(mask);
+    }
+#endif
+for (; i < size; ++i)
+    if (isNChar(dna[i]))
+        return i;
+return size;
+}
+
+int findNextNonN(DNA *dna, int start, int size)
+/* Return position of first base that isn't N or n at or after start, or
+ * size if none. */
+{
+int i = start;
+#ifdef __SSE2__
+for (; i + 16 <= size; i += 16)
+    {
+    int mask = ~nMask16(dna+i) & 0xffff;
+    if (mask != 0)
+        return i + __builtin_ctz(mask);
+    }
+#endif
+for (; i < size; ++i)
+    if (!isNChar(dna[i]))
+        return i;
+return size;
+}
+
+int findBlocksOfN(DNA *dna, int size, bits32 **retStarts, bits32 **retSizes)
+/* Find runs of N's (or n's) in dna, the same blocks a .2bit file stores
+ * as nBlocks.  Returns number of blocks and sets *retStarts and *retSizes
+ * to arrays of block starts and sizes in order, or to NULL if there are no
+ * blocks.  Free arrays with freeMem. */
+{
+int count = 0, alloc = 0;
+bits32 *starts = NULL, *sizes = NULL;
+int pos = findNextN(dna, 0, size);
+while (pos < size)
+    {
+    int end = findNextNonN(dna, pos, size);
+    if (count == alloc)
+        {
+	int newAlloc = (alloc == 0 ? 64 : alloc*2);
+	starts = needLargeMemResize(starts, newAlloc * sizeof(starts[0]));
+	sizes = needLargeMemResize(sizes, newAlloc * sizeof(sizes[0]));
+	alloc = newAlloc;
+	}
+    starts[count] = pos;
+    sizes[count] = end - pos;
+    ++count;
+    pos = findNextN(dna, end, size);
+    }
+*retStarts = starts;
+*retSizes = sizes;
+return count;
+}
+
 static int findTailPolyAMaybeMask(DNA *dna, int size, boolean doMask,
 				  boolean loose)
 /* Identify PolyA at end; mask to 'n' if specified.  This allows a few 
@@ -10,7 +10,10 @@
 #include "dnautil.h"
 #include "dnaseq.h"
 #include "fa.h"
+#include "blockGz.h"
 #include "linefile.h"
+#include "dlist.h"
+#include "sqlNum.h"
 
 
 boolean faReadNext(FILE *f, char *defaultName, boolean mustStartWithComment,
@@ -406,6 +409,16 @@ if (startLine != NULL)
 writeSeqWithBreaks(f, dna, dnaSize, 50);
 }
 
+void faWriteNextBlockGz(struct blockGz *bg, char *startLine, DNA *dna, int dnaSize)
+/* Write next sequence to a multi-threaded gzip fa stream. */
+{
+if (dnaSize == 0)
+    return;
+if (startLine != NULL)
+    blockGzPrintf(bg, ">%s\n", startLine);
+blockGzWriteSeqWithBreaks(bg, dna, dnaSize, 50);
+}
+
 void faWrite(char *fileName, char *startLine, DNA *dna, int dnaSize)
 /* Write out FA file or die trying. */
 {
@@ -646,3 +659,411 @@ struct dnaSeq *faReadAllMixedInLf(struct lineFile *lf)
 {
 return faReadAllMixableInLf(lf, FALSE, TRUE);
 }
+
+/* ------------- Random access through a samtools style .fai index. ------------- */
+
+struct faiScan
+/* Buffered reader for building an index. */
+    {
+    FILE *f;			/* File being scanned. */
+    char buf[64*1024];		/* Buffer. */
+    int bufSize, bufPos;	/* Bytes in buffer and next byte to return. */
+    bits64 offset;		/* Offset in file of next byte. */
+    };
+
+static int faiScanGetc(struct faiScan *scan)
+/* Return next character or EOF. */
+{
+if (scan->bufPos >= scan->bufSize)
+    {
+    scan->bufSize = fread(scan->buf, 1, sizeof(scan->buf), scan->f);
+    scan->bufPos = 0;
+    if (scan->bufSize <= 0)
+        return EOF;
+    }
+scan->offset += 1;
+return (UBYTE)scan->buf[scan->bufPos++];
+}
+
+static struct faIndexEntry *faIndexScan(char *faName)
+/* Scan fasta file and return list of index entries. */
+{
+struct faiScan *scan;
+struct faIndexEntry *list = NULL, *entry = NULL;
+struct dyString *name = dyStringNew(0);
+int c, lineBases = 0, lineBytes = 0;
+boolean sawShortLine = FALSE;
+
+AllocVar(scan);
+scan->f = mustOpen(faName, "rb");
+for (;;)
+    {
+    c = faiScanGetc(scan);
+    if (c == '>' || c == EOF)
+        {
+	/* Finish up any partial line of previous sequence. */
+	if (entry != NULL && lineBytes > 0)
+	    {
+	    if ((sawShortLine && lineBases > 0)
+	        || (entry->lineBases != 0 && lineBases > entry->lineBases))
+		errAbort("Can't index %s: %s has lines of different lengths",
+			faName, entry->name);
+	    if (entry->lineBases == 0)
+	        {
+		entry->lineBases = lineBases;
+		entry->lineBytes = lineBytes;
+		}
+	    entry->size += lineBases;
+	    }
+	if (c == EOF)
+	    break;
+
+	/* Read name and skip rest of header line. */
+	dyStringClear(name);
+	while ((c = faiScanGetc(scan)) != EOF && c != '\n' && !isspace(c))
+	    dyStringAppendC(name, c);
+	while (c != EOF && c != '\n')
+	    c = faiScanGetc(scan);
+	if (name->stringSize == 0)
+	    errAbort("Can't index %s: empty sequence name", faName);
+	AllocVar(entry);
+	entry->name = cloneString(name->string);
+	entry->offset = scan->offset;
+	slAddHead(&list, entry);
+	lineBases = lineBytes = 0;
+	sawShortLine = FALSE;
+	}
+    else if (entry == NULL)
+        {
+	if (!isspace(c))
+	    errAbort("Can't index %s: doesn't start with '>'", faName);
+	}
+    else
+        {
+	lineBytes += 1;
+	if (c == '\n')
+	    {
+	    if (sawShortLine && lineBases > 0)
+		errAbort("Can't index %s: %s has lines of different lengths",
+			faName, entry->name);
+	    if (entry->lineBases == 0)
+	        {
+		entry->lineBases = lineBases;
+		entry->lineBytes = lineBytes;
+		}
+	    else if (lineBases > entry->lineBases || lineBytes > entry->lineBytes)
+		errAbort("Can't index %s: %s has lines of different lengths",
+			faName, entry->name);
+	    else if (lineBases != entry->lineBases || lineBytes != entry->lineBytes)
+	        sawShortLine = TRUE;
+	    if (lineBases == 0)
+	        sawShortLine = TRUE;
+	    entry->size += lineBases;
+	    lineBases = lineBytes = 0;
+	    }
+	else if (c != '\r')
+	    lineBases += 1;
+	}
+    }
+carefulClose(&scan->f);
+freeMem(scan);
+dyStringFree(&name);
+slReverse(&list);
+return list;
+}
+
+static boolean faIndexWrite(struct faIndexEntry *list, char *faiName)
+/* Write out index.  Return FALSE if file can't be created. */
+{
+struct faIndexEntry *entry;
+FILE *f = fopen(faiName, "w");
+if (f == NULL)
+    return FALSE;
+for (entry = list; entry != NULL; entry = entry->next)
+    fprintf(f, "%s\t%llu\t%llu\t%d\t%d\n", entry->name, entry->size, entry->offset,
+	    entry->lineBases, entry->lineBytes);
+carefulClose(&f);
+return TRUE;
+}
+
+static void faIndexEntryFreeList(struct faIndexEntry **pList)
+/* Free up list of index entries. */
+{
+struct faIndexEntry *entry, *next;
+for (entry = *pList; entry != NULL; entry = next)
+    {
+    next = entry->next;
+    freeMem(entry->name);
+    freeMem(entry);
+    }
+*pList = NULL;
+}
+
+boolean faIndexBuild(char *faName, char *faiName)
+/* Scan fasta file faName and write a samtools compatible index to faiName.
+ * Aborts if the file can't be indexed because line lengths vary within a
+ * sequence.  Returns FALSE without aborting if faiName can't be written. */
+{
+struct faIndexEntry *list = faIndexScan(faName);
+boolean ok = faIndexWrite(list, faiName);
+faIndexEntryFreeList(&list);
+return ok;
+}
+
+static struct faIndexEntry *faIndexRead(char *faiName)
+/* Read in a .fai file. */
+{
+struct lineFile *lf = lineFileOpen(faiName, TRUE);
+struct faIndexEntry *list = NULL, *entry;
+char *row[5];
+while (lineFileRowTab(lf, row))
+    {
+    AllocVar(entry);
+    entry->name = cloneString(row[0]);
+    entry->size = sqlUnsignedLong(row[1]);
+    entry->offset = sqlUnsignedLong(row[2]);
+    entry->lineBases = lineFileNeedNum(lf, row, 3);
+    entry->lineBytes = lineFileNeedNum(lf, row, 4);
+    if (entry->size > 0 && (entry->lineBases <= 0 || entry->lineBytes < entry->lineBases))
+        errAbort("Bad line length for %s line %d of %s", entry->name, lf->lineIx, lf->fileName);
+    slAddHead(&list, entry);
+    }
+lineFileClose(&lf);
+slReverse(&list);
+return list;
+}
+
+boolean faIsIndexable(char *fileName)
+/* Return TRUE if fileName looks like an uncompressed fasta file. */
+{
+FILE *f = fopen(fileName, "rb");
+int c = EOF;
+if (f == NULL)
+    return FALSE;
+while ((c = getc(f)) != EOF && isspace(c))
+    ;
+fclose(f);
+return c == '>';
+}
+
+struct faIndex *faIndexOpen(char *faName)
+/* Open fasta file for random access.  Reads faName.fai, first building
+ * it if it is missing or older than faName.  If the index can't be
+ * written it is kept in memory only. */
+{
+struct faIndex *fai;
+struct faIndexEntry *entry;
+char faiName[PATH_LEN];
+int ix = 0;
+
+AllocVar(fai);
+fai->fileName = cloneString(faName);
+fai->fd = mustOpenFd(faName, O_RDONLY);
+safef(faiName, sizeof(faiName), "%s.fai", faName);
+if (fileExists(faiName) && fileModTime(faiName) >= fileModTime(faName))
+    fai->entryList = faIndexRead(faiName);
+else
+    {
+    fai->entryList = faIndexScan(faName);
+    if (!faIndexWrite(fai->entryList, faiName))
+        verbose(2, "Couldn't write %s, keeping index in memory\n", faiName);
+    }
+fai->hash = hashNew(0);
+for (entry = fai->entryList; entry != NULL; entry = entry->next)
+    {
+    entry->ix = ix++;
+    hashAdd(fai->hash, entry->name, entry);
+    }
+fai->cacheList = newDlList();
+fai->cacheHash = hashNew(0);
+fai->cacheMax = FAI_DEFAULT_CACHE_BLOCKS;
+return fai;
+}
+
+struct faiCacheBlock
+/* A block of decoded sequence. */
+    {
+    char *key;			/* Key in cacheHash, allocated in hash. */
+    struct faIndexEntry *entry;	/* Sequence this is part of. */
+    bits64 start;		/* Start of block in sequence. */
+    int size;			/* Number of bases. */
+    DNA *dna;			/* Bases. */
+    };
+
+static void faiCacheBlockFree(struct faIndex *fai, struct dlNode *node)
+/* Remove block from cache and free it. */
+{
+struct faiCacheBlock *block = node->val;
+hashRemove(fai->cacheHash, block->key);
+dlRemove(node);
+freeMem(node);
+freeMem(block->dna);
+freeMem(block);
+fai->cacheCount -= 1;
+}
+
+void faIndexSetCacheSize(struct faIndex *fai, int blockCount)
+/* Set maximum number of FAI_CACHE_BLOCK_SIZE blocks kept in fetch cache. */
+{
+if (blockCount < 1)
+    blockCount = 1;
+fai->cacheMax = blockCount;
+while (fai->cacheCount > fai->cacheMax)
+    faiCacheBlockFree(fai, fai->cacheList->tail);
+}
+
+void faIndexClose(struct faIndex **pFai)
+/* Close file and free up index and cache. */
+{
+struct faIndex *fai = *pFai;
+if (fai != NULL)
+    {
+    while (!dlEmpty(fai->cacheList))
+	faiCacheBlockFree(fai, fai->cacheList->head);
+    freeDlList(&fai->cacheList);
+    hashFree(&fai->cacheHash);
+    hashFree(&fai->hash);
+    faIndexEntryFreeList(&fai->entryList);
+    mustCloseFd(&fai->fd);
+    freeMem(fai->fileName);
+    freez(pFai);
+    }
+}
+
+struct faIndexEntry *faIndexFind(struct faIndex *fai, char *seqName)
+/* Return index entry for sequence, or NULL if not in file. */
+{
+return hashFindVal(fai->hash, seqName);
+}
+
+static struct faIndexEntry *faIndexMustFind(struct faIndex *fai, char *seqName)
+/* Return index entry for sequence or die trying. */
+{
+struct faIndexEntry *entry = faIndexFind(fai, seqName);
+if (entry == NULL)
+    errAbort("%s is not in %s", seqName, fai->fileName);
+return entry;
+}
+
+long long faIndexSeqSize(struct faIndex *fai, char *seqName)
+/* Return size of sequence.  Aborts if sequence not in file. */
+{
+return faIndexMustFind(fai, seqName)->size;
+}
+
+static void faiLoadBases(struct faIndex *fai, struct faIndexEntry *entry,
+	bits64 start, int size, DNA *dna)
+/* Read size bases starting at start from file into dna, dropping line
+ * endings. */
+{
+bits64 firstLine = start / entry->lineBases;
+bits64 lastLine = (start + size - 1) / entry->lineBases;
+bits64 fileStart = entry->offset + firstLine*entry->lineBytes + start % entry->lineBases;
+size_t bufSize = (lastLine - firstLine + 1) * entry->lineBytes;
+char *buf = needLargeMem(bufSize);
+ssize_t readSize = pread(fai->fd, buf, bufSize, fileStart);
+if (readSize < 0)
+    errnoAbort("Couldn't read %s", fai->fileName);
+
+/* Copy out a line at a time. */
+int lineLeft = entry->lineBases - start % entry->lineBases;
+char *s = buf, *end = buf + readSize;
+DNA *d = dna;
+int left = size;
+while (left > 0)
+    {
+    int oneSize = min(lineLeft, left);
+    if (s + oneSize > end)
+        errAbort("%s is shorter than its index says, try removing %s.fai",
+		fai->fileName, fai->fileName);
+    memcpy(d, s, oneSize);
+    d += oneSize;
+    left -= oneSize;
+    s += oneSize + entry->lineBytes - entry->lineBases;
+    lineLeft = entry->lineBases;
+    }
+freeMem(buf);
+}
+
+static struct faiCacheBlock *faiCacheGet(struct faIndex *fai, struct faIndexEntry *entry,
+	bits64 blockIx)
+/* Return decoded block, loading it into the cache if need be. */
+{
+char key[64];
+struct dlNode *node;
+struct faiCacheBlock *block;
+safef(key, sizeof(key), "%d:%llu", entry->ix, blockIx);
+if ((node = hashFindVal(fai->cacheHash, key)) != NULL)
+    {
+    fai->cacheHits += 1;
+    dlRemove(node);
+    dlAddHead(fai->cacheList, node);
+    return node->val;
+    }
+fai->cacheMisses += 1;
+if (fai->cacheCount >= fai->cacheMax)
+    faiCacheBlockFree(fai, fai->cacheList->tail);
+AllocVar(block);
+block->entry = entry;
+block->start = blockIx * FAI_CACHE_BLOCK_SIZE;
+block->size = min(FAI_CACHE_BLOCK_SIZE, entry->size - block->start);
+block->dna = needLargeMem(block->size);
+faiLoadBases(fai, entry, block->start, block->size, block->dna);
+node = dlAddValHead(fai->cacheList, block);
+block->key = hashAdd(fai->cacheHash, key, node)->name;
+fai->cacheCount += 1;
+return block;
+}
+
+void faIndexFetch(struct faIndex *fai, struct faIndexEntry *entry,
+	bits64 start, bits64 end, DNA *dna)
+/* Copy bases start to end of entry into dna, which must have room for
+ * end-start bases.  Case is as in file.  No zero terminator is added. */
+{
+if (end > entry->size || start > end)
+    errAbort("Range %llu-%llu is outside of %s (size %llu) in %s",
+	    start, end, entry->name, entry->size, fai->fileName);
+if (end - start > (bits64)FAI_CACHE_BLOCK_SIZE * fai->cacheMax / 2)
+    {
+    /* Too big to be worth caching, read straight into dna. */
+    faiLoadBases(fai, entry, start, end - start, dna);
+    return;
+    }
+bits64 pos = start;
+while (pos < end)
+    {
+    struct faiCacheBlock *block = faiCacheGet(fai, entry, pos / FAI_CACHE_BLOCK_SIZE);
+    bits64 offset = pos - block->start;
+    bits64 oneSize = min(block->size - offset, end - pos);
+    memcpy(dna, block->dna + offset, oneSize);
+    dna += oneSize;
+    pos += oneSize;
+    }
+}
+
+struct dnaSeq *faIndexReadSeqFrag(struct faIndex *fai, char *seqName, int start, int end)
+/* Read part of a sequence, like twoBitReadSeqFrag.  If end is 0 read to
+ * end of sequence.  Case is as in file.  Free with freeDnaSeq. */
+{
+struct faIndexEntry *entry = faIndexMustFind(fai, seqName);
+struct dnaSeq *seq;
+char fragName[256];
+if (end == 0)
+    end = entry->size;
+if (start < 0 || end < start || end > entry->size)
+    errAbort("Range %d-%d is outside of %s (size %llu) in %s",
+	    start, end, seqName, entry->size, fai->fileName);
+AllocVar(seq);
+if (start == 0 && end == entry->size)
+    seq->name = cloneString(seqName);
+else
+    {
+    safef(fragName, sizeof(fragName), "%s:%d-%d", seqName, start, end);
+    seq->name = cloneString(fragName);
+    }
+seq->size = end - start;
+seq->dna = needLargeMem(seq->size + 1);
+faIndexFetch(fai, entry, start, end, seq->dna);
+seq->dna[seq->size] = 0;
+return seq;
+}
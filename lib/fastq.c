@@ -16,7 +16,12 @@
 #include "dnautil.h"
 #include <math.h>
 #include <string.h>
+#include "dystring.h"
+#include "blockGz.h"
 #include "fastq.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 /* Function Prototypes */
@@ -75,40 +80,53 @@ void freeFastqItem(struct fastqItem * fq)
 }
 
 
-inline void printFastqItem(FILE *fp, struct fastqItem *fq)
+void printFastqItem(FILE *fp, struct fastqItem *fq)
 {
-  int i;
   fprintf(fp,"@%s\n",fq->id);
-  for(i=0; i < fq->len; i++)
-  {
-    fprintf(fp,"%c",fq->seq[i]);
-  }
-  fprintf(fp,"\n+\n");
-  for(i=0; i< fq->len; i++)
-  {
-    fprintf(fp,"%c",fq->score[i]);
-  }
-  fprintf(fp,"\n");
+  mustWrite(fp,fq->seq,fq->len);
+  fputs("\n+\n",fp);
+  mustWrite(fp,fq->score,fq->len);
+  fputc('\n',fp);
 }
 
-inline void gzPrintFastqItem(gzFile *fp, struct fastqItem *fq){
-  int i;
+void fastqItemToDyString(struct dyString *dy, struct fastqItem *fq)
+/* Append fq to dy in the same format printFastqItem uses. */
+{
+  dyStringAppendC(dy,'@');
+  dyStringAppend(dy,fq->id);
+  dyStringAppendC(dy,'\n');
+  dyStringAppendN(dy,fq->seq,fq->len);
+  dyStringAppendN(dy,"\n+\n",3);
+  dyStringAppendN(dy,fq->score,fq->len);
+  dyStringAppendC(dy,'\n');
+}
 
-  gzprintf(fp,"@%s\n",fq->id);
-  for(i=0; i < fq->len; i++)
-  {
-    gzprintf(fp,"%c",fq->seq[i]);
-  }
-  gzprintf(fp,"\n+\n");
-  for(i=0; i< fq->len; i++)
-  {
-    gzprintf(fp,"%c",fq->score[i]);
-  }
-  gzprintf(fp,"\n");
+void gzPrintFastqItem(gzFile *fp, struct fastqItem *fq){
+  gzFile zf = (gzFile)fp;
+  gzputc(zf,'@');
+  gzputs(zf,fq->id);
+  gzputc(zf,'\n');
+  gzwrite(zf,fq->seq,fq->len);
+  gzwrite(zf,"\n+\n",3);
+  gzwrite(zf,fq->score,fq->len);
+  gzputc(zf,'\n');
 }
 
+void blockGzPrintFastqItem(struct blockGz *bg, struct fastqItem *fq)
+/* Write fq to a multi-threaded gzip stream. */
+{
+  blockGzPutc(bg,'@');
+  blockGzPuts(bg,fq->id);
+  blockGzPutc(bg,'\n');
+  blockGzWrite(bg,fq->seq,fq->len);
+  blockGzWrite(bg,"\n+\n",3);
+  blockGzWrite(bg,fq->score,fq->len);
+  blockGzPutc(bg,'\n');
+}
 
-inline boolean cleanAndThrowOutFastqItem(struct fastqItem *fq, const int minlen){
+boolean cleanAndThrowOutFastqItem(struct fastqItem *fq, const int minlen){
+  /* The only per-character work here is the two strlen calls, which
+   * the C library already does a vector at a time. */
   boolean throwOut = FALSE;
   int seql = strlen(fq->seq);
   int quall = strlen(fq->score);
@@ -190,59 +208,97 @@ boolean fastqItemNext(struct lineFile *lf, struct fastqItem *fq)
   return(TRUE);
 }
 
-inline void convPhred33ToPhred64( struct fastqItem *fq )
+void convPhred33ToPhred64( struct fastqItem *fq )
 {
   phred33ToPhred64(fq->score,fq->len);
 }//end phred33To64
 
-inline void convPhred64ToPhred33(struct fastqItem *fq)
+void convPhred64ToPhred33(struct fastqItem *fq)
 {
   phred64ToPhred33(fq->score,fq->len);
 }
 
-inline void phred33ToPhred64( char * p33, int l )
+void phred33ToPhred64( char * p33, int l )
+{
+  phredShiftOffset(p33,l,33,64);
+}
+
+void phred64ToPhred33( char * p64, int l)
+{
+  phredShiftOffset(p64,l,64,33);
+}
+
+static boolean phredShiftScalar(char *qual, int len, int fromOffset, int toOffset)
+/* Scalar version of phredShiftOffset, also handles the tail of the SIMD one. */
 {
+  boolean ok = TRUE;
   int i;
-  for(i=0;i<l;i++)
+  for(i=0;i<len;i++)
   {
-    p33[i] = phredToPhred64(phred33ToPhred(p33[i]));
+    int p = ((int)qual[i]) - fromOffset;
+    if(p < MIN_PHRED){ p = MIN_PHRED; ok = FALSE; }
+    else if(p > MAX_PHRED){ p = MAX_PHRED; ok = FALSE; }
+    qual[i] = (char)(p + toOffset);
   }
+  return(ok);
 }
 
-inline void phred64ToPhred33( char * p64, int l)
+boolean phredShiftOffset(char *qual, int len, int fromOffset, int toOffset)
+/* Convert ascii phred scores in qual from fromOffset to toOffset in place,
+ * clamping to MIN_PHRED..MAX_PHRED exactly as phredToPhred33/64 do.
+ * Returns FALSE if any character was out of range for fromOffset. */
 {
-  int i;
-  for(i=0;i<l;i++)
-  {
-    p64[i] = phredToPhred33(phred64ToPhred(p64[i]));
+#ifdef __SSE2__
+  if(fromOffset >= 0 && fromOffset <= 127){
+    /* Flipping the sign bit maps signed chars onto 0..255 in order, which
+     * lets unsigned saturating arithmetic do the clamping. */
+    const __m128i sign = _mm_set1_epi8((char)0x80);
+    const __m128i lo = _mm_set1_epi8((char)(fromOffset + 128));
+    const __m128i maxP = _mm_set1_epi8(MAX_PHRED);
+    const __m128i to = _mm_set1_epi8((char)toOffset);
+    __m128i bad = _mm_setzero_si128();
+    int i;
+    for(i=0; i+16 <= len; i+=16)
+    {
+      __m128i u = _mm_xor_si128(_mm_loadu_si128((__m128i *)(qual+i)), sign);
+      __m128i d = _mm_subs_epu8(u, lo);
+      bad = _mm_or_si128(bad, _mm_subs_epu8(lo, u));
+      bad = _mm_or_si128(bad, _mm_subs_epu8(d, maxP));
+      __m128i out = _mm_add_epi8(_mm_min_epu8(d, maxP), to);
+      _mm_storeu_si128((__m128i *)(qual+i), out);
+    }
+    boolean ok = (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) == 0xFFFF);
+    return(phredShiftScalar(qual+i, len-i, fromOffset, toOffset) && ok);
   }
+#endif
+  return(phredShiftScalar(qual, len, fromOffset, toOffset));
 }
 
-inline char phredToPhred33( int p )
+char phredToPhred33( int p )
 {
   if (p > MAX_PHRED) p=MAX_PHRED;
   else if (p < MIN_PHRED) p=MIN_PHRED;
   return ((char) (p + 33));
 }
 
-inline int phred33ToPhred( char p )
+int phred33ToPhred( char p )
 {
   return ((int)p) - 33;
 }
 
-inline int phred64ToPhred( char p )
+int phred64ToPhred( char p )
 {
   return ((int)p) - 64;
 }
 
-inline char phredToPhred64( int p )
+char phredToPhred64( int p )
 {
   if (p > MAX_PHRED) p=MAX_PHRED;
   else if (p < MIN_PHRED) p=MIN_PHRED;
   return ((char) (p + 64));
 }
 
-inline int doubleToPhred( double p )
+int doubleToPhred( double p )
 /* formula: -10 log10(p) */
 {
   double res = -10.0 * log10(p);
@@ -251,24 +307,146 @@ inline int doubleToPhred( double p )
   return ((int) (res +0.5));  //guarenteed >= 0
 }
 
-inline double phredToDouble( int p )
+const double phredProbTable[MAX_PHRED+1] = {
+/* phredToDouble(p) for every p from MIN_PHRED to MAX_PHRED, precomputed with
+ * the same formula so results are unchanged. */
+  1.0, 0.7943282347242815, 0.6309573444801932, 0.5011872336272724,
+  0.39810717055349726, 0.31622776601683794, 0.251188643150958, 0.199526231496888,
+  0.15848931924611132, 0.1258925411794167, 0.1, 0.07943282347242814,
+  0.06309573444801933, 0.05011872336272723, 0.039810717055349734, 0.03162277660168379,
+  0.025118864315095794, 0.0199526231496888, 0.015848931924611134, 0.012589254117941673,
+  0.01, 0.007943282347242814, 0.006309573444801929, 0.005011872336272725,
+  0.003981071705534973, 0.003162277660168379, 0.0025118864315095794, 0.001995262314968879,
+  0.001584893192461114, 0.0012589254117941675, 0.001, 0.0007943282347242813,
+  0.000630957344480193, 0.0005011872336272724, 0.0003981071705534973, 0.00031622776601683794,
+  0.00025118864315095795, 0.00019952623149688788, 0.0001584893192461114, 0.00012589254117941674,
+  0.0001, 7.943282347242821e-05, 6.30957344480193e-05, 5.0118723362727245e-05,
+  3.981071705534969e-05, 3.1622776601683795e-05, 2.5118864315095822e-05, 1.9952623149688786e-05,
+  1.584893192461114e-05, 1.2589254117941663e-05, 1e-05, 7.943282347242822e-06,
+  6.3095734448019305e-06, 5.011872336272724e-06, 3.981071705534969e-06, 3.1622776601683796e-06,
+  2.5118864315095823e-06, 1.9952623149688787e-06, 1.584893192461114e-06, 1.2589254117941661e-06,
+  1e-06, 7.943282347242822e-07, 6.30957344480193e-07, 5.011872336272725e-07,
+  3.981071705534969e-07, 3.162277660168379e-07, 2.5118864315095823e-07, 1.9952623149688787e-07,
+  1.584893192461114e-07, 1.2589254117941662e-07, 1e-07, 7.94328234724282e-08,
+  6.30957344480193e-08, 5.011872336272725e-08, 3.981071705534969e-08, 3.162277660168379e-08,
+  2.511886431509582e-08, 1.995262314968879e-08, 1.5848931924611143e-08, 1.2589254117941661e-08,
+  1e-08, 7.943282347242822e-09, 6.309573444801943e-09, 5.011872336272715e-09,
+  3.981071705534969e-09, 3.162277660168379e-09, 2.5118864315095824e-09, 1.9952623149688828e-09,
+  1.5848931924611107e-09, 1.2589254117941663e-09, 1e-09, 7.943282347242822e-10,
+  6.309573444801943e-10, 5.011872336272715e-10
+};
+
+double phredToDouble( int p )
 /* formula: 10^(-p/10)  */
 {
+  if(p >= MIN_PHRED && p <= MAX_PHRED)
+    return phredProbTable[p];
   return 1.0/pow(10,((double)p)/10.0);
 }
 
 /* Some Functions that can now be made from  a combination of existing functions */
 
-inline double phred33ToDouble( char p )
+double phred33ToDouble( char p )
 {
   return phredToDouble(phred33ToPhred(p));
 }
 
-inline double phred64ToDouble( char p )
+double phred64ToDouble( char p )
 {
   return phredToDouble(phred64ToPhred(p));
 }
 
+static int phredClamped(char c, int offset)
+/* Return phred value of ascii c clamped to MIN_PHRED..MAX_PHRED. */
+{
+  int p = ((int)c) - offset;
+  if (p < MIN_PHRED) p = MIN_PHRED;
+  else if (p > MAX_PHRED) p = MAX_PHRED;
+  return(p);
+}
+
+static long long phredSum(char *qual, int len, int offset)
+/* Return sum of clamped phred values in qual. */
+{
+  long long sum = 0;
+  int i = 0;
+#ifdef __SSE2__
+  if(offset >= 0 && offset <= 127){
+    const __m128i sign = _mm_set1_epi8((char)0x80);
+    const __m128i lo = _mm_set1_epi8((char)(offset + 128));
+    const __m128i maxP = _mm_set1_epi8(MAX_PHRED);
+    __m128i acc = _mm_setzero_si128();
+    for(; i+16 <= len; i+=16)
+    {
+      __m128i u = _mm_xor_si128(_mm_loadu_si128((__m128i *)(qual+i)), sign);
+      __m128i p = _mm_min_epu8(_mm_subs_epu8(u, lo), maxP);
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(p, _mm_setzero_si128()));
+    }
+    long long lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = lanes[0] + lanes[1];
+  }
+#endif
+  for(; i<len; i++)
+    sum += phredClamped(qual[i], offset);
+  return(sum);
+}
+
+double fastqMeanQuality(char *qual, int len, int offset)
+/* Return mean phred quality of ascii quality string qual.  Scores outside
+ * MIN_PHRED..MAX_PHRED are clamped.  Returns 0 for empty strings. */
+{
+  if(len <= 0)
+    return(0.0);
+  return((double)phredSum(qual, len, offset) / len);
+}
+
+double fastqExpectedErrors(char *qual, int len, int offset)
+/* Return expected number of base call errors in a read, the sum of the
+ * error probabilities of its quality scores. */
+{
+  /* There is no byte gather in SSE2, so this is table lookups split over
+   * independent sums to keep several loads in flight. */
+  double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  int i;
+  for(i=0; i+4 <= len; i+=4)
+  {
+    s0 += phredProbTable[phredClamped(qual[i], offset)];
+    s1 += phredProbTable[phredClamped(qual[i+1], offset)];
+    s2 += phredProbTable[phredClamped(qual[i+2], offset)];
+    s3 += phredProbTable[phredClamped(qual[i+3], offset)];
+  }
+  for(; i<len; i++)
+    s0 += phredProbTable[phredClamped(qual[i], offset)];
+  return((s0 + s1) + (s2 + s3));
+}
+
+int fastqSlidingWindowTrim(char *qual, int len, int offset, int window, int minQual)
+/* Scan qual from the 5' end with a window of the given size and return the
+ * length to keep: the start of the first window whose mean quality is
+ * below minQual, or len if there is none.  Reads shorter than the window
+ * are judged on their overall mean. */
+{
+  if(len <= 0)
+    return(0);
+  if(window > len)
+    window = len;
+  if(window < 1)
+    window = 1;
+  long long need = (long long)minQual * window;
+  long long sum = phredSum(qual, window, offset);
+  int start;
+  for(start=0; ; start++)
+  {
+    if(sum < need)
+      return(start);
+    if(start + window >= len)
+      break;
+    sum += phredClamped(qual[start+window], offset) - phredClamped(qual[start], offset);
+  }
+  return(len);
+}
+
 void strrevi(char *s,int n)
 {
   int i=0;
@@ -282,7 +460,7 @@ void strrevi(char *s,int n)
   *(s+n) = '\0';
 }
 
-inline void reverseComplementFastqItem(struct fastqItem *fq){
+void reverseComplementFastqItem(struct fastqItem *fq){
   //reverse complement the seq, and reverse the quality string
   strrevi(fq->score,fq->len);
   reverseComplement((DNA *)fq->seq,fq->len);
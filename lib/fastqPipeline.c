@@ -0,0 +1,301 @@
+/* fastqPipeline - multi-threaded read/filter/write pipeline for single or
+ * paired end fastq files.  See fastqPipeline.h for an overview. */
+
+#include "common.h"
+#include "linefile.h"
+#include "dystring.h"
+#include "pthreadWrap.h"
+#include "synQueue.h"
+#include "blockGz.h"
+#include "fastq.h"
+#include "readPack.h"
+#include "fastqPipeline.h"
+
+struct fqBatch
+/* A batch of reads from one input file. */
+    {
+    int count;			/* Number of reads used. */
+    boolean eof;		/* Set if input ended in this batch. */
+    struct fastqItem **reads;	/* FASTQ_PIPE_BATCH_SIZE preallocated reads. */
+    struct dyString *out;	/* Formatted output for kept reads. */
+    };
+
+struct fqMate
+/* Input and output for one end of a pair. */
+    {
+    struct fastqPipeline *pipe;	/* Pipeline this is part of. */
+    struct lineFile *lf;	/* Fastq input, or NULL if input is rp. */
+    struct readPack *rp;	/* ReadPack input, or NULL if input is lf. */
+    struct blockGz *out;	/* Output. */
+    struct synQueue *freeQ;	/* Batches ready to be filled. */
+    struct synQueue *fullQ;	/* Batches ready to be processed. */
+    struct fqBatch **batches;	/* All batches, for freeing at end. */
+    int batchCount;		/* Size of batches array. */
+    pthread_t reader;		/* Reader thread. */
+    };
+
+struct fastqPipeline
+/* State shared between threads of the pipeline. */
+    {
+    int mateCount;		/* Number of inputs processed in step. */
+    struct fqMate mates[FASTQ_PIPE_MAX_MATES];	/* Per input state. */
+    fastqPipeFilter filter;	/* Filter function, may be NULL. */
+    void *context;		/* Passed to filter. */
+    pthread_mutex_t inMutex;	/* Protects pairing of batches. */
+    long long nextInIx;		/* Sequence number of next batch to pair. */
+    pthread_mutex_t doneMutex;	/* Protects inputDone.  Separate from inMutex
+                                 * since that is held while waiting on readers. */
+    boolean inputDone;		/* Set when any input runs out. */
+    pthread_mutex_t outMutex;	/* Protects output ordering and counts. */
+    pthread_cond_t outCond;	/* Signalled when nextOutIx changes. */
+    long long nextOutIx;	/* Sequence number of next batch to write. */
+    long long readCount;	/* Reads (pairs) read. */
+    long long writeCount;	/* Reads (pairs) written. */
+    };
+
+static struct fqBatch *fqBatchNew()
+/* Allocate a batch with room for a full set of reads. */
+{
+struct fqBatch *batch;
+int i;
+AllocVar(batch);
+AllocArray(batch->reads, FASTQ_PIPE_BATCH_SIZE);
+for (i=0; i<FASTQ_PIPE_BATCH_SIZE; ++i)
+    batch->reads[i] = allocFastqItem();
+batch->out = dyStringNew(0);
+return batch;
+}
+
+static void fqBatchFree(struct fqBatch **pBatch)
+/* Free up a batch and the reads in it. */
+{
+struct fqBatch *batch = *pBatch;
+if (batch != NULL)
+    {
+    int i;
+    for (i=0; i<FASTQ_PIPE_BATCH_SIZE; ++i)
+        freeFastqItem(batch->reads[i]);
+    freeMem(batch->reads);
+    dyStringFree(&batch->out);
+    freez(pBatch);
+    }
+}
+
+static boolean isInputDone(struct fastqPipeline *pipe)
+/* Return TRUE if some input has run out. */
+{
+boolean done;
+pthreadMutexLock(&pipe->doneMutex);
+done = pipe->inputDone;
+pthreadMutexUnlock(&pipe->doneMutex);
+return done;
+}
+
+static void setInputDone(struct fastqPipeline *pipe)
+/* Note that some input has run out. */
+{
+pthreadMutexLock(&pipe->doneMutex);
+pipe->inputDone = TRUE;
+pthreadMutexUnlock(&pipe->doneMutex);
+}
+
+static boolean mateNext(struct fqMate *mate, struct fastqItem *fq)
+/* Read next item from whichever kind of input mate has. */
+{
+if (mate->rp != NULL)
+    return readPackNext(mate->rp, fq);
+return fastqItemNext(mate->lf, fq);
+}
+
+static void *readerThread(void *v)
+/* Fill batches from one input until it or another input runs out. */
+{
+struct fqMate *mate = v;
+struct fastqPipeline *pipe = mate->pipe;
+for (;;)
+    {
+    struct fqBatch *batch = synQueueGet(mate->freeQ);
+    batch->count = 0;
+    batch->eof = FALSE;
+    if (isInputDone(pipe))
+        batch->eof = TRUE;
+    else
+	{
+	while (batch->count < FASTQ_PIPE_BATCH_SIZE
+	       && mateNext(mate, batch->reads[batch->count]))
+	    batch->count += 1;
+	if (batch->count < FASTQ_PIPE_BATCH_SIZE)
+	    batch->eof = TRUE;
+	}
+    synQueuePut(mate->fullQ, batch);
+    if (batch->eof)
+        break;
+    }
+return NULL;
+}
+
+static void *workerThread(void *v)
+/* Take matching batches from each input, filter them and write them out
+ * in input order. */
+{
+struct fastqPipeline *pipe = v;
+int mateCount = pipe->mateCount;
+struct fqBatch *batches[FASTQ_PIPE_MAX_MATES];
+struct fastqItem *reads[FASTQ_PIPE_MAX_MATES];
+for (;;)
+    {
+    int m, i, count = FASTQ_PIPE_BATCH_SIZE, keptCount = 0;
+    long long ix;
+
+    /* Pair up the next batch from every mate. */
+    pthreadMutexLock(&pipe->inMutex);
+    if (isInputDone(pipe))
+        {
+	pthreadMutexUnlock(&pipe->inMutex);
+	break;
+	}
+    for (m=0; m<mateCount; ++m)
+        {
+	batches[m] = synQueueGet(pipe->mates[m].fullQ);
+	if (batches[m]->count < count)
+	    count = batches[m]->count;
+	if (batches[m]->eof)
+	    setInputDone(pipe);
+	}
+    ix = pipe->nextInIx++;
+    pthreadMutexUnlock(&pipe->inMutex);
+
+    /* Filter and format. */
+    for (m=0; m<mateCount; ++m)
+	dyStringClear(batches[m]->out);
+    for (i=0; i<count; ++i)
+        {
+	for (m=0; m<mateCount; ++m)
+	    reads[m] = batches[m]->reads[i];
+	if (pipe->filter == NULL || pipe->filter(reads, mateCount, pipe->context))
+	    {
+	    for (m=0; m<mateCount; ++m)
+		fastqItemToDyString(batches[m]->out, reads[m]);
+	    ++keptCount;
+	    }
+	}
+
+    /* Wait our turn, then write.  Only the thread whose batch is next
+     * gets past the wait, so the writes themselves need no lock. */
+    pthreadMutexLock(&pipe->outMutex);
+    while (pipe->nextOutIx != ix)
+        pthreadCondWait(&pipe->outCond, &pipe->outMutex);
+    pthreadMutexUnlock(&pipe->outMutex);
+    for (m=0; m<mateCount; ++m)
+        {
+	struct dyString *dy = batches[m]->out;
+	blockGzWrite(pipe->mates[m].out, dy->string, dy->stringSize);
+	}
+    pthreadMutexLock(&pipe->outMutex);
+    pipe->nextOutIx += 1;
+    pipe->readCount += count;
+    pipe->writeCount += keptCount;
+    pthreadCondBroadcast(&pipe->outCond);
+    pthreadMutexUnlock(&pipe->outMutex);
+
+    for (m=0; m<mateCount; ++m)
+        synQueuePut(pipe->mates[m].freeQ, batches[m]);
+    }
+return NULL;
+}
+
+long long fastqPipelineRun(int mateCount, char **inFiles, char **outFiles,
+	fastqPipeFilter filter, void *context, int threadCount, int gzLevel,
+	long long *retReadCount)
+/* Read mateCount fastq(.gz) or readPack files in step, run filter over each read or
+ * read pair and write the ones it keeps to the corresponding gzipped
+ * outFiles.  Filter may be NULL to keep everything.  Processing stops
+ * when the shortest input runs out.  threadCount sets both the number of
+ * filter threads and the number of compression threads for each output.
+ * gzLevel is the zlib compression level.  Returns number of reads (pairs)
+ * written, and optionally number read in retReadCount. */
+{
+struct fastqPipeline *pipe;
+pthread_t *workers;
+int i, m;
+long long writeCount;
+
+if (mateCount < 1 || mateCount > FASTQ_PIPE_MAX_MATES)
+    errAbort("fastqPipelineRun: mateCount must be between 1 and %d, got %d",
+	    FASTQ_PIPE_MAX_MATES, mateCount);
+if (threadCount < 1)
+    threadCount = 1;
+AllocVar(pipe);
+pipe->mateCount = mateCount;
+pipe->filter = filter;
+pipe->context = context;
+pthreadMutexInit(&pipe->inMutex);
+pthreadMutexInit(&pipe->doneMutex);
+pthreadMutexInit(&pipe->outMutex);
+pthreadCondInit(&pipe->outCond);
+
+/* Set up per-mate input and output.  Two batches per worker plus one
+ * being read keeps everyone busy; the extra one is spare for shutdown. */
+for (m=0; m<mateCount; ++m)
+    {
+    struct fqMate *mate = &pipe->mates[m];
+    mate->pipe = pipe;
+    if (readPackIsFile(inFiles[m]))
+        mate->rp = readPackOpen(inFiles[m]);
+    else
+	mate->lf = lineFileOpen(inFiles[m], TRUE);
+    mate->out = blockGzOpen(outFiles[m], gzLevel, threadCount);
+    mate->freeQ = synQueueNew();
+    mate->fullQ = synQueueNew();
+    mate->batchCount = 2*threadCount + 2;
+    AllocArray(mate->batches, mate->batchCount);
+    for (i=0; i<mate->batchCount; ++i)
+	{
+        mate->batches[i] = fqBatchNew();
+	if (i < mate->batchCount - 1)
+	    synQueuePutUnprotected(mate->freeQ, mate->batches[i]);
+	}
+    }
+
+/* Start everything up and wait for workers to finish. */
+for (m=0; m<mateCount; ++m)
+    pthreadCreate(&pipe->mates[m].reader, NULL, readerThread, &pipe->mates[m]);
+AllocArray(workers, threadCount);
+for (i=0; i<threadCount; ++i)
+    pthreadCreate(&workers[i], NULL, workerThread, pipe);
+for (i=0; i<threadCount; ++i)
+    pthreadJoin(workers[i]);
+
+/* A reader may still be waiting for a free batch if the other input ran
+ * out first.  Give it the spare so it notices the end and exits. */
+for (m=0; m<mateCount; ++m)
+    {
+    struct fqMate *mate = &pipe->mates[m];
+    synQueuePut(mate->freeQ, mate->batches[mate->batchCount-1]);
+    pthreadJoin(mate->reader);
+    }
+
+/* Clean up. */
+for (m=0; m<mateCount; ++m)
+    {
+    struct fqMate *mate = &pipe->mates[m];
+    blockGzClose(&mate->out);
+    lineFileClose(&mate->lf);
+    readPackClose(&mate->rp);
+    for (i=0; i<mate->batchCount; ++i)
+        fqBatchFree(&mate->batches[i]);
+    freeMem(mate->batches);
+    synQueueFree(&mate->freeQ);
+    synQueueFree(&mate->fullQ);
+    }
+freeMem(workers);
+pthreadCondDestroy(&pipe->outCond);
+pthreadMutexDestroy(&pipe->outMutex);
+pthreadMutexDestroy(&pipe->doneMutex);
+pthreadMutexDestroy(&pipe->inMutex);
+if (retReadCount != NULL)
+    *retReadCount = pipe->readCount;
+writeCount = pipe->writeCount;
+freeMem(pipe);
+return writeCount;
+}
@@ -0,0 +1,419 @@
+/* fmi - FM-index for genome.  Use fmiMake (see sufMake.h) to create one of
+ * these, and the routines here to access it. */
+
+#include "common.h"
+#include <sys/mman.h>
+#include "offsetIndex.h"
+#include "fmi.h"
+
+static void *pointerOffset(void *pt, bits64 offset)
+/* A little wrapper around pointer arithmetic in terms of bytes. */
+{
+char *s = pt;
+return s + offset;
+}
+
+static bits64 padded(bits64 size)
+/* Return size rounded up to an 8 byte boundary. */
+{
+return (size + 7) & ~7LL;
+}
+
+struct fmi *fmiRead(char *fileName, boolean memoryMap)
+/* Read in an fmi from a file.  Does this via memory mapping if you like, which
+ * lets processes share the index, and is faster for a few reads. */
+{
+/* Open file (low level), read in header, and check it. */
+int fd = open(fileName, O_RDONLY);
+if (fd < 0)
+    errnoAbort("Can't open %s", fileName);
+struct fmiFileHeader h;
+if (read(fd, &h, sizeof(h)) < sizeof(h))
+    errnoAbort("Couldn't read header of file %s", fileName);
+if (h.magic != FMI_MAGIC)
+    errAbort("%s does not seem to be an fmi file.", fileName);
+if (h.majorVersion > FMI_MAJOR_VERSION)
+    errAbort("%s is a newer, incompatible version of fmi format. "
+             "This program works on version %d and below. "
+	     "%s is version %d.",  fileName, FMI_MAJOR_VERSION, fileName, h.majorVersion);
+if (h.sampleSize != sizeof(bits32) && h.sampleSize != sizeof(bits64))
+    errAbort("%s has bad sample size %d", fileName, h.sampleSize);
+
+struct fmi *fmi;
+verbose(2, "fmi file %s size %lld\n", fileName, h.size);
+
+/* Get a pointer to data in memory, via memory map, or allocation and read. */
+struct fmiFileHeader *header;
+if (memoryMap)
+    {
+    header = mmap(NULL, h.size, PROT_READ, MAP_FILE|MAP_SHARED, fd, 0);
+    if (header == (void*)(-1))
+	errnoAbort("Couldn't mmap %s, sorry", fileName);
+    }
+else
+    {
+    header = needHugeMem(h.size);
+    if (lseek(fd, 0, SEEK_SET) < 0)
+	errnoAbort("Couldn't seek back to start of fmi file %s.  "
+		   "Fmi files must be random access files, not pipes and the like"
+		   , fileName);
+    if (read(fd, header, h.size) < h.size)
+        errnoAbort("Couldn't read all of fmi file %s.", fileName);
+    }
+close(fd);
+
+/* Allocate wrapper structure and fill it in. */
+AllocVar(fmi);
+fmi->header = header;
+fmi->isMapped = memoryMap;
+
+/* Make an array for easy access to chromosome names. */
+int chromCount = header->chromCount;
+char **chromNames = AllocArray(fmi->chromNames, chromCount);
+char *s = pointerOffset(header, sizeof(*header) );
+int i;
+for (i=0; i<chromCount; ++i)
+    {
+    chromNames[i] = s;
+    s += strlen(s)+1;
+    }
+
+/* Point to the sections. */
+bits64 mapOffset = sizeof(*header) + header->chromNamesSize;
+bits32 *chromSizes = fmi->chromSizes = pointerOffset(header, mapOffset);
+mapOffset += padded(sizeof(bits32) * chromCount);
+fmi->chromStarts = pointerOffset(header, mapOffset);
+mapOffset += sizeof(struct fmiChromStart) * chromCount;
+fmi->blocks = pointerOffset(header, mapOffset);
+mapOffset += sizeof(struct fmiBlock) * (header->textSize / FMI_BLOCK_SIZE + 1);
+fmi->samples = pointerOffset(header, mapOffset);
+mapOffset += padded(header->sampleSize *
+	((header->textSize + header->sampleRate - 1) / header->sampleRate));
+assert(mapOffset == header->size);	/* Sanity check */
+
+/* Calculate chromOffset array and where each symbol's rows start. */
+bits64 offset = 0;
+bits64 *chromOffsets = AllocArray(fmi->chromOffsets, chromCount);
+for (i=0; i<chromCount; ++i)
+    {
+    chromOffsets[i] = offset;
+    offset += chromSizes[i] + 1;
+    }
+fmi->chromIndex = offsetIndexNew(chromOffsets, chromCount);
+bits64 rowStart = 0;
+for (i=0; i<FMI_ALPHABET_SIZE; ++i)
+    {
+    fmi->symbolStarts[i] = rowStart;
+    rowStart += header->symbolCounts[i];
+    }
+verbose(2, "fmi has %llu rows in %d chromosomes\n", header->textSize, chromCount);
+return fmi;
+}
+
+void fmiFree(struct fmi **pFmi)
+/* Free up resources associated with index. */
+{
+struct fmi *fmi = *pFmi;
+if (fmi != NULL)
+    {
+    freeMem(fmi->chromNames);
+    freeMem(fmi->chromOffsets);
+    offsetIndexFree(&fmi->chromIndex);
+    if (fmi->isMapped)
+	munmap((void *)fmi->header, fmi->header->size);
+    else
+	freeMem(fmi->header);
+    freez(pFmi);
+    }
+}
+
+int fmiOffsetToChromIx(struct fmi *fmi, bits64 tOffset)
+/* Figure out index of chromosome containing tOffset */
+{
+int ix = offsetIndexFind(fmi->chromIndex, tOffset);
+if (ix < 0 || tOffset >= fmi->chromOffsets[ix] + fmi->chromSizes[ix])
+    errAbort("tOffset %llu out of range\n", tOffset);
+return ix;
+}
+
+INLINE int popCount64(bits64 x)
+/* Return number of bits set in x. */
+{
+#ifdef __GNUC__
+return __builtin_popcountll(x);
+#else
+x = x - ((x >> 1) & 0x5555555555555555ULL);
+x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+INLINE bits64 symbolMask(bits64 *planes, int symbol)
+/* Return mask of rows in a word that have symbol. */
+{
+bits64 mask = ((symbol & 1) ? planes[0] : ~planes[0]);
+mask &= ((symbol & 2) ? planes[1] : ~planes[1]);
+mask &= ((symbol & 4) ? planes[2] : ~planes[2]);
+return mask;
+}
+
+static bits64 fmiRank(struct fmi *fmi, int symbol, bits64 row)
+/* Return number of times non-zero symbol occurs in transform before row. */
+{
+struct fmiBlock *block = &fmi->blocks[row / FMI_BLOCK_SIZE];
+int bit = row % FMI_BLOCK_SIZE;
+int word, lastWord = bit / 64;
+bits64 count = block->counts[symbol-1];
+for (word = 0; word < lastWord; ++word)
+    count += popCount64(symbolMask(block->planes[word], symbol));
+bit %= 64;
+if (bit != 0)
+    count += popCount64(symbolMask(block->planes[lastWord], symbol) & ((1ULL << bit) - 1));
+return count;
+}
+
+static int fmiSymbolAt(struct fmi *fmi, bits64 row)
+/* Return symbol of transform at row. */
+{
+struct fmiBlock *block = &fmi->blocks[row / FMI_BLOCK_SIZE];
+int bit = row % FMI_BLOCK_SIZE;
+bits64 *planes = block->planes[bit / 64];
+bit %= 64;
+return ((planes[0] >> bit) & 1) | (((planes[1] >> bit) & 1) << 1)
+	| (((planes[2] >> bit) & 1) << 2);
+}
+
+static bits64 chromStartOffset(struct fmi *fmi, bits64 row)
+/* Return offset of chromosome start with given row. */
+{
+struct fmiChromStart *starts = fmi->chromStarts;
+int lo = 0, hi = fmi->header->chromCount;
+while (lo < hi)
+    {
+    int mid = (lo + hi) / 2;
+    if (starts[mid].row < row)
+        lo = mid + 1;
+    else
+        hi = mid;
+    }
+if (lo == fmi->header->chromCount || starts[lo].row != row)
+    errAbort("fmi: row %llu should start a chromosome but doesn't", row);
+return starts[lo].offset;
+}
+
+bits64 fmiRowOffset(struct fmi *fmi, bits64 row)
+/* Return offset in text of suffix of row. */
+{
+/* Step back through the text until a row with a sample, or the start of a
+ * chromosome. */
+int sampleRate = fmi->header->sampleRate;
+bits64 steps = 0;
+for (;;)
+    {
+    if (row % sampleRate == 0)
+	{
+	bits64 ix = row / sampleRate;
+	if (fmi->header->sampleSize == sizeof(bits32))
+	    return ((bits32 *)fmi->samples)[ix] + steps;
+	else
+	    return ((bits64 *)fmi->samples)[ix] + steps;
+	}
+    int symbol = fmiSymbolAt(fmi, row);
+    if (symbol == 0)
+        return chromStartOffset(fmi, row) + steps;
+    row = fmi->symbolStarts[symbol] + fmiRank(fmi, symbol, row);
+    ++steps;
+    }
+}
+
+/* This section of code searches the index.  A search extends the query
+ * backwards from its end a base at a time, keeping the range of rows whose
+ * suffixes start with the part of the query so far. */
+
+static int querySymbol(char c)
+/* Return symbol for query base, or -1 if it can't match. */
+{
+switch (c)
+    {
+    case 'a':
+    case 'A':
+        return 1;
+    case 'c':
+    case 'C':
+        return 2;
+    case 'g':
+    case 'G':
+        return 3;
+    case 'n':
+    case 'N':
+        return 4;
+    case 't':
+    case 'T':
+        return 5;
+    default:
+        return -1;
+    }
+}
+
+static boolean fmiExtend(struct fmi *fmi, char c, bits64 *pLo, bits64 *pHi)
+/* Narrow range of rows from *pLo to *pHi to those preceded by c.  Return
+ * FALSE if there are none. */
+{
+int symbol = querySymbol(c);
+if (symbol < 0)
+    return FALSE;
+bits64 start = fmi->symbolStarts[symbol];
+bits64 lo = start + fmiRank(fmi, symbol, *pLo);
+bits64 hi = start + fmiRank(fmi, symbol, *pHi);
+if (lo >= hi)
+    return FALSE;
+*pLo = lo;
+*pHi = hi;
+return TRUE;
+}
+
+bits64 fmiFindExact(struct fmi *fmi, char *q, int qSize, bits64 *retRow)
+/* Find suffixes that start with all of q.  Returns how many there are, and
+ * puts first row in *retRow. */
+{
+bits64 lo = 0, hi = fmi->header->textSize;
+int i;
+for (i = qSize-1; i >= 0; --i)
+    {
+    if (!fmiExtend(fmi, q[i], &lo, &hi))
+	break;
+    }
+if (i >= 0 || qSize <= 0)
+    lo = hi = 0;
+*retRow = lo;
+return hi - lo;
+}
+
+static int longestPrefixSize(struct fmi *fmi, char *q, int qSize)
+/* Return size of longest prefix of q that occurs, given that all of q
+ * doesn't. */
+{
+/* Prefixes of any size up to one that occurs also occur. */
+int lo = 0, hi = qSize;
+while (hi - lo > 1)
+    {
+    int mid = (lo + hi) / 2;
+    bits64 row;
+    if (fmiFindExact(fmi, q, mid, &row) > 0)
+        lo = mid;
+    else
+        hi = mid;
+    }
+return lo;
+}
+
+int fmiFindLongestPrefix(struct fmi *fmi, char *q, int qSize,
+	bits64 *retRow, bits64 *retCount)
+/* Find the longest prefix of q that occurs in the genome.  Returns its
+ * size, and puts the range of rows starting with it in *retRow and
+ * *retCount.  Returns zero and sets both to zero if not even the first base
+ * occurs. */
+{
+int matchSize = qSize;
+*retCount = fmiFindExact(fmi, q, qSize, retRow);
+if (*retCount == 0 && qSize > 0)
+    {
+    matchSize = longestPrefixSize(fmi, q, qSize);
+    *retCount = fmiFindExact(fmi, q, matchSize, retRow);
+    }
+return matchSize;
+}
+
+static int fmiQueryCmp(const void *va, const void *vb)
+/* Compare fmiQuery pointers by reversed sequence. */
+{
+const struct fmiQuery *a = *((struct fmiQuery **)va);
+const struct fmiQuery *b = *((struct fmiQuery **)vb);
+int aIx = a->size, bIx = b->size;
+while (aIx > 0 && bIx > 0)
+    {
+    int diff = tolower(a->dna[--aIx]) - tolower(b->dna[--bIx]);
+    if (diff != 0)
+        return diff;
+    }
+return a->size - b->size;
+}
+
+void fmiFindMany(struct fmi *fmi, struct fmiQuery *queries, int queryCount)
+/* Find longest prefix matches for many queries, filling in the result
+ * fields of each.  Queries are searched in order of their reversed
+ * sequence, and each search starts from the interval for the end it shares
+ * with the one before. */
+{
+if (queryCount <= 0)
+    return;
+struct fmiQuery **sorted;
+AllocArray(sorted, queryCount);
+int i, maxSize = 0;
+for (i=0; i<queryCount; ++i)
+    {
+    sorted[i] = &queries[i];
+    maxSize = max(maxSize, queries[i].size);
+    }
+qsort(sorted, queryCount, sizeof(sorted[0]), fmiQueryCmp);
+
+/* los[d] and his[d] are the rows starting with the last d bases of the
+ * previous query, for d up to prevDepth. */
+bits64 *los, *his;
+AllocArray(los, maxSize+1);
+AllocArray(his, maxSize+1);
+los[0] = 0;
+his[0] = fmi->header->textSize;
+struct fmiQuery *prev = NULL;
+int prevDepth = 0;
+for (i=0; i<queryCount; ++i)
+    {
+    struct fmiQuery *query = sorted[i];
+    char *dna = query->dna;
+    int size = query->size;
+    int depth = 0;
+    if (prev != NULL)
+        {
+	int maxShared = min(prevDepth, size);
+	while (depth < maxShared
+	       && tolower(prev->dna[prev->size - 1 - depth]) == tolower(dna[size - 1 - depth]))
+	    ++depth;
+	}
+    bits64 lo = los[depth], hi = his[depth];
+    while (depth < size && fmiExtend(fmi, dna[size - 1 - depth], &lo, &hi))
+        {
+	++depth;
+	los[depth] = lo;
+	his[depth] = hi;
+	}
+    if (depth == size && size > 0)
+        {
+	query->matchSize = size;
+	query->row = lo;
+	query->count = hi - lo;
+	}
+    else
+	query->matchSize = fmiFindLongestPrefix(fmi, dna, size, &query->row, &query->count);
+    prev = query;
+    prevDepth = depth;
+    }
+freeMem(his);
+freeMem(los);
+freeMem(sorted);
+}
+
+int fmiHits(struct fmi *fmi, bits64 row, bits64 count, struct fmiHit *hits, int maxHits)
+/* Convert up to maxHits rows starting at row to chromosome positions.
+ * Returns number converted. */
+{
+int i, hitCount = min(count, maxHits);
+for (i=0; i<hitCount; ++i)
+    {
+    bits64 tOffset = fmiRowOffset(fmi, row + i);
+    int chromIx = fmiOffsetToChromIx(fmi, tOffset);
+    hits[i].chromIx = chromIx;
+    hits[i].offset = tOffset - fmi->chromOffsets[chromIx];
+    }
+return hitCount;
+}
@@ -4,13 +4,18 @@
 #include "common.h"
 #include "linefile.h"
 #include "gapCalc.h"
+#include <limits.h>
 
 
+#define gapCalcDenseSize 1024  /* Minimum size of tables for looking up gaps directly. */
+#define gapCalcMaxBucketBits 8 /* Most bits after the highest used to pick a bucket. */
+
 struct gapCalc
 /* A structure that bundles together stuff to help us
  * calculate gap costs quickly. */
     {
-    int smallSize; /* Size of tables for doing quick lookup of small gaps. */
+    int smallSize; /* Gaps smaller than this are interpolated from first table entries. */
+    int denseSize; /* Size of tables for doing quick lookup of small gaps. */
     int *qSmall;   /* Table for small gaps in q; */
     int *tSmall;   /* Table for small gaps in t. */
     int *bSmall;   /* Table for small gaps in either. */
@@ -31,6 +36,15 @@ struct gapCalc
     double qLastSlope;	/* What to add for each base after last. */
     double tLastSlope;	/* What to add for each base after last. */
     double bLastSlope;	/* What to add for each base after last. */
+    int longStart[32];	/* Where to start looking in longPos, by highest bit of gap. */
+    int bucketBits;	/* Bits after the highest used to pick bucket, -1 if no buckets. */
+    int bucketLowBit;	/* Highest bit of gaps in first bucket. */
+    int *bucketSeg;	/* Segment of long tables each bucket starts in, NULL if no buckets. */
+    long long *segStart; /* Where each segment starts, followed by a huge sentinel. */
+    double *segDiv;	/* Width of each segment, 1 for the last which goes on forever. */
+    double *qSegMul;	/* Rise across each segment in q, slope for the last. */
+    double *tSegMul;	/* Rise across each segment in t, slope for the last. */
+    double *bSegMul;	/* Rise across each segment in both, slope for the last. */
     };
 
 /* These are the gap costs used in the Evolution's Cauldron paper. */
@@ -100,6 +114,48 @@ dv = v[sCount-1] - v[sCount-2];
 return v[sCount-2] + dv * (x - s[sCount-2]) / ds;
 }
 
+static int interpolateLong(struct gapCalc *gapCalc, int x, double *v)
+/* Do what interpolate does for x between smallSize and the last long
+ * position, but start looking at the first position at least as big as
+ * the highest bit of x rather than at the start of the table. */
+{
+int *s = gapCalc->longPos;
+int i = gapCalc->longStart[31 - __builtin_clz(x)];
+int ds;
+double dv;
+while (s[i] < x)
+    ++i;
+if (x == s[i])
+    return v[i];
+ds = s[i] - s[i-1];
+dv = v[i] - v[i-1];
+return v[i-1] + dv * (x - s[i-1]) / ds;
+}
+
+static int longCost(struct gapCalc *gapCalc, int x, double *v,
+	int lastPos, double lastPosVal, double lastSlope)
+/* Return cost of gap too big for the small tables, interpolating from the
+ * long tables in v, or extrapolating past their end. */
+{
+if (x >= lastPos)
+    return lastPosVal + lastSlope * (x-lastPos);
+else
+    return interpolateLong(gapCalc, x, v);
+}
+
+static int bucketCost(struct gapCalc *gapCalc, int x, double *v, double *mul)
+/* Return cost of gap of at least denseSize from the segment of the long
+ * tables its bucket points to, or the next one.  The arithmetic is the same
+ * as longCost's, so the answers are too. */
+{
+int bit = 31 - __builtin_clz(x);
+int bits = gapCalc->bucketBits;
+int bucket = ((bit - gapCalc->bucketLowBit) << bits) + ((x >> (bit - bits)) & ((1 << bits) - 1));
+int i = gapCalc->bucketSeg[bucket];
+i += (x >= gapCalc->segStart[i+1]);
+return v[i] + mul[i] * (x - gapCalc->segStart[i]) / gapCalc->segDiv[i];
+}
+
 static double calcSlope(double y2, double y1, double x2, double x1)
 /* Calculate slope of line from x1/y1 to x2/y2 */
 {
@@ -140,6 +196,78 @@ if (word != NULL)
         errAbort("Too many numbers line %d of %s", lf->lineIx, lf->fileName);
 }
 
+static void makeBuckets(struct gapCalc *gapCalc)
+/* Cut the range of gaps from denseSize up into buckets by highest bit and
+ * the next few bits, and note the segment of the long tables each bucket
+ * starts in.  Segments run from one long position to the next, with the
+ * last going on forever, so a position starts the segment it is
+ * interpolated from, which keeps the arithmetic the same.  Each bucket can
+ * have at most one segment start in it after its first gap.  If it takes
+ * more than gapCalcMaxBucketBits to manage that, or positions aren't
+ * increasing, there are no buckets and longCost is used instead. */
+{
+int count = gapCalc->longCount;
+int *pos = gapCalc->longPos;
+int i, bits;
+gapCalc->bucketBits = -1;
+for (i=1; i<count; ++i)
+    if (pos[i] <= pos[i-1])
+        return;
+
+AllocArray(gapCalc->segStart, count+1);
+AllocArray(gapCalc->segDiv, count);
+AllocArray(gapCalc->qSegMul, count);
+AllocArray(gapCalc->tSegMul, count);
+AllocArray(gapCalc->bSegMul, count);
+for (i=0; i<count-1; ++i)
+    {
+    gapCalc->segStart[i] = pos[i];
+    gapCalc->segDiv[i] = pos[i+1] - pos[i];
+    gapCalc->qSegMul[i] = gapCalc->qLong[i+1] - gapCalc->qLong[i];
+    gapCalc->tSegMul[i] = gapCalc->tLong[i+1] - gapCalc->tLong[i];
+    gapCalc->bSegMul[i] = gapCalc->bLong[i+1] - gapCalc->bLong[i];
+    }
+gapCalc->segStart[count-1] = pos[count-1];
+gapCalc->segDiv[count-1] = 1;
+gapCalc->qSegMul[count-1] = gapCalc->qLastSlope;
+gapCalc->tSegMul[count-1] = gapCalc->tLastSlope;
+gapCalc->bSegMul[count-1] = gapCalc->bLastSlope;
+gapCalc->segStart[count] = LLONG_MAX;
+
+int lowBit = 31 - __builtin_clz(gapCalc->denseSize);
+for (bits = 0; bits <= gapCalcMaxBucketBits && bits <= lowBit; ++bits)
+    {
+    int bucketCount = (31 - lowBit) << bits;
+    int *bucketSeg;
+    AllocArray(bucketSeg, bucketCount);
+    int bucket, seg = 0;
+    for (bucket = 0; bucket < bucketCount; ++bucket)
+        {
+	int bit = lowBit + (bucket >> bits);
+	long long width = 1LL << (bit - bits);
+	long long first = (1LL << bit) + (bucket & ((1 << bits) - 1)) * width;
+	while (seg < count-1 && gapCalc->segStart[seg+1] <= first)
+	    ++seg;
+	if (seg < count-1 && gapCalc->segStart[seg+2] < first + width)
+	    break;
+	bucketSeg[bucket] = seg;
+	}
+    if (bucket == bucketCount)
+        {
+	gapCalc->bucketBits = bits;
+	gapCalc->bucketLowBit = lowBit;
+	gapCalc->bucketSeg = bucketSeg;
+	return;
+	}
+    freeMem(bucketSeg);
+    }
+freez(&gapCalc->segStart);
+freez(&gapCalc->segDiv);
+freez(&gapCalc->qSegMul);
+freez(&gapCalc->tSegMul);
+freez(&gapCalc->bSegMul);
+}
+
 struct gapCalc *gapCalcRead(struct lineFile *lf)
 /* Create gapCalc from open file. */
 {
@@ -211,6 +339,32 @@ gapCalc->tLastSlope = calcSlope(gapCalc->tLastPosVal, gapCalc->tLong[gapCalc->tP
 			   gapCalc->tLastPos, gapCalc->longPos[gapCalc->tPosCount-2]);
 gapCalc->bLastSlope = calcSlope(gapCalc->bLastPosVal, gapCalc->bLong[gapCalc->bPosCount-2],
 			   gapCalc->bLastPos, gapCalc->longPos[gapCalc->bPosCount-2]);
+
+/* Set up where to start looking for long values. */
+for (i=0; i<ArraySize(gapCalc->longStart); ++i)
+    {
+    long long bit = 1LL << i;
+    int j = 0;
+    while (j < gapCalc->longCount-1 && gapCalc->longPos[j] < bit)
+        ++j;
+    gapCalc->longStart[i] = j;
+    }
+
+/* Extend tables for small gaps so most gaps in chains are looked up directly. */
+gapCalc->denseSize = max(gapCalc->smallSize, gapCalcDenseSize);
+ExpandArray(gapCalc->qSmall, gapCalc->smallSize, gapCalc->denseSize);
+ExpandArray(gapCalc->tSmall, gapCalc->smallSize, gapCalc->denseSize);
+ExpandArray(gapCalc->bSmall, gapCalc->smallSize, gapCalc->denseSize);
+for (i=gapCalc->smallSize; i<gapCalc->denseSize; ++i)
+    {
+    gapCalc->qSmall[i] = longCost(gapCalc, i, gapCalc->qLong, 
+	    gapCalc->qLastPos, gapCalc->qLastPosVal, gapCalc->qLastSlope);
+    gapCalc->tSmall[i] = longCost(gapCalc, i, gapCalc->tLong, 
+	    gapCalc->tLastPos, gapCalc->tLastPosVal, gapCalc->tLastSlope);
+    gapCalc->bSmall[i] = longCost(gapCalc, i, gapCalc->bLong, 
+	    gapCalc->bLastPos, gapCalc->bLastPosVal, gapCalc->bLastSlope);
+    }
+makeBuckets(gapCalc);
 freez(&gapInitPos);
 freez(&gapInitQGap);
 freez(&gapInitTGap);
@@ -288,6 +442,12 @@ if (gapCalc != NULL)
     freeMem(gapCalc->qLong);
     freeMem(gapCalc->tLong);
     freeMem(gapCalc->bLong);
+    freeMem(gapCalc->bucketSeg);
+    freeMem(gapCalc->segStart);
+    freeMem(gapCalc->segDiv);
+    freeMem(gapCalc->qSegMul);
+    freeMem(gapCalc->tSegMul);
+    freeMem(gapCalc->bSegMul);
     freez(pGapCalc);
     }
 }
@@ -299,31 +459,34 @@ if (dt < 0) dt = 0;
 if (dq < 0) dq = 0;
 if (dt == 0)
     { 
-    if (dq < gapCalc->smallSize)
+    if (dq < gapCalc->denseSize)
         return gapCalc->qSmall[dq];
-    else if (dq >= gapCalc->qLastPos)
-        return gapCalc->qLastPosVal + gapCalc->qLastSlope * (dq-gapCalc->qLastPos);
+    else if (gapCalc->bucketSeg != NULL)
+        return bucketCost(gapCalc, dq, gapCalc->qLong, gapCalc->qSegMul);
     else
-        return interpolate(dq, gapCalc->longPos, gapCalc->qLong, gapCalc->qPosCount);
+        return longCost(gapCalc, dq, gapCalc->qLong, 
+		gapCalc->qLastPos, gapCalc->qLastPosVal, gapCalc->qLastSlope);
     }
 else if (dq == 0)
     {
-    if (dt < gapCalc->smallSize)
+    if (dt < gapCalc->denseSize)
         return gapCalc->tSmall[dt];
-    else if (dt >= gapCalc->tLastPos)
-        return gapCalc->tLastPosVal + gapCalc->tLastSlope * (dt-gapCalc->tLastPos);
+    else if (gapCalc->bucketSeg != NULL)
+        return bucketCost(gapCalc, dt, gapCalc->tLong, gapCalc->tSegMul);
     else
-        return interpolate(dt, gapCalc->longPos, gapCalc->tLong, gapCalc->tPosCount);
+        return longCost(gapCalc, dt, gapCalc->tLong, 
+		gapCalc->tLastPos, gapCalc->tLastPosVal, gapCalc->tLastSlope);
     }
 else
     {
     int both = dq + dt;
-    if (both < gapCalc->smallSize)
+    if (both < gapCalc->denseSize)
         return gapCalc->bSmall[both];
-    else if (both >= gapCalc->bLastPos)
-        return gapCalc->bLastPosVal + gapCalc->bLastSlope * (both-gapCalc->bLastPos);
+    else if (gapCalc->bucketSeg != NULL)
+        return bucketCost(gapCalc, both, gapCalc->bLong, gapCalc->bSegMul);
     else
-        return interpolate(both, gapCalc->longPos, gapCalc->bLong, gapCalc->bPosCount);
+        return longCost(gapCalc, both, gapCalc->bLong, 
+		gapCalc->bLastPos, gapCalc->bLastPosVal, gapCalc->bLastSlope);
     }
 }
 
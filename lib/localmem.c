@@ -74,6 +74,23 @@ void lmCleanup(struct lm **pLm)
     *pLm = NULL;
 }
 
+void lmReset(struct lm *lm)
+/* Free everything allocated from pool, but keep the pool and its first
+ * block of memory for reuse. */
+{
+/* Blocks are on the list newest first, so the first block is last. */
+struct lmBlock *mb = lm->blocks, *next;
+while (mb->next != NULL)
+    {
+    next = mb->next;
+    freeMem(mb);
+    mb = next;
+    }
+memset(mb+1, 0, mb->free - (char *)(mb+1));
+mb->free = (char *)(mb+1);
+lm->blocks = mb;
+}
+
 void *lmAlloc(struct lm *lm, size_t size)
 /* Allocate memory from local pool. */
 {
@@ -10,6 +10,7 @@
 #include <sys/time.h>
 #include <utime.h>
 #include <pthread.h>
+#include <poll.h>
 #include "internet.h"
 #include "errabort.h"
 #include "hash.h"
@@ -1138,6 +1139,52 @@ if (!sameString(npu.user,""))
     }
 }
 
+void netHttpRequestHeader(struct dyString *dy, char *url, struct netParsedUrl *npu,
+	char *proxyUrl, struct netParsedUrl *pxy,
+	char *method, char *protocol, char *agent, char *optionalHeader)
+/* Append the request line and header for url to dy, including the final
+ * blank line.  If proxyUrl is non-NULL the request goes via proxy pxy. */
+{
+char *urlForProxy = NULL;
+if (proxyUrl)
+    {
+    /* trim off the byterange part at the end of url because proxy does not understand it. */
+    urlForProxy = cloneString(url);
+    char *x = strrchr(urlForProxy, ';');
+    if (x && startsWith(";byterange=", x))
+	*x = 0;
+    }
+dyStringPrintf(dy, "%s %s %s\r\n", method, proxyUrl ? urlForProxy : npu->file, protocol);
+freeMem(urlForProxy);
+dyStringPrintf(dy, "User-Agent: %s\r\n", agent);
+/* do not need the 80 since it is the default */
+if ((sameString(npu->protocol, "http" ) && sameString("80", npu->port)) ||
+    (sameString(npu->protocol, "https") && sameString("443",npu->port)))
+    dyStringPrintf(dy, "Host: %s\r\n", npu->host);
+else
+    dyStringPrintf(dy, "Host: %s:%s\r\n", npu->host, npu->port);
+setAuthorization(*npu, "Authorization", dy);
+if (proxyUrl)
+    setAuthorization(*pxy, "Proxy-Authorization", dy);
+dyStringAppend(dy, "Accept: */*\r\n");
+if (npu->byteRangeStart != -1)
+    {
+    if (npu->byteRangeEnd != -1)
+	dyStringPrintf(dy, "Range: bytes=%lld-%lld\r\n"
+		       , (long long)npu->byteRangeStart
+		       , (long long)npu->byteRangeEnd);
+    else
+	dyStringPrintf(dy, "Range: bytes=%lld-\r\n"
+		       , (long long)npu->byteRangeStart);
+    }
+
+if (optionalHeader)
+    dyStringAppend(dy, optionalHeader);
+
+/* finish off the header with final blank line */
+dyStringAppend(dy, "\r\n");
+}
+
 int netHttpConnect(char *url, char *method, char *protocol, char *agent, char *optionalHeader)
 /* Parse URL, connect to associated server on port, and send most of
  * the request to the server.  If specified in the url send user name
@@ -1170,45 +1217,7 @@ if (sd < 0)
     return -1;
 
 /* Ask remote server for a file. */
-char *urlForProxy = NULL;
-if (proxyUrl)
-    {
-    /* trim off the byterange part at the end of url because proxy does not understand it. */
-    urlForProxy = cloneString(url);
-    char *x = strrchr(urlForProxy, ';');
-    if (x && startsWith(";byterange=", x))
-	*x = 0;
-    }
-dyStringPrintf(dy, "%s %s %s\r\n", method, proxyUrl ? urlForProxy : npu.file, protocol);
-freeMem(urlForProxy);
-dyStringPrintf(dy, "User-Agent: %s\r\n", agent);
-/* do not need the 80 since it is the default */
-if ((sameString(npu.protocol, "http" ) && sameString("80", npu.port)) ||
-    (sameString(npu.protocol, "https") && sameString("443",npu.port)))
-    dyStringPrintf(dy, "Host: %s\r\n", npu.host);
-else
-    dyStringPrintf(dy, "Host: %s:%s\r\n", npu.host, npu.port);
-setAuthorization(npu, "Authorization", dy);
-if (proxyUrl)
-    setAuthorization(pxy, "Proxy-Authorization", dy);
-dyStringAppend(dy, "Accept: */*\r\n");
-if (npu.byteRangeStart != -1)
-    {
-    if (npu.byteRangeEnd != -1)
-	dyStringPrintf(dy, "Range: bytes=%lld-%lld\r\n"
-		       , (long long)npu.byteRangeStart
-		       , (long long)npu.byteRangeEnd);
-    else
-	dyStringPrintf(dy, "Range: bytes=%lld-\r\n"
-		       , (long long)npu.byteRangeStart);
-    }
-
-if (optionalHeader)
-    dyStringAppend(dy, optionalHeader);
-
-/* finish off the header with final blank line */
-dyStringAppend(dy, "\r\n");
-
+netHttpRequestHeader(dy, url, &npu, proxyUrl, &pxy, method, protocol, agent, optionalHeader);
 mustWriteFd(sd, dy->string, dy->stringSize);
 
 /* Clean up and return handle. */
@@ -1660,11 +1669,760 @@ while (TRUE)
 return FALSE;
 }
 
+/* Pool of keep-alive http connections.  Idle connections are kept in a hash
+ * keyed by the protocol, host and port they are connected to, and reused by
+ * later requests to the same server, which saves a TCP (and maybe TLS)
+ * handshake per request.  Several range requests can be written down one
+ * connection before reading any of the responses.  Connections idle for too
+ * long are closed the next time the pool is used.  A connection the server
+ * has closed while idle is noticed on reuse, and the request retried once on
+ * a fresh connection.  The pool is shared by all threads. */
+
+#define NET_POOL_BUF_SIZE (16*1024)	/* Size of per connection read buffer. */
+#define NET_POOL_MAX_REDIRECTS 5	/* Follow this many redirects. */
+
+struct netPoolConn
+/* A keep-alive http connection. */
+    {
+    struct netPoolConn *next;	/* Next in idle list. */
+    char *key;			/* Protocol, host and port connected to. */
+    int sd;			/* Socket. */
+    time_t lastUsed;		/* When it was put in pool. */
+    boolean reused;		/* Set if this has served a request before. */
+    int bufStart, bufEnd;	/* Unread data in buf. */
+    char buf[NET_POOL_BUF_SIZE];	/* Data read ahead from socket. */
+    };
+
+struct netPoolResponse
+/* Interesting bits of an http response header. */
+    {
+    int status;			/* Status code, 200, 206 and so forth. */
+    long long contentLength;	/* Content-Length or -1 if not given. */
+    long long rangeStart;	/* Start from Content-Range or -1 if not given. */
+    boolean chunked;		/* Chunked transfer encoding? */
+    boolean keepAlive;		/* Server will keep connection open? */
+    char *location;		/* Location header, for redirects.  Free when done. */
+    };
+
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hash *poolHash = NULL;	/* Lists of idle connections keyed by server. */
+static int poolMaxIdle = NET_POOL_MAX_IDLE_PER_HOST;	/* Most idle connections per server. */
+static int poolIdleSeconds = NET_POOL_IDLE_SECONDS;	/* Close idle connections after this. */
+static time_t poolLastReap = 0;	/* Last time idle connections were checked. */
+
+static void poolConnFree(struct netPoolConn **pConn)
+/* Close connection and free it. */
+{
+struct netPoolConn *conn = *pConn;
+if (conn != NULL)
+    {
+    close(conn->sd);
+    freeMem(conn->key);
+    freez(pConn);
+    }
+}
+
+static void poolReap(time_t now, boolean all)
+/* Close connections that have been idle too long, or all of them.  Call with
+ * poolMutex held. */
+{
+if (poolHash == NULL)
+    return;
+struct hashEl *hel, *helList = hashElListHash(poolHash);
+for (hel = helList; hel != NULL; hel = hel->next)
+    {
+    struct hashEl *poolEl = hashLookup(poolHash, hel->name);
+    struct netPoolConn *conn, *next, *keepList = NULL;
+    for (conn = poolEl->val; conn != NULL; conn = next)
+        {
+	next = conn->next;
+	if (all || now - conn->lastUsed > poolIdleSeconds)
+	    poolConnFree(&conn);
+	else
+	    slAddHead(&keepList, conn);
+	}
+    slReverse(&keepList);
+    poolEl->val = keepList;
+    }
+hashElFreeList(&helList);
+poolLastReap = now;
+}
+
+static boolean poolConnIsClosed(struct netPoolConn *conn)
+/* Return TRUE if an idle connection has been closed by the other side.  An idle
+ * connection should have nothing to read, so anything there means it's done. */
+{
+struct pollfd pfd;
+pfd.fd = conn->sd;
+pfd.events = POLLIN;
+pfd.revents = 0;
+return poll(&pfd, 1, 0) != 0;
+}
+
+static struct netPoolConn *poolConnGet(struct netParsedUrl *target, char *url, boolean fresh)
+/* Return an idle connection to target from the pool, or a new one if there is
+ * none or fresh is set.  Returns NULL if can't connect. */
+{
+char key[512];
+safef(key, sizeof(key), "%s://%s:%s", target->protocol, target->host, target->port);
+struct netPoolConn *conn = NULL;
+netBlockBrokenPipes();
+if (!fresh)
+    {
+    time_t now = time(NULL);
+    pthread_mutex_lock(&poolMutex);
+    if (poolHash == NULL)
+        poolHash = newHash(6);
+    if (now != poolLastReap)
+        poolReap(now, FALSE);
+    struct hashEl *hel = hashLookup(poolHash, key);
+    if (hel != NULL && hel->val != NULL)
+        {
+	conn = hel->val;
+	hel->val = conn->next;
+	conn->next = NULL;
+	}
+    pthread_mutex_unlock(&poolMutex);
+    if (conn != NULL && poolConnIsClosed(conn))
+        poolConnFree(&conn);
+    }
+if (conn == NULL)
+    {
+    int sd = connectNpu(*target, url);
+    if (sd < 0)
+        return NULL;
+    AllocVar(conn);
+    conn->key = cloneString(key);
+    conn->sd = sd;
+    }
+conn->bufStart = conn->bufEnd = 0;
+return conn;
+}
+
+static void poolConnRelease(struct netPoolConn **pConn, boolean reusable)
+/* Put connection back in pool if reusable and there's room, otherwise close it. */
+{
+struct netPoolConn *conn = *pConn;
+if (conn == NULL)
+    return;
+*pConn = NULL;
+if (reusable && conn->bufStart == conn->bufEnd)
+    {
+    conn->reused = TRUE;
+    conn->lastUsed = time(NULL);
+    pthread_mutex_lock(&poolMutex);
+    if (poolHash == NULL)
+        poolHash = newHash(6);
+    struct hashEl *hel = hashLookup(poolHash, conn->key);
+    if (hel == NULL)
+        hel = hashAdd(poolHash, conn->key, NULL);
+    if (slCount(hel->val) < poolMaxIdle)
+        {
+	conn->next = hel->val;
+	hel->val = conn;
+	conn = NULL;
+	}
+    pthread_mutex_unlock(&poolMutex);
+    }
+poolConnFree(&conn);
+}
+
+static int poolFill(struct netPoolConn *conn)
+/* Read more data into empty buffer.  Return number of bytes read, 0 at end of
+ * file, -1 on error. */
+{
+int rd;
+while ((rd = read(conn->sd, conn->buf, NET_POOL_BUF_SIZE)) < 0 && errno == EINTR)
+    ;
+conn->bufStart = 0;
+conn->bufEnd = max(rd, 0);
+return rd;
+}
+
+static boolean poolReadLine(struct netPoolConn *conn, char *line, int maxSize)
+/* Read a line, without the CR/LF at the end, into line.  Return FALSE at end
+ * of file, on error, or if line is too long. */
+{
+int i = 0;
+for (;;)
+    {
+    if (conn->bufStart == conn->bufEnd && poolFill(conn) <= 0)
+	return FALSE;
+    char c = conn->buf[conn->bufStart++];
+    if (c == '\n')
+        break;
+    if (c != '\r')
+        {
+	if (i >= maxSize-1)
+	    return FALSE;
+	line[i++] = c;
+	}
+    }
+line[i] = 0;
+return TRUE;
+}
+
+static long long poolRead(struct netPoolConn *conn, void *vBuf, long long size)
+/* Read up to size bytes, stopping early only at end of file or error.  Returns
+ * number of bytes read. */
+{
+char *buf = vBuf;
+long long total = 0;
+while (total < size)
+    {
+    int inBuf = conn->bufEnd - conn->bufStart;
+    if (inBuf > 0)
+	{
+	int oneSize = min(inBuf, size - total);
+	memcpy(buf + total, conn->buf + conn->bufStart, oneSize);
+	conn->bufStart += oneSize;
+	total += oneSize;
+	}
+    else if (size - total >= NET_POOL_BUF_SIZE)
+        {
+	/* Big read, skip the buffer. */
+	ssize_t rd = read(conn->sd, buf + total, size - total);
+	if (rd < 0 && errno == EINTR)
+	    continue;
+	if (rd <= 0)
+	    break;
+	total += rd;
+	}
+    else if (poolFill(conn) <= 0)
+        break;
+    }
+return total;
+}
+
+static boolean poolSkip(struct netPoolConn *conn, long long size)
+/* Read and discard size bytes.  Return FALSE if not all there. */
+{
+char buf[NET_POOL_BUF_SIZE];
+while (size > 0)
+    {
+    long long oneSize = min(size, sizeof(buf));
+    if (poolRead(conn, buf, oneSize) != oneSize)
+        return FALSE;
+    size -= oneSize;
+    }
+return TRUE;
+}
+
+static boolean poolReadHeader(struct netPoolConn *conn, char *url,
+	struct netPoolResponse *resp, struct hash *hash, boolean *retGotAny)
+/* Read response status line and header into resp.  If hash is non-NULL also
+ * put header lines in it with upper cased keywords like netUrlHead.  Sets
+ * *retGotAny if anything at all was read.  Returns FALSE on error. */
+{
+char line[4096];
+ZeroVar(resp);
+resp->contentLength = resp->rangeStart = -1;
+*retGotAny = FALSE;
+if (!poolReadLine(conn, line, sizeof(line)))
+    return FALSE;
+*retGotAny = TRUE;
+char *s = line;
+char *version = nextWord(&s);
+char *code = nextWord(&s);
+if (version == NULL || !startsWith("HTTP/", version) || code == NULL || !isdigit(code[0]))
+    {
+    warn("Strange http header on %s", url);
+    return FALSE;
+    }
+resp->status = atoi(code);
+resp->keepAlive = !sameString(version, "HTTP/1.0");
+for (;;)
+    {
+    if (!poolReadLine(conn, line, sizeof(line)))
+        {
+	warn("Error reading http header on %s", url);
+	freez(&resp->location);
+	return FALSE;
+	}
+    if (line[0] == 0)
+        break;
+    s = line;
+    char *name = nextWord(&s);
+    if (name == NULL)
+        continue;
+    char *val = skipLeadingSpaces(s);
+    if (sameWord(name, "Content-Length:"))
+        resp->contentLength = atoll(val);
+    else if (sameWord(name, "Content-Range:"))
+        {
+	ssize_t rangeStart, rangeEnd;
+	parseContentRange(val, &rangeStart, &rangeEnd);
+	resp->rangeStart = rangeStart;
+	}
+    else if (sameWord(name, "Transfer-Encoding:"))
+        resp->chunked = (strstrNoCase(val, "chunked") != NULL);
+    else if (sameWord(name, "Connection:"))
+        {
+	if (strstrNoCase(val, "close") != NULL)
+	    resp->keepAlive = FALSE;
+	else if (strstrNoCase(val, "keep-alive") != NULL)
+	    resp->keepAlive = TRUE;
+	}
+    else if (sameWord(name, "Location:"))
+	{
+	freeMem(resp->location);
+        resp->location = cloneString(val);
+	}
+    if (hash != NULL)
+	hashAdd(hash, strUpper(name), cloneString(val));
+    }
+return TRUE;
+}
+
+static boolean poolReadBody(struct netPoolConn *conn, struct netPoolResponse *resp,
+	struct dyString *dy)
+/* Read response body into dy, or just discard it if dy is NULL.  Return FALSE
+ * if body is cut short. */
+{
+char buf[NET_POOL_BUF_SIZE];
+if (resp->chunked)
+    {
+    char line[256];
+    for (;;)
+        {
+	if (!poolReadLine(conn, line, sizeof(line)))
+	    return FALSE;
+	long long chunkSize = strtoll(line, NULL, 16);
+	if (chunkSize == 0)
+	    break;
+	while (chunkSize > 0)
+	    {
+	    long long oneSize = min(chunkSize, sizeof(buf));
+	    if (poolRead(conn, buf, oneSize) != oneSize)
+	        return FALSE;
+	    if (dy != NULL)
+		dyStringAppendN(dy, buf, oneSize);
+	    chunkSize -= oneSize;
+	    }
+	if (!poolReadLine(conn, line, sizeof(line)))	/* CR/LF after chunk. */
+	    return FALSE;
+	}
+    /* Skip trailer up to blank line. */
+    do
+        {
+	if (!poolReadLine(conn, line, sizeof(line)))
+	    return FALSE;
+	}
+    while (line[0] != 0);
+    }
+else if (resp->contentLength >= 0)
+    {
+    long long size = resp->contentLength;
+    while (size > 0)
+        {
+	long long oneSize = min(size, sizeof(buf));
+	if (poolRead(conn, buf, oneSize) != oneSize)
+	    return FALSE;
+	if (dy != NULL)
+	    dyStringAppendN(dy, buf, oneSize);
+	size -= oneSize;
+	}
+    }
+else
+    {
+    /* No length given, so body goes to end of file and connection can't be
+     * reused. */
+    long long oneSize;
+    while ((oneSize = poolRead(conn, buf, sizeof(buf))) > 0)
+        if (dy != NULL)
+	    dyStringAppendN(dy, buf, oneSize);
+    resp->keepAlive = FALSE;
+    }
+return TRUE;
+}
+
+static char *poolRedirectUrl(char *url, char *location)
+/* Return url to use for redirect to location, or NULL with a warning if
+ * it's no good.  Like netSkipHttpHeaderLinesHandlingRedirect, carries over
+ * user and password.  Free result when done. */
+{
+if (location == NULL)
+    {
+    warn("Redirect without Location on %s", url);
+    return NULL;
+    }
+if (!startsWith("http://", location) && !startsWith("https://", location))
+    {
+    warn("redirected to non-http(s): %s", location);
+    return NULL;
+    }
+struct netParsedUrl npu, newNpu;
+netParseUrl(url, &npu);
+netParseUrl(location, &newNpu);
+if (npu.user[0] != 0 && newNpu.user[0] == 0)
+    {
+    safecpy(newNpu.user, sizeof newNpu.user, npu.user);
+    safecpy(newNpu.password, sizeof newNpu.password, npu.password);
+    return urlFromNetParsedUrl(&newNpu);
+    }
+return cloneString(location);
+}
+
+static boolean isRedirect(int status)
+/* Return TRUE if http status is one of the redirects we follow. */
+{
+return status == 300 || status == 301 || status == 302 || status == 303
+    || status == 307 || status == 308;
+}
+
+static struct netPoolConn *poolConnForUrl(char *url, boolean fresh)
+/* Return a connection to the server for url, or to the proxy if there is one.
+ * Returns NULL if can't connect. */
+{
+struct netParsedUrl npu;
+char *proxyUrl = getenv("http_proxy");
+netParseUrl(proxyUrl ? proxyUrl : url, &npu);
+return poolConnGet(&npu, url, fresh);
+}
+
+static boolean poolWriteRequest(struct netPoolConn *conn, char *url, char *method,
+	long long rangeStart, long long rangeEnd)
+/* Send request for url, with a range unless rangeStart is -1.  Return FALSE
+ * if the write fails, typically because the server closed the connection. */
+{
+struct netParsedUrl npu, pxy;
+netParseUrl(url, &npu);
+npu.byteRangeStart = rangeStart;
+npu.byteRangeEnd = rangeEnd;
+char *proxyUrl = getenv("http_proxy");
+if (proxyUrl)
+    netParseUrl(proxyUrl, &pxy);
+struct dyString *dy = dyStringNew(512);
+netHttpRequestHeader(dy, url, &npu, proxyUrl, &pxy, method, "HTTP/1.1",
+	"genome.ucsc.edu/net.c", NULL);
+boolean ok = (write(conn->sd, dy->string, dy->stringSize) == dy->stringSize);
+dyStringFree(&dy);
+return ok;
+}
+
+static boolean poolGetRangeBatch(char *url, int rangeCount, bits64 *starts, bits64 *sizes,
+	void **bufs, bits64 *gotSizes, int *retDone, char **retRedirect)
+/* Fetch ranges from *retDone on, writing up to NET_POOL_PIPELINE_DEPTH
+ * requests ahead of the responses on each connection.  Updates *retDone as
+ * ranges arrive.  On redirect sets *retRedirect and returns TRUE.  Returns
+ * FALSE after a warning on failure. */
+{
+boolean fresh = FALSE;
+for (;;)
+    {
+    int firstIx = *retDone, sent = firstIx, received = firstIx;
+    boolean ok = TRUE, retry = FALSE, reusable = TRUE;
+    struct netPoolConn *conn = poolConnForUrl(url, fresh);
+    if (conn == NULL)
+	{
+	warn("Couldn't connect for %s", url);
+	return FALSE;
+	}
+    while (received < rangeCount)
+	{
+	/* Keep pipeline full. */
+	while (sent < rangeCount && sent - received < NET_POOL_PIPELINE_DEPTH)
+	    {
+	    if (!poolWriteRequest(conn, url, "GET", starts[sent], starts[sent] + sizes[sent] - 1))
+		break;	/* Server may have closed, responses already sent can still be read. */
+	    ++sent;
+	    }
+
+	/* Read next response. */
+	struct netPoolResponse resp;
+	boolean gotAny = FALSE;
+	int ix = received;
+	if (sent == received || !poolReadHeader(conn, url, &resp, NULL, &gotAny))
+	    {
+	    /* A server is allowed to close a keep-alive connection between
+	     * responses, in which case carry on with a new connection. */
+	    if (!gotAny && (conn->reused || received > firstIx))
+		retry = TRUE;
+	    else
+		warn("Error reading http response on %s", url);
+	    ok = FALSE;
+	    break;
+	    }
+	if (isRedirect(resp.status))
+	    {
+	    /* Responses for old url may still be coming, so don't reuse. */
+	    *retRedirect = poolRedirectUrl(url, resp.location);
+	    freeMem(resp.location);
+	    poolConnRelease(&conn, FALSE);
+	    return *retRedirect != NULL;
+	    }
+	freeMem(resp.location);
+	if (resp.status == 200 && starts[ix] == 0 && !resp.chunked)
+	    {
+	    /* Server ignored range but is sending whole file, take what we need. */
+	    long long want = sizes[ix];
+	    if (resp.contentLength >= 0 && resp.contentLength < want)
+	        want = resp.contentLength;
+	    gotSizes[ix] = poolRead(conn, bufs[ix], want);
+	    ok = (gotSizes[ix] == want);
+	    resp.keepAlive = FALSE;
+	    }
+	else if (resp.status != 206)
+	    {
+	    warn("Expected Partial Content 206 on %s, got %d", url, resp.status);
+	    ok = FALSE;
+	    }
+	else if (resp.rangeStart != starts[ix])
+	    {
+	    warn("Found Content-Range starting %lld, expected %lld on %s",
+		 resp.rangeStart, (long long)starts[ix], url);
+	    ok = FALSE;
+	    }
+	else if (resp.chunked || resp.contentLength < 0)
+	    {
+	    struct dyString *dy = dyStringNew(0);
+	    ok = poolReadBody(conn, &resp, dy);
+	    gotSizes[ix] = min(dy->stringSize, sizes[ix]);
+	    memcpy(bufs[ix], dy->string, gotSizes[ix]);
+	    dyStringFree(&dy);
+	    }
+	else
+	    {
+	    long long want = min(resp.contentLength, sizes[ix]);
+	    gotSizes[ix] = poolRead(conn, bufs[ix], want);
+	    ok = (gotSizes[ix] == want && poolSkip(conn, resp.contentLength - want));
+	    }
+	if (!ok)
+	    {
+	    warn("Unexpected end of data on %s", url);
+	    break;
+	    }
+	*retDone = received = ix + 1;
+	if (!resp.keepAlive)
+	    {
+	    reusable = FALSE;
+	    if (received < rangeCount)
+		{
+		retry = TRUE;	/* Rest of requests need another connection. */
+		ok = FALSE;
+		break;
+		}
+	    }
+	}
+    poolConnRelease(&conn, ok && reusable);
+    if (ok)
+        return TRUE;
+    if (!retry || (fresh && *retDone == firstIx))
+        return FALSE;
+    fresh = (*retDone == firstIx);	/* Got nowhere, so don't trust the pool next time. */
+    }
+}
+
+boolean netHttpPoolGetRanges(char *url, int rangeCount, bits64 *starts, bits64 *sizes,
+	void **bufs, bits64 *gotSizes)
+/* Fetch rangeCount byte ranges of http(s) url into bufs over a pooled keep-alive
+ * connection, pipelining the requests.  Each bufs[i] must have room for
+ * sizes[i] bytes.  The amount actually fetched, which may be less near the end
+ * of the file, is put in gotSizes.  Redirects are followed.  Warns and returns
+ * FALSE on failure. */
+{
+int done = 0, redirectCount = 0;
+char *curUrl = url;
+boolean ok = TRUE;
+while (done < rangeCount)
+    {
+    char *newUrl = NULL;
+    ok = poolGetRangeBatch(curUrl, rangeCount, starts, sizes, bufs, gotSizes, &done, &newUrl);
+    if (curUrl != url)
+        freeMem(curUrl);
+    curUrl = url;
+    if (!ok)
+        break;
+    if (newUrl != NULL)
+        {
+	if (++redirectCount > NET_POOL_MAX_REDIRECTS)
+	    {
+	    warn("code 30x redirects: exceeded limit of %d redirects, %s",
+		 NET_POOL_MAX_REDIRECTS, newUrl);
+	    freeMem(newUrl);
+	    ok = FALSE;
+	    break;
+	    }
+	curUrl = newUrl;
+	}
+    }
+if (curUrl != url)
+    freeMem(curUrl);
+return ok;
+}
+
+long long netHttpPoolGetRange(char *url, bits64 start, bits64 size, void *buf)
+/* Fetch size bytes at start of http(s) url into buf over a pooled keep-alive
+ * connection.  Returns number of bytes fetched, which may be less than size
+ * near the end of the file, or -1 after a warning on failure. */
+{
+bits64 gotSize = 0;
+if (size == 0)
+    return 0;
+if (!netHttpPoolGetRanges(url, 1, &start, &size, &buf, &gotSize))
+    return -1;
+return gotSize;
+}
+
+static struct netPoolConn *poolRequest(char *url, char *method,
+	struct netPoolResponse *resp, struct hash *hash)
+/* Send a request without a range for url and read response header, retrying
+ * on a fresh connection if a pooled one turns out to be closed.  Returns
+ * connection ready to read the body, or NULL after a warning. */
+{
+boolean fresh;
+for (fresh = FALSE; ; fresh = TRUE)
+    {
+    boolean gotAny = FALSE;
+    struct netPoolConn *conn = poolConnForUrl(url, fresh);
+    if (conn == NULL)
+	{
+        warn("Couldn't connect for %s", url);
+	return NULL;
+	}
+    if (poolWriteRequest(conn, url, method, -1, -1)
+	&& poolReadHeader(conn, url, resp, hash, &gotAny))
+        return conn;
+    boolean retry = (!gotAny && conn->reused && !fresh);
+    poolConnRelease(&conn, FALSE);
+    if (!retry)
+	{
+	warn("Error reading http response on %s", url);
+        return NULL;
+	}
+    }
+}
+
+int netHttpPoolHead(char *url, struct hash *hash)
+/* Like netUrlHead, but over a pooled keep-alive connection, so a following
+ * netHttpPoolGetRange to the same server needn't connect again. */
+{
+struct netPoolResponse resp;
+struct netPoolConn *conn = poolRequest(url, "HEAD", &resp, hash);
+if (conn == NULL)
+    return EIO;
+freeMem(resp.location);
+poolConnRelease(&conn, resp.keepAlive);
+return resp.status;
+}
+
+static struct dyString *poolSlurp(char *url, long long maxSize, int *retStatus)
+/* Fetch whole of url into a dyString over a pooled connection, following
+ * redirects.  Returns NULL if there's a problem, or if the body is more than
+ * maxSize bytes according to Content-Length, in which case *retStatus is set to
+ * 0. */
+{
+char *curUrl = url;
+struct dyString *dy = NULL;
+int redirectCount;
+*retStatus = -1;
+for (redirectCount = 0; redirectCount <= NET_POOL_MAX_REDIRECTS; ++redirectCount)
+    {
+    struct netPoolResponse resp;
+    struct netPoolConn *conn = poolRequest(curUrl, "GET", &resp, NULL);
+    if (conn == NULL)
+        break;
+    if (isRedirect(resp.status))
+        {
+	boolean reusable = resp.keepAlive && poolReadBody(conn, &resp, NULL);
+	poolConnRelease(&conn, reusable);
+	char *newUrl = poolRedirectUrl(curUrl, resp.location);
+	freeMem(resp.location);
+	if (curUrl != url)
+	    freeMem(curUrl);
+	curUrl = newUrl;
+	if (curUrl == NULL)
+	    break;
+	continue;
+	}
+    freeMem(resp.location);
+    if (resp.status == 200 && resp.contentLength > maxSize)
+        {
+	*retStatus = 0;
+	poolConnRelease(&conn, FALSE);
+	break;
+	}
+    *retStatus = resp.status;
+    dy = dyStringNew(resp.contentLength > 0 ? resp.contentLength : 0);
+    if (!poolReadBody(conn, &resp, dy))
+        {
+	warn("Unexpected end of data on %s", curUrl);
+	dyStringFree(&dy);
+	resp.keepAlive = FALSE;
+	}
+    poolConnRelease(&conn, resp.keepAlive);
+    break;
+    }
+if (redirectCount > NET_POOL_MAX_REDIRECTS)
+    warn("code 30x redirects: exceeded limit of %d redirects, %s",
+	 NET_POOL_MAX_REDIRECTS, curUrl);
+if (curUrl != url)
+    freeMem(curUrl);
+return dy;
+}
+
+void netHttpPoolSetLimits(int maxIdlePerHost, int idleSeconds)
+/* Set the most idle connections kept per server, and how long they are kept.
+ * A maxIdlePerHost of 0 turns connection reuse off. */
+{
+pthread_mutex_lock(&poolMutex);
+poolMaxIdle = maxIdlePerHost;
+poolIdleSeconds = idleSeconds;
+pthread_mutex_unlock(&poolMutex);
+}
+
+void netHttpPoolCloseIdle()
+/* Close all idle pooled connections. */
+{
+pthread_mutex_lock(&poolMutex);
+poolReap(time(NULL), TRUE);
+pthread_mutex_unlock(&poolMutex);
+}
+
+static boolean urlIsCompressed(char *url)
+/* Return TRUE if url names a compressed file. */
+{
+char *urlDecoded = cloneString(url);
+cgiDecode(url, urlDecoded, strlen(url));
+boolean isCompressed =
+    (endsWith(urlDecoded,".gz") ||
+     endsWith(urlDecoded,".Z")  ||
+     endsWith(urlDecoded,".bz2"));
+freeMem(urlDecoded);
+return isCompressed;
+}
+
+static void lineFileOnPoolClose(struct lineFile *lf)
+/* Free up buffer of lineFile made from pooled fetch. */
+{
+freez(&lf->buf);
+}
+
 struct lineFile *netLineFileMayOpen(char *url)
 /* Return a lineFile attached to url. http skips header.
  * Supports some compression formats.  Prints warning message, but
  * does not abort, just returning NULL if there's a problem. */
 {
+if ((startsWith("http://",url) || startsWith("https://",url)) && !urlIsCompressed(url))
+    {
+    /* Fetch over a pooled connection unless it's too big to hold in memory. */
+    int status;
+    struct dyString *dy = poolSlurp(url, NET_POOL_MAX_SLURP, &status);
+    if (dy != NULL && status == 200)
+	{
+	struct lineFile *lf = lineFileOnString(url, TRUE, dyStringCannibalize(&dy));
+	lf->closeCallBack = lineFileOnPoolClose;
+	return lf;
+	}
+    dyStringFree(&dy);
+    if (status != 0)
+	{
+	if (status > 0)
+	    warn("Expected 200 %s: %d", url, status);
+	warn("Couldn't open %s", url);
+	return NULL;
+	}
+    }
 int sd = netUrlOpen(url);
 if (sd < 0)
     {
@@ -1689,14 +2447,7 @@ else
 	    url = newUrl;
 	    }
 	}
-    char *urlDecoded = cloneString(url);
-    cgiDecode(url, urlDecoded, strlen(url));
-    boolean isCompressed =
-	(endsWith(urlDecoded,".gz") ||
-   	 endsWith(urlDecoded,".Z")  ||
-	 endsWith(urlDecoded,".bz2"));
-    freeMem(urlDecoded);
-    if (isCompressed)
+    if (urlIsCompressed(url))
 	{
 	lf = lineFileDecompressFd(url, TRUE, sd);
            /* url needed only for compress type determination */
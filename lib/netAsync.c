@@ -0,0 +1,821 @@
+/* netAsync - fetch many http(s) urls at once from a single thread.  See
+ * netAsync.h for an overview.
+ *
+ * Each connection goes through the states connecting, sending and
+ * receiving, then either goes idle to wait for another request to the same
+ * server or is closed.  Everything received for a request is kept in one
+ * buffer, and after each read we check whether the header and then the
+ * body are complete.  Https connections come from netConnectHttps, which
+ * does the TLS work on a thread of its own behind a socket pair, so look
+ * like plain sockets here. */
+
+#include "common.h"
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include "hash.h"
+#include "dystring.h"
+#include "internet.h"
+#include "net.h"
+#include "https.h"
+#include "portable.h"
+#include "netAsync.h"
+
+#define naMaxRedirects 5		/* Redirects followed per request. */
+#define naRetryDelay 100		/* Milliseconds before first retry, doubles after. */
+#define naMaxRetryDelay 10000		/* Longest wait before a retry. */
+#define naReadSize (64*1024)		/* Size of a single read. */
+
+enum naConnState
+/* What a connection is doing. */
+    {
+    naConnecting,	/* Waiting for non-blocking connect to finish. */
+    naSending,		/* Writing request. */
+    naReceiving,	/* Reading response. */
+    naIdle,		/* Connected, waiting for a request. */
+    };
+
+struct naRequest
+/* A request waiting for or being served. */
+    {
+    struct naRequest *next;	/* Next in queue. */
+    char *origUrl;		/* Url passed to netAsyncAdd. */
+    char *url;			/* Url being fetched, differs from origUrl after redirect. */
+    long long rangeStart;	/* Start of range or -1. */
+    long long rangeSize;	/* Size of range. */
+    netAsyncCallback callback;	/* Called when done. */
+    void *context;		/* Passed to callback. */
+    int tries;			/* Number of times sent. */
+    int redirects;		/* Number of redirects followed. */
+    long notBefore;		/* Don't send before this clock1000() time. */
+    };
+
+struct naHost
+/* A server we connect to. */
+    {
+    char *key;			/* Protocol, host and port.  Not allocated here. */
+    char host[128];		/* Host name. */
+    int port;			/* Port. */
+    boolean isHttps;		/* Connect with netConnectHttps? */
+    boolean resolved;		/* Set once address is filled in. */
+    boolean unresolvable;	/* Set if name lookup failed. */
+    struct sockaddr_in sai;	/* Address of server. */
+    int connCount;		/* Number of open connections to server. */
+    struct naConn *idleList;	/* Connections waiting for a request. */
+    };
+
+struct naConn
+/* A connection to a server. */
+    {
+    struct naConn *next;	/* Next in list of all connections. */
+    struct naConn *nextIdle;	/* Next in host's idle list. */
+    struct naHost *host;	/* Server connected to. */
+    int sd;			/* Non-blocking socket. */
+    enum naConnState state;	/* What we're doing. */
+    boolean reused;		/* Has served a request before? */
+    struct naRequest *req;	/* Request being served, NULL if idle. */
+    struct dyString *out;	/* Request text. */
+    int outPos;			/* Amount of out sent so far. */
+    struct dyString *in;	/* Everything received for this request. */
+    int headerSize;		/* Size of response header in in, 0 until it's all there. */
+    int status;			/* Response status. */
+    long long contentLength;	/* Content-Length, or -1 if none. */
+    boolean chunked;		/* Chunked transfer encoding? */
+    boolean keepAlive;		/* Can connection be reused after response? */
+    char *location;		/* Redirect location. */
+    int chunkPos;		/* Start of next chunk to check in chunked response. */
+    long deadline;		/* Give up if no progress by this clock1000() time. */
+    };
+
+struct netAsync
+/* The fetch engine. */
+    {
+    int maxInFlight;		/* Most requests being served at once. */
+    int maxPerHost;		/* Most connections per server. */
+    int timeoutMs;		/* Milliseconds without progress before request fails. */
+    int retries;		/* Times failed request is retried. */
+    struct naRequest *queue, *queueTail;	/* Requests waiting to start. */
+    struct hash *hostHash;	/* naHosts keyed by protocol, host and port. */
+    struct naConn *connList;	/* All open connections. */
+    int inFlight;		/* Number of requests being served. */
+    int epfd;			/* Epoll descriptor, -1 if using poll. */
+    };
+
+struct netAsync *netAsyncNew(int maxInFlight, int maxPerHost, int timeoutMs, int retries)
+/* Return a new fetch engine.  Zero for any parameter picks the default. */
+{
+struct netAsync *na;
+AllocVar(na);
+na->maxInFlight = (maxInFlight > 0 ? maxInFlight : NET_ASYNC_DEFAULT_IN_FLIGHT);
+na->maxPerHost = (maxPerHost > 0 ? maxPerHost : NET_ASYNC_DEFAULT_PER_HOST);
+na->timeoutMs = (timeoutMs > 0 ? timeoutMs : NET_ASYNC_DEFAULT_TIMEOUT);
+na->retries = (retries > 0 ? retries : NET_ASYNC_DEFAULT_RETRIES);
+na->hostHash = hashNew(8);
+#ifdef __linux__
+na->epfd = epoll_create(na->maxInFlight);
+if (na->epfd < 0)
+    errnoAbort("netAsyncNew: couldn't create epoll descriptor");
+#else
+na->epfd = -1;
+#endif
+netBlockBrokenPipes();
+return na;
+}
+
+static void naRequestFree(struct naRequest **pReq)
+/* Free up a request. */
+{
+struct naRequest *req = *pReq;
+if (req != NULL)
+    {
+    if (req->url != req->origUrl)
+        freeMem(req->url);
+    freeMem(req->origUrl);
+    freez(pReq);
+    }
+}
+
+static void naEnqueue(struct netAsync *na, struct naRequest *req)
+/* Add request to end of queue. */
+{
+req->next = NULL;
+if (na->queueTail == NULL)
+    na->queue = req;
+else
+    na->queueTail->next = req;
+na->queueTail = req;
+}
+
+void netAsyncAdd(struct netAsync *na, char *url, long long rangeStart, long long rangeSize,
+	netAsyncCallback callback, void *context)
+/* Queue up a GET of url, or of rangeSize bytes from rangeStart if rangeStart
+ * is not -1.  Url must be http or https. */
+{
+if (!startsWith("http://", url) && !startsWith("https://", url))
+    errAbort("netAsyncAdd: only http and https supported, not %s", url);
+struct naRequest *req;
+AllocVar(req);
+req->origUrl = req->url = cloneString(url);
+req->rangeStart = rangeStart;
+req->rangeSize = rangeSize;
+req->callback = callback;
+req->context = context;
+naEnqueue(na, req);
+}
+
+static void naWatch(struct netAsync *na, struct naConn *conn, boolean isNew)
+/* Tell epoll what conn is waiting for. */
+{
+#ifdef __linux__
+struct epoll_event ev;
+ZeroVar(&ev);
+ev.events = (conn->state == naConnecting || conn->state == naSending) ? EPOLLOUT : EPOLLIN;
+ev.data.ptr = conn;
+if (epoll_ctl(na->epfd, isNew ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, conn->sd, &ev) < 0)
+    errnoAbort("netAsync: epoll_ctl failed");
+#endif
+}
+
+static void naConnClose(struct netAsync *na, struct naConn *conn)
+/* Close connection and remove it from everywhere. */
+{
+struct naHost *host = conn->host;
+if (conn->state == naIdle)
+    {
+    struct naConn **pEl;
+    for (pEl = &host->idleList; *pEl != NULL; pEl = &(*pEl)->nextIdle)
+        if (*pEl == conn)
+	    {
+	    *pEl = conn->nextIdle;
+	    break;
+	    }
+    }
+slRemoveEl(&na->connList, conn);
+host->connCount -= 1;
+close(conn->sd);	/* Also takes it out of epoll set. */
+dyStringFree(&conn->out);
+dyStringFree(&conn->in);
+freeMem(conn->location);
+freeMem(conn);
+}
+
+static void naSetNonBlocking(int sd)
+/* Make socket non-blocking. */
+{
+int flags = fcntl(sd, F_GETFL, 0);
+if (flags < 0 || fcntl(sd, F_SETFL, flags | O_NONBLOCK) < 0)
+    errnoAbort("netAsync: couldn't make socket non-blocking");
+}
+
+static struct naConn *naConnNew(struct netAsync *na, struct naHost *host, char **retError)
+/* Start a new connection to host.  Returns NULL and sets *retError on failure. */
+{
+int sd;
+enum naConnState state = naConnecting;
+if (host->isHttps)
+    {
+    /* The TLS handshake happens on another thread, and we get one end of a
+     * socket pair that is ready to write to straight away. */
+    sd = netConnectHttps(host->host, host->port);
+    if (sd < 0)
+	{
+	*retError = "couldn't start https connection";
+        return NULL;
+	}
+    naSetNonBlocking(sd);
+    state = naSending;
+    }
+else
+    {
+    if (!host->resolved)
+        {
+	host->resolved = TRUE;
+	host->unresolvable = !internetFillInAddress(host->host, host->port, &host->sai);
+	}
+    if (host->unresolvable)
+        {
+	*retError = "couldn't look up host";
+	return NULL;
+	}
+    sd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sd < 0)
+        {
+	*retError = "couldn't make socket";
+	return NULL;
+	}
+    naSetNonBlocking(sd);
+    if (connect(sd, (struct sockaddr *)&host->sai, sizeof(host->sai)) == 0)
+        state = naSending;
+    else if (errno != EINPROGRESS)
+        {
+	close(sd);
+	*retError = "couldn't connect";
+	return NULL;
+	}
+    }
+struct naConn *conn;
+AllocVar(conn);
+conn->host = host;
+conn->sd = sd;
+conn->state = state;
+slAddHead(&na->connList, conn);
+host->connCount += 1;
+naWatch(na, conn, TRUE);
+return conn;
+}
+
+static struct naHost *naHostForUrl(struct netAsync *na, char *url)
+/* Find or make the host that requests for url go to.  Honors http_proxy
+ * like netHttpConnect. */
+{
+struct netParsedUrl npu;
+char *proxyUrl = getenv("http_proxy");
+netParseUrl(proxyUrl ? proxyUrl : url, &npu);
+char key[512];
+safef(key, sizeof(key), "%s://%s:%s", npu.protocol, npu.host, npu.port);
+struct naHost *host = hashFindVal(na->hostHash, key);
+if (host == NULL)
+    {
+    AllocVar(host);
+    hashAddSaveName(na->hostHash, key, host, &host->key);
+    safecpy(host->host, sizeof(host->host), npu.host);
+    host->port = atoi(npu.port);
+    host->isHttps = sameString(npu.protocol, "https");
+    }
+return host;
+}
+
+static void naConnAssign(struct netAsync *na, struct naConn *conn, struct naRequest *req, long now)
+/* Give request to connection and get ready to send it. */
+{
+struct netParsedUrl npu, pxy;
+netParseUrl(req->url, &npu);
+if (req->rangeStart >= 0)
+    {
+    npu.byteRangeStart = req->rangeStart;
+    npu.byteRangeEnd = req->rangeStart + req->rangeSize - 1;
+    }
+char *proxyUrl = getenv("http_proxy");
+if (proxyUrl)
+    netParseUrl(proxyUrl, &pxy);
+if (conn->out == NULL)
+    {
+    conn->out = dyStringNew(512);
+    conn->in = dyStringNew(0);
+    }
+dyStringClear(conn->out);
+dyStringClear(conn->in);
+netHttpRequestHeader(conn->out, req->url, &npu, proxyUrl, &pxy, "GET", "HTTP/1.1",
+	"genome.ucsc.edu/net.c", NULL);
+conn->outPos = 0;
+conn->headerSize = 0;
+conn->chunkPos = 0;
+freez(&conn->location);
+conn->req = req;
+conn->deadline = now + na->timeoutMs;
+req->tries += 1;
+na->inFlight += 1;
+}
+
+static boolean naStartRequest(struct netAsync *na, struct naRequest *req, long now,
+	char **retError)
+/* Start request on an idle or new connection.  Return FALSE if server already
+ * has as many connections as we allow, or on error, in which case *retError
+ * is set. */
+{
+struct naHost *host = naHostForUrl(na, req->url);
+struct naConn *conn = host->idleList;
+if (conn != NULL)
+    {
+    host->idleList = conn->nextIdle;
+    conn->state = naSending;
+    conn->reused = TRUE;
+    naWatch(na, conn, FALSE);
+    }
+else if (host->connCount < na->maxPerHost)
+    {
+    conn = naConnNew(na, host, retError);
+    if (conn == NULL)
+        return FALSE;
+    }
+else
+    return FALSE;
+naConnAssign(na, conn, req, now);
+return TRUE;
+}
+
+static void naDeliver(struct netAsync *na, struct naRequest *req, int status, char *error,
+	struct dyString *body)
+/* Call request's callback and free request and body. */
+{
+struct netAsyncResult result;
+ZeroVar(&result);
+result.url = req->origUrl;
+result.rangeStart = req->rangeStart;
+result.rangeSize = req->rangeSize;
+result.status = status;
+result.error = error;
+result.body = body;
+result.tries = req->tries;
+req->callback(&result, req->context);
+dyStringFree(&result.body);
+naRequestFree(&req);
+}
+
+static void naRetryOrFail(struct netAsync *na, struct naRequest *req, long now,
+	int status, char *error, struct dyString *body)
+/* Queue request to try again after a delay, or if it's been tried enough
+ * report failure. */
+{
+if (req->tries <= na->retries)
+    {
+    long delay = naRetryDelay << (req->tries - 1);
+    req->notBefore = now + min(delay, naMaxRetryDelay);
+    verbose(2, "netAsync: retrying %s after %s\n", req->url, error ? error : "bad status");
+    naEnqueue(na, req);
+    dyStringFree(&body);
+    }
+else
+    naDeliver(na, req, status, error, body);
+}
+
+static void naConnFail(struct netAsync *na, struct naConn *conn, long now, char *error)
+/* Close connection after a problem and retry its request. */
+{
+struct naRequest *req = conn->req;
+boolean stale = (conn->reused && conn->in->stringSize == 0);
+conn->req = NULL;
+na->inFlight -= 1;
+naConnClose(na, conn);
+if (stale)
+    {
+    /* Server closed a kept-alive connection before we used it.  That's
+     * allowed, so try again on a new connection without counting it. */
+    req->tries -= 1;
+    naEnqueue(na, req);
+    }
+else
+    naRetryOrFail(na, req, now, 0, error, NULL);
+}
+
+static boolean naParseHeader(struct naConn *conn)
+/* If the whole response header is in, parse it and return TRUE. */
+{
+char *s = conn->in->string;
+char *end = strstr(s, "\r\n\r\n");
+if (end == NULL)
+    return FALSE;
+conn->headerSize = end + 4 - s;
+conn->chunkPos = conn->headerSize;
+conn->contentLength = -1;
+conn->chunked = FALSE;
+conn->status = 0;
+
+/* Work on a copy of the header, a line at a time. */
+char *header = cloneStringZ(s, conn->headerSize);
+char *line, *next;
+for (line = header; line != NULL && *line != 0; line = next)
+    {
+    next = strchr(line, '\n');
+    if (next != NULL)
+        *next++ = 0;
+    eraseTrailingSpaces(line);
+    if (line == header)
+        {
+	char *version = nextWord(&line);
+	char *code = nextWord(&line);
+	conn->status = (code != NULL ? atoi(code) : 0);
+	conn->keepAlive = (version != NULL && !sameString(version, "HTTP/1.0"));
+	continue;
+	}
+    char *name = nextWord(&line);
+    if (name == NULL)
+        continue;
+    char *val = skipLeadingSpaces(line);
+    if (sameWord(name, "Content-Length:"))
+        conn->contentLength = atoll(val);
+    else if (sameWord(name, "Transfer-Encoding:"))
+        conn->chunked = (strstrNoCase(val, "chunked") != NULL);
+    else if (sameWord(name, "Connection:"))
+        {
+	if (strstrNoCase(val, "close") != NULL)
+	    conn->keepAlive = FALSE;
+	else if (strstrNoCase(val, "keep-alive") != NULL)
+	    conn->keepAlive = TRUE;
+	}
+    else if (sameWord(name, "Location:"))
+        {
+	freeMem(conn->location);
+	conn->location = cloneString(val);
+	}
+    }
+freeMem(header);
+if (conn->status == 204 || conn->status == 304 || conn->status / 100 == 1)
+    conn->contentLength = 0;
+return TRUE;
+}
+
+static boolean naChunkedComplete(struct naConn *conn, int *retEnd)
+/* Check chunks from conn->chunkPos on, moving chunkPos past complete ones.
+ * Return TRUE and set *retEnd to end of response if the last chunk is in. */
+{
+char *s = conn->in->string;
+int size = conn->in->stringSize;
+for (;;)
+    {
+    char *lineEnd = memMatch("\r\n", 2, s + conn->chunkPos, size - conn->chunkPos);
+    if (lineEnd == NULL)
+        return FALSE;
+    long long chunkSize = strtoll(s + conn->chunkPos, NULL, 16);
+    int dataStart = lineEnd + 2 - s;
+    if (chunkSize == 0)
+        {
+	/* Last chunk, then optional trailer lines ending with a blank line. */
+	if (size - dataStart >= 2 && s[dataStart] == '\r' && s[dataStart+1] == '\n')
+	    {
+	    *retEnd = dataStart + 2;
+	    return TRUE;
+	    }
+	char *trailerEnd = memMatch("\r\n\r\n", 4, s + dataStart, size - dataStart);
+	if (trailerEnd == NULL)
+	    return FALSE;
+	*retEnd = trailerEnd + 4 - s;
+	return TRUE;
+	}
+    if (dataStart + chunkSize + 2 > size)
+        return FALSE;
+    conn->chunkPos = dataStart + chunkSize + 2;
+    }
+}
+
+static struct dyString *naDechunk(struct naConn *conn)
+/* Return body of complete chunked response. */
+{
+struct dyString *body = dyStringNew(0);
+char *s = conn->in->string;
+int pos = conn->headerSize;
+for (;;)
+    {
+    char *lineEnd = strstr(s + pos, "\r\n");
+    long long chunkSize = strtoll(s + pos, NULL, 16);
+    if (chunkSize == 0)
+        break;
+    pos = lineEnd + 2 - s;
+    dyStringAppendN(body, s + pos, chunkSize);
+    pos += chunkSize + 2;
+    }
+return body;
+}
+
+static void naFinish(struct netAsync *na, struct naConn *conn, int end, long now)
+/* Response is all in, with end being the end of it in conn->in.  Hand it on,
+ * and either idle or close connection. */
+{
+struct naRequest *req = conn->req;
+struct dyString *body;
+if (conn->chunked)
+    body = naDechunk(conn);
+else
+    {
+    body = dyStringNew(end - conn->headerSize);
+    dyStringAppendN(body, conn->in->string + conn->headerSize, end - conn->headerSize);
+    }
+int status = conn->status;
+char *location = conn->location;
+conn->location = NULL;
+conn->req = NULL;
+na->inFlight -= 1;
+
+/* Reuse connection only if response ended exactly where the data does. */
+if (conn->keepAlive && end == conn->in->stringSize)
+    {
+    conn->state = naIdle;
+    conn->nextIdle = conn->host->idleList;
+    conn->host->idleList = conn;
+    dyStringClear(conn->in);
+    naWatch(na, conn, FALSE);
+    }
+else
+    naConnClose(na, conn);
+
+if (status >= 300 && status < 400 && location != NULL
+    && (startsWith("http://", location) || startsWith("https://", location))
+    && req->redirects < naMaxRedirects)
+    {
+    if (req->url != req->origUrl)
+        freeMem(req->url);
+    req->url = location;
+    location = NULL;
+    req->redirects += 1;
+    req->tries -= 1;	/* Redirects don't count as tries. */
+    req->notBefore = 0;
+    naEnqueue(na, req);
+    dyStringFree(&body);
+    }
+else if (status >= 500 || status == 429)
+    naRetryOrFail(na, req, now, status, NULL, body);
+else
+    naDeliver(na, req, status, NULL, body);
+freeMem(location);
+}
+
+static void naReceive(struct netAsync *na, struct naConn *conn, long now)
+/* Read what's there on connection and see if the response is complete. */
+{
+boolean eof = FALSE;
+for (;;)
+    {
+    struct dyString *in = conn->in;
+    if (in->bufSize < in->stringSize + naReadSize)
+        dyStringBumpBufSize(in, max(2*in->bufSize, in->stringSize + naReadSize));
+    ssize_t rd = read(conn->sd, in->string + in->stringSize, naReadSize);
+    if (rd > 0)
+        {
+	in->stringSize += rd;
+	in->string[in->stringSize] = 0;
+        continue;
+	}
+    if (rd == 0)
+        eof = TRUE;
+    else if (errno == EINTR)
+        continue;
+    else if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+	naConnFail(na, conn, now, "error reading response");
+	return;
+	}
+    break;
+    }
+conn->deadline = now + na->timeoutMs;
+
+if (conn->headerSize == 0 && !naParseHeader(conn))
+    {
+    if (eof)
+        naConnFail(na, conn, now, "connection closed before response header");
+    return;
+    }
+int end = 0;
+boolean complete = FALSE;
+if (conn->chunked)
+    complete = naChunkedComplete(conn, &end);
+else if (conn->contentLength >= 0)
+    {
+    end = conn->headerSize + conn->contentLength;
+    complete = (conn->in->stringSize >= end);
+    }
+else if (eof)
+    {
+    end = conn->in->stringSize;
+    complete = TRUE;
+    conn->keepAlive = FALSE;
+    }
+if (complete)
+    naFinish(na, conn, end, now);
+else if (eof)
+    naConnFail(na, conn, now, "connection closed before end of response");
+}
+
+static void naSend(struct netAsync *na, struct naConn *conn, long now)
+/* Write as much of request as we can. */
+{
+while (conn->outPos < conn->out->stringSize)
+    {
+    ssize_t wr = write(conn->sd, conn->out->string + conn->outPos,
+	    conn->out->stringSize - conn->outPos);
+    if (wr < 0)
+        {
+	if (errno == EINTR)
+	    continue;
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    return;
+	naConnFail(na, conn, now, "error sending request");
+	return;
+	}
+    conn->outPos += wr;
+    conn->deadline = now + na->timeoutMs;
+    }
+conn->state = naReceiving;
+naWatch(na, conn, FALSE);
+}
+
+static void naHandle(struct netAsync *na, struct naConn *conn, long now)
+/* Do whatever can be done on connection now that it's ready. */
+{
+switch (conn->state)
+    {
+    case naConnecting:
+	{
+	int err = 0;
+	socklen_t len = sizeof(err);
+	if (getsockopt(conn->sd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+	    {
+	    naConnFail(na, conn, now, "couldn't connect");
+	    return;
+	    }
+	conn->state = naSending;
+	naSend(na, conn, now);
+	break;
+	}
+    case naSending:
+	naSend(na, conn, now);
+	break;
+    case naReceiving:
+	naReceive(na, conn, now);
+	break;
+    case naIdle:
+	/* Server closed it, or sent something it shouldn't have. */
+	naConnClose(na, conn);
+	break;
+    }
+}
+
+static long naStartQueued(struct netAsync *na, long now)
+/* Start as many queued requests as limits allow.  Return the earliest time a
+ * request held back for retry can go, or 0 if none. */
+{
+struct naRequest *req, *next, *keepList = NULL;
+long nextTime = 0;
+for (req = na->queue; req != NULL; req = next)
+    {
+    next = req->next;
+    char *error = NULL;
+    if (req->notBefore > now)
+        {
+	if (nextTime == 0 || req->notBefore < nextTime)
+	    nextTime = req->notBefore;
+	slAddHead(&keepList, req);
+	}
+    else if (na->inFlight < na->maxInFlight && naStartRequest(na, req, now, &error))
+        ;
+    else if (error != NULL)
+	naRetryOrFail(na, req, now, 0, error, NULL);
+    else
+        slAddHead(&keepList, req);
+    }
+/* naRetryOrFail may have added to the queue while we went through it. */
+slReverse(&keepList);
+na->queue = NULL;
+na->queueTail = NULL;
+for (req = keepList; req != NULL; req = next)
+    {
+    next = req->next;
+    naEnqueue(na, req);
+    }
+return nextTime;
+}
+
+static int naWait(struct netAsync *na, int timeout, struct naConn **ready, int maxReady)
+/* Wait up to timeout milliseconds for connections to be ready.  Return number
+ * put in ready array. */
+{
+int i, count = 0;
+#ifdef __linux__
+struct epoll_event events[maxReady];
+int n = epoll_wait(na->epfd, events, maxReady, timeout);
+if (n < 0 && errno != EINTR)
+    errnoAbort("netAsync: epoll_wait failed");
+for (i=0; i<n; ++i)
+    ready[count++] = events[i].data.ptr;
+#else
+int connCount = slCount(na->connList);
+struct pollfd *pfds;
+struct naConn *conn, **conns;
+AllocArray(pfds, connCount + 1);
+AllocArray(conns, connCount + 1);
+for (conn = na->connList, i = 0; conn != NULL; conn = conn->next, ++i)
+    {
+    pfds[i].fd = conn->sd;
+    pfds[i].events = (conn->state == naConnecting || conn->state == naSending) ? POLLOUT : POLLIN;
+    conns[i] = conn;
+    }
+int n = poll(pfds, connCount, timeout);
+if (n < 0 && errno != EINTR)
+    errnoAbort("netAsync: poll failed");
+for (i=0; i<connCount && count < maxReady; ++i)
+    if (pfds[i].revents != 0)
+        ready[count++] = conns[i];
+freeMem(conns);
+freeMem(pfds);
+#endif
+return count;
+}
+
+static boolean naConnIsOpen(struct netAsync *na, struct naConn *conn)
+/* Return TRUE if conn is still in the connection list. */
+{
+struct naConn *el;
+for (el = na->connList; el != NULL; el = el->next)
+    if (el == conn)
+        return TRUE;
+return FALSE;
+}
+
+void netAsyncRun(struct netAsync *na)
+/* Run until all queued requests, including ones added by callbacks, are
+ * done. */
+{
+int maxReady = 64;
+struct naConn *ready[maxReady];
+while (na->queue != NULL || na->inFlight > 0)
+    {
+    long now = clock1000();
+    long nextRetry = naStartQueued(na, now);
+
+    /* Wait for something to happen, but not past a deadline or retry time. */
+    long wakeTime = now + 1000;
+    struct naConn *conn;
+    for (conn = na->connList; conn != NULL; conn = conn->next)
+        if (conn->req != NULL && conn->deadline < wakeTime)
+	    wakeTime = conn->deadline;
+    if (nextRetry != 0 && nextRetry < wakeTime)
+        wakeTime = nextRetry;
+    int timeout = max(0, wakeTime - now);
+    int i, readyCount = naWait(na, timeout, ready, maxReady);
+
+    /* Handle ready connections.  Handling one can close another when a
+     * callback adds requests, so check each is still there. */
+    now = clock1000();
+    for (i=0; i<readyCount; ++i)
+	if (naConnIsOpen(na, ready[i]))
+	    naHandle(na, ready[i], now);
+
+    /* Time out connections that have stalled. */
+    struct naConn *next;
+    for (conn = na->connList; conn != NULL; conn = next)
+        {
+	next = conn->next;
+	if (conn->req != NULL && conn->deadline <= now)
+	    naConnFail(na, conn, now, "timed out");
+	}
+    }
+}
+
+void netAsyncFree(struct netAsync **pNa)
+/* Close connections and free up engine.  Requests still queued are
+ * dropped without calling their callbacks. */
+{
+struct netAsync *na = *pNa;
+if (na == NULL)
+    return;
+while (na->connList != NULL)
+    {
+    struct naConn *conn = na->connList;
+    struct naRequest *req = conn->req;
+    naRequestFree(&req);
+    naConnClose(na, conn);
+    }
+struct naRequest *req, *next;
+for (req = na->queue; req != NULL; req = next)
+    {
+    next = req->next;
+    naRequestFree(&req);
+    }
+hashFreeWithVals(&na->hostHash, freez);
+if (na->epfd >= 0)
+    close(na->epfd);
+freez(pNa);
+}
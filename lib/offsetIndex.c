@@ -0,0 +1,89 @@
+/* offsetIndex - find which of many sequences laid end to end contains a
+ * given offset.  See offsetIndex.h for an overview. */
+
+#include "common.h"
+#include "offsetIndex.h"
+
+static int fillEytzinger(struct offsetIndex *oi, bits64 *sorted, int sortedIx, int node)
+/* Fill in subtree rooted at node with sorted values from sortedIx on, by an
+ * in order walk.  Returns next unused sortedIx. */
+{
+if (node <= oi->count)
+    {
+    sortedIx = fillEytzinger(oi, sorted, sortedIx, 2*node);
+    oi->starts[node] = sorted[sortedIx];
+    oi->seqIxs[node] = sortedIx;
+    ++sortedIx;
+    sortedIx = fillEytzinger(oi, sorted, sortedIx, 2*node + 1);
+    }
+return sortedIx;
+}
+
+struct offsetIndex *offsetIndexNew(bits64 *starts, int count)
+/* Make index from the start offsets of count sequences, which must be in
+ * increasing order. */
+{
+int i;
+for (i=1; i<count; ++i)
+    if (starts[i] < starts[i-1])
+        errAbort("offsetIndexNew: starts out of order at %d", i);
+struct offsetIndex *oi;
+AllocVar(oi);
+oi->count = count;
+AllocArray(oi->starts, count+1);
+AllocArray(oi->seqIxs, count+1);
+fillEytzinger(oi, starts, 0, 1);
+return oi;
+}
+
+struct offsetIndex *offsetIndexNew32(bits32 *starts, int count)
+/* Make index from 32 bit start offsets, which must be in increasing order. */
+{
+bits64 *wide;
+AllocArray(wide, max(count, 1));
+int i;
+for (i=0; i<count; ++i)
+    wide[i] = starts[i];
+struct offsetIndex *oi = offsetIndexNew(wide, count);
+freeMem(wide);
+return oi;
+}
+
+void offsetIndexFree(struct offsetIndex **pOi)
+/* Free up offset index. */
+{
+struct offsetIndex *oi = *pOi;
+if (oi != NULL)
+    {
+    freeMem(oi->starts);
+    freeMem(oi->seqIxs);
+    freez(pOi);
+    }
+}
+
+int offsetIndexFind(struct offsetIndex *oi, bits64 offset)
+/* Return index of last sequence starting at or before offset, or -1 if
+ * offset is before the first one.  The caller checks offset is not past
+ * the end of the sequence if need be. */
+{
+/* Go down the tree to a leaf, going right whenever start <= offset.  Node
+ * k's children are at 2k and 2k+1, so the great grandchildren 4 levels
+ * down are in one or two cache lines that can be fetched ahead. */
+bits64 *starts = oi->starts;
+int n = oi->count;
+unsigned k = 1;
+while (k <= n)
+    {
+#ifdef __GNUC__
+    __builtin_prefetch(starts + 16*k);
+#endif
+    k = 2*k + (starts[k] <= offset);
+    }
+
+/* Cancel the right turns at the end of the path, and the left turn before
+ * them, to get to the first start after offset. */
+k >>= ffs(~k);
+if (k == 0)
+    return n - 1;
+return oi->seqIxs[k] - 1;
+}
@@ -93,6 +93,13 @@ int err = pthread_cond_signal(cond);
 perr("pthread_cond_signal", err);
 }
 
+void pthreadCondBroadcast(pthread_cond_t *cond)
+/* Wake up all threads sleeping on conditional, or die trying. */
+{
+int err = pthread_cond_broadcast(cond);
+perr("pthread_cond_broadcast", err);
+}
+
 void pthreadCondWait(pthread_cond_t *cond, pthread_mutex_t *mutex)
 /* Wait for conditional signal. */
 {
@@ -100,3 +107,9 @@ int err = pthread_cond_wait(cond, mutex);
 perr("pthread_cond_wait", err);
 }
 
+void pthreadJoin(pthread_t thread)
+/* Wait for thread to finish, or squawk and die. */
+{
+int err = pthread_join(thread, NULL);
+perr("pthread_join", err);
+}
@@ -0,0 +1,801 @@
+/* readPack - compact binary container for sequencing reads.  See
+ * readPack.h for a description of the format. */
+
+#include "common.h"
+#include "linefile.h"
+#include "dystring.h"
+#include "dnautil.h"
+#include "blockGz.h"
+#include "fastq.h"
+#include "readPack.h"
+#include <zlib.h>
+
+#define READPACK_STREAM_COUNT 4	/* lengths, names, exceptions, qualities */
+
+enum nameOp
+/* How a piece of a read name is coded relative to the previous name. */
+    {
+    nameOpSame = 0,		/* Same as in previous name. */
+    nameOpDelta = 1,		/* Number, coded as difference from previous. */
+    nameOpLiteral = 2,		/* Stored as is. */
+    };
+
+#define MAX_NAME_TOKENS 64	/* Names with more pieces are stored as one literal. */
+#define MAX_NUM_TOKEN 18	/* Longest run of digits coded as a number. */
+
+struct nameTokens
+/* A read name split into alternating runs of digits and non-digits. */
+    {
+    char name[MAX_ID_LENGTH];	/* Copy of name. */
+    int count;			/* Number of tokens. */
+    int starts[MAX_NAME_TOKENS];	/* Start of each token in name. */
+    int sizes[MAX_NAME_TOKENS];	/* Size of each token. */
+    };
+
+struct readPackWriter
+/* State while writing a readPack file. */
+    {
+    char *fileName;		/* Name of file. */
+    FILE *f;			/* Open file. */
+    bits64 readCount;		/* Number of reads written so far. */
+    int blockReads;		/* Number of reads in current block. */
+    struct dyString *lengths;	/* Varint read lengths for current block. */
+    struct dyString *names;	/* Coded names for current block. */
+    struct dyString *excepts;	/* Runs of non-ACGT bases for current block. */
+    struct dyString *bases;	/* Bases for current block, exceptions replaced by T. */
+    struct dyString *quals;	/* Qualities for current block. */
+    bits64 exceptEnd;		/* End of last exception run written in block. */
+    int runStart, runSize;	/* Currently open exception run. */
+    char runChar;		/* Character of current exception run. */
+    struct nameTokens prev;	/* Previous name. */
+    struct readPackIndex *index;	/* Index entries so far. */
+    int blockCount;		/* Number of blocks written. */
+    int indexAlloc;		/* Allocated size of index. */
+    };
+
+static boolean isPlainBase[256];	/* TRUE for A, C, G and T. */
+static char valToUpperNt[4] = {'T', 'C', 'A', 'G'};	/* Same order as ntValNoN. */
+
+static void initTables()
+/* Initialize lookup tables. */
+{
+static boolean initted = FALSE;
+if (!initted)
+    {
+    dnaUtilOpen();
+    isPlainBase['A'] = isPlainBase['C'] = isPlainBase['G'] = isPlainBase['T'] = TRUE;
+    initted = TRUE;
+    }
+}
+
+static void putVarint(struct dyString *dy, bits64 x)
+/* Append x to dy in 7 bits per byte, low bits first. */
+{
+while (x >= 0x80)
+    {
+    dyStringAppendC(dy, (x & 0x7f) | 0x80);
+    x >>= 7;
+    }
+dyStringAppendC(dy, x);
+}
+
+static bits64 getVarint(char **pPt, char *end, char *fileName)
+/* Read a varint from *pPt, advancing *pPt. */
+{
+UBYTE *s = (UBYTE *)*pPt;
+bits64 x = 0;
+int shift = 0;
+for (;;)
+    {
+    if ((char *)s >= end || shift > 63)
+        errAbort("Corrupt varint in %s", fileName);
+    UBYTE b = *s++;
+    x |= ((bits64)(b & 0x7f)) << shift;
+    if ((b & 0x80) == 0)
+        break;
+    shift += 7;
+    }
+*pPt = (char *)s;
+return x;
+}
+
+static bits64 zigZag(long long x)
+/* Map signed to unsigned so small magnitudes stay small. */
+{
+return (x << 1) ^ (x >> 63);
+}
+
+static long long unZigZag(bits64 x)
+/* Undo zigZag. */
+{
+return (long long)(x >> 1) ^ -(long long)(x & 1);
+}
+
+static void tokenizeName(char *name, struct nameTokens *tok)
+/* Split name into runs of digits and non-digits. */
+{
+int size = strlen(name);
+if (size >= sizeof(tok->name))
+    errAbort("Read name %s too long", name);
+memcpy(tok->name, name, size+1);
+tok->count = 0;
+int i = 0;
+while (i < size)
+    {
+    int start = i;
+    boolean digit = (isdigit(name[i]) != 0);
+    while (i < size && (isdigit(name[i]) != 0) == digit)
+        ++i;
+    if (tok->count == MAX_NAME_TOKENS)
+        {
+	/* Fold the rest into the last token. */
+	tok->sizes[tok->count-1] = size - tok->starts[tok->count-1];
+	break;
+	}
+    tok->starts[tok->count] = start;
+    tok->sizes[tok->count] = i - start;
+    tok->count += 1;
+    }
+}
+
+static boolean tokenNumber(struct nameTokens *tok, int ix, long long *retVal)
+/* Return TRUE and the value if token is a number that prints back the same.
+ * The last token of a name with too many pieces can mix digits and
+ * non-digits, so every character is checked. */
+{
+char *s = tok->name + tok->starts[ix];
+int size = tok->sizes[ix];
+if (size > MAX_NUM_TOKEN || (s[0] == '0' && size > 1))
+    return FALSE;
+long long val = 0;
+int i;
+for (i=0; i<size; ++i)
+    {
+    if (!isdigit(s[i]))
+        return FALSE;
+    val = val*10 + (s[i] - '0');
+    }
+*retVal = val;
+return TRUE;
+}
+
+static void encodeName(struct dyString *dy, struct nameTokens *prev, struct nameTokens *cur)
+/* Append name in cur to dy coded against prev. */
+{
+int i;
+putVarint(dy, cur->count);
+for (i=0; i<cur->count; ++i)
+    {
+    char *s = cur->name + cur->starts[i];
+    int size = cur->sizes[i];
+    long long curVal, prevVal;
+    if (i < prev->count && prev->sizes[i] == size
+        && memcmp(prev->name + prev->starts[i], s, size) == 0)
+	dyStringAppendC(dy, nameOpSame);
+    else if (i < prev->count && tokenNumber(cur, i, &curVal) && tokenNumber(prev, i, &prevVal))
+        {
+	dyStringAppendC(dy, nameOpDelta);
+	putVarint(dy, zigZag(curVal - prevVal));
+	}
+    else
+        {
+	dyStringAppendC(dy, nameOpLiteral);
+	putVarint(dy, size);
+	dyStringAppendN(dy, s, size);
+	}
+    }
+}
+
+static void decodeName(char **pPt, char *end, struct nameTokens *prev, struct nameTokens *cur,
+	char *fileName)
+/* Decode a name coded by encodeName into cur. */
+{
+int count = getVarint(pPt, end, fileName);
+int i, size = 0;
+if (count > MAX_NAME_TOKENS)
+    errAbort("Corrupt name in %s", fileName);
+for (i=0; i<count; ++i)
+    {
+    char *s = *pPt;
+    if (s >= end)
+	errAbort("Corrupt name in %s", fileName);
+    *pPt += 1;
+    int op = *s, tokSize = 0;
+    char numBuf[32];
+    char *tok = NULL;
+    if (op == nameOpSame && i < prev->count)
+        {
+	tok = prev->name + prev->starts[i];
+	tokSize = prev->sizes[i];
+	}
+    else if (op == nameOpDelta && i < prev->count)
+        {
+	long long prevVal;
+	if (!tokenNumber(prev, i, &prevVal))
+	    errAbort("Corrupt name in %s", fileName);
+	long long val = prevVal + unZigZag(getVarint(pPt, end, fileName));
+	tokSize = safef(numBuf, sizeof(numBuf), "%lld", val);
+	tok = numBuf;
+	}
+    else if (op == nameOpLiteral)
+        {
+	tokSize = getVarint(pPt, end, fileName);
+	tok = *pPt;
+	if (tok + tokSize > end)
+	    errAbort("Corrupt name in %s", fileName);
+	*pPt += tokSize;
+	}
+    else
+        errAbort("Corrupt name in %s", fileName);
+    if (size + tokSize >= sizeof(cur->name))
+        errAbort("Corrupt name in %s", fileName);
+    cur->starts[i] = size;
+    cur->sizes[i] = tokSize;
+    memcpy(cur->name + size, tok, tokSize);
+    size += tokSize;
+    }
+cur->name[size] = 0;
+cur->count = count;
+}
+
+struct readPackWriter *readPackWriterOpen(char *fileName)
+/* Create a readPack file for writing. */
+{
+struct readPackWriter *rpw;
+initTables();
+AllocVar(rpw);
+rpw->fileName = cloneString(fileName);
+rpw->f = mustOpen(fileName, "wb");
+rpw->lengths = dyStringNew(0);
+rpw->names = dyStringNew(0);
+rpw->excepts = dyStringNew(0);
+rpw->bases = dyStringNew(0);
+rpw->quals = dyStringNew(0);
+rpw->indexAlloc = 256;
+AllocArray(rpw->index, rpw->indexAlloc);
+
+/* Write placeholder header, filled in on close. */
+bits32 zero32 = 0;
+bits64 zero64 = 0;
+int i;
+for (i=0; i<4; ++i)
+    writeOne(rpw->f, zero32);
+writeOne(rpw->f, zero64);
+writeOne(rpw->f, zero64);
+return rpw;
+}
+
+static void closeExceptRun(struct readPackWriter *rpw)
+/* Write out current run of exception characters if any. */
+{
+if (rpw->runSize > 0)
+    {
+    putVarint(rpw->excepts, rpw->runStart - rpw->exceptEnd);
+    putVarint(rpw->excepts, rpw->runSize);
+    dyStringAppendC(rpw->excepts, rpw->runChar);
+    rpw->exceptEnd = rpw->runStart + rpw->runSize;
+    rpw->runSize = 0;
+    }
+}
+
+static void writeStream(FILE *f, struct dyString *dy, bits32 *retZSize, char **retZ)
+/* Compress dy, returning compressed size and data. */
+{
+uLongf zSize = compressBound(dy->stringSize);
+char *z = needLargeMem(zSize);
+int err = compress2((Bytef *)z, &zSize, (Bytef *)dy->string, dy->stringSize, Z_DEFAULT_COMPRESSION);
+if (err != Z_OK)
+    errAbort("compress2 failed (%d)", err);
+*retZSize = zSize;
+*retZ = z;
+}
+
+static void flushBlock(struct readPackWriter *rpw)
+/* Write out current block and reset for next. */
+{
+if (rpw->blockReads == 0)
+    return;
+closeExceptRun(rpw);
+struct dyString *streams[READPACK_STREAM_COUNT] =
+    {rpw->lengths, rpw->names, rpw->excepts, rpw->quals};
+bits32 zSizes[READPACK_STREAM_COUNT];
+char *zData[READPACK_STREAM_COUNT];
+int i;
+FILE *f = rpw->f;
+bits64 offset = ftell(f);
+bits32 readCount = rpw->blockReads, baseCount = rpw->bases->stringSize;
+bits32 qualCount = rpw->quals->stringSize;
+
+writeOne(f, readCount);
+writeOne(f, baseCount);
+writeOne(f, qualCount);
+for (i=0; i<READPACK_STREAM_COUNT; ++i)
+    {
+    bits32 size = streams[i]->stringSize;
+    writeStream(f, streams[i], &zSizes[i], &zData[i]);
+    writeOne(f, zSizes[i]);
+    writeOne(f, size);
+    }
+
+/* Pack bases four to a byte, padding last byte with T's. */
+int packedSize = (baseCount + 3)/4;
+UBYTE *packed = needLargeMem(packedSize + 1);
+char *dna = rpw->bases->string;
+int end = baseCount - 4;
+UBYTE *pt = packed;
+for (i=0; i<=end; i += 4)
+    *pt++ = packDna4(dna+i);
+if (i < baseCount)
+    {
+    DNA last4[4] = {'T', 'T', 'T', 'T'};
+    memcpy(last4, dna+i, baseCount-i);
+    *pt++ = packDna4(last4);
+    }
+mustWrite(f, packed, packedSize);
+freeMem(packed);
+for (i=0; i<READPACK_STREAM_COUNT; ++i)
+    {
+    mustWrite(f, zData[i], zSizes[i]);
+    freeMem(zData[i]);
+    }
+
+/* Record in index. */
+if (rpw->blockCount == rpw->indexAlloc)
+    {
+    ExpandArray(rpw->index, rpw->indexAlloc, rpw->indexAlloc*2);
+    rpw->indexAlloc *= 2;
+    }
+struct readPackIndex *ix = &rpw->index[rpw->blockCount++];
+ix->offset = offset;
+ix->firstRead = rpw->readCount - rpw->blockReads;
+ix->readCount = rpw->blockReads;
+ix->size = ftell(f) - offset;
+
+/* Reset for next block. */
+for (i=0; i<READPACK_STREAM_COUNT; ++i)
+    dyStringClear(streams[i]);
+dyStringClear(rpw->bases);
+rpw->blockReads = 0;
+rpw->exceptEnd = 0;
+rpw->prev.count = 0;
+}
+
+void readPackWriterAdd(struct readPackWriter *rpw, struct fastqItem *fq)
+/* Add a read.  The whole of seq and score are stored, even if their
+ * lengths differ. */
+{
+struct nameTokens cur;
+int i, len = fq->len;
+int blockStart = rpw->bases->stringSize;
+
+int qualLen = strlen(fq->score);
+putVarint(rpw->lengths, len);
+putVarint(rpw->lengths, zigZag(qualLen - len));
+tokenizeName(fq->id, &cur);
+encodeName(rpw->names, &rpw->prev, &cur);
+rpw->prev = cur;
+dyStringAppendN(rpw->quals, fq->score, qualLen);
+
+/* Copy bases, pulling out runs of anything that isn't ACGT. */
+dyStringAppendN(rpw->bases, fq->seq, len);
+char *dna = rpw->bases->string + blockStart;
+for (i=0; i<len; ++i)
+    {
+    UBYTE c = dna[i];
+    if (!isPlainBase[c])
+        {
+	int pos = blockStart + i;
+	if (rpw->runSize > 0 && (rpw->runChar != (char)c || rpw->runStart + rpw->runSize != pos))
+	    closeExceptRun(rpw);
+	if (rpw->runSize == 0)
+	    {
+	    rpw->runStart = pos;
+	    rpw->runChar = c;
+	    }
+	rpw->runSize += 1;
+	dna[i] = 'T';
+	}
+    }
+rpw->readCount += 1;
+rpw->blockReads += 1;
+if (rpw->blockReads >= READPACK_BLOCK_READS || rpw->bases->stringSize >= READPACK_BLOCK_BASES)
+    flushBlock(rpw);
+}
+
+void readPackWriterClose(struct readPackWriter **pRpw)
+/* Write last block and index, close file and free up writer. */
+{
+struct readPackWriter *rpw = *pRpw;
+if (rpw == NULL)
+    return;
+flushBlock(rpw);
+FILE *f = rpw->f;
+bits64 indexOffset = ftell(f);
+int i;
+for (i=0; i<rpw->blockCount; ++i)
+    {
+    struct readPackIndex *ix = &rpw->index[i];
+    writeOne(f, ix->offset);
+    writeOne(f, ix->firstRead);
+    writeOne(f, ix->readCount);
+    writeOne(f, ix->size);
+    }
+
+/* Go back and fill in header. */
+bits32 magic = READPACK_MAGIC, version = 0, blockCount = rpw->blockCount, reserved = 0;
+if (fseek(f, 0, SEEK_SET) != 0)
+    errnoAbort("Couldn't seek to start of %s", rpw->fileName);
+writeOne(f, magic);
+writeOne(f, version);
+writeOne(f, blockCount);
+writeOne(f, reserved);
+writeOne(f, rpw->readCount);
+writeOne(f, indexOffset);
+carefulClose(&rpw->f);
+
+dyStringFree(&rpw->lengths);
+dyStringFree(&rpw->names);
+dyStringFree(&rpw->excepts);
+dyStringFree(&rpw->bases);
+dyStringFree(&rpw->quals);
+freeMem(rpw->index);
+freeMem(rpw->fileName);
+freez(pRpw);
+}
+
+static void mustPread(struct readPack *rp, void *buf, size_t size, bits64 offset)
+/* Read size bytes at offset or die trying. */
+{
+char *s = buf;
+while (size > 0)
+    {
+    ssize_t oneSize = pread(rp->fd, s, size, offset);
+    if (oneSize < 0)
+        errnoAbort("Couldn't read %s", rp->fileName);
+    if (oneSize == 0)
+        errAbort("Unexpected end of file in %s", rp->fileName);
+    s += oneSize;
+    size -= oneSize;
+    offset += oneSize;
+    }
+}
+
+boolean readPackIsFile(char *fileName)
+/* Return TRUE if fileName starts with the readPack magic number. */
+{
+FILE *f = fopen(fileName, "rb");
+bits32 magic = 0;
+boolean isPack = FALSE;
+if (f == NULL)
+    return FALSE;
+if (fread(&magic, sizeof(magic), 1, f) == 1)
+    isPack = (magic == READPACK_MAGIC || magic == READPACK_SWAPPED_MAGIC);
+fclose(f);
+return isPack;
+}
+
+struct readPack *readPackOpen(char *fileName)
+/* Open a readPack file and read its index.  Squawk and die on error. */
+{
+struct readPack *rp;
+char header[32], *pt = header;
+bits32 magic;
+bits64 indexOffset;
+int i;
+
+AllocVar(rp);
+rp->fileName = cloneString(fileName);
+rp->fd = mustOpenFd(fileName, O_RDONLY);
+mustPread(rp, header, sizeof(header), 0);
+memcpy(&magic, header, sizeof(magic));
+if (magic == READPACK_SWAPPED_MAGIC)
+    rp->isSwapped = TRUE;
+else if (magic != READPACK_MAGIC)
+    errAbort("%s is not a readPack file", fileName);
+pt += sizeof(magic);
+rp->version = memReadBits32(&pt, rp->isSwapped);
+if (rp->version != 0)
+    errAbort("Can only handle version 0 of readPack format. %s is version %d",
+	    fileName, rp->version);
+rp->blockCount = memReadBits32(&pt, rp->isSwapped);
+memReadBits32(&pt, rp->isSwapped);	/* reserved */
+rp->readCount = memReadBits64(&pt, rp->isSwapped);
+indexOffset = memReadBits64(&pt, rp->isSwapped);
+
+/* Read index in one gulp. */
+int entrySize = 2*sizeof(bits64) + 2*sizeof(bits32);
+char *buf = needLargeMem((size_t)entrySize * rp->blockCount + 1);
+mustPread(rp, buf, (size_t)entrySize * rp->blockCount, indexOffset);
+AllocArray(rp->index, rp->blockCount);
+pt = buf;
+for (i=0; i<rp->blockCount; ++i)
+    {
+    struct readPackIndex *ix = &rp->index[i];
+    ix->offset = memReadBits64(&pt, rp->isSwapped);
+    ix->firstRead = memReadBits64(&pt, rp->isSwapped);
+    ix->readCount = memReadBits32(&pt, rp->isSwapped);
+    ix->size = memReadBits32(&pt, rp->isSwapped);
+    }
+freeMem(buf);
+return rp;
+}
+
+void readPackBlockFree(struct readPackBlock **pBlock)
+/* Free up a decoded block. */
+{
+struct readPackBlock *block = *pBlock;
+if (block != NULL)
+    {
+    freeMem(block->lengths);
+    freeMem(block->starts);
+    freeMem(block->qualLengths);
+    freeMem(block->qualStarts);
+    freeMem(block->names);
+    freeMem(block->nameBuf);
+    freeMem(block->bases);
+    freeMem(block->quals);
+    freez(pBlock);
+    }
+}
+
+void readPackClose(struct readPack **pRp)
+/* Close readPack file and free up resources. */
+{
+struct readPack *rp = *pRp;
+if (rp != NULL)
+    {
+    mustCloseFd(&rp->fd);
+    readPackBlockFree(&rp->block);
+    freeMem(rp->index);
+    freeMem(rp->fileName);
+    freez(pRp);
+    }
+}
+
+static char *inflateStream(struct readPack *rp, char *z, bits32 zSize, bits32 size)
+/* Uncompress a stream into newly allocated memory. */
+{
+uLongf outSize = size;
+char *out = needLargeMem(size + 1);
+int err = uncompress((Bytef *)out, &outSize, (Bytef *)z, zSize);
+if (err != Z_OK || outSize != size)
+    errAbort("Corrupt compressed data (%d) in %s", err, rp->fileName);
+return out;
+}
+
+struct readPackBlock *readPackBlockLoad(struct readPack *rp, int blockIx)
+/* Read and decode a block.  This is safe to call from several threads at
+ * once as long as readPackNext is not being called on rp at the same time.
+ * Free with readPackBlockFree. */
+{
+struct readPackIndex *ix;
+struct readPackBlock *block;
+char *buf, *pt, *end;
+bits32 zSizes[READPACK_STREAM_COUNT], sizes[READPACK_STREAM_COUNT];
+char *streams[READPACK_STREAM_COUNT];
+bits32 baseCount, qualCount;
+int i;
+
+if (blockIx < 0 || blockIx >= rp->blockCount)
+    errAbort("Block %d out of range in %s", blockIx, rp->fileName);
+initTables();
+ix = &rp->index[blockIx];
+buf = needLargeMem(ix->size);
+mustPread(rp, buf, ix->size, ix->offset);
+pt = buf;
+end = buf + ix->size;
+
+AllocVar(block);
+block->firstRead = ix->firstRead;
+block->readCount = memReadBits32(&pt, rp->isSwapped);
+baseCount = memReadBits32(&pt, rp->isSwapped);
+qualCount = memReadBits32(&pt, rp->isSwapped);
+for (i=0; i<READPACK_STREAM_COUNT; ++i)
+    {
+    zSizes[i] = memReadBits32(&pt, rp->isSwapped);
+    sizes[i] = memReadBits32(&pt, rp->isSwapped);
+    }
+
+/* Unpack bases. */
+int packedSize = (baseCount + 3)/4;
+if (pt + packedSize > end)
+    errAbort("Corrupt block %d in %s", blockIx, rp->fileName);
+char *dna = block->bases = needLargeMem(packedSize*4 + 1);
+UBYTE *packed = (UBYTE *)pt;
+for (i=0; i<packedSize; ++i)
+    {
+    UBYTE b = packed[i];
+    dna[3] = valToUpperNt[b&3];
+    dna[2] = valToUpperNt[(b>>2)&3];
+    dna[1] = valToUpperNt[(b>>4)&3];
+    dna[0] = valToUpperNt[(b>>6)&3];
+    dna += 4;
+    }
+pt += packedSize;
+
+/* Uncompress the other streams. */
+for (i=0; i<READPACK_STREAM_COUNT; ++i)
+    {
+    if (pt + zSizes[i] > end)
+	errAbort("Corrupt block %d in %s", blockIx, rp->fileName);
+    streams[i] = inflateStream(rp, pt, zSizes[i], sizes[i]);
+    pt += zSizes[i];
+    }
+freeMem(buf);
+
+/* Lengths. */
+char *s = streams[0], *sEnd = s + sizes[0];
+bits64 start = 0, qualStart = 0;
+AllocArray(block->lengths, block->readCount);
+AllocArray(block->starts, block->readCount);
+AllocArray(block->qualLengths, block->readCount);
+AllocArray(block->qualStarts, block->readCount);
+for (i=0; i<block->readCount; ++i)
+    {
+    int len = getVarint(&s, sEnd, rp->fileName);
+    int qualLen = len + unZigZag(getVarint(&s, sEnd, rp->fileName));
+    if (len < 0 || qualLen < 0)
+	errAbort("Corrupt block %d in %s", blockIx, rp->fileName);
+    block->lengths[i] = len;
+    block->starts[i] = start;
+    block->qualLengths[i] = qualLen;
+    block->qualStarts[i] = qualStart;
+    start += len;
+    qualStart += qualLen;
+    }
+if (start != baseCount || qualStart != qualCount)
+    errAbort("Corrupt block %d in %s", blockIx, rp->fileName);
+
+/* Names. */
+struct nameTokens prev, cur;
+struct dyString *names = dyStringNew(0);
+int *nameOffsets;
+prev.count = 0;
+AllocArray(nameOffsets, block->readCount);
+s = streams[1];
+sEnd = s + sizes[1];
+for (i=0; i<block->readCount; ++i)
+    {
+    decodeName(&s, sEnd, &prev, &cur, rp->fileName);
+    nameOffsets[i] = names->stringSize;
+    dyStringAppendN(names, cur.name, strlen(cur.name) + 1);
+    prev = cur;
+    }
+block->nameBuf = dyStringCannibalize(&names);
+AllocArray(block->names, block->readCount);
+for (i=0; i<block->readCount; ++i)
+    block->names[i] = block->nameBuf + nameOffsets[i];
+freeMem(nameOffsets);
+
+/* Put back exception runs. */
+s = streams[2];
+sEnd = s + sizes[2];
+bits64 pos = 0;
+while (s < sEnd)
+    {
+    pos += getVarint(&s, sEnd, rp->fileName);
+    bits64 size = getVarint(&s, sEnd, rp->fileName);
+    if (s >= sEnd || pos + size > baseCount)
+	errAbort("Corrupt block %d in %s", blockIx, rp->fileName);
+    memset(block->bases + pos, *s++, size);
+    pos += size;
+    }
+
+block->quals = streams[3];
+block->qualCount = qualCount;
+if (sizes[3] != qualCount)
+    errAbort("Corrupt block %d in %s", blockIx, rp->fileName);
+freeMem(streams[0]);
+freeMem(streams[1]);
+freeMem(streams[2]);
+return block;
+}
+
+void readPackBlockToFastqItem(struct readPackBlock *block, int readIx,
+	struct fastqItem *fq)
+/* Copy a read from block into fq, which should be from allocFastqItem. */
+{
+int len = block->lengths[readIx], qualLen = block->qualLengths[readIx];
+bits64 start = block->starts[readIx];
+char *name = block->names[readIx];
+if (len >= MAX_SEQ_LENGTH || qualLen >= MAX_SEQ_LENGTH)
+    errAbort("Read %s is too long, can only handle %d bases", name, MAX_SEQ_LENGTH-1);
+if (strlen(name) >= MAX_ID_LENGTH)
+    errAbort("Read name %s too long", name);
+strcpy(fq->id, name);
+memcpy(fq->seq, block->bases + start, len);
+fq->seq[len] = 0;
+memcpy(fq->score, block->quals + block->qualStarts[readIx], qualLen);
+fq->score[qualLen] = 0;
+fq->len = len;
+}
+
+boolean readPackNext(struct readPack *rp, struct fastqItem *fq)
+/* Get next read into fq, a drop in replacement for fastqItemNext.
+ * Returns FALSE at end of file. */
+{
+while (rp->block == NULL || rp->blockReadIx >= rp->block->readCount)
+    {
+    readPackBlockFree(&rp->block);
+    if (rp->nextBlock >= rp->blockCount)
+        return FALSE;
+    rp->block = readPackBlockLoad(rp, rp->nextBlock++);
+    rp->blockReadIx = 0;
+    }
+readPackBlockToFastqItem(rp->block, rp->blockReadIx++, fq);
+return TRUE;
+}
+
+void readPackSeek(struct readPack *rp, bits64 readIx)
+/* Arrange for next readPackNext to return read number readIx (0 based). */
+{
+readPackBlockFree(&rp->block);
+if (readIx >= rp->readCount)
+    {
+    rp->nextBlock = rp->blockCount;
+    return;
+    }
+/* Binary search for last block starting at or before readIx. */
+int lo = 0, hi = rp->blockCount - 1;
+while (lo < hi)
+    {
+    int mid = (lo + hi + 1)/2;
+    if (rp->index[mid].firstRead <= readIx)
+        lo = mid;
+    else
+        hi = mid - 1;
+    }
+rp->block = readPackBlockLoad(rp, lo);
+rp->nextBlock = lo + 1;
+rp->blockReadIx = readIx - rp->index[lo].firstRead;
+}
+
+bits64 readPackFromFastq(char *fastqName, char *packName)
+/* Convert fastq(.gz) file to readPack.  Returns number of reads. */
+{
+struct lineFile *lf = lineFileOpen(fastqName, TRUE);
+struct readPackWriter *rpw = readPackWriterOpen(packName);
+struct fastqItem *fq = allocFastqItem();
+bits64 count = 0;
+while (fastqItemNext(lf, fq))
+    {
+    readPackWriterAdd(rpw, fq);
+    ++count;
+    }
+readPackWriterClose(&rpw);
+freeFastqItem(fq);
+lineFileClose(&lf);
+return count;
+}
+
+bits64 readPackToFastq(char *packName, char *fastqName, int gzThreads)
+/* Convert readPack to fastq.  If fastqName ends in .gz it is compressed
+ * with gzThreads worker threads.  Returns number of reads. */
+{
+struct readPack *rp = readPackOpen(packName);
+struct fastqItem *fq = allocFastqItem();
+bits64 count = 0;
+if (endsWith(fastqName, ".gz"))
+    {
+    struct blockGz *bg = blockGzOpen(fastqName, -1, gzThreads);
+    while (readPackNext(rp, fq))
+        {
+	blockGzPrintFastqItem(bg, fq);
+	++count;
+	}
+    blockGzClose(&bg);
+    }
+else
+    {
+    FILE *f = mustOpen(fastqName, "w");
+    while (readPackNext(rp, fq))
+        {
+	printFastqItem(f, fq);
+	++count;
+	}
+    carefulClose(&f);
+    }
+freeFastqItem(fq);
+readPackClose(&rp);
+return count;
+}
@@ -0,0 +1,751 @@
+/* sufMake - build suffix arrays for a genome and write them as the sufa and
+ * sufx files that sufaRead and sufxRead load.  See sufMake.h for an overview. */
+
+#include "common.h"
+#include "dnaseq.h"
+#include "dnaLoad.h"
+#include "portable.h"
+#include "pthreadWrap.h"
+#include "dystring.h"
+#include "fmi.h"
+#include "sufa.h"
+#include "sufx.h"
+#include "sufMake.h"
+
+#define bucketBases 8		/* Number of bases used to put suffixes in buckets. */
+#define bucketCount 1679616	/* Six to the bucketBases - zero, a, c, g, n, and t. */
+#define jobSize (64*1024)	/* About how many suffixes a thread sorts at a time. */
+#define smallSortSize 16	/* Insertion sort ranges smaller than this. */
+#define allDnaPad 8		/* Zeroes after allDna. */
+
+static int baseRank[256];	/* Bucket digit for each character. */
+
+static void initBaseRank()
+/* Fill in baseRank.  Ranks are in the same order as the characters. */
+{
+baseRank['a'] = 1;
+baseRank['c'] = 2;
+baseRank['g'] = 3;
+baseRank['n'] = 4;
+baseRank['t'] = 5;
+}
+
+struct sufGenome *sufGenomeLoad(char *dnaFile)
+/* Load up a genome from a fasta, .2bit or .nib file, or a file listing such
+ * files, via dnaLoad. */
+{
+struct sufGenome *genome;
+AllocVar(genome);
+struct dnaLoad *dl = dnaLoadOpen(dnaFile);
+struct dnaSeq *seq;
+int chromAlloc = 0;
+bits64 dnaAlloc = 0, dnaSize = 0, arraySize = 0;
+char *allDna = NULL;
+while ((seq = dnaLoadNext(dl)) != NULL)
+    {
+    if (genome->chromCount == chromAlloc)
+        {
+	int newAlloc = (chromAlloc == 0 ? 64 : 2*chromAlloc);
+	ExpandArray(genome->chromNames, chromAlloc, newAlloc);
+	ExpandArray(genome->chromSizes, chromAlloc, newAlloc);
+	chromAlloc = newAlloc;
+	}
+    genome->chromNames[genome->chromCount] = cloneString(seq->name);
+    genome->chromSizes[genome->chromCount] = seq->size;
+    genome->chromCount += 1;
+
+    bits64 needed = dnaSize + seq->size + 1 + allDnaPad;
+    if (needed > dnaAlloc)
+        {
+	dnaAlloc = max(needed, 2*dnaAlloc);
+	allDna = needHugeMemResize(allDna, dnaAlloc);
+	}
+    char *dna = allDna + dnaSize;
+    int i;
+    for (i=0; i<seq->size; ++i)
+        {
+	char c = tolower(seq->dna[i]);
+	switch (c)
+	    {
+	    case 'a':
+	    case 'c':
+	    case 'g':
+	    case 't':
+	        ++arraySize;
+		break;
+	    default:
+	        c = 'n';
+		break;
+	    }
+	dna[i] = c;
+	}
+    dna[seq->size] = 0;
+    dnaSize += seq->size + 1;
+    dnaSeqFree(&seq);
+    }
+dnaLoadClose(&dl);
+if (genome->chromCount == 0)
+    errAbort("No sequence in %s", dnaFile);
+if (allDna != NULL)
+    memset(allDna + dnaSize, 0, allDnaPad);
+genome->allDna = allDna;
+genome->dnaSize = dnaSize;
+genome->arraySize = arraySize;
+verbose(2, "Loaded %d sequences, %llu bases to index, from %s\n",
+	genome->chromCount, arraySize, dnaFile);
+return genome;
+}
+
+void sufGenomeFree(struct sufGenome **pGenome)
+/* Free up genome. */
+{
+struct sufGenome *genome = *pGenome;
+if (genome != NULL)
+    {
+    int i;
+    for (i=0; i<genome->chromCount; ++i)
+        freeMem(genome->chromNames[i]);
+    freeMem(genome->chromNames);
+    freeMem(genome->chromSizes);
+    freeMem(genome->allDna);
+    freez(pGenome);
+    }
+}
+
+INLINE bits64 arrayGet(void *array, boolean is64, bits64 ix)
+/* Return element ix of a bits32 or bits64 array. */
+{
+return is64 ? ((bits64 *)array)[ix] : ((bits32 *)array)[ix];
+}
+
+INLINE void arraySet(void *array, boolean is64, bits64 ix, bits64 val)
+/* Set element ix of a bits32 or bits64 array. */
+{
+if (is64)
+    ((bits64 *)array)[ix] = val;
+else
+    ((bits32 *)array)[ix] = val;
+}
+
+static void runThreads(int threadCount, void *(*func)(void *), void *args, size_t argSize)
+/* Run func on threadCount threads, passing each a pointer to its own
+ * argSize element of args, and wait for them all to finish. */
+{
+if (threadCount <= 1)
+    {
+    func(args);
+    return;
+    }
+pthread_t threads[threadCount];
+int i;
+for (i=0; i<threadCount; ++i)
+    pthreadCreate(&threads[i], NULL, func, (char *)args + i*argSize);
+for (i=0; i<threadCount; ++i)
+    pthreadJoin(threads[i]);
+}
+
+/* This section sorts the suffixes in one bucket with multikey quicksort,
+ * which looks at the suffixes one base at a time. */
+
+struct sortRange
+/* A range of suffixes that still need sorting. */
+    {
+    bits64 *pos;	/* Offsets of suffixes. */
+    bits64 size;	/* Number of suffixes. */
+    bits64 depth;	/* Number of bases all suffixes are known to share. */
+    };
+
+static int suffixCmp(char *dna, bits64 a, bits64 b, bits64 depth)
+/* Compare two suffixes that share depth bases as zero terminated strings,
+ * breaking ties by offset. */
+{
+UBYTE *s = (UBYTE *)dna + a + depth, *t = (UBYTE *)dna + b + depth;
+while (*s == *t && *s != 0)
+    {
+    ++s;
+    ++t;
+    }
+if (*s != *t)
+    return *s - *t;
+return (a < b ? -1 : (a > b ? 1 : 0));
+}
+
+static int bits64Cmp(const void *va, const void *vb)
+/* Compare two bits64s. */
+{
+bits64 a = *((bits64 *)va), b = *((bits64 *)vb);
+return (a < b ? -1 : (a > b ? 1 : 0));
+}
+
+static void insertionSort(char *dna, bits64 *pos, bits64 size, bits64 depth)
+/* Sort a few suffixes that share depth bases. */
+{
+bits64 i, j;
+for (i=1; i<size; ++i)
+    {
+    bits64 p = pos[i];
+    for (j=i; j>0 && suffixCmp(dna, pos[j-1], p, depth) > 0; --j)
+        pos[j] = pos[j-1];
+    pos[j] = p;
+    }
+}
+
+INLINE UBYTE median3(UBYTE a, UBYTE b, UBYTE c)
+/* Return the middle of three values. */
+{
+if (a < b)
+    return (b < c ? b : (a < c ? c : a));
+else
+    return (a < c ? a : (b < c ? c : b));
+}
+
+struct sortStack
+/* Ranges left to sort.  Kept on heap rather than by recursion, since long
+ * repeats would recurse very deeply. */
+    {
+    struct sortRange *ranges;
+    int count, alloc;
+    };
+
+static void sortStackPush(struct sortStack *stack, bits64 *pos, bits64 size, bits64 depth)
+/* Add range to stack if it has more than one suffix. */
+{
+if (size < 2)
+    return;
+if (stack->count == stack->alloc)
+    {
+    int newAlloc = (stack->alloc == 0 ? 256 : 2*stack->alloc);
+    ExpandArray(stack->ranges, stack->alloc, newAlloc);
+    stack->alloc = newAlloc;
+    }
+struct sortRange *range = &stack->ranges[stack->count++];
+range->pos = pos;
+range->size = size;
+range->depth = depth;
+}
+
+static void multikeySort(char *dna, bits64 *pos, bits64 size, bits64 depth,
+	struct sortStack *stack)
+/* Sort suffixes that share depth bases. */
+{
+sortStackPush(stack, pos, size, depth);
+while (stack->count > 0)
+    {
+    struct sortRange range = stack->ranges[--stack->count];
+    pos = range.pos;
+    size = range.size;
+    depth = range.depth;
+    if (size < smallSortSize)
+        {
+	insertionSort(dna, pos, size, depth);
+	continue;
+	}
+
+    /* Partition into suffixes with a base at depth smaller, equal to and
+     * bigger than a pivot. */
+    UBYTE pivot = median3(dna[pos[0] + depth], dna[pos[size/2] + depth],
+    	dna[pos[size-1] + depth]);
+    bits64 lt = 0, i = 0, gt = size;
+    while (i < gt)
+        {
+	UBYTE c = dna[pos[i] + depth];
+	bits64 temp = pos[i];
+	if (c < pivot)
+	    {
+	    pos[i++] = pos[lt];
+	    pos[lt++] = temp;
+	    }
+	else if (c > pivot)
+	    {
+	    pos[i] = pos[--gt];
+	    pos[gt] = temp;
+	    }
+	else
+	    ++i;
+	}
+    sortStackPush(stack, pos, lt, depth);
+    sortStackPush(stack, pos + gt, size - gt, depth);
+    if (pivot == 0)
+        qsort(pos + lt, gt - lt, sizeof(pos[0]), bits64Cmp);
+    else
+	sortStackPush(stack, pos + lt, gt - lt, depth + 1);
+    }
+}
+
+struct bucketSorter
+/* Hands out buckets to sorting threads. */
+    {
+    struct sufGenome *genome;	/* Genome being indexed. */
+    void *array;		/* Suffix array, filled in by bucket. */
+    boolean is64;		/* True if array is bits64. */
+    bits64 *bucketStarts;	/* Start of each bucket in array, and end of last. */
+    int nextBucket;		/* Next bucket to sort. */
+    pthread_mutex_t mutex;	/* Protects nextBucket. */
+    };
+
+static void *bucketSortThread(void *v)
+/* Sort buckets until there are none left. */
+{
+struct bucketSorter *bs = *((struct bucketSorter **)v);
+char *dna = bs->genome->allDna;
+bits64 *bucketStarts = bs->bucketStarts;
+bits64 *pos = NULL;
+bits64 posAlloc = 0;
+struct sortStack stack = {NULL, 0, 0};
+for (;;)
+    {
+    /* Grab a job's worth of buckets. */
+    pthreadMutexLock(&bs->mutex);
+    int start = bs->nextBucket, end = start;
+    while (end < bucketCount && bucketStarts[end] - bucketStarts[start] < jobSize)
+        ++end;
+    bs->nextBucket = end;
+    pthreadMutexUnlock(&bs->mutex);
+    if (start == end)
+        break;
+
+    int bucket;
+    for (bucket = start; bucket < end; ++bucket)
+        {
+	/* Buckets of suffixes that end within the first bucketBases are
+	 * all equal, and already in order of offset. */
+	bits64 size = bucketStarts[bucket+1] - bucketStarts[bucket];
+	if (size < 2 || bucket % 6 == 0)
+	    continue;
+	bits64 first = bucketStarts[bucket], i;
+	if (bs->is64)
+	    multikeySort(dna, (bits64 *)bs->array + first, size, bucketBases, &stack);
+	else
+	    {
+	    if (size > posAlloc)
+		{
+		freeMem(pos);
+		posAlloc = max(size, 2*posAlloc);
+		pos = needHugeMem(posAlloc * sizeof(pos[0]));
+		}
+	    bits32 *array = (bits32 *)bs->array + first;
+	    for (i=0; i<size; ++i)
+		pos[i] = array[i];
+	    multikeySort(dna, pos, size, bucketBases, &stack);
+	    for (i=0; i<size; ++i)
+		array[i] = pos[i];
+	    }
+	}
+    }
+freeMem(pos);
+freeMem(stack.ranges);
+return NULL;
+}
+
+static int bucketOf(char *dna)
+/* Return bucket for suffix starting at dna. */
+{
+int i, bucket = 0;
+for (i=0; i<bucketBases; ++i)
+    {
+    bucket *= 6;
+    if (*dna != 0)
+	bucket += baseRank[(UBYTE)*dna++];
+    }
+return bucket;
+}
+
+static void *arrayMake(struct sufGenome *genome, boolean full, boolean is64, int threadCount)
+/* Return suffix array for genome, including every position if full is set,
+ * or just acgt's otherwise. */
+{
+if (!is64 && genome->dnaSize > SUF_MAKE_MAX_32)
+    errAbort("Genome too big for 32 bit suffix array, %llu bases", genome->dnaSize);
+initBaseRank();
+char *dna = genome->allDna;
+bits64 dnaSize = genome->dnaSize, i;
+long startTime = clock1000();
+
+/* Count up bucket sizes and turn them into starts. */
+bits64 *bucketStarts = needHugeZeroedMem((bucketCount+1) * sizeof(bucketStarts[0]));
+for (i=0; i<dnaSize; ++i)
+    {
+    char c = dna[i];
+    if (full || (c != 0 && c != 'n'))
+	bucketStarts[bucketOf(dna + i)] += 1;
+    }
+bits64 total = 0;
+int bucket;
+for (bucket = 0; bucket <= bucketCount; ++bucket)
+    {
+    bits64 size = bucketStarts[bucket];
+    bucketStarts[bucket] = total;
+    total += size;
+    }
+assert(total == (full ? dnaSize : genome->arraySize));
+
+/* Put suffixes in buckets, in order of offset within each. */
+bits64 *fill = needHugeMem(bucketCount * sizeof(fill[0]));
+memcpy(fill, bucketStarts, bucketCount * sizeof(fill[0]));
+void *array = needHugeMem(max(total, 1) * (is64 ? sizeof(bits64) : sizeof(bits32)));
+for (i=0; i<dnaSize; ++i)
+    {
+    char c = dna[i];
+    if (full || (c != 0 && c != 'n'))
+	arraySet(array, is64, fill[bucketOf(dna + i)]++, i);
+    }
+freeMem(fill);
+verbose(2, "Bucketed %llu suffixes in %ld ms\n", total, clock1000() - startTime);
+
+/* Sort buckets. */
+startTime = clock1000();
+struct bucketSorter bs;
+ZeroVar(&bs);
+bs.genome = genome;
+bs.array = array;
+bs.is64 = is64;
+bs.bucketStarts = bucketStarts;
+pthreadMutexInit(&bs.mutex);
+if (threadCount < 1)
+    threadCount = 1;
+struct bucketSorter *args[threadCount];
+for (i=0; i<threadCount; ++i)
+    args[i] = &bs;
+runThreads(threadCount, bucketSortThread, args, sizeof(args[0]));
+pthreadMutexDestroy(&bs.mutex);
+freeMem(bucketStarts);
+verbose(2, "Sorted suffixes on %d threads in %ld ms\n", threadCount, clock1000() - startTime);
+return array;
+}
+
+bits32 *sufArrayMake(struct sufGenome *genome, int threadCount)
+/* Return suffix array for genome.  Suffixes compare as zero terminated
+ * strings, with ties broken by offset.  ThreadCount 0 or 1 sorts on the
+ * calling thread.  FreeMem result when done. */
+{
+return arrayMake(genome, FALSE, FALSE, threadCount);
+}
+
+void *sufArrayMakeFull(struct sufGenome *genome, boolean is64, int threadCount)
+/* Like sufArrayMake, but with a suffix for every position of allDna, n's and
+ * separators included, as an FM-index needs.  Array size is genome->dnaSize. */
+{
+return arrayMake(genome, TRUE, is64, threadCount);
+}
+
+struct depthJob
+/* A stretch of the suffix array to find depths for. */
+    {
+    struct sufGenome *genome;	/* Genome being indexed. */
+    bits32 *array;		/* Suffix array. */
+    bits32 *depth;		/* Where to put depths. */
+    bits64 start, end;		/* Stretch of array. */
+    };
+
+static void *depthThread(void *v)
+/* Fill in number of bases each suffix in a stretch shares with the one before. */
+{
+struct depthJob *job = v;
+UBYTE *dna = (UBYTE *)job->genome->allDna;
+bits64 i;
+for (i = job->start; i < job->end; ++i)
+    {
+    bits64 shared = 0;
+    if (i > 0)
+        {
+	UBYTE *s = dna + job->array[i-1];
+	UBYTE *t = dna + job->array[i];
+	while (s[shared] == t[shared] && s[shared] != 0)
+	    ++shared;
+	}
+    job->depth[i] = shared;
+    }
+return NULL;
+}
+
+struct depthStackEl
+/* A suffix that may be where later traversals end. */
+    {
+    bits64 ix;		/* Index in array. */
+    bits64 depth;	/* Depth of suffix. */
+    };
+
+bits32 *sufTraverseMake(struct sufGenome *genome, bits32 *array, int threadCount)
+/* Return traverse array, as described in sufx.h, for suffix array made by
+ * sufArrayMake.  FreeMem result when done. */
+{
+bits64 arraySize = genome->arraySize;
+long startTime = clock1000();
+bits32 *traverse = needHugeMem(max(arraySize, 1) * sizeof(bits32));
+
+/* Fill traverse with depths in parallel. */
+if (threadCount < 1)
+    threadCount = 1;
+struct depthJob jobs[threadCount];
+int i;
+for (i=0; i<threadCount; ++i)
+    {
+    struct depthJob *job = &jobs[i];
+    job->genome = genome;
+    job->array = array;
+    job->depth = traverse;
+    job->start = arraySize * i / threadCount;
+    job->end = arraySize * (i+1) / threadCount;
+    }
+runThreads(threadCount, depthThread, jobs, sizeof(jobs[0]));
+
+/* Go backwards keeping a stack of suffixes that could end later traversals.
+ * Depths on the stack go up from bottom to top, so it is no bigger than the
+ * deepest suffix. */
+struct depthStackEl *stack = NULL;
+int stackSize = 0, stackAlloc = 0;
+bits64 ix;
+for (ix = arraySize; ix-- > 0; )
+    {
+    bits64 depth = traverse[ix];
+    while (stackSize > 0 && stack[stackSize-1].depth > depth)
+        --stackSize;
+    bits64 end = (stackSize > 0 ? stack[stackSize-1].ix : arraySize);
+    traverse[ix] = end - ix;
+    if (stackSize > 0 && stack[stackSize-1].depth == depth)
+        stack[stackSize-1].ix = ix;
+    else
+        {
+	if (stackSize == stackAlloc)
+	    {
+	    int newAlloc = (stackAlloc == 0 ? 1024 : 2*stackAlloc);
+	    ExpandArray(stack, stackAlloc, newAlloc);
+	    stackAlloc = newAlloc;
+	    }
+	stack[stackSize].ix = ix;
+	stack[stackSize].depth = depth;
+	++stackSize;
+	}
+    }
+freeMem(stack);
+verbose(2, "Made traverse array in %ld ms\n", clock1000() - startTime);
+return traverse;
+}
+
+static void writeGenome(struct sufGenome *genome, int arrayCount, FILE *f,
+	struct sufaFileHeader *header)
+/* Fill in header from genome and write it, followed by chromosome names,
+ * sizes and DNA.  ArrayCount is the number of arrays that will follow.  The
+ * sufa and sufx headers are laid out the same. */
+{
+/* Figure out padded sizes. */
+bits32 chromNamesSize = 0;
+int i;
+for (i=0; i<genome->chromCount; ++i)
+    chromNamesSize += strlen(genome->chromNames[i]) + 1;
+bits32 namesPad = (4 - chromNamesSize % 4) % 4;
+chromNamesSize += namesPad;
+bits64 preDnaSize = sizeof(*header) + chromNamesSize + genome->chromCount * sizeof(bits32);
+bits64 dnaDiskSize = genome->dnaSize;
+while ((preDnaSize + dnaDiskSize) % 4 != 0)
+    ++dnaDiskSize;
+
+header->chromCount = genome->chromCount;
+header->chromNamesSize = chromNamesSize;
+header->arraySize = genome->arraySize;
+header->dnaDiskSize = dnaDiskSize;
+header->size = preDnaSize + dnaDiskSize + arrayCount * genome->arraySize * sizeof(bits32);
+mustWrite(f, header, sizeof(*header));
+for (i=0; i<genome->chromCount; ++i)
+    mustWrite(f, genome->chromNames[i], strlen(genome->chromNames[i]) + 1);
+static char zeroes[allDnaPad];
+mustWrite(f, zeroes, namesPad);
+mustWrite(f, genome->chromSizes, genome->chromCount * sizeof(bits32));
+mustWrite(f, genome->allDna, dnaDiskSize);
+}
+
+void sufaWrite(struct sufGenome *genome, bits32 *array, char *fileName)
+/* Write genome and its suffix array as a sufa file. */
+{
+struct sufaFileHeader header;
+ZeroVar(&header);
+header.magic = SUFA_MAGIC;
+header.majorVersion = SUFA_MAJOR_VERSION;
+header.minorVersion = SUFA_MINOR_VERSION;
+FILE *f = mustOpen(fileName, "wb");
+writeGenome(genome, 1, f, &header);
+mustWrite(f, array, genome->arraySize * sizeof(bits32));
+carefulClose(&f);
+}
+
+void sufxWrite(struct sufGenome *genome, bits32 *array, bits32 *traverse, char *fileName)
+/* Write genome with its suffix and traverse arrays as a sufx file. */
+{
+struct sufaFileHeader header;
+ZeroVar(&header);
+header.magic = SUFX_MAGIC;
+header.majorVersion = SUFX_MAJOR_VERSION;
+header.minorVersion = SUFX_MINOR_VERSION;
+FILE *f = mustOpen(fileName, "wb");
+bits64 arrayBytes = genome->arraySize * sizeof(bits32);
+writeGenome(genome, 2, f, &header);
+mustWrite(f, array, arrayBytes);
+mustWrite(f, traverse, arrayBytes);
+carefulClose(&f);
+}
+
+static void checkSufSize(struct sufGenome *genome, char *dnaFile)
+/* Make sure genome fits in a sufa or sufx file before taking the time to
+ * sort it. */
+{
+if (genome->dnaSize > SUF_MAKE_MAX_32)
+    errAbort("%s has %llu bases, too many for sufa and sufx files.  "
+	     "Make an fmi file instead.", dnaFile, genome->dnaSize);
+}
+
+void sufaMake(char *dnaFile, char *sufaFile, int threadCount)
+/* Make a sufa file from a fasta, .2bit or .nib file.  Aborts if the genome
+ * is over SUF_MAKE_MAX_32. */
+{
+struct sufGenome *genome = sufGenomeLoad(dnaFile);
+checkSufSize(genome, dnaFile);
+bits32 *array = sufArrayMake(genome, threadCount);
+sufaWrite(genome, array, sufaFile);
+freeMem(array);
+sufGenomeFree(&genome);
+}
+
+void sufxMake(char *dnaFile, char *sufxFile, int threadCount)
+/* Make a sufx file from a fasta, .2bit or .nib file.  Aborts if the genome
+ * is over SUF_MAKE_MAX_32. */
+{
+struct sufGenome *genome = sufGenomeLoad(dnaFile);
+checkSufSize(genome, dnaFile);
+bits32 *array = sufArrayMake(genome, threadCount);
+bits32 *traverse = sufTraverseMake(genome, array, threadCount);
+sufxWrite(genome, array, traverse, sufxFile);
+freeMem(traverse);
+freeMem(array);
+sufGenomeFree(&genome);
+}
+
+static int fmiSymbol(char c)
+/* Return FM-index symbol for a character of allDna. */
+{
+return (c == 0 ? 0 : baseRank[(UBYTE)c]);
+}
+
+static void writePadded(FILE *f, void *data, bits64 size)
+/* Write data followed by zeroes out to an 8 byte boundary. */
+{
+static char zeroes[8];
+mustWrite(f, data, size);
+mustWrite(f, zeroes, (8 - size % 8) % 8);
+}
+
+static bits64 padded(bits64 size)
+/* Return size rounded up to an 8 byte boundary. */
+{
+return (size + 7) & ~7LL;
+}
+
+void fmiWrite(struct sufGenome *genome, void *array, boolean is64, int sampleRate,
+	char *fileName)
+/* Write genome as an FM-index file, given the array from sufArrayMakeFull.
+ * Every sampleRate'th row gets its offset stored. */
+{
+if (sampleRate < 1)
+    errAbort("fmiWrite: sampleRate must be positive, got %d", sampleRate);
+initBaseRank();
+char *dna = genome->allDna;
+bits64 textSize = genome->dnaSize;
+int chromCount = genome->chromCount;
+bits64 blockCount = textSize / FMI_BLOCK_SIZE + 1;
+bits64 sampleCount = (textSize + sampleRate - 1) / sampleRate;
+int sampleSize = (is64 ? sizeof(bits64) : sizeof(bits32));
+
+/* Make transform, samples and chromosome starts in memory. */
+struct fmiBlock *blocks = needHugeZeroedMem(blockCount * sizeof(blocks[0]));
+void *samples = needHugeMem(max(sampleCount, 1) * sampleSize);
+struct fmiChromStart *chromStarts;
+AllocArray(chromStarts, chromCount);
+int chromStartCount = 0;
+bits64 counts[FMI_ALPHABET_SIZE];
+ZeroVar(&counts);
+bits64 row;
+for (row = 0; row < textSize; ++row)
+    {
+    bits64 offset = arrayGet(array, is64, row);
+    struct fmiBlock *block = &blocks[row / FMI_BLOCK_SIZE];
+    int bit = row % FMI_BLOCK_SIZE;
+    if (bit == 0)
+        memcpy(block->counts, counts + 1, sizeof(block->counts));
+    int symbol = fmiSymbol(offset == 0 ? dna[textSize-1] : dna[offset-1]);
+    counts[symbol] += 1;
+    bits64 *planes = block->planes[bit / 64];
+    bits64 mask = 1ULL << (bit % 64);
+    if (symbol & 1)
+        planes[0] |= mask;
+    if (symbol & 2)
+        planes[1] |= mask;
+    if (symbol & 4)
+        planes[2] |= mask;
+    if (symbol == 0)
+	{
+	if (chromStartCount >= chromCount)
+	    errAbort("fmiWrite: more chromosome starts than chromosomes");
+	chromStarts[chromStartCount].row = row;
+	chromStarts[chromStartCount].offset = offset;
+	++chromStartCount;
+	}
+    if (row % sampleRate == 0)
+        arraySet(samples, is64, row / sampleRate, offset);
+    }
+if (textSize % FMI_BLOCK_SIZE == 0)
+    memcpy(blocks[blockCount-1].counts, counts + 1, sizeof(blocks[0].counts));
+if (chromStartCount != chromCount)
+    errAbort("fmiWrite: %d chromosome starts for %d chromosomes", chromStartCount, chromCount);
+
+/* Fill in header. */
+struct fmiFileHeader header;
+ZeroVar(&header);
+header.magic = FMI_MAGIC;
+header.majorVersion = FMI_MAJOR_VERSION;
+header.minorVersion = FMI_MINOR_VERSION;
+bits32 namesSize = 0;
+int i;
+for (i=0; i<chromCount; ++i)
+    namesSize += strlen(genome->chromNames[i]) + 1;
+header.chromCount = chromCount;
+header.chromNamesSize = padded(namesSize);
+header.textSize = textSize;
+memcpy(header.symbolCounts, counts, sizeof(counts));
+header.sampleRate = sampleRate;
+header.sampleSize = sampleSize;
+header.size = sizeof(header) + header.chromNamesSize
+	+ padded(chromCount * sizeof(bits32))
+	+ chromCount * sizeof(struct fmiChromStart)
+	+ blockCount * sizeof(struct fmiBlock)
+	+ padded(sampleCount * sampleSize);
+
+/* Write it all out. */
+FILE *f = mustOpen(fileName, "wb");
+mustWrite(f, &header, sizeof(header));
+struct dyString *names = dyStringNew(namesSize);
+for (i=0; i<chromCount; ++i)
+    dyStringAppendN(names, genome->chromNames[i], strlen(genome->chromNames[i]) + 1);
+writePadded(f, names->string, names->stringSize);
+dyStringFree(&names);
+writePadded(f, genome->chromSizes, chromCount * sizeof(bits32));
+mustWrite(f, chromStarts, chromCount * sizeof(chromStarts[0]));
+mustWrite(f, blocks, blockCount * sizeof(blocks[0]));
+writePadded(f, samples, sampleCount * sampleSize);
+carefulClose(&f);
+freeMem(chromStarts);
+freeMem(samples);
+freeMem(blocks);
+}
+
+void fmiMake(char *dnaFile, char *fmiFile, int sampleRate, int threadCount)
+/* Make an FM-index file from a fasta, .2bit or .nib file.  SampleRate 0
+ * picks the default. */
+{
+if (sampleRate == 0)
+    sampleRate = FMI_DEFAULT_SAMPLE_RATE;
+struct sufGenome *genome = sufGenomeLoad(dnaFile);
+boolean is64 = (genome->dnaSize > SUF_MAKE_MAX_32);
+void *array = sufArrayMakeFull(genome, is64, threadCount);
+fmiWrite(genome, array, is64, sampleRate, fmiFile);
+freeMem(array);
+sufGenomeFree(&genome);
+}
@@ -5,6 +5,7 @@
 
 #include "common.h"
 #include <sys/mman.h>
+#include "offsetIndex.h"
 #include "sufa.h"
 
 static void *pointerOffset(void *pt, bits64 offset)
@@ -97,6 +98,7 @@ for (i=0; i<chromCount; ++i)
     verbose(2, "sufa contains %s,  %d bases, %d offset\n", 
     	sufa->chromNames[i], (int)sufa->chromSizes[i], (int)chromOffsets[i]);
     }
+sufa->chromIndex = offsetIndexNew32(chromOffsets, chromCount);
 
 /* Finally point to the suffix array!. */
 sufa->array = pointerOffset(header, mapOffset);
@@ -115,6 +117,7 @@ if (sufa != NULL)
     {
     freeMem(sufa->chromNames);
     freeMem(sufa->chromOffsets);
+    offsetIndexFree(&sufa->chromIndex);
     if (sufa->isMapped)
 	munmap((void *)sufa->header, sufa->header->size);
     else
@@ -126,17 +129,197 @@ if (sufa != NULL)
 int sufaOffsetToChromIx(struct sufa *sufa, bits32 tOffset)
 /* Figure out index of chromosome containing tOffset */
 {
-int i;
-int chromCount = sufa->header->chromCount;
-/* TODO - convert to binary search - will need to sort chromosome list though.... */
-for (i=0; i<chromCount; ++i)
+int ix = offsetIndexFind(sufa->chromIndex, tOffset);
+if (ix < 0 || tOffset >= sufa->chromOffsets[ix] + sufa->chromSizes[ix])
+    errAbort("tOffset %d out of range\n", tOffset);
+return ix;
+}
+
+
+/* This section of code searches the suffix array.  A search narrows an
+ * interval of the array one query base at a time, keeping the interval of
+ * suffixes that start with the bases so far.  Since the array is sorted, the
+ * suffixes in an interval are also sorted by their next base. */
+
+static int sufaDnaCmp(char *a, int aSize, char *b, int bSize)
+/* Compare two query sequences ignoring case. */
+{
+int i, size = min(aSize, bSize);
+for (i=0; i<size; ++i)
+    {
+    int diff = tolower(a[i]) - tolower(b[i]);
+    if (diff != 0)
+        return diff;
+    }
+return aSize - bSize;
+}
+
+static bits32 sufaFirstAtLeast(struct sufa *sufa, bits32 lo, bits32 hi, int cursor, char c)
+/* Return first position between lo and hi whose suffix has a base of at
+ * least c at cursor, or hi if none. */
+{
+char *dna = sufa->allDna;
+bits32 *array = sufa->array;
+while (lo < hi)
+    {
+    bits32 mid = lo + ((hi - lo) >> 1);
+    if ((UBYTE)dna[array[mid] + cursor] < (UBYTE)c)
+        lo = mid + 1;
+    else
+        hi = mid;
+    }
+return lo;
+}
+
+static boolean sufaNarrow(struct sufa *sufa, int cursor, char c, bits32 *pLo, bits32 *pHi)
+/* Narrow interval from *pLo to *pHi, whose suffixes all share cursor
+ * bases, to the suffixes with c at cursor.  Return FALSE if there are none. */
+{
+char *dna = sufa->allDna;
+bits32 *array = sufa->array;
+bits32 lo = *pLo, hi = *pHi;
+if (hi - lo == 1)
+    return dna[array[lo] + cursor] == c;
+lo = sufaFirstAtLeast(sufa, lo, hi, cursor, c);
+if (lo == hi || dna[array[lo] + cursor] != c)
+    return FALSE;
+*pLo = lo;
+*pHi = sufaFirstAtLeast(sufa, lo, hi, cursor, c+1);
+return TRUE;
+}
+
+static int sufaDescend(struct sufa *sufa, char *q, int qSize, int depth,
+	bits32 *los, bits32 *his)
+/* Extend intervals in los and his, which hold the interval of suffixes
+ * starting with the first d bases of q at index d, from depth on.  Returns
+ * number of bases of q matched. */
+{
+bits32 lo = los[depth], hi = his[depth];
+for (; depth < qSize; ++depth)
+    {
+    if (!sufaNarrow(sufa, depth, tolower(q[depth]), &lo, &hi))
+        break;
+    los[depth+1] = lo;
+    his[depth+1] = hi;
+    }
+return depth;
+}
+
+int sufaFindLongestPrefix(struct sufa *sufa, char *q, int qSize,
+	bits32 *retArrayIx, bits32 *retCount)
+/* Find the longest prefix of q that occurs in the genome.  Returns its
+ * size, and puts the range of suffixes starting with it in *retArrayIx and
+ * *retCount.  Returns zero and sets both to zero if not even the first base
+ * occurs. */
+{
+bits32 losBuf[64], hisBuf[64];
+bits32 *los = losBuf, *his = hisBuf;
+if (qSize >= ArraySize(losBuf))
+    {
+    AllocArray(los, qSize+1);
+    AllocArray(his, qSize+1);
+    }
+los[0] = 0;
+his[0] = sufa->header->arraySize;
+int matchSize = sufaDescend(sufa, q, qSize, 0, los, his);
+if (matchSize == 0)
+    *retArrayIx = *retCount = 0;
+else
     {
-    int chromStart = sufa->chromOffsets[i];
-    int chromEnd = chromStart + sufa->chromSizes[i];
-    if (tOffset >= chromStart && tOffset < chromEnd)
-        return i;
+    *retArrayIx = los[matchSize];
+    *retCount = his[matchSize] - los[matchSize];
     }
-errAbort("tOffset %d out of range\n", tOffset);
-return -1;
+if (los != losBuf)
+    {
+    freeMem(los);
+    freeMem(his);
+    }
+return matchSize;
 }
 
+bits32 sufaFindExact(struct sufa *sufa, char *q, int qSize, bits32 *retArrayIx)
+/* Find suffixes that start with all of q.  Returns how many there are, and
+ * puts index of first one in sufa->array in *retArrayIx. */
+{
+bits32 arrayIx, count;
+if (sufaFindLongestPrefix(sufa, q, qSize, &arrayIx, &count) < qSize)
+    arrayIx = count = 0;
+*retArrayIx = arrayIx;
+return count;
+}
+
+static int sufaQueryCmp(const void *va, const void *vb)
+/* Compare sufaQuery pointers by sequence. */
+{
+const struct sufaQuery *a = *((struct sufaQuery **)va);
+const struct sufaQuery *b = *((struct sufaQuery **)vb);
+return sufaDnaCmp(a->dna, a->size, b->dna, b->size);
+}
+
+void sufaFindMany(struct sufa *sufa, struct sufaQuery *queries, int queryCount)
+/* Find longest prefix matches for many queries, filling in the result
+ * fields of each.  Queries are searched in sorted order, and each search
+ * starts from the interval it shares with the one before, so queries with
+ * common prefixes cost much less than searching them one at a time. */
+{
+if (queryCount <= 0)
+    return;
+struct sufaQuery **sorted;
+AllocArray(sorted, queryCount);
+int i, maxSize = 0;
+for (i=0; i<queryCount; ++i)
+    {
+    sorted[i] = &queries[i];
+    maxSize = max(maxSize, queries[i].size);
+    }
+qsort(sorted, queryCount, sizeof(sorted[0]), sufaQueryCmp);
+bits32 *los, *his;
+AllocArray(los, maxSize+1);
+AllocArray(his, maxSize+1);
+los[0] = 0;
+his[0] = sufa->header->arraySize;
+
+struct sufaQuery *prev = NULL;
+for (i=0; i<queryCount; ++i)
+    {
+    struct sufaQuery *query = sorted[i];
+    int depth = 0;
+    if (prev != NULL)
+        {
+	/* Intervals are good as far as this query agrees with the last and
+	 * the last one matched. */
+	int shared = 0, maxShared = min(prev->matchSize, query->size);
+	while (shared < maxShared
+	       && tolower(prev->dna[shared]) == tolower(query->dna[shared]))
+	    ++shared;
+	depth = shared;
+	}
+    query->matchSize = sufaDescend(sufa, query->dna, query->size, depth, los, his);
+    if (query->matchSize == 0)
+        query->arrayIx = query->count = 0;
+    else
+	{
+	query->arrayIx = los[query->matchSize];
+	query->count = his[query->matchSize] - los[query->matchSize];
+	}
+    prev = query;
+    }
+freeMem(his);
+freeMem(los);
+freeMem(sorted);
+}
+
+int sufaHits(struct sufa *sufa, bits32 arrayIx, bits32 count, struct sufaHit *hits, int maxHits)
+/* Convert up to maxHits suffixes starting at arrayIx in sufa->array to
+ * chromosome positions.  Returns number converted. */
+{
+int i, hitCount = min(count, maxHits);
+for (i=0; i<hitCount; ++i)
+    {
+    bits32 tOffset = sufa->array[arrayIx + i];
+    int chromIx = sufaOffsetToChromIx(sufa, tOffset);
+    hits[i].chromIx = chromIx;
+    hits[i].offset = tOffset - sufa->chromOffsets[chromIx];
+    }
+return hitCount;
+}
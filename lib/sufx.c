@@ -5,6 +5,7 @@
 
 #include "common.h"
 #include <sys/mman.h>
+#include "offsetIndex.h"
 #include "sufx.h"
 #include "net.h"
 
@@ -98,6 +99,7 @@ for (i=0; i<chromCount; ++i)
     verbose(2, "sufx contains %s,  %d bases, %d offset\n", 
     	sufx->chromNames[i], (int)sufx->chromSizes[i], (int)chromOffsets[i]);
     }
+sufx->chromIndex = offsetIndexNew32(chromOffsets, chromCount);
 
 /* Point to the suffix array. */
 sufx->array = pointerOffset(header, mapOffset);
@@ -119,6 +121,7 @@ if (sufx != NULL)
     {
     freeMem(sufx->chromNames);
     freeMem(sufx->chromOffsets);
+    offsetIndexFree(&sufx->chromIndex);
     if (sufx->isMapped)
 	munmap((void *)sufx->header, sufx->header->size);
     else
@@ -130,17 +133,230 @@ if (sufx != NULL)
 int sufxOffsetToChromIx(struct sufx *sufx, bits32 tOffset)
 /* Figure out index of chromosome containing tOffset */
 {
-int i;
-int chromCount = sufx->header->chromCount;
-/* TODO - convert to binary search - will need to sort chromosome list though.... */
-for (i=0; i<chromCount; ++i)
+int ix = offsetIndexFind(sufx->chromIndex, tOffset);
+if (ix < 0 || tOffset >= sufx->chromOffsets[ix] + sufx->chromSizes[ix])
+    errAbort("tOffset %d out of range\n", tOffset);
+return ix;
+}
+
+
+/* This section of code searches the suffix array.  A search narrows an
+ * interval of the array one query base at a time, keeping the interval of
+ * suffixes that start with the bases so far.  Rather than binary searching
+ * within the interval, the traverse array is used to hop from one group of
+ * suffixes sharing the next base to the next group, as in a walk over the
+ * children of a node in a suffix tree. */
+
+#define sufxMaxHops 8	/* Hops through first child before falling back to binary search. */
+
+static int sufxDnaCmp(char *a, int aSize, char *b, int bSize)
+/* Compare two query sequences ignoring case. */
+{
+int i, size = min(aSize, bSize);
+for (i=0; i<size; ++i)
+    {
+    int diff = tolower(a[i]) - tolower(b[i]);
+    if (diff != 0)
+        return diff;
+    }
+return aSize - bSize;
+}
+
+static bits32 sufxFirstAbove(struct sufx *sufx, bits32 lo, bits32 hi, int cursor, char c)
+/* Return first position between lo and hi whose suffix has a base greater
+ * than c at cursor, or hi if none. */
+{
+char *dna = sufx->allDna;
+bits32 *array = sufx->array;
+while (lo < hi)
+    {
+    bits32 mid = lo + ((hi - lo) >> 1);
+    if ((UBYTE)dna[array[mid] + cursor] <= (UBYTE)c)
+        lo = mid + 1;
+    else
+        hi = mid;
+    }
+return lo;
+}
+
+static boolean sufxNarrow(struct sufx *sufx, int cursor, char c, bits32 *pLo, bits32 *pHi)
+/* Narrow interval from *pLo to *pHi, whose suffixes all share cursor
+ * bases, to the suffixes with c at cursor.  Return FALSE if there are none. */
+{
+char *dna = sufx->allDna;
+bits32 *array = sufx->array, *traverse = sufx->traverse;
+bits32 lo = *pLo, hi = *pHi;
+char ch = dna[array[lo] + cursor];
+if (hi - lo == 1)
+    return ch == c;
+
+/* Find end of the first group.  Suffixes in it past the first share more
+ * than cursor bases with the one before, so traverse hops over whole
+ * subgroups of it.  Many small subgroups in a row means a low complexity
+ * region, where binary search does better. */
+bits32 x = lo + 1;
+int hops = 0;
+while (x < hi && dna[array[x] + cursor] == ch)
+    {
+    if (++hops > sufxMaxHops)
+        {
+	x = sufxFirstAbove(sufx, x, hi, cursor, ch);
+	break;
+	}
+    x += traverse[x];
+    }
+for (;;)
+    {
+    if (ch == c)
+        {
+	*pLo = lo;
+	*pHi = x;
+	return TRUE;
+	}
+    if ((UBYTE)ch > (UBYTE)c || x >= hi)
+        return FALSE;
+    /* Later groups start with a suffix sharing just cursor bases with the
+     * one before, so one hop gets to the end of the group. */
+    lo = x;
+    ch = dna[array[lo] + cursor];
+    x = lo + traverse[lo];
+    if (x > hi)
+        x = hi;
+    }
+}
+
+static int sufxDescend(struct sufx *sufx, char *q, int qSize, int depth,
+	bits32 *los, bits32 *his)
+/* Extend intervals in los and his, which hold the interval of suffixes
+ * starting with the first d bases of q at index d, from depth on.  Returns
+ * number of bases of q matched. */
+{
+bits32 lo = los[depth], hi = his[depth];
+for (; depth < qSize; ++depth)
+    {
+    if (!sufxNarrow(sufx, depth, tolower(q[depth]), &lo, &hi))
+        break;
+    los[depth+1] = lo;
+    his[depth+1] = hi;
+    }
+return depth;
+}
+
+int sufxFindLongestPrefix(struct sufx *sufx, char *q, int qSize,
+	bits32 *retArrayIx, bits32 *retCount)
+/* Find the longest prefix of q that occurs in the genome.  Returns its
+ * size, and puts the range of suffixes starting with it in *retArrayIx and
+ * *retCount.  Returns zero and sets both to zero if not even the first base
+ * occurs. */
+{
+bits32 losBuf[64], hisBuf[64];
+bits32 *los = losBuf, *his = hisBuf;
+if (qSize >= ArraySize(losBuf))
+    {
+    AllocArray(los, qSize+1);
+    AllocArray(his, qSize+1);
+    }
+los[0] = 0;
+his[0] = sufx->header->arraySize;
+int matchSize = (his[0] == 0 ? 0 : sufxDescend(sufx, q, qSize, 0, los, his));
+if (matchSize == 0)
+    *retArrayIx = *retCount = 0;
+else
+    {
+    *retArrayIx = los[matchSize];
+    *retCount = his[matchSize] - los[matchSize];
+    }
+if (los != losBuf)
+    {
+    freeMem(los);
+    freeMem(his);
+    }
+return matchSize;
+}
+
+bits32 sufxFindExact(struct sufx *sufx, char *q, int qSize, bits32 *retArrayIx)
+/* Find suffixes that start with all of q.  Returns how many there are, and
+ * puts index of first one in sufx->array in *retArrayIx. */
+{
+bits32 arrayIx, count;
+if (sufxFindLongestPrefix(sufx, q, qSize, &arrayIx, &count) < qSize)
+    arrayIx = count = 0;
+*retArrayIx = arrayIx;
+return count;
+}
+
+static int sufxQueryCmp(const void *va, const void *vb)
+/* Compare sufxQuery pointers by sequence. */
+{
+const struct sufxQuery *a = *((struct sufxQuery **)va);
+const struct sufxQuery *b = *((struct sufxQuery **)vb);
+return sufxDnaCmp(a->dna, a->size, b->dna, b->size);
+}
+
+void sufxFindMany(struct sufx *sufx, struct sufxQuery *queries, int queryCount)
+/* Find longest prefix matches for many queries, filling in the result
+ * fields of each.  Queries are searched in sorted order, and each search
+ * starts from the interval it shares with the one before. */
+{
+if (queryCount <= 0)
+    return;
+struct sufxQuery **sorted;
+AllocArray(sorted, queryCount);
+int i, maxSize = 0;
+for (i=0; i<queryCount; ++i)
+    {
+    sorted[i] = &queries[i];
+    maxSize = max(maxSize, queries[i].size);
+    }
+qsort(sorted, queryCount, sizeof(sorted[0]), sufxQueryCmp);
+bits32 *los, *his;
+AllocArray(los, maxSize+1);
+AllocArray(his, maxSize+1);
+los[0] = 0;
+his[0] = sufx->header->arraySize;
+
+struct sufxQuery *prev = NULL;
+for (i=0; i<queryCount; ++i)
     {
-    int chromStart = sufx->chromOffsets[i];
-    int chromEnd = chromStart + sufx->chromSizes[i];
-    if (tOffset >= chromStart && tOffset < chromEnd)
-        return i;
+    struct sufxQuery *query = sorted[i];
+    int depth = 0;
+    if (prev != NULL)
+        {
+	/* Intervals are good as far as this query agrees with the last and
+	 * the last one matched. */
+	int shared = 0, maxShared = min(prev->matchSize, query->size);
+	while (shared < maxShared
+	       && tolower(prev->dna[shared]) == tolower(query->dna[shared]))
+	    ++shared;
+	depth = shared;
+	}
+    query->matchSize = (his[0] == 0 ? 0 :
+    	sufxDescend(sufx, query->dna, query->size, depth, los, his));
+    if (query->matchSize == 0)
+        query->arrayIx = query->count = 0;
+    else
+	{
+	query->arrayIx = los[query->matchSize];
+	query->count = his[query->matchSize] - los[query->matchSize];
+	}
+    prev = query;
     }
-errAbort("tOffset %d out of range\n", tOffset);
-return -1;
+freeMem(his);
+freeMem(los);
+freeMem(sorted);
 }
 
+int sufxHits(struct sufx *sufx, bits32 arrayIx, bits32 count, struct sufxHit *hits, int maxHits)
+/* Convert up to maxHits suffixes starting at arrayIx in sufx->array to
+ * chromosome positions.  Returns number converted. */
+{
+int i, hitCount = min(count, maxHits);
+for (i=0; i<hitCount; ++i)
+    {
+    bits32 tOffset = sufx->array[arrayIx + i];
+    int chromIx = sufxOffsetToChromIx(sufx, tOffset);
+    hits[i].chromIx = chromIx;
+    hits[i].offset = tOffset - sufx->chromOffsets[chromIx];
+    }
+return hitCount;
+}
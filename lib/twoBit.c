@@ -7,29 +7,11 @@
 #include "linefile.h"
 #include "obscure.h"
 #include "bPlusTree.h"
+#include "portable.h"
 #include "twoBit.h"
 #include <limits.h>
 
 
-static int countBlocksOfN(char *s, int size)
-/* Count number of blocks of N's (or n's) in s. */
-{
-int i;
-boolean isN, lastIsN = FALSE;
-char c;
-int blockCount = 0;
-
-for (i=0; i<size; ++i)
-    {
-    c = s[i];
-    isN = (c == 'n' || c == 'N');
-    if (isN && !lastIsN)
-	++blockCount;
-    lastIsN = isN;
-    }
-return blockCount;
-}
-
 static int countBlocksOfLower(char *s, int size)
 /* Count number of blocks of lower case letters. */
 {
@@ -47,40 +29,6 @@ for (i=0; i<size; ++i)
 return blockCount;
 }
 
-static void storeBlocksOfN(char *s, int size, bits32 *starts, bits32 *sizes)
-/* Store starts and sizes of blocks of N's. */
-{
-int i;
-boolean isN, lastIsN = FALSE;
-int startN = 0;
-char c;
-
-for (i=0; i<size; ++i)
-    {
-    c = s[i];
-    isN = (c == 'n' || c == 'N');
-    if (isN)
-        {
-	if (!lastIsN)
-	    startN = i;
-	}
-    else
-        {
-	if (lastIsN)
-	    {
-	    *starts++ = startN;
-	    *sizes++ = i - startN;
-	    }
-	}
-    lastIsN = isN;
-    }
-if (lastIsN)
-    {
-    *starts = startN;
-    *sizes = i - startN;
-    }
-}
-
 static void storeBlocksOfLower(char *s, int size, bits32 *starts, bits32 *sizes)
 /* Store starts and sizes of blocks of lower case letters. */
 {
@@ -113,7 +61,7 @@ if (lastIsLower)
     }
 }
 
-static int packedSize(int unpackedSize)
+static bits64 packedSize(bits64 unpackedSize)
 /* Return size when packed, rounding up. */
 {
 return ((unpackedSize + 3) >> 2);
@@ -150,13 +98,7 @@ memcpy(last4, dna+i, seq->size-i);
 *pt = packDna4(last4);
 
 /* Deal with blocks of N. */
-twoBit->nBlockCount = countBlocksOfN(dna, seq->size);
-if (twoBit->nBlockCount > 0)
-    {
-    AllocArray(twoBit->nStarts, twoBit->nBlockCount);
-    AllocArray(twoBit->nSizes, twoBit->nBlockCount);
-    storeBlocksOfN(dna, seq->size, twoBit->nStarts, twoBit->nSizes);
-    }
+twoBit->nBlockCount = findBlocksOfN(dna, seq->size, &twoBit->nStarts, &twoBit->nSizes);
 
 /* Deal with masking */
 if (doMask)
@@ -174,7 +116,7 @@ return twoBit;
 }
 
 
-static int twoBitSizeInFile(struct twoBit *twoBit)
+static bits64 twoBitSizeInFile(struct twoBit *twoBit)
 /* Figure out size structure will take in file. */
 {
 return packedSize(twoBit->size) 
@@ -214,26 +156,34 @@ writeOne(f, twoBit->reserved);
 mustWrite(f, twoBit->data, packedSize(twoBit->size));
 }
 
-void twoBitWriteHeader(struct twoBit *twoBitList, FILE *f)
+static void twoBitWriteIndexEntry(FILE *f, char *name, bits64 offset, bits32 version)
+/* Write out name and offset of one sequence in the index.  Version 0
+ * files have 32 bit offsets, version 1 files 64 bit ones. */
+{
+writeString(f, name);
+if (version == 0)
+    {
+    bits32 offset32 = offset;
+    writeOne(f, offset32);
+    }
+else
+    writeOne(f, offset);
+}
+
+void twoBitWriteHeaderExt(struct twoBit *twoBitList, FILE *f, boolean useLong)
 /* Write out header portion of twoBit file, including initial
- * index */
+ * index.  If useLong is set, or the file is too big for 32 bit
+ * offsets, write version 1 of the format with 64 bit offsets. */
 {
 bits32 sig = twoBitSig;
 bits32 version = 0;
 bits32 seqCount = slCount(twoBitList);
 bits32 reserved = 0;
-bits32 offset = 0;
+bits64 offset = 0, dataSize = 0;
 struct twoBit *twoBit;
-long long counter = 0; /* check for 32 bit overflow */
-
-/* Write out fixed parts of header. */
-writeOne(f, sig);
-writeOne(f, version);
-writeOne(f, seqCount);
-writeOne(f, reserved);
 
 /* Figure out location of first byte past index.
- * Each index entry contains 4 bytes of offset information
+ * Each index entry contains 4 or 8 bytes of offset information
  * and the name of the sequence, which is variable length. */
 offset = sizeof(sig) + sizeof(version) + sizeof(seqCount) + sizeof(reserved);
 for (twoBit = twoBitList; twoBit != NULL; twoBit = twoBit->next)
@@ -242,21 +192,175 @@ for (twoBit = twoBitList; twoBit != NULL; twoBit = twoBit->next)
     if (nameLen > 255)
         errAbort("name %s too long", twoBit->name);
     offset += nameLen + 1 + sizeof(bits32);
+    dataSize += twoBitSizeInFile(twoBit);
+    }
+if (useLong || offset + dataSize > UINT_MAX)
+    {
+    version = 1;
+    offset += (bits64)seqCount * sizeof(bits32);
     }
 
+/* Write out fixed parts of header. */
+writeOne(f, sig);
+writeOne(f, version);
+writeOne(f, seqCount);
+writeOne(f, reserved);
+
 /* Write out index. */
 for (twoBit = twoBitList; twoBit != NULL; twoBit = twoBit->next)
     {
-    int size = twoBitSizeInFile(twoBit);
-    writeString(f, twoBit->name);
-    writeOne(f, offset);
-    offset += size;
-    counter += (long long)size;
-    if (counter > UINT_MAX )
-        errAbort("Error in faToTwoBit, index overflow at %s. The 2bit format "
-                "does not support indexes larger than %dGb, \n"
-                "please split up into smaller files.\n", 
-                twoBit->name, UINT_MAX/1000000000);
+    twoBitWriteIndexEntry(f, twoBit->name, offset, version);
+    offset += twoBitSizeInFile(twoBit);
+    }
+}
+
+void twoBitWriteHeader(struct twoBit *twoBitList, FILE *f)
+/* Write out header portion of twoBit file, including initial
+ * index.  Version 1 of the format is written only if needed. */
+{
+twoBitWriteHeaderExt(twoBitList, f, FALSE);
+}
+
+struct twoBitWriterSeq
+/* Index information the streaming writer keeps for each sequence. */
+    {
+    struct twoBitWriterSeq *next;	/* Next in list. */
+    char *name;				/* Name - allocated in hash. */
+    bits64 dataOffset;			/* Offset within temporary data region. */
+    };
+
+struct twoBitWriter
+/* Writes a .2bit file one sequence at a time.  The packed sequences go
+ * to an unlinked temporary file next to the output, and only the names
+ * and offsets are kept in memory.  The header and index are written when
+ * the writer is closed, followed by a copy of the data region. */
+    {
+    char *fileName;			/* Name of output file. */
+    FILE *data;				/* Temporary file holding packed sequences. */
+    boolean force64;			/* Write 64 bit offsets even if not needed. */
+    struct hash *hash;			/* Sequence names, to catch duplicates. */
+    struct twoBitWriterSeq *seqList;	/* Sequences in reverse order of addition. */
+    bits32 seqCount;			/* Number of sequences. */
+    bits64 nameBytes;			/* Total size of names plus length bytes. */
+    bits64 dataSize;			/* Size of data region so far. */
+    };
+
+struct twoBitWriter *twoBitWriterOpen(char *fileName, boolean force64)
+/* Start writing a .2bit file.  Sequences are added one at a time with
+ * twoBitWriterAdd, so memory use does not grow with the size of the genome.
+ * The 64 bit offset format (version 1) is used if force64 is set or if the
+ * file ends up too big for 32 bit offsets.  fileName may be "stdout". */
+{
+struct twoBitWriter *tbw;
+char dir[PATH_LEN], name[FILENAME_LEN], extension[FILEEXT_LEN];
+char *tempName;
+
+AllocVar(tbw);
+tbw->fileName = cloneString(fileName);
+tbw->force64 = force64;
+tbw->hash = hashNew(18);
+
+/* Put temporary file in same directory as output since /tmp is often
+ * too small for a whole genome.  It is removed as soon as it is opened
+ * so that it goes away however we exit. */
+if (sameString(fileName, "stdout"))
+    safecpy(dir, sizeof(dir), ".");
+else
+    {
+    splitPath(fileName, dir, name, extension);
+    if (dir[0] == 0)
+	safecpy(dir, sizeof(dir), ".");
+    }
+tempName = rTempName(dir, "twoBitData", ".tmp");
+tbw->data = mustOpen(tempName, "w+b");
+if (remove(tempName) != 0)
+    errnoAbort("Couldn't remove temporary file %s", tempName);
+return tbw;
+}
+
+void twoBitWriterAddTwoBit(struct twoBitWriter *tbw, struct twoBit *twoBit)
+/* Add an already packed sequence to the file being written.  This
+ * handles sequences too big for a dnaSeq. */
+{
+struct twoBitWriterSeq *tws;
+int nameLen = strlen(twoBit->name);
+
+if (nameLen > 255)
+    errAbort("name %s too long", twoBit->name);
+if (hashLookup(tbw->hash, twoBit->name))
+    errAbort("Duplicate sequence name %s in %s", twoBit->name, tbw->fileName);
+lmAllocVar(tbw->hash->lm, tws);
+tws->dataOffset = tbw->dataSize;
+hashAddSaveName(tbw->hash, twoBit->name, tws, &tws->name);
+slAddHead(&tbw->seqList, tws);
+tbw->seqCount += 1;
+tbw->nameBytes += nameLen + 1;
+
+twoBitWriteOne(twoBit, tbw->data);
+tbw->dataSize += twoBitSizeInFile(twoBit);
+}
+
+void twoBitWriterAdd(struct twoBitWriter *tbw, struct dnaSeq *seq, boolean doMask)
+/* Pack seq and add it to the file being written.  If doMask is true
+ * interpret lower-case letters as masked. */
+{
+struct twoBit *twoBit = twoBitFromDnaSeq(seq, doMask);
+twoBitWriterAddTwoBit(tbw, twoBit);
+twoBitFree(&twoBit);
+}
+
+void twoBitWriterClose(struct twoBitWriter **pTbw)
+/* Write header and index followed by the sequence data, close file
+ * and free up writer. */
+{
+struct twoBitWriter *tbw = *pTbw;
+if (tbw != NULL)
+    {
+    bits32 sig = twoBitSig, version = 0, seqCount = tbw->seqCount, reserved = 0;
+    bits64 headerSize, offset;
+    struct twoBitWriterSeq *tws;
+    FILE *f;
+    size_t bufSize = 1024*1024, readSize;
+    char *buf;
+
+    /* Figure out size of header, and whether offsets fit in 32 bits. */
+    headerSize = sizeof(sig) + sizeof(version) + sizeof(seqCount) + sizeof(reserved)
+	    + tbw->nameBytes + (bits64)tbw->seqCount * sizeof(bits32);
+    if (tbw->force64 || headerSize + tbw->dataSize > UINT_MAX)
+	{
+	version = 1;
+	headerSize += (bits64)tbw->seqCount * sizeof(bits32);
+	}
+
+    /* Write header and index. */
+    f = mustOpen(tbw->fileName, "wb");
+    writeOne(f, sig);
+    writeOne(f, version);
+    writeOne(f, seqCount);
+    writeOne(f, reserved);
+    slReverse(&tbw->seqList);
+    for (tws = tbw->seqList; tws != NULL; tws = tws->next)
+	{
+	offset = headerSize + tws->dataOffset;
+	twoBitWriteIndexEntry(f, tws->name, offset, version);
+	}
+
+    /* Copy over data region. */
+    if (fflush(tbw->data) != 0)
+	errnoAbort("Couldn't flush temporary data for %s", tbw->fileName);
+    rewind(tbw->data);
+    buf = needLargeMem(bufSize);
+    while ((readSize = fread(buf, 1, bufSize, tbw->data)) > 0)
+	mustWrite(f, buf, readSize);
+    if (ferror(tbw->data))
+	errnoAbort("Couldn't read back temporary data for %s", tbw->fileName);
+    freeMem(buf);
+
+    carefulClose(&f);
+    carefulClose(&tbw->data);
+    hashFree(&tbw->hash);	/* seqList is allocated in hash's memory pool */
+    freeMem(tbw->fileName);
+    freez(pTbw);
     }
 }
 
@@ -310,9 +414,9 @@ tbf->isSwapped = isSwapped;
 tbf->fileName = cloneString(fileName);
 tbf->f = f;
 tbf->version = readBits32(f, isSwapped);
-if (tbf->version != 0)
+if (tbf->version > 1)
     {
-    errAbort("Can only handle version 0 of this file. This is version %d",
+    errAbort("Can only handle versions 0 and 1 of this file. This is version %d",
     	(int)tbf->version);
     }
 tbf->seqCount = readBits32(f, isSwapped);
@@ -339,7 +443,10 @@ for (i=0; i<tbf->seqCount; ++i)
     if (!fastReadString(f, name))
         errAbort("%s is truncated", fileName);
     lmAllocVar(hash->lm, index);
-    index->offset = readBits32(f, isSwapped);
+    if (tbf->version == 0)
+	index->offset = readBits32(f, isSwapped);
+    else
+	index->offset = readBits64(f, isSwapped);
     hashAddSaveName(hash, name, index, &index->name);
     slAddHead(&tbf->indexList, index);
     }
@@ -361,12 +468,12 @@ return tbf;
 
 
 static int findGreatestLowerBound(int blockCount, bits32 *pos, 
-	int val)
+	bits32 val)
 /* Find index of greatest element in posArray that is less 
  * than or equal to val using a binary search. */
 {
 int startIx=0, endIx=blockCount-1, midIx;
-int posVal;
+bits32 posVal;
 
 for (;;)
     {
@@ -392,10 +499,21 @@ static void twoBitSeekTo(struct twoBitFile *tbf, char *name)
 {
 if (tbf->bpt)
     {
-    bits32 offset;
-    if (!bptFileFind(tbf->bpt, name, strlen(name), &offset, sizeof(offset)))
-	 errAbort("%s is not in %s", name, tbf->bpt->fileName);
-    fseek(tbf->f, offset, SEEK_SET);
+    /* Bpt values are 64 bit offsets for version 1 files. */
+    if (tbf->bpt->valSize == sizeof(bits64))
+	{
+	bits64 offset;
+	if (!bptFileFind(tbf->bpt, name, strlen(name), &offset, sizeof(offset)))
+	     errAbort("%s is not in %s", name, tbf->bpt->fileName);
+	fseek(tbf->f, offset, SEEK_SET);
+	}
+    else
+	{
+	bits32 offset;
+	if (!bptFileFind(tbf->bpt, name, strlen(name), &offset, sizeof(offset)))
+	     errAbort("%s is not in %s", name, tbf->bpt->fileName);
+	fseek(tbf->f, offset, SEEK_SET);
+	}
     }
 else
     {
@@ -442,7 +560,7 @@ else
 struct twoBit *twoBitOneFromFile(struct twoBitFile *tbf, char *name)
 /* Get single sequence as two bit. */
 {
-bits32 packByteCount;
+bits64 packByteCount;
 boolean isSwapped = tbf->isSwapped;
 struct twoBit *twoBit;
 AllocVar(twoBit);
@@ -522,76 +640,19 @@ for (el = *pList; el != NULL; el = next)
 }
 
 
-struct dnaSeq *twoBitReadSeqFragExt(struct twoBitFile *tbf, char *name,
-	int fragStart, int fragEnd, boolean doMask, int *retFullSize)
-/* Read part of sequence from .2bit file.  To read full
- * sequence call with start=end=0.  Sequence will be lower
- * case if doMask is false, mixed case (repeats in lower)
- * if doMask is true. */
+static void unpackFrag(UBYTE *packed, long long fragStart, long long fragEnd, DNA *dna)
+/* Unpack bases fragStart to fragEnd into dna.  Packed points to the
+ * byte holding fragStart. */
 {
-struct dnaSeq *seq;
-bits32 seqSize;
-bits32 nBlockCount, maskBlockCount;
-bits32 *nStarts = NULL, *nSizes = NULL;
-bits32 *maskStarts = NULL, *maskSizes = NULL;
-boolean isSwapped = tbf->isSwapped;
-FILE *f = tbf->f;
-int i;
-int packByteCount, packedStart, packedEnd, remainder, midStart, midEnd;
-int outSize;
-UBYTE *packed, *packedAlloc;
-DNA *dna;
+long long i, packByteCount, midStart, midEnd;
+int remainder;
 
-/* Find offset in index and seek to it */
-dnaUtilOpen();
-twoBitSeekTo(tbf, name);
-
-/* Read in seqSize. */
-seqSize = readBits32(f, isSwapped);
-if (fragEnd == 0)
-    fragEnd = seqSize;
-if (fragEnd > seqSize)
-    errAbort("twoBitReadSeqFrag in %s end (%d) >= seqSize (%d)", name, fragEnd, seqSize);
-outSize = fragEnd - fragStart;
-if (outSize < 1)
-    errAbort("twoBitReadSeqFrag in %s start (%d) >= end (%d)", name, fragStart, fragEnd);
-
-/* Read in blocks of N. */
-readBlockCoords(f, isSwapped, &nBlockCount, &nStarts, &nSizes);
-
-/* Read in masked blocks. */
-readBlockCoords(f, isSwapped, &maskBlockCount, &maskStarts, &maskSizes);
-
-/* Skip over reserved word. */
-readBits32(f, isSwapped);
-
-/* Allocate dnaSeq, and fill in zero tag at end of sequence. */
-AllocVar(seq);
-if (outSize == seqSize)
-    seq->name = cloneString(name);
-else
-    {
-    char buf[256*2];
-    safef(buf, sizeof(buf), "%s:%d-%d", name, fragStart, fragEnd);
-    seq->name = cloneString(buf);
-    }
-seq->size = outSize;
-dna = seq->dna = needLargeMem(outSize+1);
-seq->dna[outSize] = 0;
-
-
-/* Skip to bits we need and read them in. */
-packedStart = (fragStart>>2);
-packedEnd = ((fragEnd+3)>>2);
-packByteCount = packedEnd - packedStart;
-packed = packedAlloc = needLargeMem(packByteCount);
-fseek(f, packedStart, SEEK_CUR);
-mustRead(f, packed, packByteCount);
+packByteCount = ((fragEnd+3)>>2) - (fragStart>>2);
 
 /* Handle case where everything is in one packed byte */
 if (packByteCount == 1)
     {
-    int pOff = (packedStart<<2);
+    long long pOff = ((fragStart>>2)<<2);
     int pStart = fragStart - pOff;
     int pEnd = fragEnd - pOff;
     UBYTE partial = *packed;
@@ -645,15 +706,22 @@ else
 	    }
 	}
     }
-freez(&packedAlloc);
+}
 
+static void applyBlocksToFrag(struct dnaSeq *seq, long long fragStart, long long fragEnd,
+	bits32 nBlockCount, bits32 *nStarts, bits32 *nSizes,
+	boolean doMask, bits32 maskBlockCount, bits32 *maskStarts, bits32 *maskSizes)
+/* Fill in N's, and if doMask is set upper case the fragment and lower
+ * case the masked parts of it. */
+{
+long long i;
 if (nBlockCount > 0)
     {
     int startIx = findGreatestLowerBound(nBlockCount, nStarts, fragStart);
     for (i=startIx; i<nBlockCount; ++i)
         {
-	int s = nStarts[i];
-	int e = s + nSizes[i];
+	long long s = nStarts[i];
+	long long e = s + nSizes[i];
 	if (s >= fragEnd)
 	    break;
 	if (s < fragStart)
@@ -674,8 +742,8 @@ if (doMask)
 		fragStart);
 	for (i=startIx; i<maskBlockCount; ++i)
 	    {
-	    int s = maskStarts[i];
-	    int e = s + maskSizes[i];
+	    long long s = maskStarts[i];
+	    long long e = s + maskSizes[i];
 	    if (s >= fragEnd)
 		break;
 	    if (s < fragStart)
@@ -687,6 +755,87 @@ if (doMask)
 	    }
 	}
     }
+}
+
+static struct dnaSeq *allocFragSeq(char *name, bits32 seqSize,
+	long long fragStart, long long fragEnd)
+/* Check fragment coordinates and allocate a dnaSeq of the right size
+ * and name for it.  The dna is zero terminated but otherwise unfilled. */
+{
+struct dnaSeq *seq;
+long long outSize = fragEnd - fragStart;
+if (fragEnd > seqSize)
+    errAbort("twoBitReadSeqFrag in %s end (%lld) >= seqSize (%u)", name, fragEnd, seqSize);
+if (outSize < 1 || fragStart < 0)
+    errAbort("twoBitReadSeqFrag in %s start (%lld) >= end (%lld)", name, fragStart, fragEnd);
+if (outSize > INT_MAX)
+    errAbort("twoBitReadSeqFrag in %s %lld-%lld is too big for a dnaSeq, read it in pieces",
+    	name, fragStart, fragEnd);
+AllocVar(seq);
+if (outSize == seqSize)
+    seq->name = cloneString(name);
+else
+    {
+    char buf[256*2];
+    safef(buf, sizeof(buf), "%s:%lld-%lld", name, fragStart, fragEnd);
+    seq->name = cloneString(buf);
+    }
+seq->size = outSize;
+seq->dna = needLargeMem(outSize+1);
+seq->dna[outSize] = 0;
+return seq;
+}
+
+struct dnaSeq *twoBitReadSeqFragExt(struct twoBitFile *tbf, char *name,
+	long long fragStart, long long fragEnd, boolean doMask, long long *retFullSize)
+/* Read part of sequence from .2bit file.  To read full
+ * sequence call with start=end=0.  Sequence will be lower
+ * case if doMask is false, mixed case (repeats in lower)
+ * if doMask is true. */
+{
+struct dnaSeq *seq;
+bits32 seqSize;
+bits32 nBlockCount, maskBlockCount;
+bits32 *nStarts = NULL, *nSizes = NULL;
+bits32 *maskStarts = NULL, *maskSizes = NULL;
+boolean isSwapped = tbf->isSwapped;
+FILE *f = tbf->f;
+long long packByteCount, packedStart, packedEnd;
+UBYTE *packed;
+
+/* Find offset in index and seek to it */
+dnaUtilOpen();
+twoBitSeekTo(tbf, name);
+
+/* Read in seqSize. */
+seqSize = readBits32(f, isSwapped);
+if (fragEnd == 0)
+    fragEnd = seqSize;
+
+/* Allocate dnaSeq, and fill in zero tag at end of sequence. */
+seq = allocFragSeq(name, seqSize, fragStart, fragEnd);
+
+/* Read in blocks of N. */
+readBlockCoords(f, isSwapped, &nBlockCount, &nStarts, &nSizes);
+
+/* Read in masked blocks. */
+readBlockCoords(f, isSwapped, &maskBlockCount, &maskStarts, &maskSizes);
+
+/* Skip over reserved word. */
+readBits32(f, isSwapped);
+
+/* Skip to bits we need and read them in. */
+packedStart = (fragStart>>2);
+packedEnd = ((fragEnd+3)>>2);
+packByteCount = packedEnd - packedStart;
+packed = needLargeMem(packByteCount);
+fseek(f, packedStart, SEEK_CUR);
+mustRead(f, packed, packByteCount);
+unpackFrag(packed, fragStart, fragEnd, seq->dna);
+freez(&packed);
+
+applyBlocksToFrag(seq, fragStart, fragEnd, nBlockCount, nStarts, nSizes,
+	doMask, maskBlockCount, maskStarts, maskSizes);
 freez(&nStarts);
 freez(&nSizes);
 freez(&maskStarts);
@@ -697,7 +846,7 @@ return seq;
 }
 
 struct dnaSeq *twoBitReadSeqFrag(struct twoBitFile *tbf, char *name,
-	int fragStart, int fragEnd)
+	long long fragStart, long long fragEnd)
 /* Read part of sequence from .2bit file.  To read full
  * sequence call with start=end=0.  Note that sequence will
  * be mixed case, with repeats in lower case and rest in
@@ -707,13 +856,279 @@ return twoBitReadSeqFragExt(tbf, name, fragStart, fragEnd, TRUE, NULL);
 }
 
 struct dnaSeq *twoBitReadSeqFragLower(struct twoBitFile *tbf, char *name,
-	int fragStart, int fragEnd)
+	long long fragStart, long long fragEnd)
 /* Same as twoBitReadSeqFrag, but sequence is returned in lower case. */
 {
 return twoBitReadSeqFragExt(tbf, name, fragStart, fragEnd, FALSE, NULL);
 }
 
-int twoBitSeqSize(struct twoBitFile *tbf, char *name)
+struct twoBitSeqHeader
+/* Size and block lists of a sequence, and where its packed bases start,
+ * kept while fetching a batch of regions. */
+    {
+    bits32 size;		/* Size of sequence. */
+    bits32 nBlockCount;		/* Count of blocks of Ns. */
+    bits32 *nStarts;		/* Starts of blocks of Ns. */
+    bits32 *nSizes;		/* Sizes of blocks of Ns. */
+    bits32 maskBlockCount;	/* Count of masked blocks. */
+    bits32 *maskStarts;		/* Starts of masked regions. */
+    bits32 *maskSizes;		/* Sizes of masked regions. */
+    bits64 dataOffset;		/* Offset of packed bases in file. */
+    };
+
+static struct twoBitSeqHeader *twoBitSeqHeaderReadAt(struct twoBitFile *tbf, bits64 offset)
+/* Read size, N and mask blocks of sequence starting at offset. */
+{
+struct twoBitSeqHeader *sh;
+boolean isSwapped = tbf->isSwapped;
+FILE *f = tbf->f;
+AllocVar(sh);
+fseek(f, offset, SEEK_SET);
+sh->size = readBits32(f, isSwapped);
+readBlockCoords(f, isSwapped, &sh->nBlockCount, &sh->nStarts, &sh->nSizes);
+readBlockCoords(f, isSwapped, &sh->maskBlockCount, &sh->maskStarts, &sh->maskSizes);
+readBits32(f, isSwapped);
+sh->dataOffset = ftell(f);
+return sh;
+}
+
+static void twoBitSeqHeaderFree(struct twoBitSeqHeader **pSh)
+/* Free up a sequence header. */
+{
+struct twoBitSeqHeader *sh = *pSh;
+if (sh != NULL)
+    {
+    freeMem(sh->nStarts);
+    freeMem(sh->nSizes);
+    freeMem(sh->maskStarts);
+    freeMem(sh->maskSizes);
+    freez(pSh);
+    }
+}
+
+struct twoBitSeqOffset
+/* Name and offset of a sequence, for looking up many at once. */
+    {
+    char *name;			/* Sequence name. */
+    bits64 offset;		/* Offset of sequence in file. */
+    };
+
+static int twoBitSeqOffsetNameCmp(const void *va, const void *vb)
+/* Compare by name, in the same order as keys in a bpt index. */
+{
+const struct twoBitSeqOffset *a = va;
+const struct twoBitSeqOffset *b = vb;
+return strcmp(a->name, b->name);
+}
+
+static int twoBitSeqOffsetCmp(const void *va, const void *vb)
+/* Compare by offset. */
+{
+const struct twoBitSeqOffset *a = va;
+const struct twoBitSeqOffset *b = vb;
+if (a->offset < b->offset)
+    return -1;
+return (a->offset > b->offset);
+}
+
+static void twoBitFindOffsets(struct twoBitFile *tbf, struct twoBitSeqOffset *seqs, int count)
+/* Fill in offsets of count sequences, which get reordered.  With a bpt index
+ * the names are sorted and looked up in a single pass down the tree.  Abort
+ * if any sequence isn't there. */
+{
+int i;
+struct bptFile *bpt = tbf->bpt;
+if (bpt == NULL)
+    {
+    for (i=0; i<count; ++i)
+        {
+	struct twoBitIndex *index = hashFindVal(tbf->hash, seqs[i].name);
+	if (index == NULL)
+	     errAbort("%s is not in %s", seqs[i].name, tbf->fileName);
+	seqs[i].offset = index->offset;
+	}
+    return;
+    }
+int keySize = bpt->keySize, valSize = bpt->valSize;
+char *keys = needLargeZeroedMem((size_t)count * keySize);
+UBYTE *vals = needLargeMem((size_t)count * valSize);
+boolean *found;
+AllocArray(found, count);
+qsort(seqs, count, sizeof(seqs[0]), twoBitSeqOffsetNameCmp);
+for (i=0; i<count; ++i)
+    {
+    int nameSize = strlen(seqs[i].name);
+    if (nameSize > keySize)
+	errAbort("%s is not in %s", seqs[i].name, bpt->fileName);
+    memcpy(keys + (size_t)i*keySize, seqs[i].name, nameSize);
+    }
+bptFileFindMany(bpt, count, keys, keySize, vals, valSize, found);
+for (i=0; i<count; ++i)
+    {
+    if (!found[i])
+	errAbort("%s is not in %s", seqs[i].name, bpt->fileName);
+    /* Bpt values are 64 bit offsets for version 1 files. */
+    if (valSize == sizeof(bits64))
+        {
+	bits64 offset;
+	memcpy(&offset, vals + (size_t)i*valSize, sizeof(offset));
+	seqs[i].offset = offset;
+	}
+    else
+        {
+	bits32 offset;
+	memcpy(&offset, vals + (size_t)i*valSize, sizeof(offset));
+	seqs[i].offset = offset;
+	}
+    }
+freeMem(found);
+freeMem(vals);
+freeMem(keys);
+}
+
+static void twoBitSeqHeadersLoad(struct twoBitFile *tbf, struct hash *shHash,
+	struct twoBitRegion *regions, int regionCount)
+/* Add headers for sequences of regions that aren't in shHash yet.  The
+ * offsets are all looked up at once, and the headers read in file order. */
+{
+struct twoBitSeqOffset *seqs;
+int i, seqCount = 0;
+AllocArray(seqs, regionCount);
+for (i=0; i<regionCount; ++i)
+    {
+    char *name = regions[i].name;
+    if (hashLookup(shHash, name) == NULL)
+        {
+	seqs[seqCount++].name = hashAdd(shHash, name, NULL)->name;
+	}
+    }
+if (seqCount > 0)
+    {
+    twoBitFindOffsets(tbf, seqs, seqCount);
+    qsort(seqs, seqCount, sizeof(seqs[0]), twoBitSeqOffsetCmp);
+    for (i=0; i<seqCount; ++i)
+	hashLookup(shHash, seqs[i].name)->val = twoBitSeqHeaderReadAt(tbf, seqs[i].offset);
+    }
+freeMem(seqs);
+}
+
+struct twoBitRegionJob
+/* A region being fetched by twoBitReadRegions. */
+    {
+    struct twoBitSeqHeader *sh;	/* Sequence region is on. */
+    char *name;			/* Sequence name. */
+    long long start, end;	/* Region coordinates, end filled in if zero. */
+    bits64 packStart, packEnd;	/* Range of packed bytes in file. */
+    struct dnaSeq *seq;		/* Result. */
+    };
+
+static int twoBitRegionJobCmp(const void *va, const void *vb)
+/* Compare jobs by position in file. */
+{
+const struct twoBitRegionJob *a = *((struct twoBitRegionJob **)va);
+const struct twoBitRegionJob *b = *((struct twoBitRegionJob **)vb);
+if (a->packStart < b->packStart)
+    return -1;
+if (a->packStart > b->packStart)
+    return 1;
+return 0;
+}
+
+void twoBitReadRegions(struct twoBitFile *tbf, struct twoBitRegion *regions, int regionCount,
+	boolean doMask, twoBitRegionHandler handler, void *context)
+/* Fetch many regions at once.  Regions are read in order of position in
+ * the file, and reads of regions that are close together are merged, so
+ * this is much faster than calling twoBitReadSeqFragExt for each region
+ * when there are lots of them.  Handler is called with each sequence, in
+ * the same order as the regions array, and is responsible for freeing
+ * it.  As with twoBitReadSeqFrag a region with start and end both zero is
+ * the whole sequence. */
+{
+struct hash *shHash = hashNew(0);
+struct hashEl *hel, *helList;
+struct twoBitRegionJob *jobs, **sorted;
+UBYTE *buf = NULL;
+bits64 bufSize = 0;
+int batchStart;
+
+dnaUtilOpen();
+AllocArray(jobs, TWOBIT_REGION_BATCH);
+AllocArray(sorted, TWOBIT_REGION_BATCH);
+for (batchStart = 0; batchStart < regionCount; batchStart += TWOBIT_REGION_BATCH)
+    {
+    int batchSize = min(TWOBIT_REGION_BATCH, regionCount - batchStart);
+    int i, j;
+
+    /* Look up sequences and figure out which packed bytes each region needs. */
+    twoBitSeqHeadersLoad(tbf, shHash, regions + batchStart, batchSize);
+    for (i=0; i<batchSize; ++i)
+        {
+	struct twoBitRegion *region = &regions[batchStart+i];
+	struct twoBitRegionJob *job = &jobs[i];
+	struct twoBitSeqHeader *sh = hashFindVal(shHash, region->name);
+	job->sh = sh;
+	job->name = region->name;
+	job->start = region->start;
+	job->end = (region->end == 0 ? sh->size : region->end);
+	job->seq = allocFragSeq(job->name, sh->size, job->start, job->end);
+	job->packStart = sh->dataOffset + (job->start>>2);
+	job->packEnd = sh->dataOffset + ((job->end+3)>>2);
+	sorted[i] = job;
+	}
+    qsort(sorted, batchSize, sizeof(sorted[0]), twoBitRegionJobCmp);
+
+    /* Read runs of nearby regions with a single read and unpack them. */
+    for (i=0; i<batchSize; i = j)
+        {
+	bits64 readStart = sorted[i]->packStart, readEnd = sorted[i]->packEnd;
+	for (j=i+1; j<batchSize; ++j)
+	    {
+	    struct twoBitRegionJob *job = sorted[j];
+	    if (job->packStart > readEnd + TWOBIT_REGION_MERGE_GAP)
+	        break;
+	    if (job->packEnd - readStart > TWOBIT_REGION_MAX_READ && job->packEnd > readEnd)
+	        break;
+	    if (job->packEnd > readEnd)
+	        readEnd = job->packEnd;
+	    }
+	if (readEnd - readStart > bufSize)
+	    {
+	    bufSize = readEnd - readStart;
+	    freeMem(buf);
+	    buf = needLargeMem(bufSize);
+	    }
+	fseek(tbf->f, readStart, SEEK_SET);
+	mustRead(tbf->f, buf, readEnd - readStart);
+	for (; i<j; ++i)
+	    {
+	    struct twoBitRegionJob *job = sorted[i];
+	    struct twoBitSeqHeader *sh = job->sh;
+	    unpackFrag(buf + (job->packStart - readStart), job->start, job->end, job->seq->dna);
+	    applyBlocksToFrag(job->seq, job->start, job->end,
+	    	sh->nBlockCount, sh->nStarts, sh->nSizes,
+		doMask, sh->maskBlockCount, sh->maskStarts, sh->maskSizes);
+	    }
+	}
+
+    /* Hand back results in caller's order. */
+    for (i=0; i<batchSize; ++i)
+        handler(jobs[i].seq, batchStart+i, context);
+    }
+
+helList = hashElListHash(shHash);
+for (hel = helList; hel != NULL; hel = hel->next)
+    {
+    struct twoBitSeqHeader *sh = hel->val;
+    twoBitSeqHeaderFree(&sh);
+    }
+hashElFreeList(&helList);
+hashFree(&shHash);
+freeMem(buf);
+freeMem(jobs);
+freeMem(sorted);
+}
+
+long long twoBitSeqSize(struct twoBitFile *tbf, char *name)
 /* Return size of sequence in two bit file in bases. */
 {
 twoBitSeekTo(tbf, name);
@@ -1043,7 +1458,7 @@ if (nBlockCount > 0)
 
     for (i=0; i<nBlockCount; ++i)
 	{
-	fprintf(outF, "%s\t%d\t%d\n", seqName, nStarts[i], nStarts[i] + nSizes[i]);
+	fprintf(outF, "%s\t%u\t%lld\n", seqName, nStarts[i], (long long)nStarts[i] + nSizes[i]);
 	}
 
     freez(&nStarts);
@@ -1051,11 +1466,11 @@ if (nBlockCount > 0)
     }
 }
 
-int twoBitSeqSizeNoNs(struct twoBitFile *tbf, char *seqName)
+long long twoBitSeqSizeNoNs(struct twoBitFile *tbf, char *seqName)
 /* return the size of the sequence, not counting N's*/
 {
 int nBlockCount;
-int size;
+long long size;
 
 twoBitSeekTo(tbf, seqName);
 
@@ -30,6 +30,9 @@
 #include "sig.h"
 #include "net.h"
 #include "cheapcgi.h"
+#include "dlist.h"
+#include "pthreadWrap.h"
+#include "netAsync.h"
 #include "udc.h"
 
 
@@ -92,6 +95,17 @@ struct udcFile
     bits64 endData;		/* End of area in file we know to have data. */
     bits32 bitmapVersion;	/* Version of associated bitmap we were opened with. */
     struct connInfo connInfo;   /* Connection info for open net connection. */
+    boolean sparseSeekNeeded;	/* Set if fdSparse position may not match offset. */
+    struct udcMemFile *memFile;	/* Shared in-memory block cache, may be NULL. */
+    char *memBlockBuf;		/* Copy of most recently used memory cache block. */
+    bits64 memBlockIx;		/* Block number of memBlockBuf. */
+    int memBlockSize;		/* Size of data in memBlockBuf. */
+    boolean memBlockValid;	/* Set if memBlockBuf has been loaded. */
+    bits64 lastReadEnd;		/* End of last read, to detect sequential reads. */
+    int seqReadCount;		/* Number of sequential reads in a row. */
+    bits64 aheadWindow;		/* Current read-ahead size, 0 if not reading sequentially. */
+    bits64 aheadEnd;		/* End of data fetched or being fetched ahead. */
+    struct udcPrefetch *prefetch;	/* Background fetcher, NULL until needed. */
     };
 
 struct udcBitmap
@@ -114,6 +128,16 @@ static int cacheTimeout = 0;
 
 #define MAX_SKIP_TO_SAVE_RECONNECT (udcMaxBytesPerRemoteFetch / 2)
 
+static void memFileAttach(struct udcFile *file);
+/* Connect file to the memory cache for its URL.  Defined with rest of
+ * memory cache below. */
+
+static void memFileDetach(struct udcFile *file);
+/* Disconnect file from memory cache. */
+
+static void prefetchFree(struct udcFile *file);
+/* Stop background fetching for file.  Defined with rest of read-ahead below. */
+
 static void readAndIgnore(int sd, bits64 size)
 /* Read size bytes from sd and return. */
 {
@@ -324,13 +348,23 @@ int udcDataViaHttpOrFtp(char *url, bits64 offset, int size, void *buffer, struct
 /* Fetch a block of data of given size into buffer using url's protocol,
  * which must be http, https or ftp.  Returns number of bytes actually read.
  * Does an errAbort on error.
- * Typically will be called with size in the 8k-64k range. */
+ * Typically will be called with size in the 8k-64k range.
+ * Small http(s) fetches that don't continue where ci's stream left off go
+ * over a pooled keep-alive connection instead. */
 {
 if (startsWith("http://",url) || startsWith("https://",url) || startsWith("ftp://",url))
     verbose(2, "reading http/https/ftp data - %d bytes at %lld - on %s\n", size, offset, url);
 else
     errAbort("Invalid protocol in url [%s] in udcDataViaFtp, only http, https, or ftp supported",
 	     url); 
+if (startsWith("http", url) && size < MAX_SKIP_TO_SAVE_RECONNECT
+    && (ci == NULL || ci->socket <= 0 || ci->offset != offset))
+    {
+    long long total = netHttpPoolGetRange(url, offset, size, buffer);
+    if (total < 0)
+	errAbort("Can't get data for %s", url);
+    return total;
+    }
 int sd = connInfoGetSocket(ci, url, offset, size);
 if (sd < 0)
     errAbort("Can't get data socket for %s", url);
@@ -357,7 +391,7 @@ boolean udcInfoViaHttp(char *url, struct udcRemoteFileInfo *retInfo)
 {
 verbose(2, "checking http remote info on %s\n", url);
 struct hash *hash = newHash(0);
-int status = netUrlHead(url, hash);
+int status = netHttpPoolHead(url, hash);
 if (status != 200) // && status != 302 && status != 301)
     return FALSE;
 char *sizeString = hashFindValUpperCase(hash, "Content-Length:");
@@ -846,6 +880,7 @@ if (isTransparent)
     fstat(fd, &status);
     file->startData = 0;
     file->endData = file->size = status.st_size;
+    file->updateTime = status.st_mtime;
     }
 else
     {
@@ -869,6 +904,10 @@ else
 
     file->fdSparse = mustOpenFd(file->sparseFileName, O_RDWR);
 
+    /* Plain files are read straight from the file system, whose own cache
+     * is as good.  Their mtime also only counts seconds, which can't tell
+     * apart versions written in quick succession. */
+    memFileAttach(file);
     }
 freeMem(afterProtocol);
 return file;
@@ -914,6 +953,7 @@ void udcFileClose(struct udcFile **pFile)
 struct udcFile *file = *pFile;
 if (file != NULL)
     {
+    prefetchFree(file);
     if (file->connInfo.socket != 0)
 	mustCloseFd(&(file->connInfo.socket));
     if (file->connInfo.ctrlSocket != 0)
@@ -927,6 +967,7 @@ if (file != NULL)
     freeMem(file->sparseReadAheadBuf);
     mustCloseFd(&(file->fdSparse));
     udcBitmapClose(&file->bits);
+    memFileDetach(file);
     }
 freez(pFile);
 }
@@ -1075,8 +1116,9 @@ return gotUnset;
 }
 
 static void fetchMissingBlocks(struct udcFile *file, struct udcBitmap *bits, 
-	int startBlock, int blockCount, int blockSize)
-/* Fetch missing blocks from remote and put them into file.  errAbort if trouble. */
+	int startBlock, int blockCount, int blockSize, struct connInfo *ci)
+/* Fetch missing blocks from remote over connection ci and put them into file.  
+ * errAbort if trouble. */
 {
 bits64 startPos = (bits64)startBlock * blockSize;
 bits64 endPos = startPos + (bits64)blockCount * blockSize;
@@ -1087,25 +1129,285 @@ if (endPos > startPos)
     bits64 readSize = endPos - startPos;
     void *buf = needLargeMem(readSize);
     
-    int actualSize = file->prot->fetchData(file->url, startPos, readSize, buf, &(file->connInfo));
+    int actualSize = file->prot->fetchData(file->url, startPos, readSize, buf, ci);
     if (actualSize != readSize)
 	errAbort("unable to fetch %lld bytes from %s @%lld (got %d bytes)",
 		 readSize, file->url, startPos, actualSize);
-    mustLseek(file->fdSparse, startPos, SEEK_SET);
-    mustWriteFd(file->fdSparse, buf, readSize);
+    /* Use pwrite so as not to disturb the file position, which the prefetch
+     * thread and the reading thread share. */
+    if (pwrite(file->fdSparse, buf, readSize, startPos) != readSize)
+	errnoAbort("Couldn't write %lld bytes to %s", readSize, file->sparseFileName);
     freez(&buf);
     }
 }
 
+/* Parallel fetching.  When a lot of data is missing from the cache it is cut
+ * into chunks that a small pool of threads fetch at the same time, each over
+ * its own connection.  Each thread starts on its own stretch of the chunks
+ * and keeps going along it, so usually reuses one open-ended connection, and
+ * only jumps elsewhere when its stretch is done.  Chunks finish in any order.
+ * A block's bit is set only once its data is in the sparse file, and the
+ * bitmap is written once all threads are done, so it never claims data that
+ * isn't there. */
+
+#define udcParallelChunkSize (udcMaxBytesPerRemoteFetch * 4)
+/* Amount fetched by a thread at a time. */
+
+#define udcParallelMinFetch (udcParallelChunkSize * 2)
+/* Fetches smaller than this are not worth doing in parallel. */
+
+static int fetchThreads = UDC_FETCH_THREADS_DEFAULT;	/* Size of fetching pool. */
+
+struct udcFetchChunk
+/* A run of missing blocks to be fetched by one thread. */
+    {
+    int startBlock;		/* First block. */
+    int blockCount;		/* Number of blocks. */
+    boolean claimed;		/* Set when a thread has taken this. */
+    };
+
+struct udcParallelFetch
+/* State shared by threads of a parallel fetch. */
+    {
+    struct udcFile *file;	/* File we're fetching for. */
+    struct udcBitmap *bits;	/* Bitmap of file. */
+    struct udcFetchChunk *chunks;	/* Array of chunks to fetch. */
+    int chunkCount;		/* Size of chunks array. */
+    int threadCount;		/* Number of threads. */
+    int nextThreadIx;		/* Index handed out to next thread to start. */
+    pthread_mutex_t mutex;	/* Protects claimed flags, nextThreadIx and b. */
+    Bits *b;			/* In memory copy of part of bitmap. */
+    int partOffset;		/* Block number of first bit in b. */
+    };
+
+static int claimChunk(struct udcParallelFetch *pf, int preferred)
+/* Claim preferred chunk if it's still free, otherwise first free chunk.
+ * Return index of chunk or -1 if none left. */
+{
+int i, ix = -1;
+pthreadMutexLock(&pf->mutex);
+if (preferred < pf->chunkCount && !pf->chunks[preferred].claimed)
+    ix = preferred;
+else
+    {
+    for (i=0; i<pf->chunkCount; ++i)
+        if (!pf->chunks[i].claimed)
+	    {
+	    ix = i;
+	    break;
+	    }
+    }
+if (ix >= 0)
+    pf->chunks[ix].claimed = TRUE;
+pthreadMutexUnlock(&pf->mutex);
+return ix;
+}
+
+static void *parallelFetchThread(void *v)
+/* Fetch chunks until there are none left. */
+{
+struct udcParallelFetch *pf = v;
+struct connInfo ci;
+ZeroVar(&ci);
+pthreadMutexLock(&pf->mutex);
+int threadIx = pf->nextThreadIx++;
+pthreadMutexUnlock(&pf->mutex);
+int ix = (long long)threadIx * pf->chunkCount / pf->threadCount;
+while ((ix = claimChunk(pf, ix)) >= 0)
+    {
+    struct udcFetchChunk *chunk = &pf->chunks[ix];
+    fetchMissingBlocks(pf->file, pf->bits, chunk->startBlock, chunk->blockCount,
+	    pf->bits->blockSize, &ci);
+    pthreadMutexLock(&pf->mutex);
+    bitSetRange(pf->b, chunk->startBlock - pf->partOffset, chunk->blockCount);
+    pthreadMutexUnlock(&pf->mutex);
+    ix += 1;
+    }
+if (ci.socket != 0)
+    mustCloseFd(&(ci.socket));
+if (ci.ctrlSocket != 0)
+    mustCloseFd(&(ci.ctrlSocket));
+return NULL;
+}
+
+static int countClearRuns(Bits *b, int s, int e, int *retClearCount, int *retMaxRun)
+/* Return number of runs of clear bits between s and e, and total clear bits
+ * and size of biggest run. */
+{
+int runCount = 0, clearCount = 0, maxRun = 0;
+for (;;)
+    {
+    int nextClearBit = bitFindClear(b, s, e);
+    if (nextClearBit >= e)
+        break;
+    int nextSetBit = bitFindSet(b, nextClearBit, e);
+    clearCount += nextSetBit - nextClearBit;
+    maxRun = max(maxRun, nextSetBit - nextClearBit);
+    runCount += 1;
+    s = nextSetBit;
+    }
+*retClearCount = clearCount;
+*retMaxRun = maxRun;
+return runCount;
+}
+
+static boolean fetchInParallel(struct udcFile *file, Bits *b, int s, int e)
+/* Return TRUE if the clear bits between s and e in b add up to enough to be
+ * worth fetching in parallel. */
+{
+if (fetchThreads < 2 || !startsWith("http", file->url))
+    return FALSE;
+int clearCount, maxRun;
+countClearRuns(b, s, e, &clearCount, &maxRun);
+return (bits64)clearCount * udcBlockSize >= udcParallelMinFetch;
+}
+
+static boolean fetchPipelined(struct udcFile *file, Bits *b, int s, int e)
+/* Return TRUE if there are several runs of clear bits between s and e that
+ * can be fetched with one batch of pipelined http requests.  Big runs are
+ * left to udcDataViaHttpOrFtp, which streams them. */
+{
+if (!startsWith("http", file->url))
+    return FALSE;
+int clearCount, maxRun;
+int runCount = countClearRuns(b, s, e, &clearCount, &maxRun);
+return runCount > 1 && (bits64)maxRun * udcBlockSize < MAX_SKIP_TO_SAVE_RECONNECT;
+}
+
+static void fetchMissingPipelined(struct udcFile *file, struct udcBitmap *bits,
+	Bits *b, int partOffset, int s, int e)
+/* Fetch all runs of clear bits between s and e in b with one batch of
+ * pipelined http requests, and set their bits in b. */
+{
+int clearCount, maxRun;
+int runCount = countClearRuns(b, s, e, &clearCount, &maxRun);
+int *runStarts, *runSizes;
+bits64 *starts, *sizes, *gotSizes;
+void **bufs;
+AllocArray(runStarts, runCount);
+AllocArray(runSizes, runCount);
+AllocArray(starts, runCount);
+AllocArray(sizes, runCount);
+AllocArray(gotSizes, runCount);
+AllocArray(bufs, runCount);
+char *buf = needLargeMem((bits64)clearCount * bits->blockSize);
+
+/* Make up a range for each run of clear bits. */
+int i, rangeCount = 0;
+bits64 bufOffset = 0;
+for (i=0; i<runCount; ++i)
+    {
+    int nextClearBit = bitFindClear(b, s, e);
+    int nextSetBit = bitFindSet(b, nextClearBit, e);
+    bits64 startPos = (bits64)(nextClearBit + partOffset) * bits->blockSize;
+    bits64 endPos = (bits64)(nextSetBit + partOffset) * bits->blockSize;
+    if (endPos > file->size)
+        endPos = file->size;
+    if (endPos > startPos)
+	{
+	runStarts[rangeCount] = nextClearBit;
+	runSizes[rangeCount] = nextSetBit - nextClearBit;
+	starts[rangeCount] = startPos;
+	sizes[rangeCount] = endPos - startPos;
+	bufs[rangeCount] = buf + bufOffset;
+	bufOffset += sizes[rangeCount];
+	rangeCount += 1;
+	}
+    s = nextSetBit;
+    }
+
+/* Fetch them all, and put them in sparse file. */
+verbose(2, "fetching %d ranges of %s pipelined\n", rangeCount, file->url);
+if (!netHttpPoolGetRanges(file->url, rangeCount, starts, sizes, bufs, gotSizes))
+    errAbort("unable to fetch %d ranges from %s", rangeCount, file->url);
+for (i=0; i<rangeCount; ++i)
+    {
+    if (gotSizes[i] != sizes[i])
+	errAbort("unable to fetch %lld bytes from %s @%lld (got %lld bytes)",
+		 sizes[i], file->url, starts[i], gotSizes[i]);
+    if (pwrite(file->fdSparse, bufs[i], sizes[i], starts[i]) != sizes[i])
+	errnoAbort("Couldn't write %lld bytes to %s", sizes[i], file->sparseFileName);
+    bitSetRange(b, runStarts[i], runSizes[i]);
+    }
+freeMem(buf);
+freeMem(bufs);
+freeMem(gotSizes);
+freeMem(sizes);
+freeMem(starts);
+freeMem(runSizes);
+freeMem(runStarts);
+}
+
+static void fetchMissingParallel(struct udcFile *file, struct udcBitmap *bits,
+	Bits *b, int partOffset, int s, int e)
+/* Fetch blocks that are clear between s and e in b using a pool of threads,
+ * setting bits in b as they arrive. */
+{
+struct udcParallelFetch pf;
+ZeroVar(&pf);
+pf.file = file;
+pf.bits = bits;
+pf.b = b;
+pf.partOffset = partOffset;
+
+/* Cut runs of clear bits into chunks. */
+int chunkBlocks = udcParallelChunkSize / bits->blockSize;
+int maxChunks = (e - s + chunkBlocks - 1) / chunkBlocks + (e - s + 1) / 2;
+AllocArray(pf.chunks, maxChunks);
+for (;;)
+    {
+    int nextClearBit = bitFindClear(b, s, e);
+    if (nextClearBit >= e)
+        break;
+    int nextSetBit = bitFindSet(b, nextClearBit, e);
+    int start;
+    for (start = nextClearBit; start < nextSetBit; start += chunkBlocks)
+        {
+	struct udcFetchChunk *chunk = &pf.chunks[pf.chunkCount++];
+	chunk->startBlock = start + partOffset;
+	chunk->blockCount = min(chunkBlocks, nextSetBit - start);
+	}
+    s = nextSetBit;
+    }
+
+/* Start threads and wait for them to finish. */
+int i;
+pf.threadCount = min(fetchThreads, pf.chunkCount);
+verbose(2, "fetching %d chunks of %s on %d threads\n", pf.chunkCount, file->url,
+	pf.threadCount);
+pthread_t *threads;
+AllocArray(threads, pf.threadCount);
+pthreadMutexInit(&pf.mutex);
+for (i=0; i<pf.threadCount; ++i)
+    pthreadCreate(&threads[i], NULL, parallelFetchThread, &pf);
+for (i=0; i<pf.threadCount; ++i)
+    pthreadJoin(threads[i]);
+pthreadMutexDestroy(&pf.mutex);
+freeMem(threads);
+freeMem(pf.chunks);
+}
+
+void udcSetFetchThreads(int threadCount)
+/* Set the number of connections udc uses at once to fill large gaps in
+ * the cache from http(s).  One turns parallel fetching off. */
+{
+fetchThreads = max(1, threadCount);
+}
+
 static boolean fetchMissingBits(struct udcFile *file, struct udcBitmap *bits,
-	bits64 start, bits64 end, bits64 *retFetchedStart, bits64 *retFetchedEnd)
-/* Scan through relevant parts of bitmap, fetching blocks we don't already have. */
+	bits64 start, bits64 end, struct connInfo *ci,
+	bits64 *retFetchedStart, bits64 *retFetchedEnd)
+/* Scan through relevant parts of bitmap, fetching blocks we don't already have
+ * over connection ci.  Returns TRUE if everything was already there.  Either way
+ * the block-aligned range now in cache is returned. */
 {
 /* Fetch relevant part of bitmap into memory */
 int partOffset;
 Bits *b;
 int startBlock = start / bits->blockSize;
 int endBlock = (end + bits->blockSize - 1) / bits->blockSize;
+*retFetchedStart = (bits64)startBlock * bits->blockSize;
+*retFetchedEnd = (bits64)endBlock * bits->blockSize;
 readBitsIntoBuf(bits->fd, udcBitmapHeaderSize, startBlock, endBlock, &b, &partOffset);
 if (allBitsSetInFile(startBlock, endBlock, partOffset, b))
     {  // it is already in the cache
@@ -1117,7 +1419,17 @@ if (allBitsSetInFile(startBlock, endBlock, partOffset, b))
 boolean dirty = FALSE;
 int s = startBlock - partOffset;
 int e = endBlock - partOffset;
-for (;;)
+if (fetchInParallel(file, b, s, e))
+    {
+    fetchMissingParallel(file, bits, b, partOffset, s, e);
+    dirty = TRUE;
+    }
+else if (fetchPipelined(file, b, s, e))
+    {
+    fetchMissingPipelined(file, bits, b, partOffset, s, e);
+    dirty = TRUE;
+    }
+else for (;;)
     {
     int nextClearBit = bitFindClear(b, s, e);
     if (nextClearBit >= e)
@@ -1125,7 +1437,7 @@ for (;;)
     int nextSetBit = bitFindSet(b, nextClearBit, e);
     int clearSize =  nextSetBit - nextClearBit;
 
-    fetchMissingBlocks(file, bits, nextClearBit + partOffset, clearSize, bits->blockSize);
+    fetchMissingBlocks(file, bits, nextClearBit + partOffset, clearSize, bits->blockSize, ci);
     bitSetRange(b, nextClearBit, clearSize);
 
     dirty = TRUE;
@@ -1145,8 +1457,6 @@ if (dirty)
     }
 
 freeMem(b);
-*retFetchedStart = startBlock * bits->blockSize;
-*retFetchedEnd = endBlock * bits->blockSize;
 return FALSE;
 }
 
@@ -1164,11 +1474,10 @@ static void udcFetchMissing(struct udcFile *file, struct udcBitmap *bits, bits64
 {
 /* Call lower level routine fetch remote data that is not already here. */
 bits64 fetchedStart, fetchedEnd;
-if (fetchMissingBits(file, bits, start, end, &fetchedStart, &fetchedEnd))
-    return;
+fetchMissingBits(file, bits, start, end, &(file->connInfo), &fetchedStart, &fetchedEnd);
 
-/* Update file startData/endData members to include new data (and old as well if
- * the new data overlaps the old). */
+/* Update file startData/endData members to include new data, or data we just
+ * found to be cached already (and old as well if the new data overlaps the old). */
 if (rangeIntersectOrTouch64(file->startData, file->endData, fetchedStart, fetchedEnd))
     {
     if (fetchedStart > file->startData)
@@ -1180,25 +1489,197 @@ file->startData = fetchedStart;
 file->endData = fetchedEnd;
 }
 
+/* Read-ahead for sequential access.  When a handle reads sequentially the
+ * amount fetched at a time grows geometrically up to readAheadMax, and the
+ * next window is fetched by a background thread, over its own connection, while
+ * the caller consumes the current one.  The background thread fetches a window
+ * a piece at a time, and the reading thread only waits for the pieces it needs.
+ * The two threads take turns with the bitmap via bitMutex. */
+
+#define udcPrefetchPieceSize (udcMaxBytesPerRemoteFetch * 4)
+/* Background fetches report progress after each piece this big. */
+
+static bits64 readAheadMax = UDC_READ_AHEAD_DEFAULT_MAX;	/* Biggest read-ahead window. */
+
+struct udcPrefetch
+/* Background fetching thread for one udcFile. */
+    {
+    struct udcFile *file;	/* File we're fetching for. */
+    pthread_t thread;		/* Fetching thread. */
+    pthread_mutex_t mutex;	/* Protects busy, quit, start, end and doneEnd. */
+    pthread_cond_t cond;	/* Signalled when busy, quit or doneEnd change. */
+    pthread_mutex_t bitMutex;	/* Held while fetching into cache and updating bitmap. */
+    boolean busy;		/* Set while a fetch is requested or under way. */
+    boolean quit;		/* Set when thread should exit. */
+    bits64 start, end;		/* Range to fetch. */
+    bits64 doneEnd;		/* Data from start to here has been fetched. */
+    struct connInfo ci;		/* Connection used by thread. */
+    };
+
+static void *prefetchThread(void *v)
+/* Wait for ranges to fetch and fetch them into sparse file. */
+{
+struct udcPrefetch *pf = v;
+struct udcFile *file = pf->file;
+for (;;)
+    {
+    pthreadMutexLock(&pf->mutex);
+    while (!pf->busy && !pf->quit)
+        pthreadCondWait(&pf->cond, &pf->mutex);
+    boolean quit = pf->quit;
+    bits64 start = pf->start, end = pf->end;
+    pthreadMutexUnlock(&pf->mutex);
+    if (quit)
+        break;
+
+    verbose(2, "prefetching %lld bytes at %lld of %s\n", end - start, start, file->url);
+    bits64 s, e;
+    for (s = start; s < end && !quit; s = e)
+        {
+	e = min(s + udcPrefetchPieceSize, end);
+	pthreadMutexLock(&pf->bitMutex);
+	if (file->bits->version == file->bitmapVersion)
+	    {
+	    bits64 fetchedStart, fetchedEnd;
+	    fetchMissingBits(file, file->bits, s, e, &pf->ci, &fetchedStart, &fetchedEnd);
+	    }
+	pthreadMutexUnlock(&pf->bitMutex);
+	pthreadMutexLock(&pf->mutex);
+	pf->doneEnd = e;
+	quit = pf->quit;
+	pthreadCondBroadcast(&pf->cond);
+	pthreadMutexUnlock(&pf->mutex);
+	}
+
+    pthreadMutexLock(&pf->mutex);
+    pf->busy = FALSE;
+    pthreadCondBroadcast(&pf->cond);
+    pthreadMutexUnlock(&pf->mutex);
+    }
+return NULL;
+}
+
+static boolean prefetchIsBusy(struct udcFile *file)
+/* Return TRUE if a background fetch is under way. */
+{
+struct udcPrefetch *pf = file->prefetch;
+boolean busy = FALSE;
+if (pf != NULL)
+    {
+    pthreadMutexLock(&pf->mutex);
+    busy = pf->busy;
+    pthreadMutexUnlock(&pf->mutex);
+    }
+return busy;
+}
+
+static bits64 prefetchDoneEnd(struct udcFile *file)
+/* Return end of data fetched ahead so far. */
+{
+struct udcPrefetch *pf = file->prefetch;
+bits64 doneEnd = file->aheadEnd;
+if (pf != NULL)
+    {
+    pthreadMutexLock(&pf->mutex);
+    if (pf->busy)
+        doneEnd = pf->doneEnd;
+    pthreadMutexUnlock(&pf->mutex);
+    }
+return doneEnd;
+}
+
+static void prefetchWait(struct udcFile *file, bits64 start, bits64 end)
+/* If a background fetch overlaps start-end, wait until it has got past the
+ * overlapping part. */
+{
+struct udcPrefetch *pf = file->prefetch;
+if (pf != NULL)
+    {
+    pthreadMutexLock(&pf->mutex);
+    while (pf->busy && start < pf->end && end > pf->doneEnd)
+        pthreadCondWait(&pf->cond, &pf->mutex);
+    pthreadMutexUnlock(&pf->mutex);
+    }
+}
+
+static void prefetchStart(struct udcFile *file, bits64 start, bits64 end)
+/* Start fetching start-end in background, creating thread if need be.
+ * Should only be called when not busy. */
+{
+struct udcPrefetch *pf = file->prefetch;
+if (pf == NULL)
+    {
+    AllocVar(pf);
+    pf->file = file;
+    pthreadMutexInit(&pf->mutex);
+    pthreadMutexInit(&pf->bitMutex);
+    pthreadCondInit(&pf->cond);
+    pthreadCreate(&pf->thread, NULL, prefetchThread, pf);
+    file->prefetch = pf;
+    }
+pthreadMutexLock(&pf->mutex);
+pf->start = pf->doneEnd = start;
+pf->end = end;
+pf->busy = TRUE;
+pthreadCondBroadcast(&pf->cond);
+pthreadMutexUnlock(&pf->mutex);
+}
+
+static void prefetchFree(struct udcFile *file)
+/* Wait for background fetch to finish, stop thread and free up resources. */
+{
+struct udcPrefetch *pf = file->prefetch;
+if (pf != NULL)
+    {
+    pthreadMutexLock(&pf->mutex);
+    pf->quit = TRUE;
+    pthreadCondBroadcast(&pf->cond);
+    pthreadMutexUnlock(&pf->mutex);
+    pthreadJoin(pf->thread);
+    if (pf->ci.socket != 0)
+	mustCloseFd(&(pf->ci.socket));
+    if (pf->ci.ctrlSocket != 0)
+	mustCloseFd(&(pf->ci.ctrlSocket));
+    pthreadCondDestroy(&pf->cond);
+    pthreadMutexDestroy(&pf->bitMutex);
+    pthreadMutexDestroy(&pf->mutex);
+    freez(&file->prefetch);
+    }
+}
+
 static boolean udcCachePreload(struct udcFile *file, bits64 offset, bits64 size)
 /* Make sure that given data is in cache - fetching it remotely if need be. 
  * Return TRUE on success. */
 {
 boolean ok = TRUE;
+/* If a background fetch is getting this data, let it. */
+prefetchWait(file, offset, offset + size);
+
 /* We'll break this operation into blocks of a reasonable size to allow
- * other processes to get cache access, since we have to lock the cache files. */
+ * other processes to get cache access, since we have to lock the cache files. 
+ * During sequential reads the blocks get bigger along with the read-ahead window. */
 bits64 s,e, endPos=offset+size;
+bits64 fetchSize = max(udcMaxBytesPerRemoteFetch, file->aheadWindow);
+if (fetchThreads > 1)
+    fetchSize = max(fetchSize, (bits64)fetchThreads * udcParallelChunkSize * 4);
 for (s = offset; s < endPos; s = e)
     {
     /* Figure out bounds of this section. */
-    e = s + udcMaxBytesPerRemoteFetch;
+    e = s + fetchSize;
     if (e > endPos)
 	e = endPos;
 
     struct udcBitmap *bits = file->bits;
     if (bits->version == file->bitmapVersion)
 	{
-        udcFetchMissing(file, bits, s, e);
+	if (file->prefetch != NULL)
+	    {
+	    pthreadMutexLock(&file->prefetch->bitMutex);
+	    udcFetchMissing(file, bits, s, e);
+	    pthreadMutexUnlock(&file->prefetch->bitMutex);
+	    }
+	else
+	    udcFetchMissing(file, bits, s, e);
 	}
     else
 	{
@@ -1212,6 +1693,484 @@ for (s = offset; s < endPos; s = e)
 return ok;
 }
 
+/* Filling many ranges at once.  The clear runs in each range are turned
+ * into requests for a netAsync engine.  As each request finishes its data is
+ * written to the sparse file and its bits set in a copy of that part of the
+ * bitmap.  At the end the copies are or'd into the bitmaps on disk, so bits
+ * set meanwhile by a background fetch aren't lost. */
+
+struct udcManyRange
+/* Bitmap for one range passed to udcPreloadMany. */
+    {
+    struct udcFile *file;	/* File range is in. */
+    int startBlock, endBlock;	/* Blocks covered by range. */
+    Bits *b;			/* Bitmap as read, plus blocks fetched since. */
+    int partOffset;		/* Block number of first bit in b. */
+    };
+
+struct udcManyPiece
+/* One request made by udcPreloadMany. */
+    {
+    struct udcManyPiece *next;	/* Next in list. */
+    struct udcManyRange *range;	/* Range this is in. */
+    int startBit, bitCount;	/* Bits in range->b this fills. */
+    bits64 start, size;		/* Bytes requested. */
+    int *pFailCount;		/* Incremented if request fails. */
+    };
+
+static void udcManyPieceDone(struct netAsyncResult *result, void *context)
+/* Put data that's arrived in sparse file and note it in bitmap copy. */
+{
+struct udcManyPiece *piece = context;
+struct udcManyRange *range = piece->range;
+struct udcFile *file = range->file;
+boolean gotRange = (result->status == 206 || (result->status == 200 && piece->start == 0));
+if (gotRange && result->body->stringSize >= piece->size)
+    {
+    if (pwrite(file->fdSparse, result->body->string, piece->size, piece->start) != piece->size)
+	errnoAbort("Couldn't write %lld bytes to %s", piece->size, file->sparseFileName);
+    bitSetRange(range->b, piece->startBit, piece->bitCount);
+    }
+else
+    {
+    verbose(2, "unable to fetch %lld bytes from %s @%lld: %s\n", piece->size, file->url,
+	    piece->start, (result->error != NULL ? result->error : "bad status or size"));
+    *piece->pFailCount += 1;
+    }
+}
+
+static void udcManyRangeSave(struct udcManyRange *range)
+/* Or bits fetched for range into bitmap on disk. */
+{
+struct udcFile *file = range->file;
+struct udcBitmap *bits = file->bits;
+if (file->prefetch != NULL)
+    pthreadMutexLock(&file->prefetch->bitMutex);
+Bits *onDisk;
+int partOffset;
+readBitsIntoBuf(bits->fd, udcBitmapHeaderSize, range->startBlock, range->endBlock,
+	&onDisk, &partOffset);
+int byteStart = range->startBlock/8;
+int byteSize = bitToByteSize(range->endBlock) - byteStart;
+int i;
+for (i=0; i<byteSize; ++i)
+    onDisk[i] |= range->b[i];
+mustLseek(bits->fd, byteStart + udcBitmapHeaderSize, SEEK_SET);
+mustWriteFd(bits->fd, onDisk, byteSize);
+if (file->prefetch != NULL)
+    pthreadMutexUnlock(&file->prefetch->bitMutex);
+freeMem(onDisk);
+}
+
+boolean udcPreloadMany(int count, struct udcFile **files, bits64 *offsets, bits64 *sizes)
+/* Make sure count ranges, each in the corresponding file, are in cache.
+ * Everything missing from http(s) files is fetched at once over many
+ * connections, other files are filled a range at a time.  Returns FALSE if
+ * any range couldn't be fetched, in which case udcRead will try again. */
+{
+struct udcManyRange *ranges;
+AllocArray(ranges, count);
+struct udcManyPiece *pieceList = NULL;
+struct netAsync *na = NULL;
+int i, failCount = 0;
+for (i=0; i<count; ++i)
+    {
+    struct udcFile *file = files[i];
+    bits64 start = offsets[i];
+    bits64 end = min(offsets[i] + sizes[i], file->size);
+    if (start >= end || (start >= file->startData && end <= file->endData))
+        continue;
+    if (!startsWith("http", file->url) || file->bits->version != file->bitmapVersion)
+        {
+	if (!udcCachePreload(file, start, end - start))
+	    failCount += 1;
+	continue;
+	}
+    prefetchWait(file, start, end);
+
+    /* Read bitmap for range and make a request for every clear run, split
+     * so that big gaps are fetched over several connections. */
+    struct udcManyRange *range = &ranges[i];
+    struct udcBitmap *bits = file->bits;
+    range->file = file;
+    range->startBlock = start / bits->blockSize;
+    range->endBlock = (end + bits->blockSize - 1) / bits->blockSize;
+    if (file->prefetch != NULL)
+	pthreadMutexLock(&file->prefetch->bitMutex);
+    readBitsIntoBuf(bits->fd, udcBitmapHeaderSize, range->startBlock, range->endBlock,
+	    &range->b, &range->partOffset);
+    if (file->prefetch != NULL)
+	pthreadMutexUnlock(&file->prefetch->bitMutex);
+    int s = range->startBlock - range->partOffset;
+    int e = range->endBlock - range->partOffset;
+    int chunkBlocks = udcParallelChunkSize / bits->blockSize;
+    for (;;)
+        {
+	int nextClearBit = bitFindClear(range->b, s, e);
+	if (nextClearBit >= e)
+	    break;
+	int nextSetBit = bitFindSet(range->b, nextClearBit, min(nextClearBit + chunkBlocks, e));
+	struct udcManyPiece *piece;
+	AllocVar(piece);
+	piece->range = range;
+	piece->startBit = nextClearBit;
+	piece->bitCount = nextSetBit - nextClearBit;
+	piece->start = (bits64)(nextClearBit + range->partOffset) * bits->blockSize;
+	piece->size = min((bits64)(nextSetBit + range->partOffset) * bits->blockSize,
+		file->size) - piece->start;
+	piece->pFailCount = &failCount;
+	slAddHead(&pieceList, piece);
+	if (na == NULL)
+	    na = netAsyncNew(0, fetchThreads * 4, 0, 0);
+	netAsyncAdd(na, file->url, piece->start, piece->size, udcManyPieceDone, piece);
+	s = nextSetBit;
+	}
+    }
+
+if (na != NULL)
+    {
+    verbose(2, "fetching %d pieces for %d ranges at once\n", slCount(pieceList), count);
+    netAsyncRun(na);
+    netAsyncFree(&na);
+    }
+for (i=0; i<count; ++i)
+    {
+    if (ranges[i].b != NULL)
+	{
+	udcManyRangeSave(&ranges[i]);
+	freeMem(ranges[i].b);
+	}
+    }
+slFreeList(&pieceList);
+freeMem(ranges);
+return failCount == 0;
+}
+
+static bits64 growReadAhead(bits64 window)
+/* Return next bigger read-ahead window. */
+{
+window *= 2;
+if (window > readAheadMax)
+    window = readAheadMax;
+if (window < udcMaxBytesPerRemoteFetch)
+    window = udcMaxBytesPerRemoteFetch;
+return window;
+}
+
+static void udcReadAhead(struct udcFile *file, bits64 start, bits64 end)
+/* Keep track of whether file is being read sequentially, and if so make sure
+ * a window of data ahead of the read is being fetched. */
+{
+if (file->bits == NULL || readAheadMax == 0)
+    return;	/* Transparent local file, or read-ahead turned off. */
+boolean sequential = (start == file->lastReadEnd);
+file->lastReadEnd = end;
+if (!sequential)
+    {
+    file->seqReadCount = 0;
+    file->aheadWindow = 0;
+    return;
+    }
+if (++file->seqReadCount < 2)
+    return;
+if (file->aheadWindow == 0)
+    {
+    file->aheadWindow = udcMaxBytesPerRemoteFetch;
+    file->aheadEnd = start;
+    }
+
+if (end > file->aheadEnd)
+    {
+    /* Reader got ahead of us, fetch a whole window now. */
+    bits64 newEnd = max(end, start + file->aheadWindow);
+    if (newEnd > file->size)
+        newEnd = file->size;
+    udcCachePreload(file, start, newEnd - start);
+    file->aheadEnd = newEnd;
+    file->aheadWindow = growReadAhead(file->aheadWindow);
+    }
+else if (start < file->startData || end > file->endData)
+    {
+    /* Reading data fetched in background.  Check in all that is there so far. */
+    bits64 doneEnd = max(end, prefetchDoneEnd(file));
+    udcCachePreload(file, start, doneEnd - start);
+    }
+
+/* Keep a window's worth of data being fetched ahead of the reader. */
+if (file->aheadEnd < file->size && end + file->aheadWindow > file->aheadEnd
+    && !prefetchIsBusy(file))
+    {
+    bits64 newEnd = file->aheadEnd + file->aheadWindow;
+    if (newEnd > file->size)
+        newEnd = file->size;
+    prefetchStart(file, file->aheadEnd, newEnd);
+    file->aheadEnd = newEnd;
+    file->aheadWindow = growReadAhead(file->aheadWindow);
+    }
+}
+
+void udcSetReadAheadMax(bits64 maxBytes)
+/* Set the biggest amount udc will fetch ahead of a handle that is reading
+ * sequentially.  Zero turns read-ahead off. */
+{
+readAheadMax = maxBytes;
+}
+
+/* In-memory LRU cache of udc blocks, shared by all handles on the same URL.
+ * Small reads are served out of this without touching the sparse file, which
+ * makes repeated random access, such as B+ tree lookups, much cheaper.  The
+ * cache is protected by a mutex so handles may be used on different threads. */
+
+#define udcMemCacheMaxRead (udcBlockSize * 8)
+/* Reads bigger than this bypass the memory cache. */
+
+struct udcMemFile
+/* The blocks of one URL that are in the memory cache. */
+    {
+    char *url;			/* URL - allocated in memCacheUrlHash. */
+    bits64 size;		/* Size of file blocks came from. */
+    time_t updateTime;		/* Update time of file blocks came from. */
+    struct hash *blockHash;	/* udcMemBlocks keyed by block number in hex. */
+    int blockCount;		/* Number of blocks in cache. */
+    int useCount;		/* Number of open udcFiles using this. */
+    };
+
+struct udcMemBlock
+/* A block of a file in the memory cache. */
+    {
+    struct dlNode *node;	/* Node in LRU list, most recently used at head. */
+    struct udcMemFile *memFile;	/* File block is from. */
+    bits64 blockIx;		/* Block number in file. */
+    int size;			/* Size of data, only last block is short. */
+    char *data;			/* Contents of block. */
+    };
+
+static pthread_mutex_t memCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static bits64 memCacheMaxSize = UDC_MEM_CACHE_DEFAULT_SIZE;	/* Limit on memCacheSize. */
+static bits64 memCacheSize;		/* Bytes of block data in cache. */
+static bits64 memCacheHits, memCacheMisses;	/* Lookup statistics. */
+static struct hash *memCacheUrlHash;	/* udcMemFiles keyed by URL. */
+static struct dlList *memCacheLru;	/* All udcMemBlocks, most recently used first. */
+
+static void memBlockKey(bits64 blockIx, char key[32])
+/* Make hash key for block. */
+{
+safef(key, 32, "%llx", blockIx);
+}
+
+static void memFileFreeIfUnused(struct udcMemFile *memFile)
+/* Free memFile if it has no blocks and no users.  Call with lock held. */
+{
+if (memFile->blockCount == 0 && memFile->useCount == 0)
+    {
+    hashRemove(memCacheUrlHash, memFile->url);
+    hashFree(&memFile->blockHash);
+    freeMem(memFile);
+    }
+}
+
+static void memBlockRemove(struct udcMemBlock *mb)
+/* Take block out of cache and free it.  Call with lock held. */
+{
+struct udcMemFile *memFile = mb->memFile;
+char key[32];
+memBlockKey(mb->blockIx, key);
+hashRemove(memFile->blockHash, key);
+dlRemove(mb->node);
+freeMem(mb->node);
+memCacheSize -= mb->size;
+memFile->blockCount -= 1;
+freeMem(mb->data);
+freeMem(mb);
+memFileFreeIfUnused(memFile);
+}
+
+static void memCacheTrim()
+/* Drop least recently used blocks until cache fits.  Call with lock held. */
+{
+while (memCacheSize > memCacheMaxSize && !dlEmpty(memCacheLru))
+    memBlockRemove(memCacheLru->tail->val);
+}
+
+static void memFileAttach(struct udcFile *file)
+/* Connect file to the memory cache for its URL, throwing out blocks left
+ * from an older version of the file. */
+{
+pthreadMutexLock(&memCacheMutex);
+if (memCacheMaxSize > 0)
+    {
+    if (memCacheUrlHash == NULL)
+	{
+	memCacheUrlHash = hashNew(0);
+	memCacheLru = newDlList();
+	}
+    struct udcMemFile *memFile = hashFindVal(memCacheUrlHash, file->url);
+    if (memFile == NULL)
+	{
+	AllocVar(memFile);
+	memFile->blockHash = hashNew(0);
+	memFile->url = hashAdd(memCacheUrlHash, file->url, memFile)->name;
+	memFile->size = file->size;
+	memFile->updateTime = file->updateTime;
+	}
+    memFile->useCount += 1;
+    if (memFile->size != file->size || memFile->updateTime != file->updateTime)
+	{
+	struct hashEl *hel, *helList = hashElListHash(memFile->blockHash);
+	for (hel = helList; hel != NULL; hel = hel->next)
+	    memBlockRemove(hel->val);
+	hashElFreeList(&helList);
+	memFile->size = file->size;
+	memFile->updateTime = file->updateTime;
+	}
+    file->memFile = memFile;
+    file->memBlockBuf = needMem(udcBlockSize);
+    }
+pthreadMutexUnlock(&memCacheMutex);
+}
+
+static void memFileDetach(struct udcFile *file)
+/* Disconnect file from memory cache.  Its blocks stay in the cache for
+ * the next handle opened on the same URL. */
+{
+if (file->memFile != NULL)
+    {
+    pthreadMutexLock(&memCacheMutex);
+    file->memFile->useCount -= 1;
+    memFileFreeIfUnused(file->memFile);
+    file->memFile = NULL;
+    pthreadMutexUnlock(&memCacheMutex);
+    }
+freez(&file->memBlockBuf);
+}
+
+static boolean memBlockFill(struct udcFile *file, bits64 blockIx, char *data, int *retSize)
+/* Read a block through the sparse file cache into data.  Return FALSE if
+ * it couldn't be fetched. */
+{
+bits64 s = blockIx * udcBlockSize;
+bits64 e = s + udcBlockSize;
+if (e > file->size)
+    e = file->size;
+if (s < file->startData || e > file->endData)
+    {
+    if (!udcCachePreload(file, s, e - s))
+        return FALSE;
+    }
+bits64 size = e - s;
+if (pread(file->fdSparse, data, size, s) != size)
+    errnoAbort("Couldn't read %llu bytes at %llu from %s", size, s, file->sparseFileName);
+*retSize = size;
+return TRUE;
+}
+
+static boolean memBlockLoad(struct udcFile *file, bits64 blockIx)
+/* Get block into file->memBlockBuf, from the memory cache if possible,
+ * otherwise from the sparse file, in which case add it to the memory cache. 
+ * Return FALSE if block couldn't be fetched. */
+{
+struct udcMemFile *memFile = file->memFile;
+struct udcMemBlock *mb;
+char key[32];
+memBlockKey(blockIx, key);
+
+pthreadMutexLock(&memCacheMutex);
+mb = hashFindVal(memFile->blockHash, key);
+if (mb != NULL)
+    {
+    memcpy(file->memBlockBuf, mb->data, mb->size);
+    file->memBlockSize = mb->size;
+    dlRemove(mb->node);
+    dlAddHead(memCacheLru, mb->node);
+    memCacheHits += 1;
+    }
+else
+    memCacheMisses += 1;
+pthreadMutexUnlock(&memCacheMutex);
+
+if (mb == NULL)
+    {
+    if (!memBlockFill(file, blockIx, file->memBlockBuf, &file->memBlockSize))
+        return FALSE;
+    pthreadMutexLock(&memCacheMutex);
+    if (memCacheMaxSize > 0 && hashLookup(memFile->blockHash, key) == NULL)
+	{
+	AllocVar(mb);
+	mb->memFile = memFile;
+	mb->blockIx = blockIx;
+	mb->size = file->memBlockSize;
+	mb->data = cloneMem(file->memBlockBuf, mb->size);
+	mb->node = dlAddValHead(memCacheLru, mb);
+	hashAdd(memFile->blockHash, key, mb);
+	memFile->blockCount += 1;
+	memCacheSize += mb->size;
+	memCacheTrim();
+	}
+    pthreadMutexUnlock(&memCacheMutex);
+    }
+file->memBlockIx = blockIx;
+file->memBlockValid = TRUE;
+return TRUE;
+}
+
+static bits64 udcReadViaMemCache(struct udcFile *file, void *buf, bits64 start, bits64 end)
+/* Read from start to end via the memory cache.  Return amount actually read. */
+{
+char *cbuf = buf;
+bits64 pos = start;
+/* If read spans blocks, get them all into the sparse file with one fetch
+ * rather than one per block. */
+if (start / udcBlockSize != (end - 1) / udcBlockSize
+    && (start < file->startData || end > file->endData))
+    udcCachePreload(file, start, end - start);
+while (pos < end)
+    {
+    bits64 blockIx = pos / udcBlockSize;
+    if (!file->memBlockValid || file->memBlockIx != blockIx)
+	{
+	if (!memBlockLoad(file, blockIx))
+	    {
+	    verbose(2, "udcCachePreload failed");
+	    break;
+	    }
+	}
+    bits64 blockStart = blockIx * udcBlockSize;
+    bits64 copyEnd = min(end, blockStart + file->memBlockSize);
+    memcpy(cbuf, file->memBlockBuf + (pos - blockStart), copyEnd - pos);
+    cbuf += copyEnd - pos;
+    pos = copyEnd;
+    }
+file->offset = pos;
+file->sparseSeekNeeded = TRUE;
+return pos - start;
+}
+
+void udcSetMemCacheSize(bits64 maxBytes)
+/* Set the limit on memory used by the in-memory block cache shared by all
+ * udcFiles.  Zero turns the memory cache off for files opened afterwards. */
+{
+pthreadMutexLock(&memCacheMutex);
+memCacheMaxSize = maxBytes;
+if (memCacheLru != NULL)
+    memCacheTrim();
+pthreadMutexUnlock(&memCacheMutex);
+}
+
+void udcMemCacheStats(bits64 *retHits, bits64 *retMisses, bits64 *retSize)
+/* Return number of memory cache lookups that hit and missed, and the
+ * number of bytes currently in the cache.  Any of the return parameters
+ * may be NULL. */
+{
+pthreadMutexLock(&memCacheMutex);
+if (retHits != NULL)
+    *retHits = memCacheHits;
+if (retMisses != NULL)
+    *retMisses = memCacheMisses;
+if (retSize != NULL)
+    *retSize = memCacheSize;
+pthreadMutexUnlock(&memCacheMutex);
+}
+
 #define READAHEADBUFSIZE 4096
 bits64 udcRead(struct udcFile *file, void *buf, bits64 size)
 /* Read a block from file.  Return amount actually read. */
@@ -1227,6 +2186,18 @@ if (end > file->size)
 size = end - start;
 char *cbuf = buf;
 
+udcReadAhead(file, start, end);
+if (file->memFile != NULL && size <= udcMemCacheMaxRead)
+    return udcReadViaMemCache(file, buf, start, end);
+
+/* Memory cache reads and udcSeek leave the sparse file position alone. */
+if (file->sparseSeekNeeded)
+    {
+    file->sparseReadAhead = FALSE;
+    mustLseek(file->fdSparse, start, SEEK_SET);
+    file->sparseSeekNeeded = FALSE;
+    }
+
 /* use read-ahead buffer if present */
 bits64 bytesRead = 0;
 
@@ -1440,7 +2411,10 @@ void udcSeek(struct udcFile *file, bits64 offset)
 /* Seek to a particular position in file. */
 {
 file->offset = offset;
-mustLseek(file->fdSparse, offset, SEEK_SET);
+if (file->memFile != NULL)
+    file->sparseSeekNeeded = TRUE;
+else
+    mustLseek(file->fdSparse, offset, SEEK_SET);
 }
 
 bits64 udcTell(struct udcFile *file)